@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Benchmark runner.
+//
+// Every case is calibrated until one batch of operations takes at least
+// --min-time-ms, then measured --repetitions times. The median batch is
+// reported, one JSON object per line (or CSV with --csv):
+//
+//   {"name": "rpc/on_rpc", "ops": 131072, "ns_per_op": 812.4, "ns_per_op_min": 798.0,
+//    "allocs_per_op": 2.00, "bytes_per_op": 1184.0}
+//
+// Allocations are counted by wrapping malloc() and friends at link time, so
+// they cover the SDK code and the port layer, but not libc internals.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+extern const struct bench_suite bench_suite_core;
+extern const struct bench_suite bench_suite_rpc;
+extern const struct bench_suite bench_suite_settings;
+extern const struct bench_suite bench_suite_log;
+extern const struct bench_suite bench_suite_ota;
+extern const struct bench_suite bench_suite_lightdb;
+
+static const struct bench_suite *const suites[] = {
+    &bench_suite_core,
+    &bench_suite_rpc,
+    &bench_suite_settings,
+    &bench_suite_log,
+    &bench_suite_ota,
+    &bench_suite_lightdb,
+};
+
+#define MAX_REPETITIONS 32
+
+/*--------------------------------------------------
+ * Allocation accounting
+ *------------------------------------------------*/
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+// Updated atomically: benchmarks that start client, timer or worker threads allocate from them too
+static uint64_t num_allocs;
+static uint64_t num_alloc_bytes;
+
+static void count_alloc(size_t size)
+{
+    __atomic_fetch_add(&num_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&num_alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+    count_alloc(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    count_alloc(nmemb * size);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    count_alloc(size);
+    return __real_realloc(ptr, size);
+}
+
+/*--------------------------------------------------
+ * Measurement
+ *------------------------------------------------*/
+
+struct bench_result
+{
+    uint64_t ops;
+    double ns_per_op;
+    double ns_per_op_min;
+    double allocs_per_op;
+    double bytes_per_op;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void bench_fail(const char *file, int line, const char *cond)
+{
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, cond);
+    exit(2);
+}
+
+static uint64_t paused_at_ns;
+static uint64_t paused_ns;
+
+void bench_pause_timing(void)
+{
+    paused_at_ns = now_ns();
+}
+
+void bench_resume_timing(void)
+{
+    paused_ns += now_ns() - paused_at_ns;
+}
+
+static uint64_t run_batch(const struct bench_case *bc, uint64_t ops)
+{
+    paused_ns = 0;
+    uint64_t start = now_ns();
+    bc->run(ops);
+    return now_ns() - start - paused_ns;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+    return (da > db) - (da < db);
+}
+
+static void measure(const struct bench_case *bc,
+                    uint64_t min_time_ns,
+                    unsigned int repetitions,
+                    struct bench_result *result)
+{
+    double samples[MAX_REPETITIONS];
+    uint64_t ops = 1;
+
+    if (bc->setup)
+    {
+        bc->setup();
+    }
+
+    // Calibrate: grow the batch until it takes long enough to time reliably
+    for (;;)
+    {
+        uint64_t elapsed = run_batch(bc, ops);
+        if (elapsed >= min_time_ns)
+        {
+            break;
+        }
+
+        uint64_t scale = (elapsed > 0) ? (min_time_ns * 12 / 10) / elapsed + 1 : 100;
+        ops *= (scale > 100) ? 100 : (scale < 2 ? 2 : scale);
+    }
+
+    uint64_t allocs_before = __atomic_load_n(&num_allocs, __ATOMIC_RELAXED);
+    uint64_t bytes_before = __atomic_load_n(&num_alloc_bytes, __ATOMIC_RELAXED);
+
+    for (unsigned int i = 0; i < repetitions; i++)
+    {
+        samples[i] = (double) run_batch(bc, ops) / ops;
+    }
+
+    uint64_t allocs = __atomic_load_n(&num_allocs, __ATOMIC_RELAXED) - allocs_before;
+    uint64_t bytes = __atomic_load_n(&num_alloc_bytes, __ATOMIC_RELAXED) - bytes_before;
+
+    result->ops = ops;
+    result->allocs_per_op = (double) allocs / (ops * repetitions);
+    result->bytes_per_op = (double) bytes / (ops * repetitions);
+
+    qsort(samples, repetitions, sizeof(samples[0]), compare_double);
+    result->ns_per_op = samples[repetitions / 2];
+    result->ns_per_op_min = samples[0];
+
+    if (bc->teardown)
+    {
+        bc->teardown();
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--filter SUBSTRING] [--min-time-ms MS] [--repetitions N] [--csv] [--list]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"filter", required_argument, NULL, 'f'},
+        {"min-time-ms", required_argument, NULL, 't'},
+        {"repetitions", required_argument, NULL, 'r'},
+        {"csv", no_argument, NULL, 'c'},
+        {"list", no_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    const char *filter = NULL;
+    unsigned int min_time_ms = 100;
+    unsigned int repetitions = 5;
+    bool csv = false;
+    bool list = false;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "f:t:r:clh", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                filter = optarg;
+                break;
+            case 't':
+                min_time_ms = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                repetitions = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                csv = true;
+                break;
+            case 'l':
+                list = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (repetitions < 1 || repetitions > MAX_REPETITIONS)
+    {
+        fprintf(stderr, "repetitions must be 1..%d\n", MAX_REPETITIONS);
+        return 1;
+    }
+
+    if (csv && !list)
+    {
+        printf("name,ops,ns_per_op,ns_per_op_min,allocs_per_op,bytes_per_op\n");
+    }
+
+    for (size_t s = 0; s < sizeof(suites) / sizeof(suites[0]); s++)
+    {
+        for (size_t c = 0; c < suites[s]->num_cases; c++)
+        {
+            const struct bench_case *bc = &suites[s]->cases[c];
+            struct bench_result result;
+
+            if (filter && !strstr(bc->name, filter))
+            {
+                continue;
+            }
+
+            if (list)
+            {
+                printf("%s\n", bc->name);
+                continue;
+            }
+
+            measure(bc, (uint64_t) min_time_ms * 1000000, repetitions, &result);
+
+            if (csv)
+            {
+                printf("%s,%lu,%.1f,%.1f,%.2f,%.1f\n",
+                       bc->name,
+                       (unsigned long) result.ops,
+                       result.ns_per_op,
+                       result.ns_per_op_min,
+                       result.allocs_per_op,
+                       result.bytes_per_op);
+            }
+            else
+            {
+                printf("{\"name\": \"%s\", \"ops\": %lu, \"ns_per_op\": %.1f, "
+                       "\"ns_per_op_min\": %.1f, \"allocs_per_op\": %.2f, "
+                       "\"bytes_per_op\": %.1f}\n",
+                       bc->name,
+                       (unsigned long) result.ops,
+                       result.ns_per_op,
+                       result.ns_per_op_min,
+                       result.allocs_per_op,
+                       result.bytes_per_op);
+            }
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// A single microbenchmark.
+///
+/// run() performs the measured operation num_ops times. setup() and teardown()
+/// are optional and are not measured.
+struct bench_case
+{
+    const char *name;
+    void (*setup)(void);
+    void (*run)(uint64_t num_ops);
+    void (*teardown)(void);
+};
+
+struct bench_suite
+{
+    const struct bench_case *cases;
+    size_t num_cases;
+};
+
+#define BENCH_SUITE(_name, ...)                                        \
+    static const struct bench_case _name##_cases[] = {__VA_ARGS__};    \
+    const struct bench_suite _name = {                                 \
+        .cases = _name##_cases,                                        \
+        .num_cases = sizeof(_name##_cases) / sizeof(_name##_cases[0]), \
+    }
+
+/// Keep the compiler from optimizing away a computed value
+#define BENCH_KEEP(x) __asm__ volatile("" : : "g"(x) : "memory")
+
+/// Abort the run when a benchmark detects that the code under test misbehaves,
+/// so that a broken fast path can't be mistaken for a speedup
+#define BENCH_CHECK(cond)                          \
+    do                                             \
+    {                                              \
+        if (!(cond))                               \
+        {                                          \
+            bench_fail(__FILE__, __LINE__, #cond); \
+        }                                          \
+    } while (0)
+
+void bench_fail(const char *file, int line, const char *cond) __attribute__((noreturn));
+
+/// Exclude the time until bench_resume_timing() from the measurement, e.g. to wait for another
+/// thread to finish the work started by the measured operation
+void bench_pause_timing(void);
+void bench_resume_timing(void);
+
+/*--------------------------------------------------
+ * Client double (bench_client.c)
+ *------------------------------------------------*/
+
+struct golioth_client;
+
+/// A client whose request queue is never serviced by a CoAP thread. Requests
+/// enqueued by the code under test are discarded with bench_client_drain().
+struct golioth_client *bench_client_create(void);
+void bench_client_destroy(struct golioth_client *client);
+
+/// Remove all queued requests, freeing payloads as the CoAP thread would
+///
+/// @return number of requests removed
+size_t bench_client_drain(struct golioth_client *client);
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <golioth/golioth_sys.h>
+#include "coap_client_libcoap.h"
+#include "bench.h"
+
+#define BENCH_CLIENT_QUEUE_ITEMS 16
+
+struct golioth_client *bench_client_create(void)
+{
+    struct golioth_client *client = calloc(1, sizeof(*client));
+    BENCH_CHECK(client);
+
+    client->request_queue =
+        golioth_mbox_create(BENCH_CLIENT_QUEUE_ITEMS, sizeof(struct golioth_coap_request_msg));
+    client->is_running = true;
+
+    golioth_coap_token_mutex_create();
+
+    return client;
+}
+
+void bench_client_destroy(struct golioth_client *client)
+{
+    bench_client_drain(client);
+    golioth_mbox_destroy(client->request_queue);
+    free(client);
+}
+
+size_t bench_client_drain(struct golioth_client *client)
+{
+    struct golioth_coap_request_msg req;
+    size_t count = 0;
+
+    while (golioth_mbox_recv(client->request_queue, &req, 0))
+    {
+        if (req.type == GOLIOTH_COAP_REQUEST_POST)
+        {
+            golioth_sys_free(req.post.payload);
+        }
+        else if (req.type == GOLIOTH_COAP_REQUEST_POST_BLOCK)
+        {
+            golioth_sys_free(req.post_block.payload);
+        }
+        count++;
+    }
+
+    return count;
+}
+
+/* Normally provided by the CoAP client implementation */
+
+void golioth_cancel_all_observations_by_prefix(struct golioth_client *client, const char *prefix) {}
+
+void golioth_cancel_all_observations(struct golioth_client *client) {}
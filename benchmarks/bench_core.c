@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zcbor_encode.h>
+#include <golioth/zcbor_utils.h>
+#include "coap_client.h"
+#include "mbox.h"
+#include "ringbuf.h"
+#include "bench.h"
+
+/*--------------------------------------------------
+ * ringbuf
+ *------------------------------------------------*/
+
+#define RINGBUF_ITEM_SIZE 32
+#define RINGBUF_NUM_ITEMS 16
+
+static uint8_t ringbuf_buffer[RINGBUF_BUFFER_SIZE(RINGBUF_ITEM_SIZE, RINGBUF_NUM_ITEMS)];
+static ringbuf_t ringbuf = {
+    .buffer = ringbuf_buffer,
+    .buffer_size = sizeof(ringbuf_buffer),
+    .item_size = RINGBUF_ITEM_SIZE,
+};
+
+static void ringbuf_setup(void)
+{
+    ringbuf_reset(&ringbuf);
+}
+
+/// One put followed by one get
+static void ringbuf_put_get_run(uint64_t num_ops)
+{
+    uint8_t in[RINGBUF_ITEM_SIZE] = {1};
+    uint8_t out[RINGBUF_ITEM_SIZE];
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        in[0] = i;
+        ringbuf_put(&ringbuf, in);
+        ringbuf_get(&ringbuf, out);
+        BENCH_KEEP(out[0]);
+    }
+}
+
+/// Fill the buffer, then drain it; one op is one put plus one get
+static void ringbuf_fill_drain_run(uint64_t num_ops)
+{
+    uint8_t item[RINGBUF_ITEM_SIZE] = {1};
+
+    for (uint64_t i = 0; i < num_ops; i += RINGBUF_NUM_ITEMS)
+    {
+        for (int j = 0; j < RINGBUF_NUM_ITEMS; j++)
+        {
+            ringbuf_put(&ringbuf, item);
+        }
+        for (int j = 0; j < RINGBUF_NUM_ITEMS; j++)
+        {
+            ringbuf_get(&ringbuf, item);
+        }
+        BENCH_KEEP(item[0]);
+    }
+}
+
+/*--------------------------------------------------
+ * mbox
+ *------------------------------------------------*/
+
+static golioth_mbox_t mbox;
+
+static void mbox_setup(void)
+{
+    mbox = golioth_mbox_create(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS,
+                               sizeof(struct golioth_coap_request_msg));
+}
+
+static void mbox_teardown(void)
+{
+    golioth_mbox_destroy(mbox);
+}
+
+/// Round trip of one CoAP request message, as between user thread and CoAP thread
+static void mbox_send_recv_run(uint64_t num_ops)
+{
+    struct golioth_coap_request_msg msg = {.type = GOLIOTH_COAP_REQUEST_POST};
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        msg.ageout_ms = i;
+        BENCH_CHECK(golioth_mbox_try_send(mbox, &msg));
+        BENCH_CHECK(golioth_mbox_recv(mbox, &msg, 0));
+    }
+}
+
+/*--------------------------------------------------
+ * CoAP tokens
+ *------------------------------------------------*/
+
+static void token_setup(void)
+{
+    golioth_coap_token_mutex_create();
+}
+
+static void token_run(uint64_t num_ops)
+{
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        golioth_coap_next_token(token);
+        BENCH_KEEP(token[0]);
+    }
+}
+
+/*--------------------------------------------------
+ * zcbor_map_decode
+ *------------------------------------------------*/
+
+static uint8_t map_cbor[128];
+static size_t map_cbor_len;
+
+/// {"id": "1234", "method": "set_led", "version": 1652109801583, "count": 42}
+static void zcbor_map_setup(void)
+{
+    ZCBOR_STATE_E(zse, 1, map_cbor, sizeof(map_cbor), 1);
+
+    bool ok = zcbor_map_start_encode(zse, 4) && zcbor_tstr_put_lit(zse, "id")
+           && zcbor_tstr_put_lit(zse, "1234") && zcbor_tstr_put_lit(zse, "method")
+           && zcbor_tstr_put_lit(zse, "set_led") && zcbor_tstr_put_lit(zse, "version")
+           && zcbor_int64_put(zse, 1652109801583) && zcbor_tstr_put_lit(zse, "count")
+           && zcbor_int64_put(zse, 42) && zcbor_map_end_encode(zse, 4);
+    BENCH_CHECK(ok);
+
+    map_cbor_len = zse->payload - map_cbor;
+}
+
+static void zcbor_map_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        ZCBOR_STATE_D(zsd, 2, map_cbor, map_cbor_len, 1, 0);
+        struct zcbor_string id;
+        struct zcbor_string method;
+        int64_t version;
+        int64_t count;
+        struct zcbor_map_entry map_entries[] = {
+            ZCBOR_TSTR_LIT_MAP_ENTRY("id", zcbor_map_tstr_decode, &id),
+            ZCBOR_TSTR_LIT_MAP_ENTRY("method", zcbor_map_tstr_decode, &method),
+            ZCBOR_TSTR_LIT_MAP_ENTRY("version", zcbor_map_int64_decode, &version),
+            ZCBOR_TSTR_LIT_MAP_ENTRY("count", zcbor_map_int64_decode, &count),
+        };
+
+        BENCH_CHECK(zcbor_map_decode(zsd, map_entries, 4) == 0);
+        BENCH_KEEP(count);
+    }
+}
+
+BENCH_SUITE(bench_suite_core,
+            {
+                .name = "ringbuf/put_get",
+                .setup = ringbuf_setup,
+                .run = ringbuf_put_get_run,
+            },
+            {
+                .name = "ringbuf/fill_drain",
+                .setup = ringbuf_setup,
+                .run = ringbuf_fill_drain_run,
+            },
+            {
+                .name = "mbox/try_send_recv",
+                .setup = mbox_setup,
+                .run = mbox_send_recv_run,
+                .teardown = mbox_teardown,
+            },
+            {
+                .name = "coap/next_token",
+                .setup = token_setup,
+                .run = token_run,
+            },
+            {
+                .name = "zcbor/map_decode",
+                .setup = zcbor_map_setup,
+                .run = zcbor_map_run,
+            });
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// The typed set helpers and on_payload() are private to lightdb_state.c, so
+// the source is included directly. Each case is run with JSON and with CBOR,
+// independent of CONFIG_GOLIOTH_LIGHTDB_STATE_CBOR.
+#include "../src/lightdb_state.c"
+
+#include <string.h>
+#include "bench.h"
+
+#define BENCH_PATH "sensor/temperature"
+#define BENCH_STRING "The quick brown fox"
+
+static struct golioth_client *client;
+
+static void lightdb_setup(void)
+{
+    client = bench_client_create();
+}
+
+static void lightdb_teardown(void)
+{
+    bench_client_destroy(client);
+}
+
+/* Set: encode and enqueue one value */
+
+static void set_int_run(uint64_t num_ops, enum golioth_content_type content_type)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        BENCH_CHECK(lightdb_set_int(client,
+                                    BENCH_PATH,
+                                    content_type,
+                                    -123456 + (int32_t) i,
+                                    NULL,
+                                    NULL,
+                                    false,
+                                    GOLIOTH_SYS_WAIT_FOREVER)
+                    == GOLIOTH_OK);
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+static void set_float_run(uint64_t num_ops, enum golioth_content_type content_type)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        BENCH_CHECK(lightdb_set_float(client,
+                                      BENCH_PATH,
+                                      content_type,
+                                      21.5f + (float) (i & 0xff),
+                                      NULL,
+                                      NULL,
+                                      false,
+                                      GOLIOTH_SYS_WAIT_FOREVER)
+                    == GOLIOTH_OK);
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+static void set_string_run(uint64_t num_ops, enum golioth_content_type content_type)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        BENCH_CHECK(lightdb_set_string(client,
+                                       BENCH_PATH,
+                                       content_type,
+                                       BENCH_STRING,
+                                       strlen(BENCH_STRING),
+                                       NULL,
+                                       NULL,
+                                       false,
+                                       GOLIOTH_SYS_WAIT_FOREVER)
+                    == GOLIOTH_OK);
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+static void set_int_json_run(uint64_t num_ops)
+{
+    set_int_run(num_ops, GOLIOTH_CONTENT_TYPE_JSON);
+}
+
+static void set_int_cbor_run(uint64_t num_ops)
+{
+    set_int_run(num_ops, GOLIOTH_CONTENT_TYPE_CBOR);
+}
+
+static void set_float_json_run(uint64_t num_ops)
+{
+    set_float_run(num_ops, GOLIOTH_CONTENT_TYPE_JSON);
+}
+
+static void set_float_cbor_run(uint64_t num_ops)
+{
+    set_float_run(num_ops, GOLIOTH_CONTENT_TYPE_CBOR);
+}
+
+static void set_string_json_run(uint64_t num_ops)
+{
+    set_string_run(num_ops, GOLIOTH_CONTENT_TYPE_JSON);
+}
+
+static void set_string_cbor_run(uint64_t num_ops)
+{
+    set_string_run(num_ops, GOLIOTH_CONTENT_TYPE_CBOR);
+}
+
+/* Get: decode one response payload, as received by a get or observe request */
+
+static const uint8_t int_json[] = "-123456";
+static const uint8_t int_cbor[] = {0x3a, 0x00, 0x01, 0xe2, 0x3f};
+static const uint8_t float_json[] = "21.500000";
+static const uint8_t float_cbor[] = {0xfa, 0x41, 0xac, 0x00, 0x00};
+static const uint8_t string_json[] = "\"" BENCH_STRING "\"";
+static const uint8_t string_cbor[] = "\x73" BENCH_STRING;
+
+static void get_run(uint64_t num_ops,
+                    lightdb_get_response_t *response,
+                    enum golioth_content_type content_type,
+                    const uint8_t *payload,
+                    size_t payload_size)
+{
+    response->content_type = content_type;
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        on_payload(client, GOLIOTH_OK, NULL, BENCH_PATH, payload, payload_size, response);
+        BENCH_CHECK(!response->is_null && !response->is_invalid);
+    }
+}
+
+static void get_int_json_run(uint64_t num_ops)
+{
+    int32_t value;
+    lightdb_get_response_t response = {.type = LIGHTDB_GET_TYPE_INT, .i = &value};
+
+    get_run(num_ops, &response, GOLIOTH_CONTENT_TYPE_JSON, int_json, sizeof(int_json) - 1);
+    BENCH_CHECK(value == -123456);
+}
+
+static void get_int_cbor_run(uint64_t num_ops)
+{
+    int32_t value;
+    lightdb_get_response_t response = {.type = LIGHTDB_GET_TYPE_INT, .i = &value};
+
+    get_run(num_ops, &response, GOLIOTH_CONTENT_TYPE_CBOR, int_cbor, sizeof(int_cbor));
+    BENCH_CHECK(value == -123456);
+}
+
+static void get_float_json_run(uint64_t num_ops)
+{
+    float value;
+    lightdb_get_response_t response = {.type = LIGHTDB_GET_TYPE_FLOAT, .f = &value};
+
+    get_run(num_ops, &response, GOLIOTH_CONTENT_TYPE_JSON, float_json, sizeof(float_json) - 1);
+    BENCH_CHECK(value == 21.5f);
+}
+
+static void get_float_cbor_run(uint64_t num_ops)
+{
+    float value;
+    lightdb_get_response_t response = {.type = LIGHTDB_GET_TYPE_FLOAT, .f = &value};
+
+    get_run(num_ops, &response, GOLIOTH_CONTENT_TYPE_CBOR, float_cbor, sizeof(float_cbor));
+    BENCH_CHECK(value == 21.5f);
+}
+
+static void get_string_json_run(uint64_t num_ops)
+{
+    char value[32];
+    lightdb_get_response_t response = {
+        .type = LIGHTDB_GET_TYPE_STRING,
+        .buf = (uint8_t *) value,
+        .buf_size = sizeof(value),
+    };
+
+    get_run(num_ops, &response, GOLIOTH_CONTENT_TYPE_JSON, string_json, sizeof(string_json) - 1);
+    BENCH_CHECK(strcmp(value, BENCH_STRING) == 0);
+}
+
+static void get_string_cbor_run(uint64_t num_ops)
+{
+    char value[32];
+    lightdb_get_response_t response = {
+        .type = LIGHTDB_GET_TYPE_STRING,
+        .buf = (uint8_t *) value,
+        .buf_size = sizeof(value),
+    };
+
+    get_run(num_ops, &response, GOLIOTH_CONTENT_TYPE_CBOR, string_cbor, sizeof(string_cbor) - 1);
+    BENCH_CHECK(strcmp(value, BENCH_STRING) == 0);
+}
+
+BENCH_SUITE(bench_suite_lightdb,
+            {
+                .name = "lightdb/set_int_json",
+                .setup = lightdb_setup,
+                .run = set_int_json_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/set_int_cbor",
+                .setup = lightdb_setup,
+                .run = set_int_cbor_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/set_float_json",
+                .setup = lightdb_setup,
+                .run = set_float_json_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/set_float_cbor",
+                .setup = lightdb_setup,
+                .run = set_float_cbor_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/set_string_json",
+                .setup = lightdb_setup,
+                .run = set_string_json_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/set_string_cbor",
+                .setup = lightdb_setup,
+                .run = set_string_cbor_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/get_int_json",
+                .setup = lightdb_setup,
+                .run = get_int_json_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/get_int_cbor",
+                .setup = lightdb_setup,
+                .run = get_int_cbor_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/get_float_json",
+                .setup = lightdb_setup,
+                .run = get_float_json_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/get_float_cbor",
+                .setup = lightdb_setup,
+                .run = get_float_cbor_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/get_string_json",
+                .setup = lightdb_setup,
+                .run = get_string_json_run,
+                .teardown = lightdb_teardown,
+            },
+            {
+                .name = "lightdb/get_string_cbor",
+                .setup = lightdb_setup,
+                .run = get_string_cbor_run,
+                .teardown = lightdb_teardown,
+            });
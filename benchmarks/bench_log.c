@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// golioth_log_internal() is private to log.c, so the source is included directly.
+#include "../src/log.c"
+
+#include "bench.h"
+
+static struct golioth_client *client;
+
+static void log_setup(void)
+{
+    client = bench_client_create();
+}
+
+static void log_teardown(void)
+{
+    bench_client_destroy(client);
+}
+
+/// CBOR-encode a typical log line and enqueue it
+static void log_internal_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        enum golioth_status status = golioth_log_internal(client,
+                                                          GOLIOTH_LOG_LEVEL_INFO,
+                                                          "app_sensors",
+                                                          "Temperature 23.50 C, humidity 41.2 %",
+                                                          false,
+                                                          GOLIOTH_SYS_WAIT_FOREVER,
+                                                          NULL,
+                                                          NULL);
+        BENCH_CHECK(status == GOLIOTH_OK);
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+static void log_debug_setup(void)
+{
+    log_setup();
+    golioth_debug_set_client(client);
+    golioth_debug_set_cloud_log_enabled(true);
+}
+
+static void log_debug_teardown(void)
+{
+    golioth_debug_set_cloud_log_enabled(false);
+    golioth_debug_set_client(NULL);
+    log_teardown();
+}
+
+/// Cloud path of a GLTH_LOGI statement: format, CBOR-encode and enqueue
+static void log_debug_printf_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        golioth_debug_printf(i,
+                             GOLIOTH_DEBUG_LOG_LEVEL_INFO,
+                             "app_sensors",
+                             "Temperature %d.%02d C, humidity %s %%",
+                             23,
+                             50,
+                             "41.2");
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+/// Same message with CONFIG_GOLIOTH_LOG_DICTIONARY: format string ID and CBOR-encoded arguments
+static void log_debug_printf_dict_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        GOLIOTH_DEBUG_PRINTF(i,
+                             GOLIOTH_DEBUG_LOG_LEVEL_INFO,
+                             "app_sensors",
+                             "Temperature %d.%02d C, humidity %s %%",
+                             23,
+                             50,
+                             "41.2");
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+BENCH_SUITE(bench_suite_log,
+            {
+                .name = "log/golioth_log_internal",
+                .setup = log_setup,
+                .run = log_internal_run,
+                .teardown = log_teardown,
+            },
+            {
+                .name = "log/debug_printf",
+                .setup = log_debug_setup,
+                .run = log_debug_printf_run,
+                .teardown = log_debug_teardown,
+            },
+            {
+                .name = "log/debug_printf_dict",
+                .setup = log_debug_setup,
+                .run = log_debug_printf_dict_run,
+                .teardown = log_debug_teardown,
+            });
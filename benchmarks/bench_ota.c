@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <zcbor_encode.h>
+#include <golioth/ota.h>
+#include "bench.h"
+
+static uint8_t manifest_cbor[512];
+static size_t manifest_cbor_len;
+
+static const char *const hash = "4a6f3a1e9b2c8d7e6f5a4b3c2d1e0f9a8b7c6d5e4f3a2b1c0d9e8f7a6b5c4d3e";
+
+/// Manifest as sent on .u/desired, with CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS components
+static void manifest_setup(void)
+{
+    static const char *const packages[] = {"main", "modem", "cert", "model"};
+    size_t num_components = CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS;
+
+    ZCBOR_STATE_E(zse, 3, manifest_cbor, sizeof(manifest_cbor), 1);
+    bool ok = zcbor_map_start_encode(zse, 3) && zcbor_uint32_put(zse, 1)
+           && zcbor_int64_put(zse, 1700000000) && zcbor_uint32_put(zse, 2)
+           && zcbor_tstr_put_term(zse, hash, SIZE_MAX) && zcbor_uint32_put(zse, 3)
+           && zcbor_list_start_encode(zse, num_components);
+
+    for (size_t i = 0; ok && i < num_components; i++)
+    {
+        char uri[64];
+        const char *package = packages[i % 4];
+
+        snprintf(uri, sizeof(uri), "/.u/c/%s@1.2.3", package);
+
+        ok = zcbor_map_start_encode(zse, 5) && zcbor_uint32_put(zse, 1)
+          && zcbor_tstr_put_term(zse, package, SIZE_MAX) && zcbor_uint32_put(zse, 2)
+          && zcbor_tstr_put_lit(zse, "1.2.3") && zcbor_uint32_put(zse, 3)
+          && zcbor_tstr_put_term(zse, hash, SIZE_MAX) && zcbor_uint32_put(zse, 4)
+          && zcbor_int64_put(zse, 524288) && zcbor_uint32_put(zse, 5)
+          && zcbor_tstr_put_term(zse, uri, sizeof(uri)) && zcbor_map_end_encode(zse, 5);
+    }
+
+    ok = ok && zcbor_list_end_encode(zse, num_components) && zcbor_map_end_encode(zse, 3);
+    BENCH_CHECK(ok);
+
+    manifest_cbor_len = zse->payload - manifest_cbor;
+}
+
+static void manifest_run(uint64_t num_ops)
+{
+    static struct golioth_ota_manifest manifest;
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        enum golioth_status status =
+            golioth_ota_payload_as_manifest(manifest_cbor, manifest_cbor_len, &manifest);
+        BENCH_CHECK(status == GOLIOTH_OK);
+        BENCH_CHECK(manifest.num_components == CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS);
+    }
+}
+
+BENCH_SUITE(bench_suite_ota,
+            {
+                .name = "ota/payload_as_manifest",
+                .setup = manifest_setup,
+                .run = manifest_run,
+            });
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// on_rpc() is private to rpc.c, so the source is included directly, as in
+// tests/unit_tests/test_rpc.c.
+#include "../src/rpc.c"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+static struct golioth_client *client;
+static struct golioth_rpc *grpc;
+static uint8_t request_first[128];
+static size_t request_first_len;
+static uint8_t request_last[128];
+static size_t request_last_len;
+
+static const char *const method_names[] = {
+    "get_status",
+    "reboot",
+    "set_log_level",
+    "set_led",
+    "get_config",
+    "set_config",
+    "identify",
+    "multiply",
+};
+
+static enum golioth_rpc_status multiply(zcbor_state_t *request_params_array,
+                                        zcbor_state_t *response_detail_map,
+                                        void *callback_arg)
+{
+    double a, b;
+
+    if (!zcbor_float_decode(request_params_array, &a)
+        || !zcbor_float_decode(request_params_array, &b))
+    {
+        return GOLIOTH_RPC_INVALID_ARGUMENT;
+    }
+
+    bool ok = zcbor_tstr_put_lit(response_detail_map, "value")
+           && zcbor_float64_put(response_detail_map, a * b);
+
+    return ok ? GOLIOTH_RPC_OK : GOLIOTH_RPC_RESOURCE_EXHAUSTED;
+}
+
+// Offset of the 8 characters of the id in an encoded request: map, "id", text(8)
+#define REQUEST_ID_OFFSET 5
+
+static size_t encode_request(uint8_t *buf, size_t buf_size, const char *method)
+{
+    ZCBOR_STATE_E(zse, 2, buf, buf_size, 1);
+
+    bool ok = zcbor_map_start_encode(zse, 3) && zcbor_tstr_put_lit(zse, "id")
+           && zcbor_tstr_put_lit(zse, "5f1c9a2e") && zcbor_tstr_put_lit(zse, "method")
+           && zcbor_tstr_put_term(zse, method, SIZE_MAX) && zcbor_tstr_put_lit(zse, "params")
+           && zcbor_list_start_encode(zse, 2) && zcbor_float64_put(zse, 6.0)
+           && zcbor_float64_put(zse, 7.0) && zcbor_list_end_encode(zse, 2)
+           && zcbor_map_end_encode(zse, 3);
+    BENCH_CHECK(ok);
+    BENCH_CHECK(memcmp(&buf[REQUEST_ID_OFFSET], "5f1c9a2e", 8) == 0);
+
+    return zse->payload - buf;
+}
+
+/// Give every request a new id, so that none is answered from the de-duplication cache
+static void next_request_id(uint8_t *request)
+{
+    static uint32_t request_id;
+    char id[9];
+
+    snprintf(id, sizeof(id), "%08" PRIx32, request_id++);
+    memcpy(&request[REQUEST_ID_OFFSET], id, 8);
+}
+
+static enum golioth_rpc_status slow(zcbor_state_t *request_params_array,
+                                    zcbor_state_t *response_detail_map,
+                                    void *callback_arg)
+{
+    // E.g. a sensor read over I2C
+    golioth_sys_msleep(1);
+
+    return GOLIOTH_RPC_OK;
+}
+
+static void rpc_setup(void)
+{
+    client = bench_client_create();
+    grpc = golioth_rpc_init(client);
+    rpc_workers_stop(grpc);
+
+    for (size_t i = 0; i < ARRAY_SIZE(method_names); i++)
+    {
+        BENCH_CHECK(golioth_rpc_register(grpc, method_names[i], multiply, NULL) == GOLIOTH_OK);
+    }
+    bench_client_drain(client);
+
+    request_first_len = encode_request(request_first, sizeof(request_first), method_names[0]);
+    request_last_len = encode_request(request_last,
+                                      sizeof(request_last),
+                                      method_names[ARRAY_SIZE(method_names) - 1]);
+}
+
+/* Method lookup with many registered methods */
+
+static char (*lookup_names)[32];
+static struct zcbor_string *lookup_keys;
+static size_t num_lookup_methods;
+
+static void lookup_setup(size_t num_methods)
+{
+    client = bench_client_create();
+    grpc = golioth_rpc_init(client);
+    rpc_workers_stop(grpc);
+
+    num_lookup_methods = num_methods;
+    lookup_names = malloc(num_methods * sizeof(*lookup_names));
+    lookup_keys = malloc(num_methods * sizeof(*lookup_keys));
+    BENCH_CHECK(lookup_names && lookup_keys);
+
+    for (size_t i = 0; i < num_methods; i++)
+    {
+        snprintf(lookup_names[i], sizeof(lookup_names[i]), "diag_read_%04zu", i);
+        lookup_keys[i].value = (const uint8_t *) lookup_names[i];
+        lookup_keys[i].len = strlen(lookup_names[i]);
+        BENCH_CHECK(golioth_rpc_register(grpc, lookup_names[i], multiply, NULL) == GOLIOTH_OK);
+    }
+    bench_client_drain(client);
+}
+
+static void lookup_8_setup(void)
+{
+    lookup_setup(8);
+}
+
+static void lookup_128_setup(void)
+{
+    lookup_setup(128);
+}
+
+static void lookup_1000_setup(void)
+{
+    lookup_setup(1000);
+}
+
+static void lookup_teardown(void)
+{
+    golioth_rpc_deinit(grpc);
+    bench_client_destroy(client);
+    free(lookup_names);
+    free(lookup_keys);
+}
+
+/// method_find(), cycling through all registered methods
+static void method_find_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        size_t n = i % num_lookup_methods;
+        BENCH_CHECK(method_find(grpc, &lookup_keys[n]) == &grpc->rpcs[n]);
+    }
+}
+
+/// The linear scan method_find() used to do, for comparison
+static void method_find_linear_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        size_t n = i % num_lookup_methods;
+        const struct zcbor_string *method = &lookup_keys[n];
+        const struct golioth_rpc_method *found = NULL;
+
+        for (int j = 0; j < grpc->num_rpcs; j++)
+        {
+            const struct golioth_rpc_method *rpc = &grpc->rpcs[j];
+            if (strlen(rpc->method) == method->len
+                && strncmp(rpc->method, (char *) method->value, method->len) == 0)
+            {
+                found = rpc;
+                break;
+            }
+        }
+        BENCH_CHECK(found == &grpc->rpcs[n]);
+    }
+}
+
+static void rpc_stall_setup(void)
+{
+    client = bench_client_create();
+    grpc = golioth_rpc_init(client);
+
+    BENCH_CHECK(golioth_rpc_register(grpc, "slow", slow, NULL) == GOLIOTH_OK);
+    bench_client_drain(client);
+
+    request_first_len = encode_request(request_first, sizeof(request_first), "slow");
+}
+
+static void rpc_stall_inline_setup(void)
+{
+    rpc_stall_setup();
+    rpc_workers_stop(grpc);
+}
+
+static void rpc_teardown(void)
+{
+    golioth_rpc_deinit(grpc);
+    bench_client_destroy(client);
+}
+
+static void run_on_rpc(uint8_t *request, size_t request_len, uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        next_request_id(request);
+        on_rpc(client, GOLIOTH_OK, NULL, ".rpc", request, request_len, grpc);
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+/// Decode, dispatch to the first registered method, encode and enqueue the response
+static void on_rpc_first_run(uint64_t num_ops)
+{
+    run_on_rpc(request_first, request_first_len, num_ops);
+}
+
+/// Same, but the method is the last of the 8
+static void on_rpc_last_run(uint64_t num_ops)
+{
+    run_on_rpc(request_last, request_last_len, num_ops);
+}
+
+/// A request received again, answered from the de-duplication cache
+static void on_rpc_duplicate_run(uint64_t num_ops)
+{
+    on_rpc(client, GOLIOTH_OK, NULL, ".rpc", request_last, request_last_len, grpc);
+    bench_client_drain(client);
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        on_rpc(client, GOLIOTH_OK, NULL, ".rpc", request_last, request_last_len, grpc);
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+/// Time on_rpc() keeps the client thread from other I/O, with a method that takes 1 ms.
+/// Without workers, this is the whole method.
+static void io_stall_inline_run(uint64_t num_ops)
+{
+    run_on_rpc(request_first, request_first_len, num_ops);
+}
+
+/// Same, with CONFIG_GOLIOTH_RPC_NUM_WORKERS. Waiting for the worker to respond is not measured.
+static void io_stall_executor_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        next_request_id(request_first);
+        on_rpc(client, GOLIOTH_OK, NULL, ".rpc", request_first, request_first_len, grpc);
+
+        bench_pause_timing();
+        while (bench_client_drain(client) == 0)
+        {
+        }
+        bench_resume_timing();
+    }
+}
+
+BENCH_SUITE(bench_suite_rpc,
+            {
+                .name = "rpc/on_rpc_first_method",
+                .setup = rpc_setup,
+                .run = on_rpc_first_run,
+                .teardown = rpc_teardown,
+            },
+            {
+                .name = "rpc/on_rpc_last_method",
+                .setup = rpc_setup,
+                .run = on_rpc_last_run,
+                .teardown = rpc_teardown,
+            },
+            {
+                .name = "rpc/on_rpc_duplicate",
+                .setup = rpc_setup,
+                .run = on_rpc_duplicate_run,
+                .teardown = rpc_teardown,
+            },
+            {
+                .name = "rpc/method_find_8",
+                .setup = lookup_8_setup,
+                .run = method_find_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "rpc/method_find_128",
+                .setup = lookup_128_setup,
+                .run = method_find_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "rpc/method_find_1000",
+                .setup = lookup_1000_setup,
+                .run = method_find_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "rpc/method_find_linear_8",
+                .setup = lookup_8_setup,
+                .run = method_find_linear_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "rpc/method_find_linear_128",
+                .setup = lookup_128_setup,
+                .run = method_find_linear_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "rpc/method_find_linear_1000",
+                .setup = lookup_1000_setup,
+                .run = method_find_linear_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "rpc/io_stall_inline",
+                .setup = rpc_stall_inline_setup,
+                .run = io_stall_inline_run,
+                .teardown = rpc_teardown,
+            },
+            {
+                .name = "rpc/io_stall_executor",
+                .setup = rpc_stall_setup,
+                .run = io_stall_executor_run,
+                .teardown = rpc_teardown,
+            });
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// stream_feed() and on_settings() are private to settings.c, so the
+// source is included directly.
+#include "../src/settings.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define NUM_BENCH_SETTINGS 16
+
+static struct golioth_client *client;
+static struct golioth_settings *gsettings;
+static char setting_names[NUM_BENCH_SETTINGS][24];
+
+/* Full document: {"version": ..., "settings": {...}} */
+static uint8_t document[1024];
+static size_t document_len;
+
+/* Size of blocks in a block-wise transfer of the document */
+#define BENCH_BLOCK_SIZE 64
+
+static enum golioth_settings_status on_int(int32_t new_value, void *arg)
+{
+    BENCH_KEEP(new_value);
+    return GOLIOTH_SETTINGS_SUCCESS;
+}
+
+static enum golioth_settings_status on_bool(bool new_value, void *arg)
+{
+    BENCH_KEEP(new_value);
+    return GOLIOTH_SETTINGS_SUCCESS;
+}
+
+static enum golioth_settings_status on_float(float new_value, void *arg)
+{
+    BENCH_KEEP(new_value);
+    return GOLIOTH_SETTINGS_SUCCESS;
+}
+
+static enum golioth_settings_status on_string(const char *new_value,
+                                              size_t new_value_len,
+                                              void *arg)
+{
+    BENCH_KEEP(new_value_len);
+    return GOLIOTH_SETTINGS_SUCCESS;
+}
+
+/// Settings cycle through the four value types
+static void settings_setup(void)
+{
+    client = bench_client_create();
+    gsettings = golioth_settings_init(client);
+    BENCH_CHECK(gsettings);
+
+    ZCBOR_STATE_E(zse, 2, document, sizeof(document), 1);
+    bool ok = zcbor_map_start_encode(zse, 2) && zcbor_tstr_put_lit(zse, "version")
+           && zcbor_int64_put(zse, 1652109801583) && zcbor_tstr_put_lit(zse, "settings");
+    BENCH_CHECK(ok);
+
+    ok = ok && zcbor_map_start_encode(zse, NUM_BENCH_SETTINGS);
+
+    for (int i = 0; ok && i < NUM_BENCH_SETTINGS; i++)
+    {
+        const char *name = setting_names[i];
+        enum golioth_status status;
+
+        snprintf(setting_names[i], sizeof(setting_names[i]), "SETTING_%02d", i);
+        ok = zcbor_tstr_put_term(zse, name, SIZE_MAX);
+
+        switch (i % 4)
+        {
+            case 0:
+                status = golioth_settings_register_int(gsettings, name, on_int, NULL);
+                ok = ok && zcbor_int32_put(zse, 1000 + i);
+                break;
+            case 1:
+                status = golioth_settings_register_bool(gsettings, name, on_bool, NULL);
+                ok = ok && zcbor_bool_put(zse, true);
+                break;
+            case 2:
+                status = golioth_settings_register_float(gsettings, name, on_float, NULL);
+                ok = ok && zcbor_float64_put(zse, 0.5 * i);
+                break;
+            default:
+                status = golioth_settings_register_string(gsettings, name, on_string, NULL);
+                ok = ok && zcbor_tstr_put_lit(zse, "celsius");
+                break;
+        }
+        BENCH_CHECK(status == GOLIOTH_OK);
+
+        /* Each registration requests the settings */
+        bench_client_drain(client);
+    }
+
+    ok = ok && zcbor_map_end_encode(zse, NUM_BENCH_SETTINGS);
+    ok = ok && zcbor_map_end_encode(zse, 2);
+    BENCH_CHECK(ok);
+
+    document_len = zse->payload - document;
+    bench_client_drain(client);
+}
+
+static void settings_teardown(void)
+{
+    golioth_settings_deinit(gsettings);
+    bench_client_destroy(client);
+}
+
+/// Make the next document apply all settings again, as if they changed
+static void forget_applied(void)
+{
+    for (size_t i = 0; i < gsettings->num_settings; i++)
+    {
+        gsettings->settings[i].has_value = false;
+    }
+    gsettings->has_applied_version = false;
+}
+
+/// Decode all settings and invoke their callbacks
+static void settings_decode_run(uint64_t num_ops)
+{
+    struct settings_stream stream;
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        forget_applied();
+        stream_init(&stream, gsettings);
+        BENCH_CHECK(stream_feed(&stream, document, document_len) == 0);
+        BENCH_CHECK(stream.state == STREAM_DONE && stream.response.num_errors == 0);
+    }
+}
+
+/// Same as settings_decode, with the document received in blocks
+static void stream_feed_blocks_run(uint64_t num_ops)
+{
+    struct settings_stream stream;
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        forget_applied();
+        stream_init(&stream, gsettings);
+
+        for (size_t offset = 0; offset < document_len; offset += BENCH_BLOCK_SIZE)
+        {
+            size_t len = min(BENCH_BLOCK_SIZE, document_len - offset);
+            BENCH_CHECK(stream_feed(&stream, &document[offset], len) == 0);
+        }
+
+        BENCH_CHECK(stream.state == STREAM_DONE && stream.carry_len == 0);
+        BENCH_CHECK(stream.response.num_errors == 0);
+    }
+}
+
+/// Same as settings_decode, with all values applied before
+static void settings_decode_unchanged_run(uint64_t num_ops)
+{
+    struct settings_stream stream;
+
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        stream_init(&stream, gsettings);
+        BENCH_CHECK(stream_feed(&stream, document, document_len) == 0);
+        BENCH_CHECK(stream.state == STREAM_DONE && stream.response.num_errors == 0);
+    }
+
+    BENCH_CHECK(gsettings->stats.skipped >= (num_ops - 1) * NUM_BENCH_SETTINGS);
+}
+
+/* Setting lookup with many registered settings */
+
+static char (*lookup_names)[40];
+static size_t num_lookup_settings;
+
+static void lookup_setup(size_t num_settings)
+{
+    client = bench_client_create();
+    gsettings = golioth_settings_init(client);
+    BENCH_CHECK(gsettings);
+
+    num_lookup_settings = num_settings;
+    lookup_names = malloc(num_settings * sizeof(*lookup_names));
+    BENCH_CHECK(lookup_names);
+
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        snprintf(lookup_names[i], sizeof(lookup_names[i]), "SENSOR_THRESHOLD_%04zu", i);
+        BENCH_CHECK(golioth_settings_register_int(gsettings, lookup_names[i], on_int, NULL)
+                    == GOLIOTH_OK);
+
+        /* Each registration requests the settings */
+        bench_client_drain(client);
+    }
+}
+
+static void lookup_16_setup(void)
+{
+    lookup_setup(16);
+}
+
+static void lookup_128_setup(void)
+{
+    lookup_setup(128);
+}
+
+static void lookup_1024_setup(void)
+{
+    lookup_setup(1024);
+}
+
+static void lookup_teardown(void)
+{
+    settings_teardown();
+    free(lookup_names);
+}
+
+/// find_registered_setting(), cycling through all registered settings
+static void find_setting_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        size_t n = i % num_lookup_settings;
+        const char *key = lookup_names[n];
+
+        BENCH_CHECK(find_registered_setting(gsettings, key, strlen(key))
+                    == &gsettings->settings[n]);
+    }
+}
+
+/// The linear scan find_registered_setting() used to do, for comparison
+static void find_setting_linear_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        size_t n = i % num_lookup_settings;
+        const char *key = lookup_names[n];
+        const struct golioth_setting *found = NULL;
+
+        for (size_t j = 0; j < gsettings->num_settings; j++)
+        {
+            const struct golioth_setting *s = &gsettings->settings[j];
+            if (s->is_valid && strcmp(s->key, key) == 0)
+            {
+                found = s;
+                break;
+            }
+        }
+
+        BENCH_CHECK(found == &gsettings->settings[n]);
+    }
+}
+
+/// Full observe notification: decode, callbacks, status report enqueued
+static void on_settings_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        forget_applied();
+        on_settings(client, GOLIOTH_OK, NULL, ".c", document, document_len, gsettings);
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+}
+
+/// Same as on_settings, with a version applied before
+static void on_settings_unchanged_run(uint64_t num_ops)
+{
+    for (uint64_t i = 0; i < num_ops; i++)
+    {
+        on_settings(client, GOLIOTH_OK, NULL, ".c", document, document_len, gsettings);
+        BENCH_CHECK(bench_client_drain(client) == 1);
+    }
+
+    BENCH_CHECK(gsettings->stats.documents_skipped >= num_ops - 1);
+}
+
+BENCH_SUITE(bench_suite_settings,
+            {
+                .name = "settings/settings_decode",
+                .setup = settings_setup,
+                .run = settings_decode_run,
+                .teardown = settings_teardown,
+            },
+            {
+                .name = "settings/settings_decode_unchanged",
+                .setup = settings_setup,
+                .run = settings_decode_unchanged_run,
+                .teardown = settings_teardown,
+            },
+            {
+                .name = "settings/stream_feed_blocks",
+                .setup = settings_setup,
+                .run = stream_feed_blocks_run,
+                .teardown = settings_teardown,
+            },
+            {
+                .name = "settings/on_settings",
+                .setup = settings_setup,
+                .run = on_settings_run,
+                .teardown = settings_teardown,
+            },
+            {
+                .name = "settings/on_settings_unchanged",
+                .setup = settings_setup,
+                .run = on_settings_unchanged_run,
+                .teardown = settings_teardown,
+            },
+            {
+                .name = "settings/find_setting_16",
+                .setup = lookup_16_setup,
+                .run = find_setting_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "settings/find_setting_128",
+                .setup = lookup_128_setup,
+                .run = find_setting_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "settings/find_setting_1024",
+                .setup = lookup_1024_setup,
+                .run = find_setting_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "settings/find_setting_linear_16",
+                .setup = lookup_16_setup,
+                .run = find_setting_linear_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "settings/find_setting_linear_128",
+                .setup = lookup_128_setup,
+                .run = find_setting_linear_run,
+                .teardown = lookup_teardown,
+            },
+            {
+                .name = "settings/find_setting_linear_1024",
+                .setup = lookup_1024_setup,
+                .run = find_setting_linear_run,
+                .teardown = lookup_teardown,
+            });
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+# Copyright (c) 2024 Golioth, Inc.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""Compare two golioth_benchmarks JSON outputs.
+
+Prints a table of ns/op and allocs/op for every benchmark present in both
+files, and exits with status 1 if any benchmark got slower than the threshold
+or allocates more than before.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('{'):
+                result = json.loads(line)
+                results[result['name']] = result
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='allowed ns/op increase in percent (default: 10)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressed = False
+
+    print(f"{'benchmark':40} {'ns/op':>12} {'new ns/op':>12} {'delta':>8} "
+          f"{'allocs/op':>10} {'new':>8}")
+
+    for name in sorted(set(baseline) & set(current)):
+        old, new = baseline[name], current[name]
+        delta = 100.0 * (new['ns_per_op'] - old['ns_per_op']) / old['ns_per_op']
+        marker = ''
+
+        if delta > args.threshold or new['allocs_per_op'] > old['allocs_per_op']:
+            marker = '  <-- regression'
+            regressed = True
+
+        print(f"{name:40} {old['ns_per_op']:12.1f} {new['ns_per_op']:12.1f} {delta:+7.1f}% "
+              f"{old['allocs_per_op']:10.2f} {new['allocs_per_op']:8.2f}{marker}")
+
+    for name in sorted(set(baseline) ^ set(current)):
+        print(f"{name:40} only in {'baseline' if name in baseline else 'current'}")
+
+    return 1 if regressed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
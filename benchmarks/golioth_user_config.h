@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+/* Debug logging is left disabled, so it doesn't show up in measurements */
+#define CONFIG_GOLIOTH_RPC
+/* rpc/on_rpc_* stop the workers, to measure RPC handling on the client thread */
+#define CONFIG_GOLIOTH_RPC_NUM_WORKERS 2
+/* rpc/method_find_* register up to 1000 methods */
+#define CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS 1000
+#define CONFIG_GOLIOTH_SETTINGS
+/* settings/find_setting_* register up to 1024 settings */
+#define CONFIG_GOLIOTH_MAX_NUM_SETTINGS 1024
+#define CONFIG_GOLIOTH_OTA
+#define CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS 4
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
+
+/* With debug logging disabled, this only affects log/debug_printf_dict */
+#define CONFIG_GOLIOTH_LOG_DICTIONARY
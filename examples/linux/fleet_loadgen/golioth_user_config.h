@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#define CONFIG_GOLIOTH_AUTO_LOG_TO_CLOUD 0
+#define CONFIG_GOLIOTH_DEBUG_DEFAULT_LOG_LEVEL GOLIOTH_DEBUG_LOG_LEVEL_WARN
+#define CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS 20
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_STREAM
+#define CONFIG_GOLIOTH_RPC
+#define CONFIG_GOLIOTH_OTA
+#define CONFIG_GOLIOTH_CLIENT_STATS
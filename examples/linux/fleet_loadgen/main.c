@@ -0,0 +1,788 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Device fleet load generator
+//
+// Spins up N virtual devices using the regular client stack, each with its own
+// PSK identity, and drives a configurable mix of stream, LightDB, log and OTA
+// block traffic against a CoAP/DTLS server. Every device also registers an RPC
+// method, so server-initiated RPC calls can be part of the load.
+//
+// At the end of the run (and every report interval) it prints throughput,
+// latency percentiles per operation, and transport counters summed over all
+// clients (retransmissions, timeouts, reconnects, ...) from
+// golioth_client_get_stats().
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <golioth/client.h>
+#include <golioth/lightdb_state.h>
+#include <golioth/log.h>
+#include <golioth/ota.h>
+#include <golioth/rpc.h>
+#include <golioth/stream.h>
+
+enum loadgen_op
+{
+    OP_STREAM,
+    OP_LIGHTDB_SET,
+    OP_LIGHTDB_GET,
+    OP_LOG,
+    OP_OTA_BLOCK,
+    NUM_OPS,
+};
+
+static const char *op_names[NUM_OPS] = {
+    [OP_STREAM] = "stream",
+    [OP_LIGHTDB_SET] = "lightdb_set",
+    [OP_LIGHTDB_GET] = "lightdb_get",
+    [OP_LOG] = "log",
+    [OP_OTA_BLOCK] = "ota_block",
+};
+
+struct op_stats
+{
+    pthread_mutex_t lock;
+    uint32_t *latencies_ms;
+    size_t num_latencies;
+    size_t capacity;
+    uint64_t ok;
+    uint64_t failed;
+    uint64_t rejected;
+    uint64_t bytes;
+};
+
+struct loadgen_config
+{
+    unsigned int num_devices;
+    unsigned int duration_s;
+    unsigned int report_interval_s;
+    double ops_per_device_s;
+    unsigned int weights[NUM_OPS];
+    unsigned int payload_len;
+    unsigned int ota_threads;
+    const char *ota_package;
+    const char *ota_version;
+    bool json;
+};
+
+struct device
+{
+    unsigned int index;
+    char *psk_id;
+    struct golioth_client *client;
+    struct golioth_rpc *rpc;
+};
+
+struct request_ctx
+{
+    enum loadgen_op op;
+    uint64_t start_ms;
+    size_t bytes;
+};
+
+static struct loadgen_config cfg = {
+    .num_devices = 10,
+    .duration_s = 60,
+    .report_interval_s = 10,
+    .ops_per_device_s = 0.5,
+    .weights =
+        {
+            [OP_STREAM] = 40,
+            [OP_LIGHTDB_SET] = 20,
+            [OP_LIGHTDB_GET] = 10,
+            [OP_LOG] = 20,
+            [OP_OTA_BLOCK] = 10,
+        },
+    .payload_len = 64,
+    .ota_threads = 4,
+    .ota_package = "main",
+    .ota_version = NULL,
+};
+
+static struct op_stats stats[NUM_OPS];
+static struct device *devices;
+static atomic_uint num_connected;
+static atomic_uint num_rpc_calls;
+static atomic_bool running = true;
+static sem_t ota_work;
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void record(enum loadgen_op op, bool ok, uint64_t start_ms, size_t bytes)
+{
+    struct op_stats *s = &stats[op];
+    uint32_t latency_ms = (uint32_t) (now_ms() - start_ms);
+
+    pthread_mutex_lock(&s->lock);
+    if (ok)
+    {
+        s->ok++;
+        s->bytes += bytes;
+    }
+    else
+    {
+        s->failed++;
+    }
+    if (s->num_latencies == s->capacity)
+    {
+        size_t capacity = s->capacity ? 2 * s->capacity : 4096;
+        uint32_t *latencies = realloc(s->latencies_ms, capacity * sizeof(*latencies));
+        if (latencies)
+        {
+            s->latencies_ms = latencies;
+            s->capacity = capacity;
+        }
+    }
+    if (s->num_latencies < s->capacity)
+    {
+        s->latencies_ms[s->num_latencies++] = latency_ms;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void record_rejected(enum loadgen_op op)
+{
+    pthread_mutex_lock(&stats[op].lock);
+    stats[op].rejected++;
+    pthread_mutex_unlock(&stats[op].lock);
+}
+
+static void on_set(struct golioth_client *client,
+                   enum golioth_status status,
+                   const struct golioth_coap_rsp_code *coap_rsp_code,
+                   const char *path,
+                   void *arg)
+{
+    struct request_ctx *ctx = arg;
+    record(ctx->op, status == GOLIOTH_OK, ctx->start_ms, ctx->bytes);
+    free(ctx);
+}
+
+static void on_get(struct golioth_client *client,
+                   enum golioth_status status,
+                   const struct golioth_coap_rsp_code *coap_rsp_code,
+                   const char *path,
+                   const uint8_t *payload,
+                   size_t payload_size,
+                   void *arg)
+{
+    struct request_ctx *ctx = arg;
+    record(ctx->op, status == GOLIOTH_OK, ctx->start_ms, payload_size);
+    free(ctx);
+}
+
+static enum golioth_rpc_status on_rpc_ping(zcbor_state_t *request_params_array,
+                                           zcbor_state_t *response_detail_map,
+                                           void *callback_arg)
+{
+    num_rpc_calls++;
+    return GOLIOTH_RPC_OK;
+}
+
+static void on_client_event(struct golioth_client *client,
+                            enum golioth_client_event event,
+                            void *arg)
+{
+    if (event == GOLIOTH_CLIENT_EVENT_CONNECTED)
+    {
+        num_connected++;
+    }
+    else
+    {
+        num_connected--;
+    }
+}
+
+static enum loadgen_op pick_op(void)
+{
+    unsigned int total = 0;
+    for (int i = 0; i < NUM_OPS; i++)
+    {
+        total += cfg.weights[i];
+    }
+
+    unsigned int r = rand() % total;
+    for (int i = 0; i < NUM_OPS; i++)
+    {
+        if (r < cfg.weights[i])
+        {
+            return i;
+        }
+        r -= cfg.weights[i];
+    }
+
+    return OP_STREAM;
+}
+
+static void issue_op(struct device *dev, enum loadgen_op op, const uint8_t *payload)
+{
+    if (op == OP_OTA_BLOCK)
+    {
+        sem_post(&ota_work);
+        return;
+    }
+
+    struct request_ctx *ctx = malloc(sizeof(*ctx));
+    if (!ctx)
+    {
+        record_rejected(op);
+        return;
+    }
+    ctx->op = op;
+    ctx->start_ms = now_ms();
+    ctx->bytes = cfg.payload_len;
+
+    enum golioth_status status = GOLIOTH_ERR_NOT_IMPLEMENTED;
+    switch (op)
+    {
+        case OP_STREAM:
+            status = golioth_stream_set_async(dev->client,
+                                              "loadgen",
+                                              GOLIOTH_CONTENT_TYPE_OCTET_STREAM,
+                                              payload,
+                                              cfg.payload_len,
+                                              on_set,
+                                              ctx);
+            break;
+        case OP_LIGHTDB_SET:
+            ctx->bytes = sizeof(int32_t);
+            status = golioth_lightdb_set_int_async(dev->client,
+                                                   "loadgen/counter",
+                                                   (int32_t) ctx->start_ms,
+                                                   on_set,
+                                                   ctx);
+            break;
+        case OP_LIGHTDB_GET:
+            status = golioth_lightdb_get_async(dev->client,
+                                               "loadgen/counter",
+                                               GOLIOTH_CONTENT_TYPE_JSON,
+                                               on_get,
+                                               ctx);
+            break;
+        case OP_LOG:
+            ctx->bytes = strlen("loadgen log message");
+            status = golioth_log_info_async(dev->client,
+                                            "loadgen",
+                                            "loadgen log message",
+                                            on_set,
+                                            ctx);
+            break;
+        default:
+            break;
+    }
+
+    if (status != GOLIOTH_OK)
+    {
+        record_rejected(op);
+        free(ctx);
+    }
+}
+
+static void *ota_worker(void *arg)
+{
+    uint8_t *buf = malloc(CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE);
+    size_t block_index = 0;
+
+    while (running)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        if (sem_timedwait(&ota_work, &deadline) != 0)
+        {
+            continue;
+        }
+
+        struct device *dev = &devices[rand() % cfg.num_devices];
+        if (!cfg.ota_version || !golioth_client_is_connected(dev->client))
+        {
+            record_rejected(OP_OTA_BLOCK);
+            continue;
+        }
+
+        size_t block_nbytes = 0;
+        bool is_last = false;
+        uint64_t start_ms = now_ms();
+        enum golioth_status status = golioth_ota_get_block_sync(dev->client,
+                                                                cfg.ota_package,
+                                                                cfg.ota_version,
+                                                                block_index,
+                                                                buf,
+                                                                &block_nbytes,
+                                                                &is_last,
+                                                                GOLIOTH_SYS_WAIT_FOREVER);
+        if (status == GOLIOTH_ERR_QUEUE_FULL || status == GOLIOTH_ERR_INVALID_STATE)
+        {
+            record_rejected(OP_OTA_BLOCK);
+            continue;
+        }
+
+        record(OP_OTA_BLOCK, status == GOLIOTH_OK, start_ms, block_nbytes);
+        block_index = is_last ? 0 : block_index + 1;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, double p)
+{
+    if (n == 0)
+    {
+        return 0;
+    }
+    size_t idx = (size_t) (p / 100.0 * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+// Client statistics, summed (or maxed) over all devices
+struct fleet_stats
+{
+    uint64_t retransmissions;
+    uint64_t timeouts;
+    uint64_t aged_out;
+    uint64_t queue_full;
+    uint64_t reconnects;
+    uint32_t handshake_ms_max;
+    uint32_t queue_depth_peak;
+};
+
+static void collect_fleet_stats(struct fleet_stats *fleet)
+{
+    memset(fleet, 0, sizeof(*fleet));
+
+    for (unsigned int i = 0; i < cfg.num_devices; i++)
+    {
+        struct golioth_client_stats cs;
+        if (golioth_client_get_stats(devices[i].client, &cs) != GOLIOTH_OK)
+        {
+            continue;
+        }
+
+        fleet->retransmissions += cs.retransmissions;
+        fleet->aged_out += cs.aged_out;
+        fleet->queue_full += cs.queue_full;
+        fleet->reconnects += cs.reconnects;
+        for (int type = 0; type < GOLIOTH_CLIENT_NUM_REQUEST_TYPES; type++)
+        {
+            fleet->timeouts += cs.requests[type].timeouts;
+        }
+        if (cs.handshake_ms_max > fleet->handshake_ms_max)
+        {
+            fleet->handshake_ms_max = cs.handshake_ms_max;
+        }
+        if (cs.queue_depth_peak > fleet->queue_depth_peak)
+        {
+            fleet->queue_depth_peak = cs.queue_depth_peak;
+        }
+    }
+}
+
+static void report(double elapsed_s, bool final)
+{
+    uint64_t total_ok = 0;
+    struct fleet_stats fleet;
+
+    collect_fleet_stats(&fleet);
+
+    if (cfg.json)
+    {
+        printf("{\"elapsed_s\": %.1f, \"final\": %s, \"connected\": %u, \"rpc_calls\": %u, "
+               "\"ops\": {",
+               elapsed_s,
+               final ? "true" : "false",
+               (unsigned int) num_connected,
+               (unsigned int) num_rpc_calls);
+    }
+    else
+    {
+        printf("\n--- %.1f s, %u/%u devices connected, %u RPC calls ---\n",
+               elapsed_s,
+               (unsigned int) num_connected,
+               cfg.num_devices,
+               (unsigned int) num_rpc_calls);
+        printf("%-12s %9s %8s %8s %10s %7s %7s %7s %7s\n",
+               "op",
+               "ok",
+               "failed",
+               "rejected",
+               "ops/s",
+               "p50ms",
+               "p90ms",
+               "p99ms",
+               "maxms");
+    }
+
+    for (int op = 0; op < NUM_OPS; op++)
+    {
+        struct op_stats *s = &stats[op];
+
+        pthread_mutex_lock(&s->lock);
+        size_t n = s->num_latencies;
+        uint32_t *sorted = malloc((n ? n : 1) * sizeof(*sorted));
+        if (sorted && n)
+        {
+            memcpy(sorted, s->latencies_ms, n * sizeof(*sorted));
+        }
+        uint64_t ok = s->ok, failed = s->failed, rejected = s->rejected;
+        pthread_mutex_unlock(&s->lock);
+
+        if (!sorted)
+        {
+            continue;
+        }
+        qsort(sorted, n, sizeof(*sorted), cmp_u32);
+
+        double ops_s = ok / (elapsed_s > 0 ? elapsed_s : 1);
+        uint32_t p50 = percentile(sorted, n, 50);
+        uint32_t p90 = percentile(sorted, n, 90);
+        uint32_t p99 = percentile(sorted, n, 99);
+        uint32_t pmax = n ? sorted[n - 1] : 0;
+
+        if (cfg.json)
+        {
+            printf("%s\"%s\": {\"ok\": %" PRIu64 ", \"failed\": %" PRIu64 ", \"rejected\": %" PRIu64
+                   ", \"ops_per_s\": %.2f, \"p50_ms\": %" PRIu32 ", \"p90_ms\": %" PRIu32
+                   ", \"p99_ms\": %" PRIu32 ", \"max_ms\": %" PRIu32 "}",
+                   op ? ", " : "",
+                   op_names[op],
+                   ok,
+                   failed,
+                   rejected,
+                   ops_s,
+                   p50,
+                   p90,
+                   p99,
+                   pmax);
+        }
+        else
+        {
+            printf("%-12s %9" PRIu64 " %8" PRIu64 " %8" PRIu64 " %10.2f %7" PRIu32 " %7" PRIu32
+                   " %7" PRIu32 " %7" PRIu32 "\n",
+                   op_names[op],
+                   ok,
+                   failed,
+                   rejected,
+                   ops_s,
+                   p50,
+                   p90,
+                   p99,
+                   pmax);
+        }
+
+        total_ok += ok;
+        free(sorted);
+    }
+
+    if (cfg.json)
+    {
+        printf("}, \"total_ops_per_s\": %.2f, \"retransmissions\": %" PRIu64
+               ", \"timeouts\": %" PRIu64 ", \"aged_out\": %" PRIu64 ", \"queue_full\": %" PRIu64
+               ", \"reconnects\": %" PRIu64 ", \"handshake_max_ms\": %" PRIu32
+               ", \"queue_depth_peak\": %" PRIu32 "}\n",
+               total_ok / (elapsed_s > 0 ? elapsed_s : 1),
+               fleet.retransmissions,
+               fleet.timeouts,
+               fleet.aged_out,
+               fleet.queue_full,
+               fleet.reconnects,
+               fleet.handshake_ms_max,
+               fleet.queue_depth_peak);
+    }
+    else
+    {
+        printf("total: %.2f ops/s\n", total_ok / (elapsed_s > 0 ? elapsed_s : 1));
+        printf("client: %" PRIu64 " retransmissions, %" PRIu64 " timeouts, %" PRIu64
+               " aged out, %" PRIu64 " queue full, %" PRIu64 " reconnects, max handshake %" PRIu32
+               " ms, peak queue depth %" PRIu32 "\n",
+               fleet.retransmissions,
+               fleet.timeouts,
+               fleet.aged_out,
+               fleet.queue_full,
+               fleet.reconnects,
+               fleet.handshake_ms_max,
+               fleet.queue_depth_peak);
+    }
+    fflush(stdout);
+}
+
+static int parse_mix(char *mix)
+{
+    for (char *tok = strtok(mix, ","); tok; tok = strtok(NULL, ","))
+    {
+        char *eq = strchr(tok, '=');
+        if (!eq)
+        {
+            return -EINVAL;
+        }
+        *eq = '\0';
+
+        int op;
+        for (op = 0; op < NUM_OPS; op++)
+        {
+            if (strcmp(tok, op_names[op]) == 0)
+            {
+                break;
+            }
+        }
+        if (op == NUM_OPS)
+        {
+            fprintf(stderr, "Unknown operation: %s\n", tok);
+            return -EINVAL;
+        }
+        cfg.weights[op] = strtoul(eq + 1, NULL, 0);
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n <devices>     number of virtual devices (default %u)\n"
+            "  -d <seconds>     test duration (default %u)\n"
+            "  -i <seconds>     report interval (default %u)\n"
+            "  -r <ops/s>       operations per device per second (default %.2f)\n"
+            "  -m <mix>         operation weights, e.g. "
+            "stream=40,lightdb_set=20,lightdb_get=10,log=20,ota_block=10\n"
+            "  -p <bytes>       stream payload length (default %u)\n"
+            "  -o <version>     OTA artifact version to fetch blocks from (OTA disabled if unset)\n"
+            "  -P <package>     OTA artifact package (default \"%s\")\n"
+            "  -t <threads>     OTA fetch threads (default %u)\n"
+            "  -j               print reports as JSON lines\n",
+            prog,
+            cfg.num_devices,
+            cfg.duration_s,
+            cfg.report_interval_s,
+            cfg.ops_per_device_s,
+            cfg.payload_len,
+            cfg.ota_package,
+            cfg.ota_threads);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:i:r:m:p:o:P:t:jh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                cfg.num_devices = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                cfg.duration_s = strtoul(optarg, NULL, 0);
+                break;
+            case 'i':
+                cfg.report_interval_s = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                cfg.ops_per_device_s = strtod(optarg, NULL);
+                break;
+            case 'm':
+                memset(cfg.weights, 0, sizeof(cfg.weights));
+                if (parse_mix(optarg))
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'p':
+                cfg.payload_len = strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                cfg.ota_version = optarg;
+                break;
+            case 'P':
+                cfg.ota_package = optarg;
+                break;
+            case 't':
+                cfg.ota_threads = strtoul(optarg, NULL, 0);
+                break;
+            case 'j':
+                cfg.json = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    unsigned int total_weight = 0;
+    for (int i = 0; i < NUM_OPS; i++)
+    {
+        total_weight += cfg.weights[i];
+    }
+    if (cfg.num_devices == 0 || total_weight == 0 || cfg.report_interval_s == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char *psk_id_fmt = getenv("GOLIOTH_SAMPLE_PSK_ID");
+    if ((!psk_id_fmt) || strlen(psk_id_fmt) <= 0)
+    {
+        fprintf(stderr, "PSK ID is not specified.\n");
+        return 1;
+    }
+    char *psk = getenv("GOLIOTH_SAMPLE_PSK");
+    if ((!psk) || strlen(psk) <= 0)
+    {
+        fprintf(stderr, "PSK is not specified.\n");
+        return 1;
+    }
+    bool per_device_id = (strstr(psk_id_fmt, "%u") != NULL);
+
+    for (int i = 0; i < NUM_OPS; i++)
+    {
+        pthread_mutex_init(&stats[i].lock, NULL);
+    }
+    sem_init(&ota_work, 0, 0);
+
+    devices = calloc(cfg.num_devices, sizeof(*devices));
+    uint8_t *payload = calloc(1, cfg.payload_len + 1);
+    if (!devices || !payload)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < cfg.num_devices; i++)
+    {
+        struct device *dev = &devices[i];
+
+        dev->index = i;
+        if (per_device_id)
+        {
+            size_t len = strlen(psk_id_fmt) + 11;
+            dev->psk_id = malloc(len);
+            snprintf(dev->psk_id, len, psk_id_fmt, i);
+        }
+        else
+        {
+            dev->psk_id = psk_id_fmt;
+        }
+
+        struct golioth_client_config config = {
+            .credentials =
+                {
+                    .auth_type = GOLIOTH_TLS_AUTH_TYPE_PSK,
+                    .psk =
+                        {
+                            .psk_id = dev->psk_id,
+                            .psk_id_len = strlen(dev->psk_id),
+                            .psk = psk,
+                            .psk_len = strlen(psk),
+                        },
+                },
+        };
+
+        dev->client = golioth_client_create(&config);
+        if (!dev->client)
+        {
+            fprintf(stderr, "Failed to create client %u\n", i);
+            return 1;
+        }
+        golioth_client_register_event_callback(dev->client, on_client_event, NULL);
+
+        dev->rpc = golioth_rpc_init(dev->client);
+        if (dev->rpc)
+        {
+            golioth_rpc_register(dev->rpc, "loadgen_ping", on_rpc_ping, dev);
+        }
+    }
+
+    pthread_t *ota_threads = calloc(cfg.ota_threads ? cfg.ota_threads : 1, sizeof(pthread_t));
+    for (unsigned int i = 0; i < cfg.ota_threads; i++)
+    {
+        pthread_create(&ota_threads[i], NULL, ota_worker, NULL);
+    }
+
+    // Issue operations at a constant aggregate rate, spread over all devices
+    const double total_rate = cfg.ops_per_device_s * cfg.num_devices;
+    const uint64_t start_ms = now_ms();
+    uint64_t next_report_ms = start_ms + cfg.report_interval_s * 1000;
+    double issued = 0;
+
+    while (now_ms() - start_ms < (uint64_t) cfg.duration_s * 1000)
+    {
+        usleep(10 * 1000);
+
+        uint64_t now = now_ms();
+        double due = total_rate * (now - start_ms) / 1000.0;
+
+        while (issued + 1 <= due)
+        {
+            struct device *dev = &devices[rand() % cfg.num_devices];
+            issued++;
+
+            if (!golioth_client_is_connected(dev->client))
+            {
+                continue;
+            }
+
+            memset(payload, 'a' + (dev->index % 26), cfg.payload_len);
+            issue_op(dev, pick_op(), payload);
+        }
+
+        if (now >= next_report_ms)
+        {
+            report((now - start_ms) / 1000.0, false);
+            next_report_ms += cfg.report_interval_s * 1000;
+        }
+    }
+
+    running = false;
+    for (unsigned int i = 0; i < cfg.ota_threads; i++)
+    {
+        pthread_join(ota_threads[i], NULL);
+    }
+
+    report((now_ms() - start_ms) / 1000.0, true);
+
+    for (unsigned int i = 0; i < cfg.num_devices; i++)
+    {
+        if (devices[i].rpc)
+        {
+            golioth_rpc_deinit(devices[i].rpc);
+        }
+        golioth_client_destroy(devices[i].client);
+        if (per_device_id)
+        {
+            free(devices[i].psk_id);
+        }
+    }
+
+    free(ota_threads);
+    free(payload);
+    free(devices);
+
+    return 0;
+}
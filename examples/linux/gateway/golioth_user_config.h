@@ -0,0 +1,12 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#define CONFIG_GOLIOTH_COAP_GATEWAY
+#define CONFIG_GOLIOTH_COAP_GATEWAY_NUM_IO_THREADS 1
+#define CONFIG_GOLIOTH_AUTO_LOG_TO_CLOUD 0
+#define CONFIG_GOLIOTH_DEBUG_DEFAULT_LOG_LEVEL GOLIOTH_DEBUG_LOG_LEVEL_WARN
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
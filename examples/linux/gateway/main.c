@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Gateway mode benchmark
+//
+// Creates many Golioth clients, each with its own PSK identity, which are all
+// served by the shared gateway I/O thread(s). Every client periodically writes
+// a counter to LightDB state. Once per second the number of connected
+// sessions, completed requests, CPU usage and resident memory are printed.
+//
+// Environment:
+//   GOLIOTH_SAMPLE_PSK_ID            PSK-ID; may contain one "%u", replaced by the device index
+//   GOLIOTH_SAMPLE_PSK               PSK, shared by all devices
+//   GOLIOTH_GATEWAY_NUM_CLIENTS      number of sessions (default 1000)
+//   GOLIOTH_GATEWAY_DURATION_S       benchmark duration in seconds (default 60)
+//   GOLIOTH_GATEWAY_SET_INTERVAL_S   per-device LightDB write interval (default 10)
+
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <golioth/client.h>
+#include <golioth/lightdb_state.h>
+
+static atomic_uint num_connected;
+static atomic_uint num_set_ok;
+static atomic_uint num_set_failed;
+
+static unsigned int env_uint(const char *name, unsigned int default_value)
+{
+    const char *value = getenv(name);
+    if (!value || strlen(value) == 0)
+    {
+        return default_value;
+    }
+    return strtoul(value, NULL, 0);
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t cpu_time_ms(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+static size_t rss_kb(void)
+{
+    long pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (fscanf(f, "%*d %ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return (size_t) pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static size_t heap_in_use(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static void on_client_event(struct golioth_client *client,
+                            enum golioth_client_event event,
+                            void *arg)
+{
+    if (event == GOLIOTH_CLIENT_EVENT_CONNECTED)
+    {
+        num_connected++;
+    }
+    else
+    {
+        num_connected--;
+    }
+}
+
+static void on_set(struct golioth_client *client,
+                   enum golioth_status status,
+                   const struct golioth_coap_rsp_code *coap_rsp_code,
+                   const char *path,
+                   void *arg)
+{
+    if (status == GOLIOTH_OK)
+    {
+        num_set_ok++;
+    }
+    else
+    {
+        num_set_failed++;
+    }
+}
+
+int main(void)
+{
+    const char *psk_id_fmt = getenv("GOLIOTH_SAMPLE_PSK_ID");
+    if ((!psk_id_fmt) || strlen(psk_id_fmt) <= 0)
+    {
+        fprintf(stderr, "PSK ID is not specified.\n");
+        return 1;
+    }
+    char *psk = getenv("GOLIOTH_SAMPLE_PSK");
+    if ((!psk) || strlen(psk) <= 0)
+    {
+        fprintf(stderr, "PSK is not specified.\n");
+        return 1;
+    }
+
+    unsigned int num_clients = env_uint("GOLIOTH_GATEWAY_NUM_CLIENTS", 1000);
+    unsigned int duration_s = env_uint("GOLIOTH_GATEWAY_DURATION_S", 60);
+    unsigned int set_interval_s = env_uint("GOLIOTH_GATEWAY_SET_INTERVAL_S", 10);
+    bool per_device_id = (strstr(psk_id_fmt, "%u") != NULL);
+
+    struct golioth_client **clients = calloc(num_clients, sizeof(*clients));
+    char **psk_ids = calloc(num_clients, sizeof(*psk_ids));
+    if (!clients || !psk_ids)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    size_t heap_before = heap_in_use();
+    uint64_t start_ms = now_ms();
+
+    for (unsigned int i = 0; i < num_clients; i++)
+    {
+        // Credentials must persist for the lifetime of the client
+        if (per_device_id)
+        {
+            size_t len = strlen(psk_id_fmt) + 11;
+            psk_ids[i] = malloc(len);
+            snprintf(psk_ids[i], len, psk_id_fmt, i);
+        }
+        else
+        {
+            psk_ids[i] = (char *) psk_id_fmt;
+        }
+
+        struct golioth_client_config config = {
+            .credentials =
+                {
+                    .auth_type = GOLIOTH_TLS_AUTH_TYPE_PSK,
+                    .psk =
+                        {
+                            .psk_id = psk_ids[i],
+                            .psk_id_len = strlen(psk_ids[i]),
+                            .psk = psk,
+                            .psk_len = strlen(psk),
+                        },
+                },
+        };
+
+        clients[i] = golioth_client_create(&config);
+        if (!clients[i])
+        {
+            fprintf(stderr, "Failed to create client %u\n", i);
+            return 1;
+        }
+        golioth_client_register_event_callback(clients[i], on_client_event, NULL);
+    }
+
+    size_t heap_created = heap_in_use();
+
+    printf("{\"clients\": %u, \"create_ms\": %" PRIu64 ", \"heap_per_client_idle\": %zu}\n",
+           num_clients,
+           now_ms() - start_ms,
+           (heap_created - heap_before) / num_clients);
+
+    uint64_t last_cpu_ms = cpu_time_ms();
+    uint64_t last_ms = now_ms();
+    uint64_t all_connected_ms = 0;
+    unsigned int next_client = 0;
+    int32_t counter = 0;
+
+    for (unsigned int t = 1; t <= duration_s; t++)
+    {
+        sleep(1);
+
+        if (all_connected_ms == 0 && num_connected == num_clients)
+        {
+            all_connected_ms = now_ms() - start_ms;
+        }
+
+        // Spread writes evenly, so every device writes once per interval
+        unsigned int num_writes = (num_clients + set_interval_s - 1) / set_interval_s;
+        for (unsigned int i = 0; i < num_writes; i++)
+        {
+            struct golioth_client *client = clients[next_client];
+            next_client = (next_client + 1) % num_clients;
+
+            if (golioth_client_is_connected(client))
+            {
+                golioth_lightdb_set_int_async(client, "counter", counter++, on_set, NULL);
+            }
+        }
+
+        uint64_t cpu_ms = cpu_time_ms();
+        uint64_t wall_ms = now_ms();
+
+        printf("{\"t\": %u, \"connected\": %u, \"set_ok\": %u, \"set_failed\": %u, "
+               "\"cpu_pct\": %.1f, \"rss_kb\": %zu, \"heap_per_client\": %zu}\n",
+               t,
+               (unsigned int) num_connected,
+               (unsigned int) num_set_ok,
+               (unsigned int) num_set_failed,
+               100.0 * (cpu_ms - last_cpu_ms) / (wall_ms - last_ms),
+               rss_kb(),
+               (heap_in_use() - heap_before) / num_clients);
+        fflush(stdout);
+
+        last_cpu_ms = cpu_ms;
+        last_ms = wall_ms;
+    }
+
+    printf("{\"summary\": true, \"clients\": %u, \"all_connected_ms\": %" PRIu64
+           ", \"set_ok\": %u, \"set_failed\": %u}\n",
+           num_clients,
+           all_connected_ms,
+           (unsigned int) num_set_ok,
+           (unsigned int) num_set_failed);
+
+    for (unsigned int i = 0; i < num_clients; i++)
+    {
+        golioth_client_destroy(clients[i]);
+        if (per_device_id)
+        {
+            free(psk_ids[i]);
+        }
+    }
+    free(clients);
+    free(psk_ids);
+
+    return 0;
+}
@@ -15,6 +15,7 @@ extern "C"
 #include <stdint.h>
 #include <stdlib.h>
 #include <golioth/golioth_status.h>
+#include <golioth/heap_stats.h>
 #include "golioth_sys.h"
 
 /// @defgroup golioth_client golioth_client
@@ -40,6 +41,15 @@ enum golioth_client_event
     GOLIOTH_CLIENT_EVENT_DISCONNECTED,
 };
 
+/// Request queue watermarks, see @ref golioth_client_set_queue_watermarks
+enum golioth_client_queue_watermark
+{
+    /// The request queue filled up to the high watermark
+    GOLIOTH_CLIENT_QUEUE_HIGH_WATERMARK,
+    /// The request queue drained down to the low watermark, after reaching the high watermark
+    GOLIOTH_CLIENT_QUEUE_LOW_WATERMARK,
+};
+
 /// Golioth Content Type
 enum golioth_content_type
 {
@@ -134,6 +144,18 @@ typedef void (*golioth_client_event_cb_fn)(struct golioth_client *client,
                                            enum golioth_client_event event,
                                            void *arg);
 
+/// Callback function type for request queue watermarks
+///
+/// Called from the thread that enqueued the request that reached the high watermark, or from
+/// the client thread when the queue drained down to the low watermark. Must not block.
+///
+/// @param client The client handle
+/// @param watermark The watermark that was reached
+/// @param arg User argument, copied from @ref golioth_client_set_queue_watermarks. Can be NULL.
+typedef void (*golioth_client_queue_watermark_cb_fn)(struct golioth_client *client,
+                                                     enum golioth_client_queue_watermark watermark,
+                                                     void *arg);
+
 /// Callback function type for all asynchronous get and observe requests
 ///
 /// Will be called when a response is received, on timeout (i.e. response never received), or when
@@ -360,6 +382,174 @@ void golioth_client_register_event_callback(struct golioth_client *client,
 /// @return The number of items currently in the client thread request queue.
 uint32_t golioth_client_num_items_in_request_queue(struct golioth_client *client);
 
+/// Get notified when the request queue fills up, and again when it drains.
+///
+/// The callback is called with GOLIOTH_CLIENT_QUEUE_HIGH_WATERMARK when the number of requests in
+/// the queue reaches \p high, and then with GOLIOTH_CLIENT_QUEUE_LOW_WATERMARK once it drops to
+/// \p low. Producers can use this to throttle, rather than polling
+/// @ref golioth_client_num_items_in_request_queue or retrying on GOLIOTH_ERR_QUEUE_FULL.
+///
+/// @param client The client handle
+/// @param high High watermark, at most GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS
+/// @param low Low watermark, less than \p high
+/// @param callback Callback function to register, or NULL to unregister
+/// @param arg Optional argument, forwarded directly to the callback when invoked. Can be NULL.
+///
+/// @retval GOLIOTH_OK watermarks set
+/// @retval GOLIOTH_ERR_NULL client is NULL
+/// @retval GOLIOTH_ERR_INVALID_FORMAT invalid watermarks
+enum golioth_status golioth_client_set_queue_watermarks(
+    struct golioth_client *client,
+    uint32_t high,
+    uint32_t low,
+    golioth_client_queue_watermark_cb_fn callback,
+    void *arg);
+
+/// Set how long requests wait for space in a full request queue.
+///
+/// By default (0), a request that does not fit in the request queue fails immediately with
+/// GOLIOTH_ERR_QUEUE_FULL. With a timeout, all request functions (synchronous and asynchronous)
+/// wait up to \p timeout_ms for the client thread to make space, and fail with
+/// GOLIOTH_ERR_QUEUE_FULL only after that. Requests made from the client thread, e.g. from
+/// callbacks, never wait, since that is the thread that empties the queue.
+///
+/// @param client The client handle
+/// @param timeout_ms Time to wait, in milliseconds, or GOLIOTH_SYS_WAIT_FOREVER
+void golioth_client_set_enqueue_timeout(struct golioth_client *client, int32_t timeout_ms);
+
+/// Transmission window statistics, returned by @ref golioth_client_get_tx_window_stats
+struct golioth_client_tx_window_stats
+{
+    /// Windows opened, for any reason
+    uint32_t windows;
+    /// Requests held for a window
+    uint32_t held;
+    /// Windows opened early, because an urgent request was sent while requests were held
+    uint32_t piggybacked;
+    /// Windows opened early, because the maximum number of requests was held
+    uint32_t hold_full;
+    /// Idle keepalives deferred to the next window
+    uint32_t keepalives_deferred;
+};
+
+/// Open a transmission window now.
+///
+/// With CONFIG_GOLIOTH_TX_WINDOW, non-urgent requests (asynchronous uploads to stream, LightDB
+/// State and logs) are held and sent together when a window opens, so that the radio wakes up
+/// less often. Windows open every CONFIG_GOLIOTH_TX_WINDOW_PERIOD_S, whenever an urgent request is
+/// sent while requests are held, and when this function is called, e.g. when the application
+/// knows the radio is on. A window stays open for CONFIG_GOLIOTH_TX_WINDOW_DURATION_MS.
+///
+/// @param client The client handle
+///
+/// @retval GOLIOTH_OK window opened
+/// @retval GOLIOTH_ERR_NULL client is NULL
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_TX_WINDOW is disabled
+enum golioth_status golioth_client_tx_window_open(struct golioth_client *client);
+
+/// Get the transmission window statistics
+///
+/// @param client The client handle
+/// @param stats Filled with the statistics
+///
+/// @retval GOLIOTH_OK statistics returned
+/// @retval GOLIOTH_ERR_NULL client or stats is NULL
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_TX_WINDOW is disabled
+enum golioth_status golioth_client_get_tx_window_stats(
+    struct golioth_client *client,
+    struct golioth_client_tx_window_stats *stats);
+
+/// Request types counted separately in @ref golioth_client_stats
+enum golioth_client_request_type
+{
+    GOLIOTH_CLIENT_REQUEST_EMPTY,
+    GOLIOTH_CLIENT_REQUEST_GET,
+    GOLIOTH_CLIENT_REQUEST_GET_BLOCK,
+    GOLIOTH_CLIENT_REQUEST_POST,
+    GOLIOTH_CLIENT_REQUEST_POST_BLOCK,
+    GOLIOTH_CLIENT_REQUEST_DELETE,
+    GOLIOTH_CLIENT_REQUEST_OBSERVE,
+    GOLIOTH_CLIENT_REQUEST_OBSERVE_RELEASE,
+    GOLIOTH_CLIENT_NUM_REQUEST_TYPES,
+};
+
+/// Upper bounds, in milliseconds, of the response latency histogram buckets.
+///
+/// The last bucket of the histogram counts all responses slower than the last bound.
+#define GOLIOTH_CLIENT_STATS_LATENCY_BOUNDS_MS {25, 50, 100, 250, 500, 1000, 2500, 5000, 10000}
+#define GOLIOTH_CLIENT_STATS_NUM_LATENCY_BUCKETS 10
+
+/// Statistics of a single request type
+struct golioth_client_request_stats
+{
+    /// Requests sent to the server
+    uint32_t sent;
+    /// Requests that never got a response
+    uint32_t timeouts;
+    /// Histogram of the time between sending a request and receiving its response,
+    /// bucketed by @ref GOLIOTH_CLIENT_STATS_LATENCY_BOUNDS_MS
+    uint32_t latency[GOLIOTH_CLIENT_STATS_NUM_LATENCY_BUCKETS];
+};
+
+/// Client statistics, returned by @ref golioth_client_get_stats
+///
+/// All counters start at zero when the client is created and wrap around on overflow.
+struct golioth_client_stats
+{
+    /// Per request type statistics, indexed by @ref golioth_client_request_type
+    struct golioth_client_request_stats requests[GOLIOTH_CLIENT_NUM_REQUEST_TYPES];
+    /// Application payload bytes sent (CoAP and DTLS overhead not included)
+    uint32_t bytes_sent;
+    /// Application payload bytes received, including observation notifications
+    uint32_t bytes_received;
+    /// CoAP retransmissions of confirmable messages
+    uint32_t retransmissions;
+    /// Requests dropped before being sent, because they aged out in the request queue
+    uint32_t aged_out;
+    /// Requests that missed their deadline, either dropped before being sent or answered after
+    /// their timeout
+    uint32_t deadline_missed;
+    /// Requests rejected because the request queue was full
+    uint32_t queue_full;
+    /// Sessions established with the server
+    uint32_t handshakes;
+    /// Sessions established after the first one
+    uint32_t reconnects;
+    /// Time it took to establish the most recent session, in milliseconds
+    uint32_t handshake_ms_last;
+    /// Longest time it took to establish a session, in milliseconds
+    uint32_t handshake_ms_max;
+    /// Number of items currently in the request queue
+    uint32_t queue_depth;
+    /// Highest number of items seen in the request queue
+    uint32_t queue_depth_peak;
+    /// Estimated number of times the radio woke up to send a request, i.e. requests sent at least
+    /// CONFIG_GOLIOTH_CLIENT_STATS_RADIO_TAIL_MS after the previous one
+    uint32_t radio_wakeups;
+    /// Estimated time the radio was on, in milliseconds, assuming it stays on for
+    /// CONFIG_GOLIOTH_CLIENT_STATS_RADIO_TAIL_MS after each request sent
+    uint32_t radio_on_ms;
+    /// Heap usage per SDK subsystem, indexed by @ref golioth_heap_subsystem. Shared by all
+    /// clients, and only filled in with CONFIG_GOLIOTH_HEAP_STATS.
+    struct golioth_heap_stats heap[GOLIOTH_HEAP_NUM_SUBSYSTEMS];
+};
+
+/// Get a snapshot of the client statistics.
+///
+/// Counters are updated without locking, so the snapshot is not atomic as a whole: a request
+/// that is being processed concurrently may be counted in some fields and not yet in others.
+///
+/// Requires CONFIG_GOLIOTH_CLIENT_STATS. When disabled, statistics are not collected at all.
+///
+/// @param client The client handle
+/// @param stats Filled with the current statistics
+///
+/// @retval GOLIOTH_OK Statistics copied to \p stats
+/// @retval GOLIOTH_ERR_NULL Client handle or \p stats invalid
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_CLIENT_STATS is disabled
+enum golioth_status golioth_client_get_stats(struct golioth_client *client,
+                                             struct golioth_client_stats *stats);
+
 /// Simulate packet loss at a particular percentage (0 to 100).
 ///
 /// Intended for testing and troubleshooting in packet loss scenarios.
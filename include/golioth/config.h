@@ -39,6 +39,26 @@ extern "C"
 #define CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS 10
 #endif
 
+#ifndef CONFIG_GOLIOTH_COAP_REQUEST_DEADLINE_MARGIN_MS
+#define CONFIG_GOLIOTH_COAP_REQUEST_DEADLINE_MARGIN_MS 0
+#endif
+
+#ifndef CONFIG_GOLIOTH_CLIENT_STATS_RADIO_TAIL_MS
+#define CONFIG_GOLIOTH_CLIENT_STATS_RADIO_TAIL_MS 10000
+#endif
+
+#ifndef CONFIG_GOLIOTH_TX_WINDOW_PERIOD_S
+#define CONFIG_GOLIOTH_TX_WINDOW_PERIOD_S 60
+#endif
+
+#ifndef CONFIG_GOLIOTH_TX_WINDOW_DURATION_MS
+#define CONFIG_GOLIOTH_TX_WINDOW_DURATION_MS 2000
+#endif
+
+#ifndef CONFIG_GOLIOTH_TX_WINDOW_MAX_ITEMS
+#define CONFIG_GOLIOTH_TX_WINDOW_MAX_ITEMS 16
+#endif
+
 #ifndef CONFIG_GOLIOTH_COAP_THREAD_PRIORITY
 #define CONFIG_GOLIOTH_COAP_THREAD_PRIORITY 5
 #endif
@@ -51,6 +71,18 @@ extern "C"
 #define CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S 9
 #endif
 
+#ifndef CONFIG_GOLIOTH_COAP_GATEWAY_NUM_IO_THREADS
+#define CONFIG_GOLIOTH_COAP_GATEWAY_NUM_IO_THREADS 1
+#endif
+
+#ifndef CONFIG_GOLIOTH_COAP_GATEWAY_POLL_INTERVAL_MS
+#define CONFIG_GOLIOTH_COAP_GATEWAY_POLL_INTERVAL_MS 50
+#endif
+
+#ifndef CONFIG_GOLIOTH_COAP_GATEWAY_MAX_SENDS_PER_TICK
+#define CONFIG_GOLIOTH_COAP_GATEWAY_MAX_SENDS_PER_TICK 32
+#endif
+
 #ifndef CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS
 #define CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS 8
 #endif
@@ -93,6 +125,30 @@ extern "C"
 #define CONFIG_GOLIOTH_COAP_MAX_PATH_LEN 39
 #endif
 
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_PATHS
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_PATHS 4
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_VALUE_LEN
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_VALUE_LEN 64
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_FIELDS
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_FIELDS 16
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_KEY_LEN
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_KEY_LEN 23
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_STRING_LEN
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_STRING_LEN 32
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_PAYLOAD_LEN
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_PAYLOAD_LEN 256
+#endif
+
 #ifndef CONFIG_GOLIOTH_MAX_NUM_SETTINGS
 #define CONFIG_GOLIOTH_MAX_NUM_SETTINGS 16
 #endif
@@ -101,6 +157,20 @@ extern "C"
 #define CONFIG_GOLIOTH_SETTINGS_MAX_RESPONSE_LEN 256
 #endif
 
+#ifndef CONFIG_GOLIOTH_SETTINGS_STREAM_BUF_LEN
+#define CONFIG_GOLIOTH_SETTINGS_STREAM_BUF_LEN 160
+#endif
+
+#ifndef CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN
+#define CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN 1024
+#endif
+
+// Settings snapshot file of the Linux port for CONFIG_GOLIOTH_SETTINGS_SNAPSHOT. The path can be
+// overridden at runtime with the GOLIOTH_SETTINGS_SNAPSHOT_FILE environment variable.
+#ifndef CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_LINUX_PATH
+#define CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_LINUX_PATH ".golioth_settings.cbor"
+#endif
+
 #ifndef CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS
 #define CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS 8
 #endif
@@ -109,6 +179,30 @@ extern "C"
 #define CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN 256
 #endif
 
+#ifndef CONFIG_GOLIOTH_RPC_NUM_WORKERS
+#define CONFIG_GOLIOTH_RPC_NUM_WORKERS 0
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_WORKER_QUEUE_LEN
+#define CONFIG_GOLIOTH_RPC_WORKER_QUEUE_LEN 4
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_WORKER_STACK_SIZE
+#define CONFIG_GOLIOTH_RPC_WORKER_STACK_SIZE 4096
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_WORKER_PRIORITY
+#define CONFIG_GOLIOTH_RPC_WORKER_PRIORITY CONFIG_GOLIOTH_COAP_THREAD_PRIORITY
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE
+#define CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE 4
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_DEDUP_TTL_S
+#define CONFIG_GOLIOTH_RPC_DEDUP_TTL_S 60
+#endif
+
 #ifndef CONFIG_GOLIOTH_AUTO_LOG_TO_CLOUD
 #define CONFIG_GOLIOTH_AUTO_LOG_TO_CLOUD 0
 #endif
@@ -117,6 +211,38 @@ extern "C"
 #define CONFIG_GOLIOTH_DEBUG_DEFAULT_LOG_LEVEL GOLIOTH_DEBUG_LOG_LEVEL_INFO
 #endif
 
+#ifndef CONFIG_GOLIOTH_LOG_RATE_LIMIT_TAG_RATE
+#define CONFIG_GOLIOTH_LOG_RATE_LIMIT_TAG_RATE 10
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_RATE_LIMIT_TAG_BURST
+#define CONFIG_GOLIOTH_LOG_RATE_LIMIT_TAG_BURST 20
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_RATE_LIMIT_CALLSITE_RATE
+#define CONFIG_GOLIOTH_LOG_RATE_LIMIT_CALLSITE_RATE 2
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_RATE_LIMIT_CALLSITE_BURST
+#define CONFIG_GOLIOTH_LOG_RATE_LIMIT_CALLSITE_BURST 5
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_RATE_LIMIT_REPEAT_WINDOW_MS
+#define CONFIG_GOLIOTH_LOG_RATE_LIMIT_REPEAT_WINDOW_MS 10000
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_RATE_LIMIT_NUM_SLOTS
+#define CONFIG_GOLIOTH_LOG_RATE_LIMIT_NUM_SLOTS 16
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_BATCH_MAX_BYTES
+#define CONFIG_GOLIOTH_LOG_BATCH_MAX_BYTES 1024
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS
+#define CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS 5000
+#endif
+
 #ifndef GOLIOTH_OVERRIDE_LIBCOAP_LOG_HANDLER
 #define GOLIOTH_OVERRIDE_LIBCOAP_LOG_HANDLER 1
 #endif
@@ -129,6 +255,73 @@ extern "C"
 #define CONFIG_GOLIOTH_FW_UPDATE_ROLLBACK_TIMER_S 300
 #endif
 
+// Static pools for CONFIG_GOLIOTH_HEAP_STATIC. The defaults fit one client with the default
+// configuration; the xlarge blocks hold the client itself and its request queue. Port-layer
+// objects (semaphores, mutexes, timers, threads) are not served from the pools, see
+// docs/Flash_and_RAM_Usage.md.
+#ifndef CONFIG_GOLIOTH_HEAP_STATIC_SMALL_BLOCK_SIZE
+#define CONFIG_GOLIOTH_HEAP_STATIC_SMALL_BLOCK_SIZE 64
+#endif
+
+#ifndef CONFIG_GOLIOTH_HEAP_STATIC_SMALL_NUM_BLOCKS
+#define CONFIG_GOLIOTH_HEAP_STATIC_SMALL_NUM_BLOCKS 32
+#endif
+
+#ifndef CONFIG_GOLIOTH_HEAP_STATIC_MEDIUM_BLOCK_SIZE
+#define CONFIG_GOLIOTH_HEAP_STATIC_MEDIUM_BLOCK_SIZE 320
+#endif
+
+#ifndef CONFIG_GOLIOTH_HEAP_STATIC_MEDIUM_NUM_BLOCKS
+#define CONFIG_GOLIOTH_HEAP_STATIC_MEDIUM_NUM_BLOCKS 16
+#endif
+
+#ifndef CONFIG_GOLIOTH_HEAP_STATIC_LARGE_BLOCK_SIZE
+#define CONFIG_GOLIOTH_HEAP_STATIC_LARGE_BLOCK_SIZE 1088
+#endif
+
+#ifndef CONFIG_GOLIOTH_HEAP_STATIC_LARGE_NUM_BLOCKS
+#define CONFIG_GOLIOTH_HEAP_STATIC_LARGE_NUM_BLOCKS 8
+#endif
+
+#ifndef CONFIG_GOLIOTH_HEAP_STATIC_XLARGE_BLOCK_SIZE
+#define CONFIG_GOLIOTH_HEAP_STATIC_XLARGE_BLOCK_SIZE 2304
+#endif
+
+#ifndef CONFIG_GOLIOTH_HEAP_STATIC_XLARGE_NUM_BLOCKS
+#define CONFIG_GOLIOTH_HEAP_STATIC_XLARGE_NUM_BLOCKS 2
+#endif
+
+// Log the per-subsystem heap usage (CONFIG_GOLIOTH_HEAP_STATS) when a client is destroyed
+#ifndef CONFIG_GOLIOTH_HEAP_STATS_REPORT
+#define CONFIG_GOLIOTH_HEAP_STATS_REPORT 0
+#endif
+
+#ifndef CONFIG_GOLIOTH_STORE_FORWARD_MAX_RECORD_SIZE
+#define CONFIG_GOLIOTH_STORE_FORWARD_MAX_RECORD_SIZE 1024
+#endif
+
+#ifndef CONFIG_GOLIOTH_STORE_FORWARD_MAX_IN_FLIGHT
+#define CONFIG_GOLIOTH_STORE_FORWARD_MAX_IN_FLIGHT 2
+#endif
+
+#ifndef CONFIG_GOLIOTH_STORE_FORWARD_RETRY_MS
+#define CONFIG_GOLIOTH_STORE_FORWARD_RETRY_MS 10000
+#endif
+
+// Store of the Linux port for CONFIG_GOLIOTH_STORE_FORWARD. The directory can be overridden at
+// runtime with the GOLIOTH_STORE_FORWARD_DIR environment variable.
+#ifndef CONFIG_GOLIOTH_STORE_FORWARD_LINUX_DIR
+#define CONFIG_GOLIOTH_STORE_FORWARD_LINUX_DIR ".golioth_store"
+#endif
+
+#ifndef CONFIG_GOLIOTH_STORE_FORWARD_LINUX_SEGMENT_SIZE
+#define CONFIG_GOLIOTH_STORE_FORWARD_LINUX_SEGMENT_SIZE 65536
+#endif
+
+#ifndef CONFIG_GOLIOTH_STORE_FORWARD_LINUX_MAX_SEGMENTS
+#define CONFIG_GOLIOTH_STORE_FORWARD_LINUX_MAX_SEGMENTS 64
+#endif
+
 #ifdef __cplusplus
 }
 #endif
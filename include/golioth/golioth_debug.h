@@ -12,6 +12,7 @@ extern "C"
 #pragma once
 
 #include <golioth/config.h>
+#include <golioth/golioth_status.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -39,17 +40,75 @@ enum golioth_debug_log_level
     GOLIOTH_DEBUG_LOG_LEVEL_VERBOSE,
 };
 
+/// Counters of GLTH_LOGX messages for Golioth, with CONFIG_GOLIOTH_LOG_RATE_LIMIT
+struct golioth_debug_log_stats
+{
+    /// Messages sent
+    uint32_t sent;
+    /// Messages dropped by the per-tag or per-callsite rate limit
+    uint32_t rate_limited;
+    /// Messages collapsed as repeats of the previous message from the same callsite
+    uint32_t repeated;
+    /// Summaries ("message ... repeated N times in T s") sent for rate limited and repeated
+    /// messages
+    uint32_t summaries;
+};
+
 void golioth_debug_set_log_level(enum golioth_debug_log_level level);
 enum golioth_debug_log_level golioth_debug_get_log_level(void);
 void golioth_debug_hexdump(const char *tag, const void *addr, int len);
 void golioth_debug_set_client(struct golioth_client *client);
 void golioth_debug_set_cloud_log_enabled(bool enable);
+
+/// Get the counters of the cloud log rate limit
+///
+/// @param stats Filled with the counters since boot
+///
+/// @retval GOLIOTH_OK success
+/// @retval GOLIOTH_ERR_NULL stats is NULL
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_LOG_RATE_LIMIT is disabled
+enum golioth_status golioth_debug_get_log_stats(struct golioth_debug_log_stats *stats);
 void golioth_debug_printf(uint64_t tstamp_ms,
                           enum golioth_debug_log_level level,
                           const char *tag,
                           const char *format,
                           ...);
 
+#if defined(CONFIG_GOLIOTH_LOG_DICTIONARY)
+
+/// Section holding the format strings of cloud log messages. The format string IDs sent to
+/// Golioth are offsets within this section.
+#define GOLIOTH_LOG_DICT_SECTION "golioth_log_fmt"
+
+/// Same as @ref golioth_debug_printf, but \p format must be in GOLIOTH_LOG_DICT_SECTION, and
+/// is sent to Golioth as an ID along with the arguments, without formatting on the device.
+void golioth_debug_printf_dict(uint64_t tstamp_ms,
+                               enum golioth_debug_log_level level,
+                               const char *tag,
+                               const char *format,
+                               ...);
+
+#define _GOLIOTH_DEBUG_PRINTF_DICT(tstamp_ms, level, tag, format, ...)                        \
+    do                                                                                        \
+    {                                                                                         \
+        static const char _golioth_log_format[]                                               \
+            __attribute__((section(GOLIOTH_LOG_DICT_SECTION), used, aligned(1))) = format;    \
+        golioth_debug_printf_dict(tstamp_ms, level, tag, _golioth_log_format, ##__VA_ARGS__); \
+    } while (0)
+
+/// Send a log message to Golioth, used by GLTH_LOGX. The format string must be a string
+/// literal.
+#define GOLIOTH_DEBUG_PRINTF(tstamp_ms, level, tag, ...) \
+    _GOLIOTH_DEBUG_PRINTF_DICT(tstamp_ms, level, tag, __VA_ARGS__)
+
+#else /* CONFIG_GOLIOTH_LOG_DICTIONARY */
+
+/// Send a log message to Golioth, used by GLTH_LOGX
+#define GOLIOTH_DEBUG_PRINTF(tstamp_ms, level, tag, ...) \
+    golioth_debug_printf(tstamp_ms, level, tag, __VA_ARGS__)
+
+#endif /* CONFIG_GOLIOTH_LOG_DICTIONARY */
+
 #ifdef __cplusplus
 }
 #endif
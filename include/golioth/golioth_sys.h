@@ -94,6 +94,8 @@ struct golioth_thread_config
 
 golioth_sys_thread_t golioth_sys_thread_create(const struct golioth_thread_config *config);
 void golioth_sys_thread_destroy(golioth_sys_thread_t thread);
+/// Whether the calling thread is \p thread. Returns false for a NULL \p thread.
+bool golioth_sys_thread_is_current(golioth_sys_thread_t thread);
 
 /*--------------------------------------------------
  * Malloc/Free
@@ -250,7 +252,7 @@ void golioth_sys_client_disconnected(void *client);
             uint64_t now_ms = golioth_sys_now_ms();                        \
             printf(COLOR "%s (%" PRIu64 ") %s: ", LEVEL_STR, now_ms, TAG); \
             printf(__VA_ARGS__);                                           \
-            golioth_debug_printf(now_ms, LEVEL, TAG, __VA_ARGS__);         \
+            GOLIOTH_DEBUG_PRINTF(now_ms, LEVEL, TAG, __VA_ARGS__);         \
             printf("%s", LOG_RESET_COLOR);                                 \
             puts("");                                                      \
         }                                                                  \
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/golioth_status.h>
+
+/// @defgroup golioth_heap_stats golioth_heap_stats
+/// Heap usage of the SDK, per subsystem
+///
+/// With CONFIG_GOLIOTH_HEAP_STATS enabled, every heap allocation made by the SDK is tagged with
+/// the subsystem it belongs to, so the current and peak heap usage of each subsystem can be read
+/// at runtime. This is meant for sizing the heap of constrained devices.
+///
+/// With CONFIG_GOLIOTH_HEAP_STATIC enabled, the same allocations are served from statically
+/// sized pools of fixed-size blocks instead of the heap. An exhausted pool is reported like a
+/// full heap, as GOLIOTH_ERR_MEM_ALLOC (or a NULL handle) from the API call that needed memory.
+///
+/// The figures are shared by all clients of the process. Allocations made by the port layer
+/// (semaphores, mutexes, timers, threads) and by third-party libraries (libcoap, TLS) are not
+/// included, and are not served from the static pools either. In particular, every synchronous
+/// request creates three semaphores, and every blockwise transfer one.
+/// @{
+
+/// SDK subsystems, for heap accounting
+enum golioth_heap_subsystem
+{
+    /// Client core: client state, request queue, in-flight requests and payloads of requests
+    /// that do not belong to any of the subsystems below
+    GOLIOTH_HEAP_CLIENT,
+    /// Blockwise transfer contexts and block buffers
+    GOLIOTH_HEAP_BLOCKWISE,
+    /// LightDB State buffers and queued payloads
+    GOLIOTH_HEAP_LIGHTDB,
+    /// Queued LightDB Stream payloads
+    GOLIOTH_HEAP_STREAM,
+    /// Settings state and queued payloads
+    GOLIOTH_HEAP_SETTINGS,
+    /// RPC state and queued payloads
+    GOLIOTH_HEAP_RPC,
+    /// Cloud logging and debug log formatting buffers, and queued log payloads
+    GOLIOTH_HEAP_LOG,
+    /// Queued OTA payloads
+    GOLIOTH_HEAP_OTA,
+    GOLIOTH_HEAP_NUM_SUBSYSTEMS,
+};
+
+/// Heap usage of a subsystem
+struct golioth_heap_stats
+{
+    /// Bytes currently allocated
+    uint32_t bytes;
+    /// Highest number of bytes allocated at any time
+    uint32_t bytes_peak;
+    /// Allocations currently live
+    uint32_t blocks;
+    /// Successful allocations, in total
+    uint32_t allocations;
+    /// Failed allocations, in total
+    uint32_t failures;
+};
+
+/// Get the heap usage of a subsystem.
+///
+/// Sizes are the sizes requested by the SDK. Each allocation additionally carries a small
+/// accounting header, and the overhead of the allocator itself is not included.
+///
+/// Requires CONFIG_GOLIOTH_HEAP_STATS.
+///
+/// @param subsystem The subsystem
+/// @param stats Filled with the heap usage of \p subsystem
+///
+/// @retval GOLIOTH_OK Statistics copied to \p stats
+/// @retval GOLIOTH_ERR_NULL \p stats is NULL
+/// @retval GOLIOTH_ERR_INVALID_FORMAT \p subsystem is out of range
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_HEAP_STATS is disabled
+enum golioth_status golioth_heap_get_stats(enum golioth_heap_subsystem subsystem,
+                                           struct golioth_heap_stats *stats);
+
+/// Number of static pools, with CONFIG_GOLIOTH_HEAP_STATIC: small, medium, large and xlarge
+#define GOLIOTH_HEAP_NUM_POOLS 4
+
+/// Usage of a static pool
+struct golioth_heap_pool_stats
+{
+    /// Size of each block, in bytes, rounded up for alignment
+    uint32_t block_size;
+    /// Number of blocks in the pool
+    uint32_t num_blocks;
+    /// Blocks currently in use
+    uint32_t used;
+    /// Highest number of blocks in use at any time
+    uint32_t used_peak;
+    /// Allocations that fit in this pool's blocks but found no free block, in total. They were
+    /// served by a pool with larger blocks, or failed.
+    uint32_t exhausted;
+};
+
+/// Get the usage of a static pool.
+///
+/// Requires CONFIG_GOLIOTH_HEAP_STATIC.
+///
+/// @param pool Index of the pool, from 0 (smallest blocks) to GOLIOTH_HEAP_NUM_POOLS - 1
+/// @param stats Filled with the usage of \p pool
+///
+/// @retval GOLIOTH_OK Statistics copied to \p stats
+/// @retval GOLIOTH_ERR_NULL \p stats is NULL
+/// @retval GOLIOTH_ERR_INVALID_FORMAT \p pool is out of range
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_HEAP_STATIC is disabled
+enum golioth_status golioth_heap_get_pool_stats(size_t pool, struct golioth_heap_pool_stats *stats);
+
+/// Get the name of a subsystem, e.g. "settings"
+///
+/// @param subsystem The subsystem
+///
+/// @return The name, or "unknown" if \p subsystem is out of range
+const char *golioth_heap_subsystem_name(enum golioth_heap_subsystem subsystem);
+
+/// Log the heap usage of all subsystems (CONFIG_GOLIOTH_HEAP_STATS) and the usage of the static
+/// pools (CONFIG_GOLIOTH_HEAP_STATIC), one line per subsystem and pool.
+void golioth_heap_log_stats(void);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
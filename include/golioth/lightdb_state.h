@@ -24,6 +24,9 @@ extern "C"
 // LightDB State
 //-------------------------------------------------------------------------------
 
+// The typed helpers (golioth_lightdb_set_int_async(), golioth_lightdb_get_int_sync(), ...) encode
+// and decode values as JSON text by default, or as CBOR with CONFIG_GOLIOTH_LIGHTDB_STATE_CBOR.
+
 /// Set an integer in LightDB state at a particular path asynchronously
 ///
 /// This function will enqueue a request and return immediately without
@@ -315,6 +318,175 @@ enum golioth_status golioth_lightdb_observe_async(struct golioth_client *client,
                                                   golioth_get_cb_fn callback,
                                                   void *callback_arg);
 
+/// LightDB State mirror statistics, returned by @ref golioth_lightdb_mirror_get_stats
+struct golioth_lightdb_mirror_stats
+{
+    /// Reads served from the mirror while the path was observed
+    uint32_t hits;
+    /// Reads served from the mirror between sessions, within the path's max_stale_ms
+    uint32_t stale_hits;
+    /// Reads of mirrored paths that were sent to the server
+    uint32_t misses;
+    /// Notifications copied into the mirror
+    uint32_t updates;
+};
+
+/// Mirror a path in LightDB state locally
+///
+/// With CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR, the path is observed (see
+/// @ref golioth_lightdb_observe_async) and its value kept in RAM, so that
+/// golioth_lightdb_get_*_sync() calls for exactly this path return without a request to the
+/// server. Only the content type of the typed helpers is mirrored: JSON, or CBOR with
+/// CONFIG_GOLIOTH_LIGHTDB_STATE_CBOR. Observations are re-established on reconnect, which
+/// refreshes the value. Until then, the value is served for up to \p max_stale_ms after the
+/// session ended; older values are read from the server. While the device sets or deletes a
+/// value, it is read from the server; once the request completed, it is read from the server
+/// until the server notifies the change, unless the value was set to the mirrored one. Values
+/// longer than
+/// CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_VALUE_LEN are always read from the server.
+///
+/// Mirrored paths cannot be removed, and use one of CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS each.
+///
+/// @param client The client handle from @ref golioth_client_create
+/// @param path The path in LightDB state to mirror (e.g. "desired/setpoint")
+/// @param max_stale_ms How long, in milliseconds, the value may be served while not connected
+///
+/// @retval GOLIOTH_OK path mirrored, or already mirrored (\p max_stale_ms is updated)
+/// @retval GOLIOTH_ERR_NULL client or path is NULL
+/// @retval GOLIOTH_ERR_INVALID_FORMAT path is too long
+/// @retval GOLIOTH_ERR_MEM_ALLOC CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_PATHS are mirrored already
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR is disabled
+/// @return Otherwise, as @ref golioth_lightdb_observe_async
+enum golioth_status golioth_lightdb_mirror_add(struct golioth_client *client,
+                                               const char *path,
+                                               uint32_t max_stale_ms);
+
+/// Get the LightDB State mirror statistics
+///
+/// @param client The client handle from @ref golioth_client_create
+/// @param stats Filled with the statistics
+///
+/// @retval GOLIOTH_OK statistics returned
+/// @retval GOLIOTH_ERR_NULL client or stats is NULL
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR is disabled
+enum golioth_status golioth_lightdb_mirror_get_stats(struct golioth_client *client,
+                                                     struct golioth_lightdb_mirror_stats *stats);
+
+//-------------------------------------------------------------------------------
+// LightDB State reports
+//-------------------------------------------------------------------------------
+
+/// Reported state document, see @ref golioth_lightdb_report_init
+struct golioth_lightdb_report;
+
+/// Report statistics, returned by @ref golioth_lightdb_report_get_stats
+struct golioth_lightdb_report_stats
+{
+    /// Requests sent, each with all fields changed since the previous one
+    uint32_t uploads;
+    /// Fields sent, summed over all uploads
+    uint32_t fields_uploaded;
+    /// Values set to the value the field already had, which did not mark it changed
+    uint32_t fields_unchanged;
+    /// Uploads that failed; their fields are sent again with the next upload
+    uint32_t failed;
+};
+
+/// Create a reported state document
+///
+/// Many small values are cheaper to report together: the golioth_lightdb_report_set_*()
+/// functions only update a local copy of the field and mark it changed, and the changed fields
+/// are sent as one CBOR map, in one request to \p path. LightDB State merges the map into the
+/// object at \p path, so fields that did not change keep their value.
+///
+/// Changed fields are sent \p interval_ms after the first change, or when
+/// @ref golioth_lightdb_report_flush is called. Only one upload is in flight at a time; fields
+/// changed meanwhile, and the fields of a failed upload, are sent with the next one.
+///
+/// Requires CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT.
+///
+/// @param client The client handle from @ref golioth_client_create
+/// @param path The path in LightDB state of the object holding the fields (e.g. "state"), or ""
+///     for the root
+/// @param interval_ms How long changes are collected before they are sent, in milliseconds. With
+///     0, they are only sent by @ref golioth_lightdb_report_flush.
+///
+/// @return The report handle, or NULL if the path is too long or memory could not be allocated
+struct golioth_lightdb_report *golioth_lightdb_report_init(struct golioth_client *client,
+                                                           const char *path,
+                                                           uint32_t interval_ms);
+
+/// Free a reported state document. Changed fields that were not sent are discarded.
+///
+/// @param report The report handle from @ref golioth_lightdb_report_init
+///
+/// @retval GOLIOTH_OK report freed, or freed when the upload in flight completes
+/// @retval GOLIOTH_ERR_NULL report is NULL
+enum golioth_status golioth_lightdb_report_deinit(struct golioth_lightdb_report *report);
+
+/// Set an integer field of a reported state document
+///
+/// @param report The report handle from @ref golioth_lightdb_report_init
+/// @param key The key of the field in the object (e.g. "battery_mv")
+/// @param value The value of the field
+///
+/// @retval GOLIOTH_OK field set, and marked changed if its value changed
+/// @retval GOLIOTH_ERR_NULL report or key is NULL
+/// @retval GOLIOTH_ERR_INVALID_FORMAT key is longer than
+///     CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_KEY_LEN
+/// @retval GOLIOTH_ERR_MEM_ALLOC the report has CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_FIELDS
+///     fields already
+enum golioth_status golioth_lightdb_report_set_int(struct golioth_lightdb_report *report,
+                                                   const char *key,
+                                                   int32_t value);
+
+/// Set a bool field of a reported state document
+///
+/// See @ref golioth_lightdb_report_set_int
+enum golioth_status golioth_lightdb_report_set_bool(struct golioth_lightdb_report *report,
+                                                    const char *key,
+                                                    bool value);
+
+/// Set a float field of a reported state document
+///
+/// Requires CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS. See @ref golioth_lightdb_report_set_int
+enum golioth_status golioth_lightdb_report_set_float(struct golioth_lightdb_report *report,
+                                                     const char *key,
+                                                     float value);
+
+/// Set a string field of a reported state document
+///
+/// See @ref golioth_lightdb_report_set_int. The string is copied.
+///
+/// @retval GOLIOTH_ERR_INVALID_FORMAT also when str_len is longer than
+///     CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_STRING_LEN
+enum golioth_status golioth_lightdb_report_set_string(struct golioth_lightdb_report *report,
+                                                      const char *key,
+                                                      const char *str,
+                                                      size_t str_len);
+
+/// Send the changed fields of a reported state document now
+///
+/// The request is enqueued, as with @ref golioth_lightdb_set_async. If an upload is in flight,
+/// the changed fields are sent as soon as it completes.
+///
+/// @param report The report handle from @ref golioth_lightdb_report_init
+///
+/// @retval GOLIOTH_OK fields sent, or nothing changed
+/// @retval GOLIOTH_ERR_NULL report is NULL
+/// @return Otherwise, as @ref golioth_lightdb_set_async; the fields are sent with the next upload
+enum golioth_status golioth_lightdb_report_flush(struct golioth_lightdb_report *report);
+
+/// Get the statistics of a reported state document
+///
+/// @param report The report handle from @ref golioth_lightdb_report_init
+/// @param stats Filled with the statistics
+///
+/// @retval GOLIOTH_OK statistics returned
+/// @retval GOLIOTH_ERR_NULL report or stats is NULL
+enum golioth_status golioth_lightdb_report_get_stats(struct golioth_lightdb_report *report,
+                                                     struct golioth_lightdb_report_stats *stats);
+
 /// @}
 
 #ifdef __cplusplus
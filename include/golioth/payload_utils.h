@@ -12,11 +12,13 @@ extern "C"
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <golioth/golioth_status.h>
 
 
 /// @defgroup golioth_payload_utils golioth_payload_utils
-/// Functions for converting JSON types into C types
+/// Functions for converting JSON and CBOR types into C types
 /// @{
 
 /// Convert raw byte payload into an int32_t
@@ -53,6 +55,47 @@ bool golioth_payload_as_bool(const uint8_t *payload, size_t payload_size);
 /// @retval false otherwise
 bool golioth_payload_is_null(const uint8_t *payload, size_t payload_size);
 
+/// Decode a CBOR payload holding an integer, e.g. from an observation with
+/// GOLIOTH_CONTENT_TYPE_CBOR
+///
+/// @param payload Pointer to payload data
+/// @param payload_size Size of payload, in bytes
+/// @param value Set to the decoded value
+///
+/// @retval GOLIOTH_OK value decoded
+/// @retval GOLIOTH_ERR_NULL payload is empty, or CBOR null
+/// @retval GOLIOTH_ERR_INVALID_FORMAT payload is not an integer in the range of int32_t
+enum golioth_status golioth_payload_cbor_as_int(const uint8_t *payload,
+                                                size_t payload_size,
+                                                int32_t *value);
+
+/// Decode a CBOR payload holding a float (of any size) or an integer
+///
+/// See @ref golioth_payload_cbor_as_int
+enum golioth_status golioth_payload_cbor_as_float(const uint8_t *payload,
+                                                  size_t payload_size,
+                                                  float *value);
+
+/// Decode a CBOR payload holding a bool
+///
+/// See @ref golioth_payload_cbor_as_int
+enum golioth_status golioth_payload_cbor_as_bool(const uint8_t *payload,
+                                                 size_t payload_size,
+                                                 bool *value);
+
+/// Decode a CBOR payload holding a text string, without copying it
+///
+/// See @ref golioth_payload_cbor_as_int
+///
+/// @param payload Pointer to payload data
+/// @param payload_size Size of payload, in bytes
+/// @param str Set to the string in \p payload, which is not NULL-terminated
+/// @param str_len Set to the length of the string, in bytes
+enum golioth_status golioth_payload_cbor_as_string(const uint8_t *payload,
+                                                   size_t payload_size,
+                                                   const char **str,
+                                                   size_t *str_len);
+
 /// @}
 
 #ifdef __cplusplus
@@ -22,6 +22,9 @@ extern "C"
 
 struct golioth_rpc;
 
+/// A received RPC request, to be answered with @ref golioth_rpc_respond
+struct golioth_rpc_call;
+
 /// Enumeration of RPC status codes, sent in the RPC response
 enum golioth_rpc_status
 {
@@ -89,8 +92,65 @@ typedef enum golioth_rpc_status (*golioth_rpc_cb_fn)(zcbor_state_t *request_para
                                                      zcbor_state_t *response_detail_map,
                                                      void *callback_arg);
 
+/// Callback function type for remote procedure call answered later
+///
+/// The callback may return before the method completed. The response is sent when
+/// @ref golioth_rpc_respond is called with @p call, from any thread. Until then, details can be
+/// encoded into the map returned by @ref golioth_rpc_call_detail.
+///
+/// @p request_params_array is only valid until the callback returns.
+///
+/// @param call The call to respond to. Must be passed to @ref golioth_rpc_respond exactly once.
+/// @param request_params_array zcbor decode state, inside of the RPC request params array
+/// @param callback_arg callback_arg, unchanged from callback_arg of
+///         @ref golioth_rpc_register_deferred
+typedef void (*golioth_rpc_deferred_cb_fn)(struct golioth_rpc_call *call,
+                                           zcbor_state_t *request_params_array,
+                                           void *callback_arg);
+
+/// An RPC method, for @ref golioth_rpc_register_methods
+struct golioth_rpc_method_desc
+{
+    const char *method;
+    /// strlen(method)
+    size_t method_len;
+    golioth_rpc_cb_fn callback;
+    void *callback_arg;
+};
+
+/// Initializer of a @ref golioth_rpc_method_desc, with the length of the method name computed at
+/// compile time
+///
+/// @code{.c}
+/// static const struct golioth_rpc_method_desc rpc_methods[] = {
+///     GOLIOTH_RPC_METHOD("multiply", on_multiply, NULL),
+///     GOLIOTH_RPC_METHOD("reboot", on_reboot, NULL),
+/// };
+/// @endcode
+///
+/// @param _method The name of the method, a string literal
+/// @param _callback The callback to be invoked, see @ref golioth_rpc_register
+/// @param _callback_arg User data forwarded to callback when invoked
+#define GOLIOTH_RPC_METHOD(_method, _callback, _callback_arg) \
+    {                                                         \
+        .method = "" _method,                                 \
+        .method_len = sizeof(_method) - 1,                    \
+        .callback = _callback,                                \
+        .callback_arg = _callback_arg,                        \
+    }
+
 /// Initialize the RPC service
 ///
+/// With CONFIG_GOLIOTH_RPC_NUM_WORKERS > 0, RPC methods are called from a pool of worker
+/// threads instead of the Golioth client thread, so that slow methods do not delay other
+/// requests. Requests received while all workers are busy and
+/// CONFIG_GOLIOTH_RPC_WORKER_QUEUE_LEN requests are waiting are answered with
+/// GOLIOTH_RPC_RESOURCE_EXHAUSTED.
+///
+/// The last CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE calls are remembered for
+/// CONFIG_GOLIOTH_RPC_DEDUP_TTL_S. When the server sends one of them again, e.g. after a
+/// reconnect, it is answered with the response of the first call, and the method is not called.
+///
 /// @param client Golioth client handle
 ///
 /// @return pointer to golioth rpc struct
@@ -99,7 +159,8 @@ struct golioth_rpc *golioth_rpc_init(struct golioth_client *client);
 
 /// Deinitialize the RPC service
 ///
-/// Cancel all registered RPCs and free the Golioth RPC service handle.
+/// Cancel all registered RPCs and free the Golioth RPC service handle. Requests waiting for a
+/// worker are answered with GOLIOTH_RPC_CANCELED, and running methods are waited for.
 ///
 /// @param grpc Golioth RPC service handle.
 ///
@@ -122,6 +183,61 @@ enum golioth_status golioth_rpc_register(struct golioth_rpc *grpc,
                                          golioth_rpc_cb_fn callback,
                                          void *callback_arg);
 
+/// Register a list of RPC methods
+///
+/// Either all or none of the methods are registered. Registered methods are looked up by a hash
+/// of their name, so the number of methods (up to CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS) has little
+/// effect on the time needed to handle a request.
+///
+/// @param grpc Golioth RPC service handle
+/// @param methods Methods to register, usually a static array of @ref GOLIOTH_RPC_METHOD. Must
+///         remain valid while the RPC service is in use.
+/// @param num_methods Number of entries in @p methods
+///
+/// @return GOLIOTH_OK - RPC methods successfully registered
+/// @return GOLIOTH_ERR_MEM_ALLOC - More than CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS methods
+/// @return otherwise - Error registering RPC methods
+enum golioth_status golioth_rpc_register_methods(struct golioth_rpc *grpc,
+                                                 const struct golioth_rpc_method_desc *methods,
+                                                 size_t num_methods);
+
+/// Register an RPC method which responds with @ref golioth_rpc_respond
+///
+/// Useful for methods which wait for something (e.g. a peripheral or another request) before
+/// they can respond, since the callback does not have to wait.
+///
+/// @param grpc Golioth RPC service handle
+/// @param method The name of the method to register
+/// @param callback The callback to be invoked, when an RPC request with matching method name
+///         is received by the client.
+/// @param callback_arg User data forwarded to callback when invoked. Optional, can be NULL.
+///
+/// @return GOLIOTH_OK - RPC method successfully registered
+/// @return otherwise - Error registering RPC method
+enum golioth_status golioth_rpc_register_deferred(struct golioth_rpc *grpc,
+                                                  const char *method,
+                                                  golioth_rpc_deferred_cb_fn callback,
+                                                  void *callback_arg);
+
+/// Get the response detail map of a call
+///
+/// @param call A call passed to a @ref golioth_rpc_deferred_cb_fn, not yet responded to
+///
+/// @return zcbor encode state, inside of the RPC response detail map. The space is limited by
+///         CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN.
+zcbor_state_t *golioth_rpc_call_detail(struct golioth_rpc_call *call);
+
+/// Respond to a call, and free it
+///
+/// @param call A call passed to a @ref golioth_rpc_deferred_cb_fn
+/// @param rpc_status Status code of the response
+///
+/// @return GOLIOTH_OK - Response was queued to be sent
+/// @return GOLIOTH_ERR_SERIALIZE - Response did not fit in CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN
+/// @return otherwise - Error sending the response
+enum golioth_status golioth_rpc_respond(struct golioth_rpc_call *call,
+                                        enum golioth_rpc_status rpc_status);
+
 /// @}
 
 #ifdef __cplusplus
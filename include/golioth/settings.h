@@ -42,6 +42,16 @@ extern "C"
 ///     * The type matches the registered type
 ///     * (integer only) The value is within the min/max range
 ///
+/// Callbacks are only called for settings whose value changed since it was last applied
+/// successfully. A document with the same version as the last one applied without errors is
+/// only acknowledged.
+///
+/// With CONFIG_GOLIOTH_SETTINGS_SNAPSHOT, the settings applied from the last document are saved
+/// with @ref golioth_settings_snapshot_save. When a setting is registered, its value from the
+/// snapshot is applied right away, before the client connects, until the first document from
+/// the server is applied. That document only calls the callbacks of settings that changed.
+/// Settings must not be registered from a setting callback.
+///
 /// @{
 
 /// Opaque struct for the Settings service
@@ -90,6 +100,17 @@ typedef enum golioth_settings_status (*golioth_string_setting_cb)(const char *ne
                                                                   size_t new_value_len,
                                                                   void *arg);
 
+/// Settings statistics, returned by @ref golioth_settings_get_stats
+struct golioth_settings_stats
+{
+    /// Values applied by their callbacks
+    uint32_t applied;
+    /// Values not passed to their callbacks, because they were applied before
+    uint32_t skipped;
+    /// Documents only acknowledged, because their version was applied before
+    uint32_t documents_skipped;
+};
+
 /// Initialize the Settings service
 ///
 /// @param client Client handle
@@ -153,6 +174,55 @@ enum golioth_status golioth_settings_register_string(struct golioth_settings *se
                                                      const char *setting_name,
                                                      golioth_string_setting_cb callback,
                                                      void *callback_arg);
+
+/// Get the settings statistics
+///
+/// @param settings Settings handle
+/// @param stats Filled with the counters since golioth_settings_init()
+///
+/// @retval GOLIOTH_OK statistics returned
+/// @retval GOLIOTH_ERR_NULL settings or stats is NULL
+enum golioth_status golioth_settings_get_stats(struct golioth_settings *settings,
+                                               struct golioth_settings_stats *stats);
+
+/// @defgroup golioth_settings_snapshot golioth_settings_snapshot
+/// @ingroup golioth_settings
+/// Snapshot storage, implemented by the port when CONFIG_GOLIOTH_SETTINGS_SNAPSHOT is enabled
+///
+/// The snapshot is a CBOR document of at most CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN bytes,
+/// which must survive a reboot.
+/// @{
+
+/// Load the snapshot
+///
+/// Called by golioth_settings_init().
+///
+/// @param buf Buffer for the snapshot
+/// @param len On input, the size of buf. On return, the length of the snapshot.
+///
+/// @retval GOLIOTH_OK snapshot loaded
+/// @retval GOLIOTH_ERR_NO_MORE_DATA no snapshot was saved
+/// @retval GOLIOTH_ERR_MEM_ALLOC the snapshot does not fit in buf
+/// @retval GOLIOTH_ERR_FAIL the snapshot could not be read
+enum golioth_status golioth_settings_snapshot_load(uint8_t *buf, size_t *len);
+
+/// Replace the snapshot
+///
+/// Called from the client thread after a settings document was applied. If saving is interrupted
+/// (e.g. by a power loss), either the previous or the new snapshot must be loaded afterwards.
+///
+/// When the settings applied could not be captured in a snapshot, this is called with len 0 to
+/// remove the previous one, which is out of date. @ref golioth_settings_snapshot_load then
+/// returns GOLIOTH_ERR_NO_MORE_DATA.
+///
+/// @param data Snapshot, or NULL if len is 0
+/// @param len Length of data, in bytes
+///
+/// @retval GOLIOTH_OK snapshot saved
+/// @retval GOLIOTH_ERR_FAIL the snapshot could not be saved
+enum golioth_status golioth_settings_snapshot_save(const uint8_t *data, size_t len);
+
+/// @}
 /// @}
 
 #ifdef __cplusplus
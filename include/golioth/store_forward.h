@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/golioth_status.h>
+
+/// @defgroup golioth_store_forward golioth_store_forward
+/// Persistent store-and-forward queue for stream and log data
+///
+/// With CONFIG_GOLIOTH_STORE_FORWARD enabled, asynchronous stream and log requests without a
+/// callback are written to a persistent store instead of being dropped when the client is not
+/// connected, not running, or its request queue is full. While the store holds requests, new
+/// requests are appended to it as well, so that they are delivered in order.
+///
+/// The store is drained when the client reports GOLIOTH_CLIENT_EVENT_CONNECTED, with at most
+/// CONFIG_GOLIOTH_STORE_FORWARD_MAX_IN_FLIGHT requests outstanding at a time. Consecutive log
+/// requests are merged into one. A request is removed from the store once the server responded
+/// to it; if a request gets no response, forwarding restarts from the oldest request without a
+/// response, so requests are delivered at least once.
+///
+/// The store itself is provided by the port, see @ref golioth_store_open. The Linux port provides
+/// a store of memory-mapped segment files in CONFIG_GOLIOTH_STORE_FORWARD_LINUX_DIR.
+/// @{
+
+/// Store-and-forward statistics, see @ref golioth_store_forward_get_stats
+struct golioth_store_forward_stats
+{
+    /// Requests written to the store
+    uint32_t stored;
+    /// Requests not stored, because the store was full or the request too large
+    uint32_t dropped;
+    /// Stored requests acknowledged by the server
+    uint32_t forwarded;
+    /// Stored requests rejected by the server, which are not retried
+    uint32_t rejected;
+    /// CoAP requests sent to forward stored requests
+    uint32_t requests;
+    /// Times forwarding restarted from the oldest request without a response
+    uint32_t retries;
+};
+
+/// Get the store-and-forward statistics
+///
+/// @param stats Filled with the statistics
+///
+/// @retval GOLIOTH_OK statistics returned
+/// @retval GOLIOTH_ERR_NULL stats is NULL
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED CONFIG_GOLIOTH_STORE_FORWARD is disabled
+enum golioth_status golioth_store_forward_get_stats(struct golioth_store_forward_stats *stats);
+
+/// @defgroup golioth_store golioth_store
+/// @ingroup golioth_store_forward
+/// Store backend, implemented by the port when CONFIG_GOLIOTH_STORE_FORWARD is enabled
+///
+/// The store is a persistent queue of records. Every record has a position; positions increase
+/// with every append but need not be contiguous. Records are read from a position and released up
+/// to a position, after which they need not be kept. Records that were not released must be
+/// returned again after the device restarts.
+///
+/// Calls are serialized by the SDK.
+/// @{
+
+/// Open the store, recovering the records left from a previous run
+///
+/// Called by golioth_client_create().
+///
+/// @retval GOLIOTH_OK store opened
+/// @retval GOLIOTH_ERR_FAIL the store could not be opened
+enum golioth_status golioth_store_open(void);
+
+/// Close the store. Called by golioth_client_destroy().
+void golioth_store_close(void);
+
+/// Append a record
+///
+/// @param data Record data
+/// @param len Length of data, in bytes
+///
+/// @retval GOLIOTH_OK record stored
+/// @retval GOLIOTH_ERR_QUEUE_FULL the store is full
+/// @retval GOLIOTH_ERR_MEM_ALLOC the record is larger than the store supports
+enum golioth_status golioth_store_append(const uint8_t *data, size_t len);
+
+/// Read the first record at or after a position
+///
+/// @param pos On input, the position to read from. On return, the position after the record.
+/// @param buf Buffer for the record data
+/// @param len On input, the size of buf. On return, the length of the record.
+///
+/// @retval GOLIOTH_OK record read
+/// @retval GOLIOTH_ERR_NO_MORE_DATA no record at or after pos
+/// @retval GOLIOTH_ERR_MEM_ALLOC the record does not fit in buf. pos is still advanced past it, so
+///         the record can be skipped.
+enum golioth_status golioth_store_read(uint64_t *pos, uint8_t *buf, size_t *len);
+
+/// Position of the oldest record that was not released
+uint64_t golioth_store_head(void);
+
+/// Position after the newest record. Equal to @ref golioth_store_head when the store is empty.
+uint64_t golioth_store_tail(void);
+
+/// Release the records before a position
+///
+/// @param pos Position returned by @ref golioth_store_read
+void golioth_store_release(uint64_t pos);
+
+/// @}
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#pragma once
+
+#include <stdint.h>
+#include <golioth/client.h>
+#include <golioth/golioth_status.h>
+
+/// @defgroup golioth_trace golioth_trace
+/// Request lifecycle tracing hooks
+///
+/// With CONFIG_GOLIOTH_TRACE enabled, the client reports every stage of every CoAP request to
+/// @ref golioth_trace_request_event, which must be provided by the application or the port.
+/// The Linux port provides a backend that writes a Chrome trace (JSON) file, which can be opened
+/// in chrome://tracing or https://ui.perfetto.dev.
+///
+/// With CONFIG_GOLIOTH_TRACE disabled, the hooks are compiled out.
+/// @{
+
+/// Length, in bytes, of the token in @ref golioth_trace_request_event
+#define GOLIOTH_TRACE_TOKEN_LEN 8
+
+/// Stages of a request
+///
+/// A request is enqueued by the calling thread, then dequeued, sent and completed by the client
+/// thread. Every request that was enqueued ends with either QUEUE_FULL, AGED_OUT or DONE.
+/// Callbacks of observations are reported as CALLBACK_BEGIN/CALLBACK_END pairs only.
+enum golioth_trace_stage
+{
+    /// About to be put in the request queue
+    GOLIOTH_TRACE_ENQUEUE,
+    /// Rejected, the request queue was full
+    GOLIOTH_TRACE_QUEUE_FULL,
+    /// Taken out of the request queue by the client thread
+    GOLIOTH_TRACE_DEQUEUE,
+    /// Dropped without being sent, because it aged out in the request queue
+    GOLIOTH_TRACE_AGED_OUT,
+    /// Sent to the server
+    GOLIOTH_TRACE_SEND,
+    /// Response received
+    GOLIOTH_TRACE_RESPONSE,
+    /// No response received
+    GOLIOTH_TRACE_TIMEOUT,
+    /// User callback about to be called
+    GOLIOTH_TRACE_CALLBACK_BEGIN,
+    /// User callback returned
+    GOLIOTH_TRACE_CALLBACK_END,
+    /// Request completed
+    GOLIOTH_TRACE_DONE,
+};
+
+/// A request lifecycle event
+struct golioth_trace_request_event
+{
+    enum golioth_trace_stage stage;
+    struct golioth_client *client;
+    /// CoAP token (GOLIOTH_TRACE_TOKEN_LEN bytes), identifies the request across stages
+    const uint8_t *token;
+    enum golioth_client_request_type type;
+    const char *path_prefix;
+    const char *path;
+    /// Result of RESPONSE, TIMEOUT and DONE events, GOLIOTH_OK for other stages
+    enum golioth_status status;
+};
+
+/// Called for each stage of each request. Must be implemented when CONFIG_GOLIOTH_TRACE is
+/// enabled.
+///
+/// Called from the thread enqueueing the request (ENQUEUE and QUEUE_FULL) and from the client
+/// thread (all other stages), so it must be thread safe. It is on the request path of the client,
+/// and should return quickly.
+///
+/// @param event The event. Only valid for the duration of the call.
+void golioth_trace_request_event(const struct golioth_trace_request_event *event);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
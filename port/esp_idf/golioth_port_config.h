@@ -9,6 +9,9 @@
 #include <esp_log.h>
 #include <esp_random.h>
 
+// Defined by the linker fragment of the golioth_sdk component (linker.lf)
+#define GOLIOTH_LOG_DICT_SECTION_START _golioth_log_fmt_start
+
 #define GLTH_LOG_BUFFER_HEXDUMP(TAG, payload, size, level)                   \
     do                                                                       \
     {                                                                        \
@@ -65,7 +68,7 @@
                 default:                                           \
                     break;                                         \
             }                                                      \
-            golioth_debug_printf(now_ms, LEVEL, TAG, __VA_ARGS__); \
+            GOLIOTH_DEBUG_PRINTF(now_ms, LEVEL, TAG, __VA_ARGS__); \
         }                                                          \
     } while (0)
 
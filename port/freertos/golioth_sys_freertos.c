@@ -193,6 +193,11 @@ void golioth_sys_thread_destroy(golioth_sys_thread_t thread)
     vTaskDelete((TaskHandle_t) thread);
 }
 
+bool golioth_sys_thread_is_current(golioth_sys_thread_t thread)
+{
+    return thread && (TaskHandle_t) thread == xTaskGetCurrentTaskHandle();
+}
+
 /*--------------------------------------------------
  * Misc
  *------------------------------------------------*/
@@ -0,0 +1,12 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+// On Linux, report heap usage when a client is destroyed, typically at process exit.
+// Only has an effect with CONFIG_GOLIOTH_HEAP_STATS.
+#ifndef CONFIG_GOLIOTH_HEAP_STATS_REPORT
+#define CONFIG_GOLIOTH_HEAP_STATS_REPORT 1
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Settings snapshot storage, see golioth/settings.h.
+//
+// The snapshot is kept in the file CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_LINUX_PATH, or the file named
+// by the GOLIOTH_SETTINGS_SNAPSHOT_FILE environment variable. It is replaced by writing the new
+// snapshot to <path>.tmp and renaming it over the old one, so a crash leaves either of them.
+
+#include <golioth/config.h>
+
+#if defined(CONFIG_GOLIOTH_SETTINGS_SNAPSHOT)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <golioth/settings.h>
+
+static const char *snapshot_path(void)
+{
+    const char *path = getenv("GOLIOTH_SETTINGS_SNAPSHOT_FILE");
+
+    if (!path || !path[0])
+    {
+        path = CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_LINUX_PATH;
+    }
+
+    return path;
+}
+
+enum golioth_status golioth_settings_snapshot_load(uint8_t *buf, size_t *len)
+{
+    const char *path = snapshot_path();
+    enum golioth_status status = GOLIOTH_ERR_FAIL;
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return GOLIOTH_ERR_NO_MORE_DATA;
+        }
+        perror(path);
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        perror(path);
+        goto finish;
+    }
+
+    if ((size_t) st.st_size > *len)
+    {
+        status = GOLIOTH_ERR_MEM_ALLOC;
+        goto finish;
+    }
+
+    size_t offset = 0;
+    while (offset < (size_t) st.st_size)
+    {
+        ssize_t n = read(fd, &buf[offset], st.st_size - offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            perror(path);
+            goto finish;
+        }
+        offset += n;
+    }
+
+    *len = offset;
+    status = GOLIOTH_OK;
+
+finish:
+    close(fd);
+    return status;
+}
+
+enum golioth_status golioth_settings_snapshot_save(const uint8_t *data, size_t len)
+{
+    const char *path = snapshot_path();
+    char tmp_path[PATH_MAX];
+
+    if (len == 0)
+    {
+        if (unlink(path) != 0 && errno != ENOENT)
+        {
+            perror(path);
+            return GOLIOTH_ERR_FAIL;
+        }
+        return GOLIOTH_OK;
+    }
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int) sizeof(tmp_path))
+    {
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        perror(tmp_path);
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    size_t offset = 0;
+    while (offset < len)
+    {
+        ssize_t n = write(fd, &data[offset], len - offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            perror(tmp_path);
+            goto error;
+        }
+        offset += n;
+    }
+
+    if (fsync(fd) != 0)
+    {
+        perror(tmp_path);
+        goto error;
+    }
+
+    close(fd);
+
+    if (rename(tmp_path, path) != 0)
+    {
+        perror(path);
+        unlink(tmp_path);
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    return GOLIOTH_OK;
+
+error:
+    close(fd);
+    unlink(tmp_path);
+    return GOLIOTH_ERR_FAIL;
+}
+
+#endif /* CONFIG_GOLIOTH_SETTINGS_SNAPSHOT */
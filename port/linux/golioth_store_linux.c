@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Store-and-forward backend, see golioth/store_forward.h.
+//
+// Records are appended to memory-mapped segment files in CONFIG_GOLIOTH_STORE_FORWARD_LINUX_DIR,
+// or in the directory named by the GOLIOTH_STORE_FORWARD_DIR environment variable. Segment n is
+// named <n>.seg (16 hex digits) and is CONFIG_GOLIOTH_STORE_FORWARD_LINUX_SEGMENT_SIZE bytes. The
+// data area of every segment has the same size, DATA_SIZE, so the position of a record is
+// n * DATA_SIZE + its offset in the data area:
+//
+//   +--------+-----+-----+------+-----+-----+-----+------+-----+-----+---+-----+
+//   | header | len | crc | data | pad | len | crc | data | pad | ... | 0 | ... |
+//   +--------+-----+-----+------+-----+-----+-----+------+-----+-----+---+-----+
+//
+// A record is its length, the CRC-32 of its data, and its data padded to 4 bytes. The length is
+// written last, and a zero length ends the records of a segment. Records never span segments.
+//
+// When opened, the records of the last segment are scanned and the first one with a bad CRC
+// (torn by a crash or power loss) and everything after it is discarded. Released records are
+// recorded in the header of the oldest segment; segments that only hold released records are
+// deleted. When the store holds CONFIG_GOLIOTH_STORE_FORWARD_LINUX_MAX_SEGMENTS segments and the
+// last one is full, new records are rejected.
+//
+// Changes are flushed with msync(MS_ASYNC), and with msync(MS_SYNC) when the store is closed.
+
+#include <golioth/config.h>
+
+#if defined(CONFIG_GOLIOTH_STORE_FORWARD)
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <golioth/store_forward.h>
+
+#define SEGMENT_MAGIC 0x31465347  // "GSF1"
+#define SEGMENT_VERSION 1
+
+#define SEGMENT_SIZE CONFIG_GOLIOTH_STORE_FORWARD_LINUX_SEGMENT_SIZE
+#define MAX_SEGMENTS CONFIG_GOLIOTH_STORE_FORWARD_LINUX_MAX_SEGMENTS
+
+struct segment_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint64_t index;
+    /// Offset in the data area of the first record that was not released
+    uint32_t released;
+    uint32_t reserved;
+};
+
+struct record_header
+{
+    uint32_t len;
+    uint32_t crc;
+};
+
+#define DATA_SIZE (SEGMENT_SIZE - sizeof(struct segment_header))
+
+_Static_assert(SEGMENT_SIZE % 4 == 0 && SEGMENT_SIZE > 2 * sizeof(struct segment_header),
+               "Invalid CONFIG_GOLIOTH_STORE_FORWARD_LINUX_SEGMENT_SIZE");
+
+struct segment
+{
+    uint64_t index;
+    uint8_t *map;
+};
+
+static struct
+{
+    char dir[PATH_MAX];
+    /// Oldest first
+    struct segment segments[MAX_SEGMENTS];
+    size_t num_segments;
+    /// Position after the last record
+    uint64_t tail;
+    bool is_open;
+} _store;
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    static const uint32_t nibble_table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+        0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+        0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ nibble_table[crc & 0xf];
+        crc = (crc >> 4) ^ nibble_table[crc & 0xf];
+    }
+
+    return ~crc;
+}
+
+static size_t record_size(uint32_t len)
+{
+    return sizeof(struct record_header) + ((len + 3) & ~(size_t) 3);
+}
+
+static struct segment_header *segment_header(const struct segment *segment)
+{
+    return (struct segment_header *) segment->map;
+}
+
+static uint8_t *segment_data(const struct segment *segment)
+{
+    return segment->map + sizeof(struct segment_header);
+}
+
+static void segment_path(char *path, size_t size, uint64_t index)
+{
+    snprintf(path, size, "%s/%016" PRIx64 ".seg", _store.dir, index);
+}
+
+static void flush(void *addr, size_t len)
+{
+    uintptr_t page_mask = (uintptr_t) sysconf(_SC_PAGESIZE) - 1;
+    uintptr_t start = (uintptr_t) addr & ~page_mask;
+
+    msync((void *) start, ((uintptr_t) addr + len) - start, MS_ASYNC);
+}
+
+// Map segment index, creating it if create is true
+static uint8_t *segment_map(uint64_t index, bool create)
+{
+    char path[PATH_MAX + 32];
+    segment_path(path, sizeof(path), index);
+
+    int fd = open(path, O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0600);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (create && ftruncate(fd, SEGMENT_SIZE) != 0)
+    {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != SEGMENT_SIZE)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *map = mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        if (create)
+        {
+            unlink(path);
+        }
+        return NULL;
+    }
+
+    struct segment_header *header = (struct segment_header *) map;
+
+    if (create)
+    {
+        *header = (struct segment_header){
+            .magic = SEGMENT_MAGIC,
+            .version = SEGMENT_VERSION,
+            .header_size = sizeof(struct segment_header),
+            .index = index,
+        };
+        flush(header, sizeof(*header));
+    }
+    else if (header->magic != SEGMENT_MAGIC || header->version != SEGMENT_VERSION
+             || header->header_size != sizeof(struct segment_header) || header->index != index
+             || header->released > DATA_SIZE)
+    {
+        munmap(map, SEGMENT_SIZE);
+        return NULL;
+    }
+
+    return map;
+}
+
+static void segment_delete(struct segment *segment)
+{
+    char path[PATH_MAX + 32];
+    segment_path(path, sizeof(path), segment->index);
+
+    munmap(segment->map, SEGMENT_SIZE);
+    unlink(path);
+}
+
+// Offset in the data area after the last valid record
+static size_t segment_scan(const struct segment *segment)
+{
+    const uint8_t *data = segment_data(segment);
+    size_t offset = 0;
+
+    while (offset + sizeof(struct record_header) <= DATA_SIZE)
+    {
+        const struct record_header *record = (const struct record_header *) &data[offset];
+
+        if (record->len == 0 || record->len > DATA_SIZE - offset - sizeof(struct record_header)
+            || crc32(&data[offset + sizeof(struct record_header)], record->len) != record->crc)
+        {
+            break;
+        }
+
+        offset += record_size(record->len);
+    }
+
+    return offset;
+}
+
+static struct segment *segment_find(uint64_t index)
+{
+    for (size_t i = 0; i < _store.num_segments; i++)
+    {
+        if (_store.segments[i].index == index)
+        {
+            return &_store.segments[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int compare_index(const void *a, const void *b)
+{
+    uint64_t index_a = *(const uint64_t *) a;
+    uint64_t index_b = *(const uint64_t *) b;
+
+    return (index_a > index_b) - (index_a < index_b);
+}
+
+enum golioth_status golioth_store_open(void)
+{
+    static uint64_t indexes[MAX_SEGMENTS];
+    size_t num_indexes = 0;
+    const char *dir = getenv("GOLIOTH_STORE_FORWARD_DIR");
+
+    if (_store.is_open)
+    {
+        return GOLIOTH_OK;
+    }
+
+    if (!dir || !dir[0])
+    {
+        dir = CONFIG_GOLIOTH_STORE_FORWARD_LINUX_DIR;
+    }
+    if (strlen(dir) >= sizeof(_store.dir))
+    {
+        return GOLIOTH_ERR_FAIL;
+    }
+    strcpy(_store.dir, dir);
+
+    if (mkdir(_store.dir, 0700) != 0 && errno != EEXIST)
+    {
+        perror(_store.dir);
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    DIR *d = opendir(_store.dir);
+    if (!d)
+    {
+        perror(_store.dir);
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        uint64_t index;
+        int name_len;
+
+        if (sscanf(entry->d_name, "%16" SCNx64 ".seg%n", &index, &name_len) != 1
+            || name_len != 20 || entry->d_name[name_len] != '\0')
+        {
+            continue;
+        }
+
+        if (num_indexes == MAX_SEGMENTS)
+        {
+            // More segments than configured; keep the newest
+            qsort(indexes, num_indexes, sizeof(indexes[0]), compare_index);
+            if (index < indexes[0])
+            {
+                continue;
+            }
+            indexes[0] = index;
+            continue;
+        }
+
+        indexes[num_indexes++] = index;
+    }
+    closedir(d);
+
+    qsort(indexes, num_indexes, sizeof(indexes[0]), compare_index);
+
+    _store.num_segments = 0;
+    for (size_t i = 0; i < num_indexes; i++)
+    {
+        uint8_t *map = segment_map(indexes[i], false);
+        if (!map)
+        {
+            fprintf(stderr,
+                    "%s: ignoring invalid segment %016" PRIx64 "\n",
+                    _store.dir,
+                    indexes[i]);
+            continue;
+        }
+
+        _store.segments[_store.num_segments++] = (struct segment){
+            .index = indexes[i],
+            .map = map,
+        };
+    }
+
+    if (_store.num_segments == 0)
+    {
+        uint8_t *map = segment_map(0, true);
+        if (!map)
+        {
+            perror(_store.dir);
+            return GOLIOTH_ERR_FAIL;
+        }
+
+        _store.segments[0] = (struct segment){
+            .index = 0,
+            .map = map,
+        };
+        _store.num_segments = 1;
+    }
+
+    struct segment *last = &_store.segments[_store.num_segments - 1];
+    size_t end = segment_scan(last);
+
+    // Discard a torn record, so that the next record appended is not followed by its remains
+    if (end < DATA_SIZE)
+    {
+        memset(&segment_data(last)[end], 0, DATA_SIZE - end);
+        flush(&segment_data(last)[end], DATA_SIZE - end);
+    }
+
+    _store.tail = last->index * DATA_SIZE + end;
+    _store.is_open = true;
+
+    return GOLIOTH_OK;
+}
+
+void golioth_store_close(void)
+{
+    if (!_store.is_open)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < _store.num_segments; i++)
+    {
+        msync(_store.segments[i].map, SEGMENT_SIZE, MS_SYNC);
+        munmap(_store.segments[i].map, SEGMENT_SIZE);
+    }
+
+    _store.num_segments = 0;
+    _store.is_open = false;
+}
+
+enum golioth_status golioth_store_append(const uint8_t *data, size_t len)
+{
+    if (!_store.is_open)
+    {
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+    if (len == 0 || record_size(len) > DATA_SIZE)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    struct segment *segment = &_store.segments[_store.num_segments - 1];
+    size_t offset = _store.tail - segment->index * DATA_SIZE;
+
+    if (offset + record_size(len) > DATA_SIZE)
+    {
+        if (_store.num_segments == MAX_SEGMENTS)
+        {
+            return GOLIOTH_ERR_QUEUE_FULL;
+        }
+
+        uint64_t index = segment->index + 1;
+        uint8_t *map = segment_map(index, true);
+        if (!map)
+        {
+            return GOLIOTH_ERR_FAIL;
+        }
+
+        segment = &_store.segments[_store.num_segments++];
+        *segment = (struct segment){
+            .index = index,
+            .map = map,
+        };
+        offset = 0;
+    }
+
+    uint8_t *dest = &segment_data(segment)[offset];
+    struct record_header *record = (struct record_header *) dest;
+
+    memcpy(dest + sizeof(struct record_header), data, len);
+    record->crc = crc32(data, len);
+    __atomic_store_n(&record->len, len, __ATOMIC_RELEASE);
+    flush(dest, record_size(len));
+
+    _store.tail += record_size(len);
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_store_read(uint64_t *pos, uint8_t *buf, size_t *len)
+{
+    if (!_store.is_open)
+    {
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    uint64_t head = golioth_store_head();
+    uint64_t p = (*pos < head) ? head : *pos;
+
+    while (p < _store.tail)
+    {
+        const struct segment *segment = segment_find(p / DATA_SIZE);
+        if (!segment)
+        {
+            p = (p / DATA_SIZE + 1) * DATA_SIZE;
+            continue;
+        }
+
+        const uint8_t *data = segment_data(segment);
+        size_t offset = p % DATA_SIZE;
+        const struct record_header *record = (const struct record_header *) &data[offset];
+
+        if (offset + sizeof(struct record_header) > DATA_SIZE || record->len == 0
+            || record->len > DATA_SIZE - offset - sizeof(struct record_header)
+            || crc32(&data[offset + sizeof(struct record_header)], record->len) != record->crc)
+        {
+            // End of the segment, or a corrupted record; continue with the next segment
+            p = (segment->index + 1) * DATA_SIZE;
+            continue;
+        }
+
+        *pos = p + record_size(record->len);
+
+        if (record->len > *len)
+        {
+            *len = record->len;
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+
+        memcpy(buf, &data[offset + sizeof(struct record_header)], record->len);
+        *len = record->len;
+        return GOLIOTH_OK;
+    }
+
+    *pos = p;
+    return GOLIOTH_ERR_NO_MORE_DATA;
+}
+
+uint64_t golioth_store_head(void)
+{
+    if (!_store.is_open)
+    {
+        return 0;
+    }
+
+    const struct segment *first = &_store.segments[0];
+
+    return first->index * DATA_SIZE + segment_header(first)->released;
+}
+
+uint64_t golioth_store_tail(void)
+{
+    if (!_store.is_open)
+    {
+        return 0;
+    }
+
+    return _store.tail;
+}
+
+void golioth_store_release(uint64_t pos)
+{
+    if (!_store.is_open)
+    {
+        return;
+    }
+
+    if (pos > _store.tail)
+    {
+        pos = _store.tail;
+    }
+
+    // Delete the segments before pos, but always keep the last one
+    size_t num_deleted = 0;
+    while (num_deleted < _store.num_segments - 1
+           && (_store.segments[num_deleted].index + 1) * DATA_SIZE <= pos)
+    {
+        segment_delete(&_store.segments[num_deleted]);
+        num_deleted++;
+    }
+    if (num_deleted > 0)
+    {
+        memmove(&_store.segments[0],
+                &_store.segments[num_deleted],
+                (_store.num_segments - num_deleted) * sizeof(_store.segments[0]));
+        _store.num_segments -= num_deleted;
+    }
+
+    struct segment *first = &_store.segments[0];
+    struct segment_header *header = segment_header(first);
+    uint64_t base = first->index * DATA_SIZE;
+
+    if (pos > base + header->released)
+    {
+        header->released = (pos - base < DATA_SIZE) ? pos - base : DATA_SIZE;
+        flush(header, sizeof(*header));
+    }
+}
+
+#endif /* CONFIG_GOLIOTH_STORE_FORWARD */
@@ -379,6 +379,13 @@ void golioth_sys_thread_destroy(golioth_sys_thread_t thread)
     // process exits.
 }
 
+bool golioth_sys_thread_is_current(golioth_sys_thread_t thread)
+{
+    wrapped_pthread_t *wt = (wrapped_pthread_t *) thread;
+
+    return wt && pthread_equal(wt->pthread, pthread_self());
+}
+
 /*--------------------------------------------------
  * Hash
  *------------------------------------------------*/
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Request lifecycle trace backend, writing the Chrome trace event format.
+//
+// Tracing is enabled at runtime by setting GOLIOTH_TRACE_FILE to the output path. The file
+// can be opened in chrome://tracing or https://ui.perfetto.dev.
+//
+// Every request is an async slice named after its type and path, keyed by its CoAP token,
+// with nested "queued", "in flight" and "callback" slices:
+//
+//   GET .d/counter  |-------------------------------------------------|
+//   queued          |--------|
+//   in flight                 |------------------------|
+//   callback                                            |-------------|
+//
+// The JSON array is left open while the process runs (which the format allows, so a trace
+// of a process that crashed can still be loaded) and closed at exit.
+
+#include <golioth/config.h>
+
+#if defined(CONFIG_GOLIOTH_TRACE)
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <golioth/trace.h>
+
+static const char *const type_names[GOLIOTH_CLIENT_NUM_REQUEST_TYPES] = {
+    [GOLIOTH_CLIENT_REQUEST_EMPTY] = "EMPTY",
+    [GOLIOTH_CLIENT_REQUEST_GET] = "GET",
+    [GOLIOTH_CLIENT_REQUEST_GET_BLOCK] = "GET_BLOCK",
+    [GOLIOTH_CLIENT_REQUEST_POST] = "POST",
+    [GOLIOTH_CLIENT_REQUEST_POST_BLOCK] = "POST_BLOCK",
+    [GOLIOTH_CLIENT_REQUEST_DELETE] = "DELETE",
+    [GOLIOTH_CLIENT_REQUEST_OBSERVE] = "OBSERVE",
+    [GOLIOTH_CLIENT_REQUEST_OBSERVE_RELEASE] = "OBSERVE_RELEASE",
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file;
+static bool trace_opened;
+static bool trace_first_event = true;
+
+static void trace_close(void)
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file)
+    {
+        fputs("\n]\n", trace_file);
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+// Called with trace_lock held
+static FILE *trace_open(void)
+{
+    if (trace_opened)
+    {
+        return trace_file;
+    }
+    trace_opened = true;
+
+    const char *path = getenv("GOLIOTH_TRACE_FILE");
+    if (!path || !path[0])
+    {
+        return NULL;
+    }
+
+    trace_file = fopen(path, "w");
+    if (!trace_file)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    fputs("[\n", trace_file);
+    atexit(trace_close);
+
+    return trace_file;
+}
+
+static uint64_t trace_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void trace_write_string(FILE *f, const char *str)
+{
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            fputc('\\', f);
+            fputc(*str, f);
+        }
+        else if ((unsigned char) *str < 0x20)
+        {
+            fprintf(f, "\\u%04x", *str);
+        }
+        else
+        {
+            fputc(*str, f);
+        }
+    }
+}
+
+// Called with trace_lock held
+static void trace_write(FILE *f,
+                        const struct golioth_trace_request_event *event,
+                        char phase,
+                        const char *name,
+                        uint64_t ts_us,
+                        long tid,
+                        bool with_status)
+{
+    if (!trace_first_event)
+    {
+        fputs(",\n", f);
+    }
+    trace_first_event = false;
+
+    fprintf(f, "{\"ph\": \"%c\", \"cat\": \"golioth\", \"name\": \"", phase);
+    trace_write_string(f, name);
+    fputs("\", \"id\": \"0x", f);
+    for (int i = 0; i < GOLIOTH_TRACE_TOKEN_LEN; i++)
+    {
+        fprintf(f, "%02x", event->token[i]);
+    }
+    fprintf(f, "\", \"ts\": %" PRIu64 ", \"pid\": %d, \"tid\": %ld", ts_us, (int) getpid(), tid);
+
+    if (with_status)
+    {
+        fprintf(f,
+                ", \"args\": {\"client\": \"%p\", \"status\": \"%s\"}",
+                (void *) event->client,
+                golioth_status_to_str(event->status));
+    }
+
+    fputs("}", f);
+}
+
+void golioth_trace_request_event(const struct golioth_trace_request_event *event)
+{
+    uint64_t ts_us = trace_now_us();
+    long tid = syscall(SYS_gettid);
+    char request_name[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 64];
+
+    snprintf(request_name,
+             sizeof(request_name),
+             "%s %s%s",
+             (event->type < GOLIOTH_CLIENT_NUM_REQUEST_TYPES) ? type_names[event->type] : "?",
+             event->path_prefix,
+             event->path);
+
+    pthread_mutex_lock(&trace_lock);
+
+    FILE *f = trace_open();
+    if (!f)
+    {
+        pthread_mutex_unlock(&trace_lock);
+        return;
+    }
+
+    switch (event->stage)
+    {
+        case GOLIOTH_TRACE_ENQUEUE:
+            trace_write(f, event, 'b', request_name, ts_us, tid, true);
+            trace_write(f, event, 'b', "queued", ts_us, tid, false);
+            break;
+        case GOLIOTH_TRACE_QUEUE_FULL:
+            trace_write(f, event, 'e', "queued", ts_us, tid, false);
+            trace_write(f, event, 'e', request_name, ts_us, tid, true);
+            break;
+        case GOLIOTH_TRACE_DEQUEUE:
+            trace_write(f, event, 'e', "queued", ts_us, tid, false);
+            break;
+        case GOLIOTH_TRACE_AGED_OUT:
+        case GOLIOTH_TRACE_DONE:
+            trace_write(f, event, 'e', request_name, ts_us, tid, true);
+            break;
+        case GOLIOTH_TRACE_SEND:
+            trace_write(f, event, 'b', "in flight", ts_us, tid, false);
+            break;
+        case GOLIOTH_TRACE_RESPONSE:
+        case GOLIOTH_TRACE_TIMEOUT:
+            trace_write(f, event, 'e', "in flight", ts_us, tid, true);
+            break;
+        case GOLIOTH_TRACE_CALLBACK_BEGIN:
+            trace_write(f, event, 'b', "callback", ts_us, tid, false);
+            break;
+        case GOLIOTH_TRACE_CALLBACK_END:
+            trace_write(f, event, 'e', "callback", ts_us, tid, false);
+            break;
+    }
+
+    pthread_mutex_unlock(&trace_lock);
+}
+
+#endif /* CONFIG_GOLIOTH_TRACE */
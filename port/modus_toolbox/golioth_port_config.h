@@ -13,7 +13,7 @@
             uint32_t now_ms = (uint32_t)golioth_sys_now_ms(); \
             printf(COLOR "%s (%" PRIu32 ") %s: ", LEVEL_STR, now_ms, TAG); \
             printf(__VA_ARGS__); \
-            golioth_debug_printf(now_ms, LEVEL, TAG, __VA_ARGS__); \
+            GOLIOTH_DEBUG_PRINTF(now_ms, LEVEL, TAG, __VA_ARGS__); \
             printf("%s", LOG_RESET_COLOR); \
             puts(""); \
         } \
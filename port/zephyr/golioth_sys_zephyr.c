@@ -287,6 +287,13 @@ void golioth_sys_thread_destroy(golioth_sys_thread_t gthread)
     golioth_sys_free(thread);
 }
 
+bool golioth_sys_thread_is_current(golioth_sys_thread_t gthread)
+{
+    struct golioth_thread *thread = gthread;
+
+    return thread && thread->tid == k_current_get();
+}
+
 /*--------------------------------------------------
  * Hash
  *------------------------------------------------*/
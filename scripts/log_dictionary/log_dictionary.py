@@ -0,0 +1,279 @@
+#!/usr/bin/env python3
+
+"""Expand dictionary (CONFIG_GOLIOTH_LOG_DICTIONARY) log messages.
+
+With CONFIG_GOLIOTH_LOG_DICTIONARY, devices send the ID of the format string
+("fmt_id", its offset in the golioth_log_fmt section) and the arguments
+("args") instead of the formatted message ("msg").
+
+Build the dictionary from the ELF file of the firmware:
+
+    log_dictionary.py build app.elf -o app_log_dict.json
+
+Expand log messages, given as JSON objects (one per line, as exported from
+Golioth, or arrays of them) or as the CBOR payloads sent by the device:
+
+    log_dictionary.py decode app_log_dict.json logs.jsonl
+    log_dictionary.py decode --cbor app_log_dict.json payload.cbor
+"""
+
+__author__ = "Golioth, Inc."
+__copyright__ = "Copyright (c) 2024 Golioth, Inc."
+__license__ = "Apache-2.0"
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+SECTION = "golioth_log_fmt"
+
+
+def elf_section(path, name):
+    """Contents of the section called name, or, when the linker merged it into another output
+    section (ESP-IDF), of the range between the _<name>_start and _<name>_end symbols."""
+    with open(path, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF":
+        raise ValueError(f"{path} is not an ELF file")
+
+    is_64 = elf[4] == 2
+    endian = "<" if elf[5] == 1 else ">"
+
+    if is_64:
+        shoff, = struct.unpack_from(endian + "Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x3A)
+        sh_fmt = "IIQQQQIIQQ"
+    else:
+        shoff, = struct.unpack_from(endian + "I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x2E)
+        sh_fmt = "IIIIIIIIII"
+
+    sections = [struct.unpack_from(endian + sh_fmt, elf, shoff + i * shentsize)
+                for i in range(shnum)]
+
+    def c_str(offset):
+        return elf[offset:elf.index(b"\0", offset)].decode()
+
+    strtab = sections[shstrndx]
+    for sh_name, _, _, _, sh_offset, sh_size, *_ in sections:
+        if c_str(strtab[4] + sh_name) == name:
+            return elf[sh_offset:sh_offset + sh_size]
+
+    symbols = elf_symbols(elf, endian, is_64, sections, c_str)
+    start = symbols.get(f"_{name}_start")
+    end = symbols.get(f"_{name}_end")
+    if start is not None and end is not None:
+        for _, sh_type, _, sh_addr, sh_offset, sh_size, *_ in sections:
+            # SHT_PROGBITS
+            if sh_type == 1 and sh_addr <= start <= end <= sh_addr + sh_size:
+                return elf[sh_offset + start - sh_addr:sh_offset + end - sh_addr]
+
+    raise ValueError(f"{path} has no {name} section, is CONFIG_GOLIOTH_LOG_DICTIONARY enabled?")
+
+
+def elf_symbols(elf, endian, is_64, sections, c_str):
+    symbols = {}
+    for _, sh_type, _, _, sh_offset, sh_size, sh_link, _, _, sh_entsize in sections:
+        # SHT_SYMTAB
+        if sh_type != 2 or sh_entsize == 0:
+            continue
+        strtab_offset = sections[sh_link][4]
+        for offset in range(sh_offset, sh_offset + sh_size, sh_entsize):
+            if is_64:
+                st_name, _, _, _, st_value, _ = struct.unpack_from(endian + "IBBHQQ", elf, offset)
+            else:
+                st_name, st_value, *_ = struct.unpack_from(endian + "IIIBBH", elf, offset)
+            if st_name:
+                symbols[c_str(strtab_offset + st_name)] = st_value
+    return symbols
+
+
+def build(args):
+    data = elf_section(args.elf, SECTION)
+
+    # Format strings are NUL-terminated, and may be padded with NULs for alignment
+    formats = {}
+    offset = 0
+    while offset < len(data):
+        end = data.index(b"\0", offset)
+        if end > offset:
+            formats[offset] = data[offset:end].decode(errors="replace")
+        offset = end + 1
+
+    with open(args.output, "w") if args.output else sys.stdout as f:
+        json.dump({"section": SECTION, "formats": formats}, f, indent=2)
+        f.write("\n")
+
+
+def cbor_decode(data, offset=0):
+    initial = data[offset]
+    major, info = initial >> 5, initial & 0x1F
+    offset += 1
+
+    if major == 7:
+        if info == 20:
+            return False, offset
+        if info == 21:
+            return True, offset
+        if info in (22, 23):
+            return None, offset
+        if info == 25:
+            return struct.unpack_from(">e", data, offset)[0], offset + 2
+        if info == 26:
+            return struct.unpack_from(">f", data, offset)[0], offset + 4
+        if info == 27:
+            return struct.unpack_from(">d", data, offset)[0], offset + 8
+        raise ValueError(f"Unsupported CBOR simple value {info}")
+
+    if info < 24:
+        value = info
+    elif info <= 27:
+        size = 1 << (info - 24)
+        value = int.from_bytes(data[offset:offset + size], "big")
+        offset += size
+    elif info == 31 and major in (4, 5):
+        value = None
+    else:
+        raise ValueError(f"Unsupported CBOR header {initial:#x}")
+
+    if major == 0:
+        return value, offset
+    if major == 1:
+        return -1 - value, offset
+    if major in (2, 3):
+        raw = data[offset:offset + value]
+        return (raw.decode() if major == 3 else raw), offset + value
+    if major in (4, 5):
+        items = []
+        count = value if major == 4 else None if value is None else 2 * value
+        while count is None or len(items) < count:
+            if count is None and data[offset] == 0xFF:
+                offset += 1
+                break
+            item, offset = cbor_decode(data, offset)
+            items.append(item)
+        if major == 4:
+            return items, offset
+        return dict(zip(items[0::2], items[1::2])), offset
+    if major == 6:
+        return cbor_decode(data, offset)
+
+    raise ValueError(f"Unsupported CBOR major type {major}")
+
+
+CONVERSION = re.compile(
+    r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<precision>\*|\d*))?"
+    r"(?:hh|h|ll|l|j|z|t|L)?(?P<conversion>[diouxXcpsfFeEgGaA%])")
+
+
+def expand(fmt, args):
+    args = list(args)
+
+    def replace(match):
+        conversion = match["conversion"]
+        if conversion == "%":
+            return "%"
+
+        flags = match["flags"]
+        width = match["width"] or ""
+        precision = match["precision"]
+        if width == "*":
+            width = args.pop(0)
+            if width < 0:
+                flags += "-"
+                width = -width
+            width = str(width)
+        if precision == "*":
+            precision = str(args.pop(0))
+
+        value = args.pop(0)
+        spec = flags + width + ("." + precision if precision is not None else "")
+
+        if conversion == "p":
+            return f"0x{value:x}"
+        if conversion == "c":
+            return ("%" + spec + "c") % chr(value)
+        if conversion in "aA":
+            return float(value).hex()
+        if conversion in "iu":
+            conversion = "d"
+        if conversion == "o" and "#" in flags:
+            return "0" + ("%" + spec.replace("#", "") + "o") % value
+        return ("%" + spec + conversion) % value
+
+    try:
+        return CONVERSION.sub(replace, fmt)
+    except (IndexError, TypeError, ValueError) as e:
+        return f"{fmt} {args} (could not expand: {e})"
+
+
+def expand_record(record, formats):
+    if isinstance(record, list):
+        for r in record:
+            expand_record(r, formats)
+        return
+    if not isinstance(record, dict):
+        return
+
+    # Exported logs keep fields other than level, module and msg in "metadata"
+    fields = record.get("metadata") if "fmt_id" not in record else record
+    if not isinstance(fields, dict) or "fmt_id" not in fields:
+        return
+
+    fmt = formats.get(str(fields["fmt_id"]))
+    if fmt is None:
+        record["msg"] = f"<unknown format {fields['fmt_id']}> {fields.get('args')}"
+    else:
+        record["msg"] = expand(fmt, fields.get("args", []))
+
+
+def decode(args):
+    with open(args.dictionary) as f:
+        formats = json.load(f)["formats"]
+
+    if args.cbor:
+        with open(args.input, "rb") if args.input != "-" else sys.stdin.buffer as f:
+            data = f.read()
+        offset = 0
+        while offset < len(data):
+            record, offset = cbor_decode(data, offset)
+            expand_record(record, formats)
+            print(json.dumps(record))
+        return
+
+    with open(args.input) if args.input != "-" else sys.stdin as f:
+        for line in f:
+            if not line.strip():
+                continue
+            record = json.loads(line)
+            expand_record(record, formats)
+            print(json.dumps(record))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    subparsers = parser.add_subparsers(required=True)
+
+    build_parser = subparsers.add_parser("build", help="build the dictionary from an ELF file")
+    build_parser.add_argument("elf")
+    build_parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    build_parser.set_defaults(func=build)
+
+    decode_parser = subparsers.add_parser("decode", help="expand log messages")
+    decode_parser.add_argument("dictionary")
+    decode_parser.add_argument("input", nargs="?", default="-",
+                               help="log messages (default: stdin)")
+    decode_parser.add_argument("--cbor", action="store_true",
+                               help="input is CBOR payloads instead of JSON lines")
+    decode_parser.set_defaults(func=decode)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <golioth/client.h>
+#include <golioth/config.h>
+#include "coap_client.h"
+
+// Client statistics, see golioth_client_get_stats().
+//
+// Counters live in struct golioth_client and are updated from the client thread (and,
+// for queue_full, from the threads enqueueing requests) with relaxed atomic operations,
+// so the hot paths never take a lock. When CONFIG_GOLIOTH_CLIENT_STATS is disabled,
+// the macros below expand to nothing and their arguments are not evaluated.
+//
+// The including file must have the definition of struct golioth_client in scope.
+
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+
+static inline void golioth_stats_add(uint32_t *counter, uint32_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void golioth_stats_store(uint32_t *stat, uint32_t value)
+{
+    __atomic_store_n(stat, value, __ATOMIC_RELAXED);
+}
+
+static inline void golioth_stats_max(uint32_t *stat, uint32_t value)
+{
+    uint32_t old = __atomic_load_n(stat, __ATOMIC_RELAXED);
+
+    while (value > old
+           && !__atomic_compare_exchange_n(stat,
+                                           &old,
+                                           value,
+                                           true,
+                                           __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static inline void golioth_stats_request_sent(struct golioth_client_stats *stats,
+                                              struct golioth_coap_request_msg *req)
+{
+    req->sent_ms = golioth_sys_now_ms();
+    golioth_stats_add(&stats->requests[req->type].sent, 1);
+
+    if (req->type == GOLIOTH_COAP_REQUEST_POST)
+    {
+        golioth_stats_add(&stats->bytes_sent, req->post.payload_size);
+    }
+    else if (req->type == GOLIOTH_COAP_REQUEST_POST_BLOCK)
+    {
+        golioth_stats_add(&stats->bytes_sent, req->post_block.payload_size);
+    }
+}
+
+// Estimate the radio-on time, assuming every transmission keeps the radio on for
+// CONFIG_GOLIOTH_CLIENT_STATS_RADIO_TAIL_MS, and that the radio wakes up for a transmission
+// if it was off. Only called from the client thread.
+static inline void golioth_stats_radio_tx(struct golioth_client_stats *stats,
+                                          uint64_t *last_tx_ms)
+{
+    uint64_t now_ms = golioth_sys_now_ms();
+    uint64_t idle_ms = now_ms - *last_tx_ms;
+
+    if (*last_tx_ms == 0 || idle_ms >= CONFIG_GOLIOTH_CLIENT_STATS_RADIO_TAIL_MS)
+    {
+        golioth_stats_add(&stats->radio_wakeups, 1);
+        golioth_stats_add(&stats->radio_on_ms, CONFIG_GOLIOTH_CLIENT_STATS_RADIO_TAIL_MS);
+    }
+    else
+    {
+        golioth_stats_add(&stats->radio_on_ms, idle_ms);
+    }
+
+    *last_tx_ms = now_ms;
+}
+
+static inline void golioth_stats_response(struct golioth_client_stats *stats,
+                                          struct golioth_coap_request_msg *req)
+{
+    static const uint32_t bounds_ms[] = GOLIOTH_CLIENT_STATS_LATENCY_BOUNDS_MS;
+
+    if (req->sent_ms == 0)
+    {
+        return;
+    }
+
+    uint64_t latency_ms = golioth_sys_now_ms() - req->sent_ms;
+    size_t bucket = 0;
+
+    while (bucket < sizeof(bounds_ms) / sizeof(bounds_ms[0]) && latency_ms > bounds_ms[bucket])
+    {
+        bucket++;
+    }
+
+    golioth_stats_add(&stats->requests[req->type].latency[bucket], 1);
+    req->sent_ms = 0;
+}
+
+static inline void golioth_stats_handshake(struct golioth_client_stats *stats, uint32_t duration_ms)
+{
+    if (__atomic_fetch_add(&stats->handshakes, 1, __ATOMIC_RELAXED) > 0)
+    {
+        golioth_stats_add(&stats->reconnects, 1);
+    }
+
+    golioth_stats_store(&stats->handshake_ms_last, duration_ms);
+    golioth_stats_max(&stats->handshake_ms_max, duration_ms);
+}
+
+/// Increment a struct golioth_client_stats counter
+#define GOLIOTH_STATS_INC(_client, _field) golioth_stats_add(&(_client)->stats._field, 1)
+
+/// Add to a struct golioth_client_stats counter
+#define GOLIOTH_STATS_ADD(_client, _field, _value) \
+    golioth_stats_add(&(_client)->stats._field, (_value))
+
+/// A request was sent; records the send time for the latency histogram and the radio-on estimate
+#define GOLIOTH_STATS_REQUEST_SENT(_client, _req)                                \
+    do                                                                           \
+    {                                                                            \
+        golioth_stats_request_sent(&(_client)->stats, _req);                     \
+        golioth_stats_radio_tx(&(_client)->stats, &(_client)->stats_last_tx_ms); \
+    } while (0)
+
+/// The first response to a request was received
+#define GOLIOTH_STATS_RESPONSE(_client, _req) golioth_stats_response(&(_client)->stats, _req)
+
+/// A request got no response
+#define GOLIOTH_STATS_TIMEOUT(_client, _req) \
+    golioth_stats_add(&(_client)->stats.requests[(_req)->type].timeouts, 1)
+
+/// A request was taken out of the request queue. Only the client thread removes requests,
+/// so the queue is at its largest since the previous dequeue right before this one.
+#define GOLIOTH_STATS_DEQUEUED(_client)                      \
+    golioth_stats_max(&(_client)->stats.queue_depth_peak,    \
+                      golioth_mbox_num_messages((_client)->request_queue) + 1)
+
+/// A session was established, \p _duration_ms after it was started
+#define GOLIOTH_STATS_HANDSHAKE(_client, _duration_ms) \
+    golioth_stats_handshake(&(_client)->stats, (_duration_ms))
+
+#else /* CONFIG_GOLIOTH_CLIENT_STATS */
+
+#define GOLIOTH_STATS_INC(_client, _field)
+#define GOLIOTH_STATS_ADD(_client, _field, _value)
+#define GOLIOTH_STATS_REQUEST_SENT(_client, _req)
+#define GOLIOTH_STATS_RESPONSE(_client, _req)
+#define GOLIOTH_STATS_TIMEOUT(_client, _req)
+#define GOLIOTH_STATS_DEQUEUED(_client)
+#define GOLIOTH_STATS_HANDSHAKE(_client, _duration_ms)
+
+#endif /* CONFIG_GOLIOTH_CLIENT_STATS */
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <golioth/config.h>
+#include "coap_client.h"
+
+// Request lifecycle tracing, see golioth/trace.h.
+//
+// When CONFIG_GOLIOTH_TRACE is disabled, GOLIOTH_TRACE_REQUEST() expands to nothing and its
+// arguments are not evaluated.
+
+#if defined(CONFIG_GOLIOTH_TRACE)
+
+#include <golioth/trace.h>
+
+_Static_assert(GOLIOTH_TRACE_TOKEN_LEN == GOLIOTH_COAP_TOKEN_LEN, "Trace token length mismatch");
+
+static inline void golioth_trace_request(struct golioth_client *client,
+                                         enum golioth_trace_stage stage,
+                                         const struct golioth_coap_request_msg *req,
+                                         enum golioth_status status)
+{
+    struct golioth_trace_request_event event = {
+        .stage = stage,
+        .client = client,
+        .token = req->token,
+        .type = (enum golioth_client_request_type) req->type,
+        .path_prefix = req->path_prefix ? req->path_prefix : "",
+        .path = req->path,
+        .status = status,
+    };
+
+    golioth_trace_request_event(&event);
+}
+
+/// Report a stage of request \p _req
+#define GOLIOTH_TRACE_REQUEST(_client, _stage, _req, _status) \
+    golioth_trace_request((_client), (_stage), (_req), (_status))
+
+#else /* CONFIG_GOLIOTH_TRACE */
+
+#define GOLIOTH_TRACE_REQUEST(_client, _stage, _req, _status)
+
+#endif /* CONFIG_GOLIOTH_TRACE */
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include "coap_client.h"
 #include "coap_blockwise.h"
+#include "heap_accounting.h"
 
 LOG_TAG_DEFINE(coap_blockwise);
 
@@ -73,7 +74,8 @@ static struct blockwise_transfer *blockwise_transfer_init(struct golioth_client
                                                           const char *path,
                                                           enum golioth_content_type content_type)
 {
-    struct blockwise_transfer *ctx = golioth_sys_malloc(sizeof(struct blockwise_transfer));
+    struct blockwise_transfer *ctx =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_BLOCKWISE, sizeof(struct blockwise_transfer));
     if (NULL == ctx)
     {
         return NULL;
@@ -91,7 +93,7 @@ static struct blockwise_transfer *blockwise_transfer_init(struct golioth_client
 // Function to free the blockwise_transfer structure
 static void blockwise_transfer_free(struct blockwise_transfer *ctx)
 {
-    free(ctx);
+    GOLIOTH_HEAP_FREE(ctx);
 }
 
 /* Blockwise Uploads related functions */
@@ -231,13 +233,15 @@ enum golioth_status golioth_blockwise_post(struct golioth_client *client,
 
     status = GOLIOTH_ERR_MEM_ALLOC;
 
-    struct post_block_ctx *ctx = golioth_sys_malloc(sizeof(struct post_block_ctx));
+    struct post_block_ctx *ctx =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_BLOCKWISE, sizeof(struct post_block_ctx));
     if (NULL == ctx)
     {
         goto finish;
     }
 
-    ctx->block_buffer = golioth_sys_malloc(CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE);
+    ctx->block_buffer =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_BLOCKWISE, CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE);
     if (NULL == ctx->block_buffer)
     {
         goto finish_with_post_block_ctx;
@@ -297,10 +301,10 @@ finish_with_transfer_ctx:
     blockwise_transfer_free(ctx->transfer_ctx);
 
 finish_with_block_buffer:
-    free(ctx->block_buffer);
+    GOLIOTH_HEAP_FREE(ctx->block_buffer);
 
 finish_with_post_block_ctx:
-    free(ctx);
+    GOLIOTH_HEAP_FREE(ctx);
 
 finish:
     return status;
@@ -331,7 +335,7 @@ struct blockwise_transfer *golioth_blockwise_upload_start(struct golioth_client
     }
 
     /* Allocate and store path; freed in golioth_blockwise_upload_finish() */
-    char *path_buff = golioth_sys_malloc(strlen(path) + 1);
+    char *path_buff = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_BLOCKWISE, strlen(path) + 1);
     if (NULL == path_buff)
     {
         goto finish_with_ctx;
@@ -351,7 +355,7 @@ finish_with_ctx:
 void golioth_blockwise_upload_finish(struct blockwise_transfer *ctx)
 {
     /* ctx->path was allocated in golioth_blockwise_upload_start() */
-    free((char *) ctx->path);
+    GOLIOTH_HEAP_FREE((char *) ctx->path);
     blockwise_transfer_free(ctx);
 }
 
@@ -493,13 +497,15 @@ enum golioth_status golioth_blockwise_get(struct golioth_client *client,
 
     status = GOLIOTH_ERR_MEM_ALLOC;
 
-    struct get_block_ctx *ctx = malloc(sizeof(struct get_block_ctx));
+    struct get_block_ctx *ctx =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_BLOCKWISE, sizeof(struct get_block_ctx));
     if (NULL == ctx)
     {
         goto finish;
     }
 
-    ctx->block_buffer = malloc(CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE);
+    ctx->block_buffer = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_BLOCKWISE,
+                                            CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE);
     if (NULL == ctx->block_buffer)
     {
         goto finish_with_ctx;
@@ -555,10 +561,10 @@ finish_with_transfer_ctx:
     blockwise_transfer_free(ctx->transfer_ctx);
 
 finish_with_block_buffer:
-    free(ctx->block_buffer);
+    GOLIOTH_HEAP_FREE(ctx->block_buffer);
 
 finish_with_ctx:
-    free(ctx);
+    GOLIOTH_HEAP_FREE(ctx);
 
 finish:
     return status;
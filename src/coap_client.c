@@ -15,6 +15,11 @@
 #else
 #include "coap_client_libcoap.h"
 #endif
+#include "client_stats.h"
+#include "client_trace.h"
+#include "heap_accounting.h"
+#include "store_forward.h"
+#include "tx_window.h"
 
 LOG_TAG_DEFINE(golioth_coap_client);
 
@@ -76,6 +81,34 @@ void golioth_coap_next_token(uint8_t token[GOLIOTH_COAP_TOKEN_LEN])
     golioth_sys_mutex_unlock(token_mut);
 }
 
+// Enqueue a request, waiting up to the enqueue timeout of the client for space. The client thread
+// is the one emptying the queue, so requests made from it (e.g. from callbacks) never wait.
+// Deferrable requests may be held for the next transmission window instead.
+static bool request_queue_send(struct golioth_client *client,
+                               const struct golioth_coap_request_msg *request_msg)
+{
+    int32_t timeout_ms = client->enqueue_timeout_ms;
+
+    if (golioth_tx_window_hold(client, request_msg))
+    {
+        return true;
+    }
+
+    if (timeout_ms != 0 && golioth_sys_thread_is_current(client->coap_thread_handle))
+    {
+        timeout_ms = 0;
+    }
+
+    if (!golioth_mbox_send(client->request_queue, request_msg, timeout_ms))
+    {
+        return false;
+    }
+
+    golioth_tx_window_queued(client, request_msg);
+
+    return true;
+}
+
 enum golioth_status golioth_coap_client_empty(struct golioth_client *client,
                                               bool is_synchronous,
                                               int32_t timeout_s)
@@ -124,9 +157,15 @@ enum golioth_status golioth_coap_client_empty(struct golioth_client *client,
         request_msg.status = &status;
     }
 
-    bool sent = golioth_mbox_try_send(client->request_queue, &request_msg);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_ENQUEUE, &request_msg, GOLIOTH_OK);
+    bool sent = request_queue_send(client, &request_msg);
     if (!sent)
     {
+        GOLIOTH_STATS_INC(client, queue_full);
+        GOLIOTH_TRACE_REQUEST(client,
+                              GOLIOTH_TRACE_QUEUE_FULL,
+                              &request_msg,
+                              GOLIOTH_ERR_QUEUE_FULL);
         GLTH_LOGW(TAG, "Failed to enqueue request, queue full");
         if (is_synchronous)
         {
@@ -162,6 +201,41 @@ enum golioth_status golioth_coap_client_empty(struct golioth_client *client,
     return GOLIOTH_OK;
 }
 
+#if defined(CONFIG_GOLIOTH_HEAP_STATS) || defined(CONFIG_GOLIOTH_HEAP_STATIC)
+// Account queued payloads to the subsystem that sent them, based on the path
+// prefixes used by each of them.
+static enum golioth_heap_subsystem payload_heap_subsystem(const char *path_prefix,
+                                                          const char *path)
+{
+    static const struct
+    {
+        const char *path_prefix;
+        enum golioth_heap_subsystem subsystem;
+    } prefixes[] = {
+        {".d/", GOLIOTH_HEAP_LIGHTDB},
+        {".s/", GOLIOTH_HEAP_STREAM},
+        {".c/", GOLIOTH_HEAP_SETTINGS},
+        {".rpc/", GOLIOTH_HEAP_RPC},
+        {".u/", GOLIOTH_HEAP_OTA},
+    };
+
+    for (size_t i = 0; path_prefix && i < ARRAY_SIZE(prefixes); i++)
+    {
+        if (strncmp(path_prefix, prefixes[i].path_prefix, strlen(prefixes[i].path_prefix)) == 0)
+        {
+            return prefixes[i].subsystem;
+        }
+    }
+
+    if (strcmp(path, "logs") == 0)
+    {
+        return GOLIOTH_HEAP_LOG;
+    }
+
+    return GOLIOTH_HEAP_CLIENT;
+}
+#endif
+
 static enum golioth_status golioth_coap_client_set_internal(
     struct golioth_client *client,
     const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
@@ -204,7 +278,8 @@ static enum golioth_status golioth_coap_client_set_internal(
         //
         // This memory will be free'd by the CoAP thread after handling the request,
         // or in this function if we fail to enqueue the request.
-        request_payload = (uint8_t *) golioth_sys_malloc(payload_size);
+        request_payload = (uint8_t *) GOLIOTH_HEAP_MALLOC(payload_heap_subsystem(path_prefix, path),
+                                                          payload_size);
         if (!request_payload)
         {
             GLTH_LOGE(TAG, "Payload alloc failure");
@@ -235,7 +310,7 @@ static enum golioth_status golioth_coap_client_set_internal(
             GLTH_LOGW(TAG, "Failed to create event group");
             if (request_payload)
             {
-                golioth_sys_free(request_payload);
+                GOLIOTH_HEAP_FREE(request_payload);
             }
             return GOLIOTH_ERR_MEM_ALLOC;
         }
@@ -247,7 +322,7 @@ static enum golioth_status golioth_coap_client_set_internal(
             golioth_event_group_destroy(request_msg.request_complete_event);
             if (request_payload)
             {
-                golioth_sys_free(request_payload);
+                GOLIOTH_HEAP_FREE(request_payload);
             }
             return GOLIOTH_ERR_MEM_ALLOC;
         }
@@ -269,9 +344,15 @@ static enum golioth_status golioth_coap_client_set_internal(
         request_msg.post.payload_size = payload_size;
     }
 
-    bool sent = golioth_mbox_try_send(client->request_queue, &request_msg);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_ENQUEUE, &request_msg, GOLIOTH_OK);
+    bool sent = request_queue_send(client, &request_msg);
     if (!sent)
     {
+        GOLIOTH_STATS_INC(client, queue_full);
+        GOLIOTH_TRACE_REQUEST(client,
+                              GOLIOTH_TRACE_QUEUE_FULL,
+                              &request_msg,
+                              GOLIOTH_ERR_QUEUE_FULL);
         /* NOTE: Logging a message here when cloud logging is enabled can cause
          *       a loop where the logging thread attempts to enqueue a message,
          *       the mbox is full, so coap_client writes a log, which the
@@ -279,7 +360,7 @@ static enum golioth_status golioth_coap_client_set_internal(
          */
         if (request_payload)
         {
-            golioth_sys_free(request_payload);
+            GOLIOTH_HEAP_FREE(request_payload);
         }
         if (is_synchronous)
         {
@@ -362,16 +443,41 @@ enum golioth_status golioth_coap_client_set(struct golioth_client *client,
         .callback_set = callback,
         .arg = callback_arg,
     };
-    return golioth_coap_client_set_internal(client,
-                                            token,
+    bool store_forward =
+        golioth_store_forward_is_eligible(path_prefix, path, callback, is_synchronous);
+
+    if (store_forward && golioth_store_forward_should_store(client))
+    {
+        return golioth_store_forward_append(client,
                                             path_prefix,
                                             path,
+                                            content_type,
                                             payload,
-                                            payload_size,
-                                            GOLIOTH_COAP_REQUEST_POST,
-                                            &params,
-                                            is_synchronous,
-                                            timeout_s);
+                                            payload_size);
+    }
+
+    enum golioth_status status = golioth_coap_client_set_internal(client,
+                                                                  token,
+                                                                  path_prefix,
+                                                                  path,
+                                                                  payload,
+                                                                  payload_size,
+                                                                  GOLIOTH_COAP_REQUEST_POST,
+                                                                  &params,
+                                                                  is_synchronous,
+                                                                  timeout_s);
+
+    if (store_forward && (status == GOLIOTH_ERR_QUEUE_FULL || status == GOLIOTH_ERR_INVALID_STATE))
+    {
+        return golioth_store_forward_append(client,
+                                            path_prefix,
+                                            path,
+                                            content_type,
+                                            payload,
+                                            payload_size);
+    }
+
+    return status;
 }
 
 enum golioth_status golioth_coap_client_set_block(struct golioth_client *client,
@@ -478,9 +584,15 @@ enum golioth_status golioth_coap_client_delete(struct golioth_client *client,
         request_msg.status = &status;
     }
 
-    bool sent = golioth_mbox_try_send(client->request_queue, &request_msg);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_ENQUEUE, &request_msg, GOLIOTH_OK);
+    bool sent = request_queue_send(client, &request_msg);
     if (!sent)
     {
+        GOLIOTH_STATS_INC(client, queue_full);
+        GOLIOTH_TRACE_REQUEST(client,
+                              GOLIOTH_TRACE_QUEUE_FULL,
+                              &request_msg,
+                              GOLIOTH_ERR_QUEUE_FULL);
         GLTH_LOGW(TAG, "Failed to enqueue request, queue full");
         if (is_synchronous)
         {
@@ -589,9 +701,15 @@ static enum golioth_status golioth_coap_client_get_internal(
         request_msg.get = *(struct golioth_coap_get_params *) request_params;
     }
 
-    bool sent = golioth_mbox_try_send(client->request_queue, &request_msg);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_ENQUEUE, &request_msg, GOLIOTH_OK);
+    bool sent = request_queue_send(client, &request_msg);
     if (!sent)
     {
+        GOLIOTH_STATS_INC(client, queue_full);
+        GOLIOTH_TRACE_REQUEST(client,
+                              GOLIOTH_TRACE_QUEUE_FULL,
+                              &request_msg,
+                              GOLIOTH_ERR_QUEUE_FULL);
         GLTH_LOGE(TAG, "Failed to enqueue request, queue full");
         if (is_synchronous)
         {
@@ -724,9 +842,15 @@ enum golioth_status golioth_coap_client_observe(struct golioth_client *client,
     }
     strncpy(request_msg.path, path, sizeof(request_msg.path) - 1);
 
-    bool sent = golioth_mbox_try_send(client->request_queue, &request_msg);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_ENQUEUE, &request_msg, GOLIOTH_OK);
+    bool sent = request_queue_send(client, &request_msg);
     if (!sent)
     {
+        GOLIOTH_STATS_INC(client, queue_full);
+        GOLIOTH_TRACE_REQUEST(client,
+                              GOLIOTH_TRACE_QUEUE_FULL,
+                              &request_msg,
+                              GOLIOTH_ERR_QUEUE_FULL);
         GLTH_LOGW(TAG, "Failed to enqueue request, queue full");
         return GOLIOTH_ERR_QUEUE_FULL;
     }
@@ -774,9 +898,15 @@ enum golioth_status golioth_coap_client_observe_release(struct golioth_client *c
     strncpy(request_msg.path, path, sizeof(request_msg.path) - 1);
     memcpy(request_msg.token, token, GOLIOTH_COAP_TOKEN_LEN);
 
-    bool sent = golioth_mbox_try_send(client->request_queue, &request_msg);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_ENQUEUE, &request_msg, GOLIOTH_OK);
+    bool sent = request_queue_send(client, &request_msg);
     if (!sent)
     {
+        GOLIOTH_STATS_INC(client, queue_full);
+        GOLIOTH_TRACE_REQUEST(client,
+                              GOLIOTH_TRACE_QUEUE_FULL,
+                              &request_msg,
+                              GOLIOTH_ERR_QUEUE_FULL);
         GLTH_LOGE(TAG, "Failed to enqueue request, queue full");
         return GOLIOTH_ERR_QUEUE_FULL;
     }
@@ -795,6 +925,117 @@ void golioth_coap_client_cancel_observations_by_prefix(struct golioth_client *cl
     golioth_cancel_all_observations_by_prefix(client, prefix);
 }
 
+static void notify_dropped(struct golioth_client *client,
+                           struct golioth_coap_request_msg *req,
+                           enum golioth_status status)
+{
+    if (req->request_complete_event)
+    {
+        assert(req->request_complete_ack_sem);
+
+        golioth_event_group_set_bits(req->request_complete_event, RESPONSE_TIMEOUT_EVENT_BIT);
+
+        // Wait for user thread to receive the event, before deleting it.
+        golioth_sys_sem_take(req->request_complete_ack_sem, GOLIOTH_SYS_WAIT_FOREVER);
+
+        golioth_event_group_destroy(req->request_complete_event);
+        golioth_sys_sem_destroy(req->request_complete_ack_sem);
+        return;
+    }
+
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_BEGIN, req, status);
+
+    switch (req->type)
+    {
+        case GOLIOTH_COAP_REQUEST_GET:
+            if (req->get.callback)
+            {
+                req->get.callback(client, status, NULL, req->path, NULL, 0, req->get.arg);
+            }
+            break;
+        case GOLIOTH_COAP_REQUEST_GET_BLOCK:
+            if (req->get_block.callback)
+            {
+                req->get_block
+                    .callback(client, status, NULL, req->path, NULL, 0, false, req->get_block.arg);
+            }
+            break;
+        case GOLIOTH_COAP_REQUEST_POST:
+            if (req->post.callback_is_post && req->post.callback_post)
+            {
+                req->post.callback_post(client, status, NULL, req->path, NULL, 0, req->post.arg);
+            }
+            else if (!req->post.callback_is_post && req->post.callback_set)
+            {
+                req->post.callback_set(client, status, NULL, req->path, req->post.arg);
+            }
+            break;
+        case GOLIOTH_COAP_REQUEST_POST_BLOCK:
+            if (req->post_block.callback)
+            {
+                req->post_block.callback(client,
+                                         status,
+                                         NULL,
+                                         req->path,
+                                         req->post_block.block_szx,
+                                         req->post_block.arg);
+            }
+            break;
+        case GOLIOTH_COAP_REQUEST_DELETE:
+            if (req->delete.callback)
+            {
+                req->delete.callback(client, status, NULL, req->path, req->delete.arg);
+            }
+            break;
+        default:
+            break;
+    }
+
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_END, req, status);
+}
+
+bool golioth_coap_client_drop_if_aged_out(struct golioth_client *client,
+                                          struct golioth_coap_request_msg *req)
+{
+    uint64_t now_ms = golioth_sys_now_ms();
+
+    // The margin drops requests that would expire before their response could arrive
+    if (now_ms + CONFIG_GOLIOTH_COAP_REQUEST_DEADLINE_MARGIN_MS <= req->ageout_ms)
+    {
+        return false;
+    }
+
+    GOLIOTH_STATS_INC(client, aged_out);
+    GOLIOTH_STATS_INC(client, deadline_missed);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_AGED_OUT, req, GOLIOTH_ERR_TIMEOUT);
+
+    GLTH_LOGW(TAG,
+              "Dropping request that cannot meet its deadline, type %d, path %s",
+              req->type,
+              req->path);
+
+    golioth_coap_client_drop(client, req, GOLIOTH_ERR_TIMEOUT);
+
+    return true;
+}
+
+void golioth_coap_client_drop(struct golioth_client *client,
+                              struct golioth_coap_request_msg *req,
+                              enum golioth_status status)
+{
+    notify_dropped(client, req, status);
+
+    if (req->type == GOLIOTH_COAP_REQUEST_POST && req->post.payload_size > 0)
+    {
+        GOLIOTH_HEAP_FREE(req->post.payload);
+    }
+
+    if (req->type == GOLIOTH_COAP_REQUEST_POST_BLOCK && req->post_block.payload_size > 0)
+    {
+        GOLIOTH_HEAP_FREE(req->post_block.payload);
+    }
+}
+
 void golioth_client_register_event_callback(struct golioth_client *client,
                                             golioth_client_event_cb_fn callback,
                                             void *arg)
@@ -816,11 +1057,107 @@ uint32_t golioth_client_num_items_in_request_queue(struct golioth_client *client
     return golioth_mbox_num_messages(client->request_queue);
 }
 
+static void on_queue_watermark(bool is_high, void *arg)
+{
+    struct golioth_client *client = arg;
+    golioth_client_queue_watermark_cb_fn callback = client->queue_watermark_callback;
+
+    if (callback)
+    {
+        callback(client,
+                 is_high ? GOLIOTH_CLIENT_QUEUE_HIGH_WATERMARK : GOLIOTH_CLIENT_QUEUE_LOW_WATERMARK,
+                 client->queue_watermark_callback_arg);
+    }
+}
+
+enum golioth_status golioth_client_set_queue_watermarks(
+    struct golioth_client *client,
+    uint32_t high,
+    uint32_t low,
+    golioth_client_queue_watermark_cb_fn callback,
+    void *arg)
+{
+    if (!client)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+    if (low >= high || high > golioth_mbox_capacity(client->request_queue))
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    client->queue_watermark_callback = callback;
+    client->queue_watermark_callback_arg = arg;
+    golioth_mbox_set_watermarks(client->request_queue,
+                                high,
+                                low,
+                                callback ? on_queue_watermark : NULL,
+                                client);
+
+    return GOLIOTH_OK;
+}
+
+void golioth_client_set_enqueue_timeout(struct golioth_client *client, int32_t timeout_ms)
+{
+    if (!client)
+    {
+        return;
+    }
+    client->enqueue_timeout_ms = timeout_ms;
+}
+
+enum golioth_status golioth_client_get_stats(struct golioth_client *client,
+                                             struct golioth_client_stats *stats)
+{
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+    if (!client || !stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    // All fields are uint32_t, copy them one by one with relaxed atomic loads
+    const uint32_t *src = (const uint32_t *) &client->stats;
+    uint32_t *dst = (uint32_t *) stats;
+    for (size_t i = 0; i < sizeof(*stats) / sizeof(uint32_t); i++)
+    {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+
+    stats->queue_depth = golioth_mbox_num_messages(client->request_queue);
+
+#if defined(CONFIG_GOLIOTH_HEAP_STATS)
+    for (int i = 0; i < GOLIOTH_HEAP_NUM_SUBSYSTEMS; i++)
+    {
+        golioth_heap_get_stats(i, &stats->heap[i]);
+    }
+#endif
+
+    return GOLIOTH_OK;
+#else
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+#endif
+}
+
 golioth_sys_thread_t golioth_client_get_thread(struct golioth_client *client)
 {
     return client->coap_thread_handle;
 }
 
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+struct golioth_log_batch *golioth_coap_client_get_log_batch(struct golioth_client *client)
+{
+    return &client->log_batch;
+}
+#endif
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT)
+struct golioth_lightdb_report **golioth_coap_client_get_lightdb_reports_due(
+    struct golioth_client *client)
+{
+    return &client->lightdb_reports_due;
+}
+#endif
+
 bool golioth_client_wait_for_connect(struct golioth_client *client, int timeout_ms)
 {
     const uint32_t poll_period_ms = 100;
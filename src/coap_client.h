@@ -89,16 +89,17 @@ struct golioth_coap_observe_params
     void *arg;
 };
 
+/// Values match enum golioth_client_request_type, so they index client statistics directly
 enum golioth_coap_request_type
 {
-    GOLIOTH_COAP_REQUEST_EMPTY,
-    GOLIOTH_COAP_REQUEST_GET,
-    GOLIOTH_COAP_REQUEST_GET_BLOCK,
-    GOLIOTH_COAP_REQUEST_POST,
-    GOLIOTH_COAP_REQUEST_POST_BLOCK,
-    GOLIOTH_COAP_REQUEST_DELETE,
-    GOLIOTH_COAP_REQUEST_OBSERVE,
-    GOLIOTH_COAP_REQUEST_OBSERVE_RELEASE,
+    GOLIOTH_COAP_REQUEST_EMPTY = GOLIOTH_CLIENT_REQUEST_EMPTY,
+    GOLIOTH_COAP_REQUEST_GET = GOLIOTH_CLIENT_REQUEST_GET,
+    GOLIOTH_COAP_REQUEST_GET_BLOCK = GOLIOTH_CLIENT_REQUEST_GET_BLOCK,
+    GOLIOTH_COAP_REQUEST_POST = GOLIOTH_CLIENT_REQUEST_POST,
+    GOLIOTH_COAP_REQUEST_POST_BLOCK = GOLIOTH_CLIENT_REQUEST_POST_BLOCK,
+    GOLIOTH_COAP_REQUEST_DELETE = GOLIOTH_CLIENT_REQUEST_DELETE,
+    GOLIOTH_COAP_REQUEST_OBSERVE = GOLIOTH_CLIENT_REQUEST_OBSERVE,
+    GOLIOTH_COAP_REQUEST_OBSERVE_RELEASE = GOLIOTH_CLIENT_REQUEST_OBSERVE_RELEASE,
 };
 
 struct golioth_coap_request_msg
@@ -124,6 +125,11 @@ struct golioth_coap_request_msg
     /// This is checked when reqeusts are pulled out of the queue and when responses are received.
     /// Primarily intended to be used for synchronous requests, to avoid blocking forever.
     uint64_t ageout_ms;
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+    /// Time (since boot) in milliseconds when the request was sent, 0 once the response
+    /// latency has been recorded.
+    uint64_t sent_ms;
+#endif
     bool got_response;
     bool got_nack;
     enum golioth_status *status;
@@ -253,6 +259,35 @@ void golioth_coap_client_cancel_all_observations(struct golioth_client *client);
 void golioth_coap_client_cancel_observations_by_prefix(struct golioth_client *client,
                                                        const char *prefix);
 
+/// Drop a dequeued request that cannot meet its deadline, i.e. its ageout_ms is less than
+/// CONFIG_GOLIOTH_COAP_REQUEST_DEADLINE_MARGIN_MS away.
+///
+/// The callback (or synchronous caller) of a dropped request is informed with
+/// GOLIOTH_ERR_TIMEOUT and its payload is freed; the request message itself is not.
+///
+/// @return true if the request was dropped
+bool golioth_coap_client_drop_if_aged_out(struct golioth_client *client,
+                                          struct golioth_coap_request_msg *req);
+
+/// Drop a request that will not be sent. Its callback (or synchronous caller) is informed with
+/// \p status (synchronous callers see a timeout) and its payload is freed; the request message
+/// itself is not.
+void golioth_coap_client_drop(struct golioth_client *client,
+                              struct golioth_coap_request_msg *req,
+                              enum golioth_status status);
+
 /// Getters, for internal SDK code to access data within the
 /// coap client struct.
 golioth_sys_thread_t golioth_coap_client_get_thread(struct golioth_client *client);
+
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+struct golioth_log_batch;
+struct golioth_log_batch *golioth_coap_client_get_log_batch(struct golioth_client *client);
+#endif
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT)
+struct golioth_lightdb_report;
+/// Head of the list of reports whose timer expired, see lightdb_report.h
+struct golioth_lightdb_report **golioth_coap_client_get_lightdb_reports_due(
+    struct golioth_client *client);
+#endif
@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <netdb.h>      // struct addrinfo
+#include <poll.h>
 #include <sys/param.h>  // MIN
 #include <coap3/coap.h>
 #include <golioth/golioth_debug.h>
@@ -15,11 +16,30 @@
 #include "golioth_util.h"
 #include "mbox.h"
 #include "coap_client_libcoap.h"
+#include "client_stats.h"
+#include "client_trace.h"
+#include "heap_accounting.h"
+#include "store_forward.h"
 
 LOG_TAG_DEFINE(golioth_coap_client_libcoap);
 
 static bool _initialized;
 
+static void reset_keepalive(struct golioth_client *client)
+{
+#if defined(CONFIG_GOLIOTH_COAP_GATEWAY)
+    client->gw_last_activity_ms = golioth_sys_now_ms();
+#else
+    if (CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S > 0)
+    {
+        if (!golioth_sys_timer_reset(client->keepalive_timer))
+        {
+            GLTH_LOGW(TAG, "Failed to reset keepalive timer");
+        }
+    }
+#endif
+}
+
 static bool token_matches_request(const struct golioth_coap_request_msg *req, const coap_pdu_t *pdu)
 {
     coap_bin_const_t rcvd_token = coap_pdu_get_token(pdu);
@@ -49,6 +69,7 @@ static void notify_observers(const coap_pdu_t *received,
         bool len_matches = (rcvd_token.length == GOLIOTH_COAP_TOKEN_LEN);
         if (len_matches && (0 == memcmp(rcvd_token.s, obs_info->req.token, GOLIOTH_COAP_TOKEN_LEN)))
         {
+            GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_BEGIN, &obs_info->req, status);
             callback(client,
                      status,
                      coap_rsp_code,
@@ -56,6 +77,7 @@ static void notify_observers(const coap_pdu_t *received,
                      data,
                      data_len,
                      obs_info->req.observe.arg);
+            GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_END, &obs_info->req, status);
         }
     }
 }
@@ -91,6 +113,7 @@ static coap_response_t coap_response_handler(coap_session_t *session,
     const uint8_t *data = NULL;
     size_t data_len = 0;
     coap_get_data(received, &data_len, &data);
+    GOLIOTH_STATS_ADD(client, bytes_received, data_len);
 
     // Get the original/pending request info
     struct golioth_coap_request_msg *req = client->pending_req;
@@ -148,21 +171,20 @@ static coap_response_t coap_response_handler(coap_session_t *session,
     if (req && token_matches_request(req, received))
     {
         req->got_response = true;
+        GOLIOTH_STATS_RESPONSE(client, req);
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_RESPONSE, req, status);
 
-        if (CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S > 0)
-        {
-            if (!golioth_sys_timer_reset(client->keepalive_timer))
-            {
-                GLTH_LOGW(TAG, "Failed to reset keepalive timer");
-            }
-        }
+        reset_keepalive(client);
 
         if (golioth_sys_now_ms() > req->ageout_ms)
         {
+            GOLIOTH_STATS_INC(client, deadline_missed);
             GLTH_LOGW(TAG, "Ignoring response from old request, type %d", req->type);
         }
         else
         {
+            GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_BEGIN, req, status);
+
             if (req->type == GOLIOTH_COAP_REQUEST_GET)
             {
                 if (req->get.callback)
@@ -264,6 +286,8 @@ static coap_response_t coap_response_handler(coap_session_t *session,
                                          req->delete.arg);
                 }
             }
+
+            GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_END, req, status);
         }
     }
 
@@ -277,6 +301,10 @@ static int event_handler(coap_session_t *session, const coap_event_t event)
     if (event == COAP_EVENT_MSG_RETRANSMITTED)
     {
         GLTH_LOGW(TAG, "CoAP message retransmitted");
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+        struct golioth_client *client = coap_get_app_data(coap_session_get_context(session));
+        GOLIOTH_STATS_INC(client, retransmissions);
+#endif
     }
     else
     {
@@ -845,114 +873,52 @@ static enum golioth_status create_session(struct golioth_client *client,
     return GOLIOTH_OK;
 }
 
-static enum golioth_status coap_io_loop_once(struct golioth_client *client,
-                                             coap_context_t *context,
-                                             coap_session_t *session)
+// Sends the request to the server. Returns true if a confirmable request was sent
+// and a response should be waited for.
+static bool send_request(struct golioth_client *client,
+                         coap_session_t *session,
+                         struct golioth_coap_request_msg *request_msg)
 {
-    struct golioth_coap_request_msg request_msg = {};
-    int mbox_fd = golioth_sys_sem_get_fd(client->request_queue->fill_count_sem);
-
-    if (mbox_fd >= 0)
-    {
-        fd_set readfds;
-
-        FD_ZERO(&readfds);
-        FD_SET(mbox_fd, &readfds);
-
-        coap_io_process_with_fds(context, COAP_IO_WAIT, mbox_fd + 1, &readfds, NULL, NULL);
-
-        if (!FD_ISSET(mbox_fd, &readfds))
-        {
-            return GOLIOTH_OK;
-        }
-
-        bool got_request_msg = golioth_mbox_recv(client->request_queue, &request_msg, 0);
-        if (!got_request_msg)
-        {
-            GLTH_LOGE(TAG, "Failed to get request_message from mbox");
-            return GOLIOTH_ERR_IO;
-        }
-    }
-    else
-    {
-        // Wait for request message, with timeout
-        bool got_request_msg = golioth_mbox_recv(client->request_queue,
-                                                 &request_msg,
-                                                 CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_TIMEOUT_MS);
-        if (!got_request_msg)
-        {
-            // No requests, so process other pending IO (e.g. observations)
-            GLTH_LOGV(TAG, "Idle io process start");
-            coap_io_process(context, COAP_IO_NO_WAIT);
-            GLTH_LOGV(TAG, "Idle io process end");
-            return GOLIOTH_OK;
-        }
-    }
-
-    // Make sure the request isn't too old
-    if (golioth_sys_now_ms() > request_msg.ageout_ms)
-    {
-        GLTH_LOGW(TAG,
-                  "Ignoring request that has aged out, type %d, path %s",
-                  request_msg.type,
-                  (request_msg.path ? request_msg.path : "N/A"));
-
-        if (request_msg.type == GOLIOTH_COAP_REQUEST_POST && request_msg.post.payload_size > 0)
-        {
-            golioth_sys_free(request_msg.post.payload);
-        }
-
-        if (request_msg.type == GOLIOTH_COAP_REQUEST_POST_BLOCK
-            && request_msg.post_block.payload_size > 0)
-        {
-            golioth_sys_free(request_msg.post_block.payload);
-        }
-
-        if (request_msg.request_complete_event)
-        {
-            assert(request_msg.request_complete_ack_sem);
-            golioth_event_group_destroy(request_msg.request_complete_event);
-            golioth_sys_sem_destroy(request_msg.request_complete_ack_sem);
-        }
-        return GOLIOTH_OK;
-    }
-
     int err;
-    // Handle message and send request to server
     bool request_is_valid = true;
-    switch (request_msg.type)
+
+    // Before the switch, which frees POST payloads
+    GOLIOTH_STATS_REQUEST_SENT(client, request_msg);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_SEND, request_msg, GOLIOTH_OK);
+
+    switch (request_msg->type)
     {
         case GOLIOTH_COAP_REQUEST_EMPTY:
             GLTH_LOGD(TAG, "Handle EMPTY");
-            golioth_coap_empty(&request_msg, session);
+            golioth_coap_empty(request_msg, session);
             break;
         case GOLIOTH_COAP_REQUEST_GET:
-            GLTH_LOGD(TAG, "Handle GET %s", request_msg.path);
-            golioth_coap_get(&request_msg, session);
+            GLTH_LOGD(TAG, "Handle GET %s", request_msg->path);
+            golioth_coap_get(request_msg, session);
             break;
         case GOLIOTH_COAP_REQUEST_GET_BLOCK:
-            GLTH_LOGD(TAG, "Handle GET_BLOCK %s", request_msg.path);
-            golioth_coap_get_block(&request_msg, client, session);
+            GLTH_LOGD(TAG, "Handle GET_BLOCK %s", request_msg->path);
+            golioth_coap_get_block(request_msg, client, session);
             break;
         case GOLIOTH_COAP_REQUEST_POST:
-            GLTH_LOGD(TAG, "Handle POST %s", request_msg.path);
-            golioth_coap_post(&request_msg, session);
-            assert(request_msg.post.payload);
-            golioth_sys_free(request_msg.post.payload);
+            GLTH_LOGD(TAG, "Handle POST %s", request_msg->path);
+            golioth_coap_post(request_msg, session);
+            assert(request_msg->post.payload);
+            GOLIOTH_HEAP_FREE(request_msg->post.payload);
             break;
         case GOLIOTH_COAP_REQUEST_POST_BLOCK:
-            GLTH_LOGD(TAG, "Handle POST_BLOCK %s", request_msg.path);
-            golioth_coap_post_block(&request_msg, client, session);
-            assert(request_msg.post_block.payload);
-            golioth_sys_free(request_msg.post_block.payload);
+            GLTH_LOGD(TAG, "Handle POST_BLOCK %s", request_msg->path);
+            golioth_coap_post_block(request_msg, client, session);
+            assert(request_msg->post_block.payload);
+            GOLIOTH_HEAP_FREE(request_msg->post_block.payload);
             break;
         case GOLIOTH_COAP_REQUEST_DELETE:
-            GLTH_LOGD(TAG, "Handle DELETE %s", request_msg.path);
-            golioth_coap_delete(&request_msg, session);
+            GLTH_LOGD(TAG, "Handle DELETE %s", request_msg->path);
+            golioth_coap_delete(request_msg, session);
             break;
         case GOLIOTH_COAP_REQUEST_OBSERVE:
-            GLTH_LOGD(TAG, "Handle OBSERVE %s", request_msg.path);
-            err = add_observation(&request_msg, client, session);
+            GLTH_LOGD(TAG, "Handle OBSERVE %s", request_msg->path);
+            err = add_observation(request_msg, client, session);
             if (err)
             {
                 GLTH_LOGE(TAG, "Error adding observation: %d", err);
@@ -960,95 +926,68 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client,
             }
             break;
         case GOLIOTH_COAP_REQUEST_OBSERVE_RELEASE:
-            GLTH_LOGD(TAG, "Handle OBSERVE CANCEL %s", request_msg.path);
-            err = golioth_coap_observe(&request_msg, client, session, true);
+            GLTH_LOGD(TAG, "Handle OBSERVE CANCEL %s", request_msg->path);
+            err = golioth_coap_observe(request_msg, client, session, true);
             if (err == COAP_INVALID_MID)
             {
                 GLTH_LOGE(TAG,
                           "Unable to release observed path %s, cannot send CoAP PDU",
-                          request_msg.path);
+                          request_msg->path);
                 request_is_valid = false;
             }
             break;
         default:
-            GLTH_LOGW(TAG, "Unknown request_msg type: %u", request_msg.type);
+            GLTH_LOGW(TAG, "Unknown request_msg type: %u", request_msg->type);
             request_is_valid = false;
             break;
     }
 
-    if (!request_is_valid)
-    {
-        return GOLIOTH_OK;
-    }
+    return request_is_valid;
+}
 
-    // If we get here, then a confirmable request has been sent to the server,
-    // and we should wait for a response.
-    client->pending_req = &request_msg;
-    request_msg.got_response = false;
-    int32_t time_spent_waiting_ms = 0;
+// Maximum time to wait for the response to a request that has just been sent
+static int32_t response_timeout_ms(const struct golioth_coap_request_msg *request_msg)
+{
     int32_t timeout_ms = CONFIG_GOLIOTH_COAP_RESPONSE_TIMEOUT_S * 1000;
 
-    if (request_msg.ageout_ms != GOLIOTH_SYS_WAIT_FOREVER)
+    if (request_msg->ageout_ms != GOLIOTH_SYS_WAIT_FOREVER)
     {
-        int32_t time_till_ageout_ms = (int32_t) (request_msg.ageout_ms - golioth_sys_now_ms());
+        int32_t time_till_ageout_ms = (int32_t) (request_msg->ageout_ms - golioth_sys_now_ms());
         timeout_ms = min(timeout_ms, time_till_ageout_ms);
     }
 
-    bool io_error = false;
-    while (time_spent_waiting_ms < timeout_ms)
-    {
-        int32_t remaining_ms = timeout_ms - time_spent_waiting_ms;
-        int32_t wait_ms = min(1000, remaining_ms);
-        int32_t num_ms = coap_io_process(context, wait_ms);
-        if (num_ms < 0)
-        {
-            io_error = true;
-            break;
-        }
-        else
-        {
-            time_spent_waiting_ms += num_ms;
-            if (request_msg.got_response)
-            {
-                GLTH_LOGD(TAG, "Received response in %" PRId32 " ms", time_spent_waiting_ms);
-                break;
-            }
-            else if (request_msg.got_nack)
-            {
-                GLTH_LOGE(TAG, "Got NACKed request");
-                break;
-            }
-            else
-            {
-                // During normal operation, there will be other kinds of IO to process,
-                // in which case we will get here.
-                // Since we haven't received the response yet, just keep waiting.
-            }
-        }
-    }
-    client->pending_req = NULL;
+    return timeout_ms;
+}
 
-    if (request_msg.request_complete_event)
+// Completes a request that was sent with send_request(): notifies synchronous callers,
+// reports timeouts to the user callback and tracks connection state transitions.
+static enum golioth_status finish_request(struct golioth_client *client,
+                                          coap_session_t *session,
+                                          struct golioth_coap_request_msg *request_msg,
+                                          bool io_error,
+                                          bool timed_out)
+{
+    if (request_msg->request_complete_event)
     {
-        assert(request_msg.request_complete_ack_sem);
+        assert(request_msg->request_complete_ack_sem);
 
-        if (request_msg.got_response)
+        if (request_msg->got_response)
         {
-            golioth_event_group_set_bits(request_msg.request_complete_event,
+            golioth_event_group_set_bits(request_msg->request_complete_event,
                                          RESPONSE_RECEIVED_EVENT_BIT);
         }
         else
         {
-            golioth_event_group_set_bits(request_msg.request_complete_event,
+            golioth_event_group_set_bits(request_msg->request_complete_event,
                                          RESPONSE_TIMEOUT_EVENT_BIT);
         }
 
         // Wait for user thread to receive the event.
-        golioth_sys_sem_take(request_msg.request_complete_ack_sem, GOLIOTH_SYS_WAIT_FOREVER);
+        golioth_sys_sem_take(request_msg->request_complete_ack_sem, GOLIOTH_SYS_WAIT_FOREVER);
 
         // Now it's safe to delete the event and semaphore.
-        golioth_event_group_destroy(request_msg.request_complete_event);
-        golioth_sys_sem_destroy(request_msg.request_complete_ack_sem);
+        golioth_event_group_destroy(request_msg->request_complete_event);
+        golioth_sys_sem_destroy(request_msg->request_complete_ack_sem);
     }
 
     if (io_error)
@@ -1057,14 +996,16 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client,
         return GOLIOTH_ERR_IO;
     }
 
-    if (request_msg.got_nack)
+    if (request_msg->got_nack)
     {
         return GOLIOTH_ERR_NACK;
     }
 
-    if (time_spent_waiting_ms >= timeout_ms)
+    if (timed_out)
     {
         GLTH_LOGE(TAG, "Timeout: never got a response from the server");
+        GOLIOTH_STATS_TIMEOUT(client, request_msg);
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_TIMEOUT, request_msg, GOLIOTH_ERR_TIMEOUT);
 
         if (coap_session_get_state(session) == COAP_SESSION_STATE_HANDSHAKE)
         {
@@ -1076,64 +1017,71 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client,
         // TODO - simplify, put callback directly in request which removes if/else branches
         enum golioth_status status = GOLIOTH_ERR_TIMEOUT;
 
-        if (request_msg.type == GOLIOTH_COAP_REQUEST_GET && request_msg.get.callback)
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_BEGIN, request_msg, status);
+
+        if (request_msg->type == GOLIOTH_COAP_REQUEST_GET && request_msg->get.callback)
         {
-            request_msg.get
-                .callback(client, status, NULL, request_msg.path, NULL, 0, request_msg.get.arg);
+            request_msg->get
+                .callback(client, status, NULL, request_msg->path, NULL, 0, request_msg->get.arg);
         }
-        else if (request_msg.type == GOLIOTH_COAP_REQUEST_GET_BLOCK
-                 && request_msg.get_block.callback)
+        else if (request_msg->type == GOLIOTH_COAP_REQUEST_GET_BLOCK
+                 && request_msg->get_block.callback)
         {
-            request_msg.get_block.callback(client,
-                                           status,
-                                           NULL,
-                                           request_msg.path,
-                                           NULL,
-                                           0,
-                                           false,
-                                           request_msg.get_block.arg);
+            request_msg->get_block.callback(client,
+                                            status,
+                                            NULL,
+                                            request_msg->path,
+                                            NULL,
+                                            0,
+                                            false,
+                                            request_msg->get_block.arg);
         }
-        else if (request_msg.type == GOLIOTH_COAP_REQUEST_POST && request_msg.post.callback_post)
+        else if (request_msg->type == GOLIOTH_COAP_REQUEST_POST
+                 && request_msg->post.callback_post)
         {
-            if (request_msg.post.callback_is_post)
+            if (request_msg->post.callback_is_post)
             {
-                request_msg.post.callback_post(client,
-                                               status,
-                                               NULL,
-                                               request_msg.path,
-                                               NULL,
-                                               0,
-                                               request_msg.post.arg);
+                request_msg->post.callback_post(client,
+                                                status,
+                                                NULL,
+                                                request_msg->path,
+                                                NULL,
+                                                0,
+                                                request_msg->post.arg);
             }
             else
             {
-                request_msg.post.callback_set(client,
-                                              status,
-                                              NULL,
-                                              request_msg.path,
-                                              request_msg.post.arg);
+                request_msg->post.callback_set(client,
+                                               status,
+                                               NULL,
+                                               request_msg->path,
+                                               request_msg->post.arg);
             }
         }
-        else if (request_msg.type == GOLIOTH_COAP_REQUEST_POST_BLOCK
-                 && request_msg.post_block.callback)
+        else if (request_msg->type == GOLIOTH_COAP_REQUEST_POST_BLOCK
+                 && request_msg->post_block.callback)
         {
-            request_msg.post_block.callback(client,
-                                            status,
-                                            NULL,
-                                            request_msg.path,
-                                            request_msg.post_block.block_szx,
-                                            request_msg.post_block.arg);
+            request_msg->post_block.callback(client,
+                                             status,
+                                             NULL,
+                                             request_msg->path,
+                                             request_msg->post_block.block_szx,
+                                             request_msg->post_block.arg);
         }
-        else if (request_msg.type == GOLIOTH_COAP_REQUEST_DELETE && request_msg.delete.callback)
+        else if (request_msg->type == GOLIOTH_COAP_REQUEST_DELETE
+                 && request_msg->delete.callback)
         {
-            request_msg.delete.callback(client,
-                                        status,
-                                        NULL,
-                                        request_msg.path,
-                                        request_msg.delete.arg);
+            request_msg->delete.callback(client,
+                                         status,
+                                         NULL,
+                                         request_msg->path,
+                                         request_msg->delete.arg);
         }
 
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_END, request_msg, status);
+
         golioth_sys_client_disconnected(client);
+        golioth_lightdb_mirror_disconnected(client);
         if (client->event_callback && client->session_connected)
         {
             client->event_callback(client,
@@ -1148,6 +1096,7 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client,
     {
         // Transitioned from not connected to connected
         GLTH_LOGI(TAG, "Golioth CoAP client connected");
+        GOLIOTH_STATS_HANDSHAKE(client, golioth_sys_now_ms() - client->stats_session_start_ms);
         golioth_sys_client_connected(client);
         if (client->event_callback)
         {
@@ -1155,143 +1104,816 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client,
                                    GOLIOTH_CLIENT_EVENT_CONNECTED,
                                    client->event_callback_arg);
         }
+        golioth_store_forward_connected(client);
     }
 
     client->session_connected = true;
     return GOLIOTH_OK;
 }
 
-static void on_keepalive(golioth_sys_timer_t timer, void *arg)
-{
-    struct golioth_client *client = arg;
-    if (client->is_running && golioth_client_num_items_in_request_queue(client) == 0
-        && !client->pending_req)
-    {
-        golioth_coap_client_empty(client, false, GOLIOTH_SYS_WAIT_FOREVER);
-    }
-}
+#if !defined(CONFIG_GOLIOTH_COAP_GATEWAY)
 
-bool golioth_client_is_running(struct golioth_client *client)
+static enum golioth_status coap_io_loop_once(struct golioth_client *client,
+                                             coap_context_t *context,
+                                             coap_session_t *session)
 {
-    if (!client)
-    {
-        return false;
-    }
-    return client->is_running;
-}
+    struct golioth_coap_request_msg request_msg = {};
+    int mbox_fd = golioth_sys_sem_get_fd(client->request_queue->fill_count_sem);
 
-// Note: libcoap is not thread safe, so all rx/tx I/O for the session must be
-// done in this thread.
-static void golioth_coap_client_thread(void *arg)
-{
-    struct golioth_client *client = arg;
-    assert(client);
+    golioth_tx_window_poll(client);
+    golioth_log_batch_poll(client);
+    golioth_lightdb_report_poll(client);
+    golioth_store_forward_poll(client);
 
-    while (1)
+    if (mbox_fd >= 0)
     {
-        coap_context_t *coap_context = NULL;
-        coap_session_t *coap_session = NULL;
+        fd_set readfds;
 
-        client->end_session = false;
-        client->session_connected = false;
+        FD_ZERO(&readfds);
+        FD_SET(mbox_fd, &readfds);
 
-        client->is_running = false;
-        GLTH_LOGD(TAG, "Waiting for the \"run\" signal");
-        golioth_sys_sem_take(client->run_sem, GOLIOTH_SYS_WAIT_FOREVER);
-        golioth_sys_sem_give(client->run_sem);
-        GLTH_LOGD(TAG, "Received \"run\" signal");
-        client->is_running = true;
+        // Timers only mark work (transmission windows, log batches) as due, so wake up
+        // periodically for the polls above to do it
+        coap_io_process_with_fds(context,
+                                 CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_TIMEOUT_MS,
+                                 mbox_fd + 1,
+                                 &readfds,
+                                 NULL,
+                                 NULL);
 
-        if (create_context(client, &coap_context) != GOLIOTH_OK)
+        if (!FD_ISSET(mbox_fd, &readfds))
         {
-            goto cleanup;
+            return GOLIOTH_OK;
         }
 
-        if (create_session(client, coap_context, &coap_session) != GOLIOTH_OK)
+        bool got_request_msg = golioth_mbox_recv(client->request_queue, &request_msg, 0);
+        if (!got_request_msg)
         {
-            goto cleanup;
+            GLTH_LOGE(TAG, "Failed to get request_message from mbox");
+            return GOLIOTH_ERR_IO;
         }
-
-        // Seed the session token generator
-        //
-        // We should still do this even though Golioth generates CoAP tokens outside of libcoap.
-        //
-        // There are a couple of cases (using eTag is the most notable) where libcoap uses this to
-        // generate a new token. However, with our current usage of libcoap we don't anticipate any
-        // cases where it generates its own token.
-        //
-        // The two generators both use simple increment after first token. Avoid collision by
-        // getting a token from Golioth, then incrementing it by half its max value.
-        uint8_t *seed_token = golioth_sys_malloc(sizeof(uint8_t) * GOLIOTH_COAP_TOKEN_LEN);
-        if (seed_token)
+    }
+    else
+    {
+        // Wait for request message, with timeout
+        bool got_request_msg = golioth_mbox_recv(client->request_queue,
+                                                 &request_msg,
+                                                 CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_TIMEOUT_MS);
+        if (!got_request_msg)
         {
-            golioth_coap_next_token(seed_token);
-            seed_token[(GOLIOTH_COAP_TOKEN_LEN / 2) + 1] += 1;
-            coap_session_init_token(coap_session,
-                                    (GOLIOTH_COAP_TOKEN_LEN <= 8) ? GOLIOTH_COAP_TOKEN_LEN : 8,
-                                    seed_token);
-            free(seed_token);
+            // No requests, so process other pending IO (e.g. observations)
+            GLTH_LOGV(TAG, "Idle io process start");
+            coap_io_process(context, COAP_IO_NO_WAIT);
+            GLTH_LOGV(TAG, "Idle io process end");
+            return GOLIOTH_OK;
         }
+    }
 
-        // Enqueue an asynchronous EMPTY request immediately.
-        //
-        // This is done so we can determine quickly whether we are connected
-        // to the cloud or not (libcoap does not tell us when it's connected
-        // for some reason, so this is a workaround for that).
-        if (golioth_client_num_items_in_request_queue(client) == 0)
-        {
-            golioth_coap_client_empty(client, false, GOLIOTH_SYS_WAIT_FOREVER);
-        }
+    GOLIOTH_STATS_DEQUEUED(client);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DEQUEUE, &request_msg, GOLIOTH_OK);
 
-        // If we are re-connecting and had prior observations, set
-        // them up again now (tokens will be updated).
-        reestablish_observations(client, coap_session);
+    // Make sure the request isn't too old
+    if (golioth_coap_client_drop_if_aged_out(client, &request_msg))
+    {
+        return GOLIOTH_OK;
+    }
 
-        GLTH_LOGI(TAG, "Entering CoAP I/O loop");
-        int iteration = 0;
-        while (!client->end_session)
+    // Handle message and send request to server
+    if (!send_request(client, session, &request_msg))
+    {
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, &request_msg, GOLIOTH_ERR_FAIL);
+        return GOLIOTH_OK;
+    }
+
+    // If we get here, then a confirmable request has been sent to the server,
+    // and we should wait for a response.
+    client->pending_req = &request_msg;
+    request_msg.got_response = false;
+    int32_t time_spent_waiting_ms = 0;
+    int32_t timeout_ms = response_timeout_ms(&request_msg);
+
+    bool io_error = false;
+    while (time_spent_waiting_ms < timeout_ms)
+    {
+        int32_t remaining_ms = timeout_ms - time_spent_waiting_ms;
+        int32_t wait_ms = min(1000, remaining_ms);
+        int32_t num_ms = coap_io_process(context, wait_ms);
+        if (num_ms < 0)
         {
-            // Check if we should still run (non-blocking)
-            if (!golioth_sys_sem_take(client->run_sem, 0))
+            io_error = true;
+            break;
+        }
+        else
+        {
+            time_spent_waiting_ms += num_ms;
+            if (request_msg.got_response)
             {
-                GLTH_LOGI(TAG, "Stopping");
+                GLTH_LOGD(TAG, "Received response in %" PRId32 " ms", time_spent_waiting_ms);
                 break;
             }
-            golioth_sys_sem_give(client->run_sem);
-
-            if (coap_io_loop_once(client, coap_context, coap_session) != GOLIOTH_OK)
+            else if (request_msg.got_nack)
             {
-                client->end_session = true;
+                GLTH_LOGE(TAG, "Got NACKed request");
+                break;
+            }
+            else
+            {
+                // During normal operation, there will be other kinds of IO to process,
+                // in which case we will get here.
+                // Since we haven't received the response yet, just keep waiting.
             }
-            iteration++;
         }
+    }
+    client->pending_req = NULL;
 
-    cleanup:
-        GLTH_LOGI(TAG, "Ending session");
+    enum golioth_status status = finish_request(client,
+                                                session,
+                                                &request_msg,
+                                                io_error,
+                                                (time_spent_waiting_ms >= timeout_ms));
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, &request_msg, status);
 
-        golioth_sys_client_disconnected(client);
-        if (client->event_callback && client->session_connected)
-        {
-            client->event_callback(client,
-                                   GOLIOTH_CLIENT_EVENT_DISCONNECTED,
-                                   client->event_callback_arg);
-        }
+    return status;
+}
+
+static void on_keepalive(golioth_sys_timer_t timer, void *arg)
+{
+    struct golioth_client *client = arg;
+    if (client->is_running && golioth_client_num_items_in_request_queue(client) == 0
+        && !client->pending_req && !golioth_tx_window_defer_keepalive(client))
+    {
+        golioth_coap_client_empty(client, false, GOLIOTH_SYS_WAIT_FOREVER);
+    }
+}
+
+#endif /* !CONFIG_GOLIOTH_COAP_GATEWAY */
+
+bool golioth_client_is_running(struct golioth_client *client)
+{
+    if (!client)
+    {
+        return false;
+    }
+    return client->is_running;
+}
+
+// Creates the libcoap context and DTLS session for the client and queues the initial
+// requests of a new session.
+static enum golioth_status session_begin(struct golioth_client *client,
+                                         coap_context_t **coap_context,
+                                         coap_session_t **coap_session)
+{
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+    client->stats_session_start_ms = golioth_sys_now_ms();
+#endif
+
+    GOLIOTH_STATUS_RETURN_IF_ERROR(create_context(client, coap_context));
+    GOLIOTH_STATUS_RETURN_IF_ERROR(create_session(client, *coap_context, coap_session));
+
+    // Seed the session token generator
+    //
+    // We should still do this even though Golioth generates CoAP tokens outside of libcoap.
+    //
+    // There are a couple of cases (using eTag is the most notable) where libcoap uses this to
+    // generate a new token. However, with our current usage of libcoap we don't anticipate any
+    // cases where it generates its own token.
+    //
+    // The two generators both use simple increment after first token. Avoid collision by
+    // getting a token from Golioth, then incrementing it by half its max value.
+    uint8_t *seed_token =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, sizeof(uint8_t) * GOLIOTH_COAP_TOKEN_LEN);
+    if (seed_token)
+    {
+        golioth_coap_next_token(seed_token);
+        seed_token[(GOLIOTH_COAP_TOKEN_LEN / 2) + 1] += 1;
+        coap_session_init_token(*coap_session,
+                                (GOLIOTH_COAP_TOKEN_LEN <= 8) ? GOLIOTH_COAP_TOKEN_LEN : 8,
+                                seed_token);
+        GOLIOTH_HEAP_FREE(seed_token);
+    }
+
+    // Enqueue an asynchronous EMPTY request immediately.
+    //
+    // This is done so we can determine quickly whether we are connected
+    // to the cloud or not (libcoap does not tell us when it's connected
+    // for some reason, so this is a workaround for that).
+    if (golioth_client_num_items_in_request_queue(client) == 0)
+    {
+        golioth_coap_client_empty(client, false, GOLIOTH_SYS_WAIT_FOREVER);
+    }
+
+    // If we are re-connecting and had prior observations, set
+    // them up again now (tokens will be updated).
+    reestablish_observations(client, *coap_session);
+
+    return GOLIOTH_OK;
+}
+
+static void session_end(struct golioth_client *client,
+                        coap_context_t *coap_context,
+                        coap_session_t *coap_session)
+{
+    GLTH_LOGI(TAG, "Ending session");
+
+    golioth_sys_client_disconnected(client);
+    golioth_lightdb_mirror_disconnected(client);
+    if (client->event_callback && client->session_connected)
+    {
+        client->event_callback(client,
+                               GOLIOTH_CLIENT_EVENT_DISCONNECTED,
+                               client->event_callback_arg);
+    }
+    client->session_connected = false;
+
+    if (coap_session)
+    {
+        coap_session_release(coap_session);
+    }
+    if (coap_context)
+    {
+        coap_free_context(coap_context);
+    }
+}
+
+#if !defined(CONFIG_GOLIOTH_COAP_GATEWAY)
+
+// Note: libcoap is not thread safe, so all rx/tx I/O for the session must be
+// done in this thread.
+static void golioth_coap_client_thread(void *arg)
+{
+    struct golioth_client *client = arg;
+    assert(client);
+
+    while (1)
+    {
+        coap_context_t *coap_context = NULL;
+        coap_session_t *coap_session = NULL;
+
+        client->end_session = false;
         client->session_connected = false;
 
-        if (coap_session)
+        client->is_running = false;
+        GLTH_LOGD(TAG, "Waiting for the \"run\" signal");
+        golioth_sys_sem_take(client->run_sem, GOLIOTH_SYS_WAIT_FOREVER);
+        golioth_sys_sem_give(client->run_sem);
+        GLTH_LOGD(TAG, "Received \"run\" signal");
+        client->is_running = true;
+
+        if (session_begin(client, &coap_context, &coap_session) != GOLIOTH_OK)
         {
-            coap_session_release(coap_session);
+            goto cleanup;
         }
-        if (coap_context)
+
+        GLTH_LOGI(TAG, "Entering CoAP I/O loop");
+        int iteration = 0;
+        while (!client->end_session)
         {
-            coap_free_context(coap_context);
+            // Check if we should still run (non-blocking)
+            if (!golioth_sys_sem_take(client->run_sem, 0))
+            {
+                GLTH_LOGI(TAG, "Stopping");
+                break;
+            }
+            golioth_sys_sem_give(client->run_sem);
+
+            if (coap_io_loop_once(client, coap_context, coap_session) != GOLIOTH_OK)
+            {
+                client->end_session = true;
+            }
+            iteration++;
         }
 
+    cleanup:
+        session_end(client, coap_context, coap_session);
+
         // Small delay before starting a new session
         golioth_sys_msleep(1000);
     }
 }
 
+static enum golioth_status client_io_attach(struct golioth_client *client)
+{
+    struct golioth_thread_config thread_cfg = {
+        .name = "coap_client",
+        .fn = golioth_coap_client_thread,
+        .user_arg = client,
+        .stack_size = CONFIG_GOLIOTH_COAP_THREAD_STACK_SIZE,
+        .prio = CONFIG_GOLIOTH_COAP_THREAD_PRIORITY,
+    };
+
+    client->coap_thread_handle = golioth_sys_thread_create(&thread_cfg);
+    if (!client->coap_thread_handle)
+    {
+        GLTH_LOGE(TAG, "Failed to create client thread");
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    struct golioth_timer_config keepalive_timer_cfg = {
+        .name = "keepalive",
+        .expiration_ms = max(1000, 1000 * CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S),
+        .fn = on_keepalive,
+        .user_arg = client};
+
+    client->keepalive_timer = golioth_sys_timer_create(&keepalive_timer_cfg);
+    if (!client->keepalive_timer)
+    {
+        GLTH_LOGE(TAG, "Failed to create keepalive timer");
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    if (CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S > 0)
+    {
+        if (!golioth_sys_timer_start(client->keepalive_timer))
+        {
+            GLTH_LOGE(TAG, "Failed to start keepalive timer");
+            return GOLIOTH_ERR_FAIL;
+        }
+    }
+
+    return GOLIOTH_OK;
+}
+
+static void client_io_detach(struct golioth_client *client)
+{
+    if (client->keepalive_timer)
+    {
+        golioth_sys_timer_destroy(client->keepalive_timer);
+    }
+    if (client->coap_thread_handle)
+    {
+        golioth_sys_thread_destroy(client->coap_thread_handle);
+    }
+}
+
+#else /* CONFIG_GOLIOTH_COAP_GATEWAY */
+
+// Gateway mode
+//
+// Instead of one thread (plus keepalive timer) per client, a small, fixed set of I/O
+// threads is shared by all clients. Each client still owns its libcoap context, DTLS
+// session, credentials, observations and request queue.
+//
+// Every I/O thread runs a non-blocking state machine for each of its clients:
+//
+//   - not running: wait for golioth_client_start()
+//   - no session: (re)connect, rate limited to one attempt per second
+//   - request in flight: process I/O until response, NACK or timeout
+//   - idle: dequeue and send the next request from the client's queue
+//
+// Clients are visited round-robin. At most CONFIG_GOLIOTH_COAP_GATEWAY_MAX_SENDS_PER_TICK
+// new requests are sent per pass, and the next pass starts with the first client that was
+// skipped, so a busy client cannot starve the others. Between passes the thread sleeps in
+// poll() on the libcoap sockets (when libcoap is built with epoll) and on the request queues
+// of idle clients, for at most CONFIG_GOLIOTH_COAP_GATEWAY_POLL_INTERVAL_MS.
+//
+// Clients are stepped without the lock of their I/O thread, so client callbacks may create
+// clients, and destroy other clients; golioth_client_destroy() waits for the step of the client
+// it destroys to finish. Callbacks must not destroy their own client. They run on the shared
+// I/O thread, so a slow callback still delays every client served by that thread.
+
+struct golioth_gateway_worker
+{
+    golioth_sys_thread_t thread;
+    golioth_sys_mutex_t lock;
+    /// Client being stepped by the I/O thread, without the lock
+    struct golioth_client *stepping;
+    /// Given when the step of a client waited for by client_io_detach() is finished
+    golioth_sys_sem_t step_done;
+    bool detach_waiting;
+    struct golioth_client **clients;
+    size_t num_clients;
+    size_t capacity;
+    size_t next_client;
+    uint32_t generation;
+    struct pollfd *pollfds;
+    struct golioth_client **poll_owners;
+    size_t pollfds_capacity;
+};
+
+static struct golioth_gateway_worker _gw_workers[CONFIG_GOLIOTH_COAP_GATEWAY_NUM_IO_THREADS];
+static golioth_sys_mutex_t _gw_workers_lock;
+
+static void gateway_session_end(struct golioth_client *client)
+{
+    if (client->pending_req)
+    {
+        // The I/O thread owns the in-flight request; release any waiting sync caller.
+        client->pending_req = NULL;
+        finish_request(client, client->gw_session, &client->gw_req, true, false);
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, &client->gw_req, GOLIOTH_ERR_IO);
+    }
+
+    session_end(client, client->gw_context, client->gw_session);
+    client->gw_context = NULL;
+    client->gw_session = NULL;
+    client->gw_reconnect_ms = golioth_sys_now_ms() + 1000;
+}
+
+static void gateway_client_step(struct golioth_client *client, uint64_t now, size_t *sends_left)
+{
+    // Check if we should still run (non-blocking)
+    if (!golioth_sys_sem_take(client->run_sem, 0))
+    {
+        if (client->gw_context)
+        {
+            GLTH_LOGI(TAG, "Stopping");
+            gateway_session_end(client);
+        }
+        client->is_running = false;
+        return;
+    }
+    golioth_sys_sem_give(client->run_sem);
+    client->is_running = true;
+
+    if (!client->gw_context)
+    {
+        if (now < client->gw_reconnect_ms)
+        {
+            return;
+        }
+
+        client->session_connected = false;
+        client->gw_last_activity_ms = now;
+        if (session_begin(client, &client->gw_context, &client->gw_session) != GOLIOTH_OK)
+        {
+            gateway_session_end(client);
+            return;
+        }
+        client->gw_io_ready = true;
+    }
+
+    if (client->gw_io_ready || client->pending_req || now >= client->gw_next_io_ms)
+    {
+        client->gw_io_ready = false;
+        client->gw_next_io_ms = now + CONFIG_GOLIOTH_COAP_GATEWAY_POLL_INTERVAL_MS;
+        if (coap_io_process(client->gw_context, COAP_IO_NO_WAIT) < 0)
+        {
+            GLTH_LOGE(TAG, "Error in coap_io_process");
+            gateway_session_end(client);
+            return;
+        }
+    }
+
+    if (client->pending_req)
+    {
+        struct golioth_coap_request_msg *req = client->pending_req;
+        bool timed_out = !req->got_response && !req->got_nack
+                      && (golioth_sys_now_ms() >= client->gw_req_deadline_ms);
+
+        if (!req->got_response && !req->got_nack && !timed_out)
+        {
+            return;
+        }
+
+        if (req->got_nack)
+        {
+            GLTH_LOGE(TAG, "Got NACKed request");
+        }
+
+        client->pending_req = NULL;
+        enum golioth_status status =
+            finish_request(client, client->gw_session, req, false, timed_out);
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, req, status);
+        if (status != GOLIOTH_OK)
+        {
+            gateway_session_end(client);
+            return;
+        }
+    }
+
+    golioth_tx_window_poll(client);
+    golioth_log_batch_poll(client);
+    golioth_lightdb_report_poll(client);
+    golioth_store_forward_poll(client);
+
+    if (golioth_mbox_num_messages(client->request_queue) == 0)
+    {
+        if (CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S > 0 && now > client->gw_last_activity_ms
+            && now - client->gw_last_activity_ms >= CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S * 1000)
+        {
+            client->gw_last_activity_ms = now;
+            if (!golioth_tx_window_defer_keepalive(client))
+            {
+                golioth_coap_client_empty(client, false, GOLIOTH_SYS_WAIT_FOREVER);
+            }
+        }
+        return;
+    }
+
+    if (*sends_left == 0)
+    {
+        return;
+    }
+
+    struct golioth_coap_request_msg *req = &client->gw_req;
+    if (!golioth_mbox_recv(client->request_queue, req, 0))
+    {
+        return;
+    }
+
+    (*sends_left)--;
+    GOLIOTH_STATS_DEQUEUED(client);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DEQUEUE, req, GOLIOTH_OK);
+
+    if (golioth_coap_client_drop_if_aged_out(client, req))
+    {
+        return;
+    }
+
+    if (!send_request(client, client->gw_session, req))
+    {
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, req, GOLIOTH_ERR_FAIL);
+        return;
+    }
+
+    req->got_response = false;
+    client->gw_req_deadline_ms = golioth_sys_now_ms() + response_timeout_ms(req);
+    client->pending_req = req;
+}
+
+static bool gateway_reserve_pollfds(struct golioth_gateway_worker *worker, size_t count)
+{
+    if (count <= worker->pollfds_capacity)
+    {
+        return true;
+    }
+
+    struct pollfd *pollfds = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, count * sizeof(*pollfds));
+    struct golioth_client **owners =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, count * sizeof(*owners));
+    if (!pollfds || !owners)
+    {
+        GOLIOTH_HEAP_FREE(pollfds);
+        GOLIOTH_HEAP_FREE(owners);
+        return false;
+    }
+
+    GOLIOTH_HEAP_FREE(worker->pollfds);
+    GOLIOTH_HEAP_FREE(worker->poll_owners);
+    worker->pollfds = pollfds;
+    worker->poll_owners = owners;
+    worker->pollfds_capacity = count;
+
+    return true;
+}
+
+static void gateway_worker_thread(void *arg)
+{
+    struct golioth_gateway_worker *worker = arg;
+
+    while (1)
+    {
+        size_t nfds = 0;
+        uint32_t generation;
+
+        golioth_sys_mutex_lock(worker->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+        size_t num_clients = worker->num_clients;
+        size_t start = num_clients > 0 ? worker->next_client % num_clients : 0;
+        size_t sends_left = CONFIG_GOLIOTH_COAP_GATEWAY_MAX_SENDS_PER_TICK;
+        uint64_t now = golioth_sys_now_ms();
+        bool budget_exhausted = false;
+
+        generation = worker->generation;
+
+        // Clients are stepped without the lock, since their callbacks may add or remove clients.
+        // The pass ends early when they do.
+        for (size_t i = 0; i < num_clients && generation == worker->generation; i++)
+        {
+            size_t idx = (start + i) % num_clients;
+            struct golioth_client *client = worker->clients[idx];
+
+            worker->stepping = client;
+            golioth_sys_mutex_unlock(worker->lock);
+
+            gateway_client_step(client, now, &sends_left);
+
+            golioth_sys_mutex_lock(worker->lock, GOLIOTH_SYS_WAIT_FOREVER);
+            worker->stepping = NULL;
+            if (worker->detach_waiting)
+            {
+                worker->detach_waiting = false;
+                golioth_sys_sem_give(worker->step_done);
+            }
+
+            if (sends_left == 0 && !budget_exhausted)
+            {
+                // Resume with the next client on the following pass
+                budget_exhausted = true;
+                worker->next_client = (idx + 1) % num_clients;
+            }
+        }
+
+        if (!budget_exhausted && num_clients > 0)
+        {
+            worker->next_client = (start + 1) % num_clients;
+        }
+
+        num_clients = worker->num_clients;
+
+        if (gateway_reserve_pollfds(worker, 2 * num_clients))
+        {
+            for (size_t i = 0; i < num_clients; i++)
+            {
+                struct golioth_client *client = worker->clients[i];
+
+                if (!client->gw_context)
+                {
+                    continue;
+                }
+
+                int coap_fd = coap_context_get_coap_fd(client->gw_context);
+                if (coap_fd >= 0)
+                {
+                    worker->pollfds[nfds] = (struct pollfd){.fd = coap_fd, .events = POLLIN};
+                    worker->poll_owners[nfds++] = client;
+                }
+
+                // Only wake up for queued requests when they can be sent
+                if (!client->pending_req)
+                {
+                    int mbox_fd = golioth_sys_sem_get_fd(client->request_queue->fill_count_sem);
+                    if (mbox_fd >= 0)
+                    {
+                        worker->pollfds[nfds] = (struct pollfd){.fd = mbox_fd, .events = POLLIN};
+                        worker->poll_owners[nfds++] = client;
+                    }
+                }
+            }
+        }
+        generation = worker->generation;
+
+        golioth_sys_mutex_unlock(worker->lock);
+
+        int ret = poll(worker->pollfds, nfds, CONFIG_GOLIOTH_COAP_GATEWAY_POLL_INTERVAL_MS);
+
+        if (ret <= 0)
+        {
+            continue;
+        }
+
+        golioth_sys_mutex_lock(worker->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+        // Client pointers are only valid if no client was added or removed meanwhile
+        if (generation == worker->generation)
+        {
+            for (size_t i = 0; i < nfds; i++)
+            {
+                if (worker->pollfds[i].revents)
+                {
+                    worker->poll_owners[i]->gw_io_ready = true;
+                }
+            }
+        }
+
+        golioth_sys_mutex_unlock(worker->lock);
+    }
+}
+
+static enum golioth_status client_io_attach(struct golioth_client *client)
+{
+    if (!_gw_workers_lock)
+    {
+        _gw_workers_lock = golioth_sys_mutex_create();
+        if (!_gw_workers_lock)
+        {
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+    }
+
+    golioth_sys_mutex_lock(_gw_workers_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    // Assign the client to the least loaded I/O thread
+    struct golioth_gateway_worker *worker = &_gw_workers[0];
+    for (size_t i = 1; i < ARRAY_SIZE(_gw_workers); i++)
+    {
+        if (_gw_workers[i].num_clients < worker->num_clients)
+        {
+            worker = &_gw_workers[i];
+        }
+    }
+
+    enum golioth_status status = GOLIOTH_OK;
+
+    if (!worker->lock)
+    {
+        worker->lock = golioth_sys_mutex_create();
+        if (!worker->lock)
+        {
+            status = GOLIOTH_ERR_MEM_ALLOC;
+            goto finish;
+        }
+    }
+
+    if (!worker->step_done)
+    {
+        worker->step_done = golioth_sys_sem_create(1, 0);
+        if (!worker->step_done)
+        {
+            status = GOLIOTH_ERR_MEM_ALLOC;
+            goto finish;
+        }
+    }
+
+    if (!worker->thread)
+    {
+        struct golioth_thread_config thread_cfg = {
+            .name = "coap_gateway",
+            .fn = gateway_worker_thread,
+            .user_arg = worker,
+            .stack_size = CONFIG_GOLIOTH_COAP_THREAD_STACK_SIZE,
+            .prio = CONFIG_GOLIOTH_COAP_THREAD_PRIORITY,
+        };
+
+        worker->thread = golioth_sys_thread_create(&thread_cfg);
+        if (!worker->thread)
+        {
+            GLTH_LOGE(TAG, "Failed to create gateway I/O thread");
+            status = GOLIOTH_ERR_MEM_ALLOC;
+            goto finish;
+        }
+    }
+
+    golioth_sys_mutex_lock(worker->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (worker->num_clients == worker->capacity)
+    {
+        size_t capacity = worker->capacity ? 2 * worker->capacity : 16;
+        struct golioth_client **clients =
+            GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, capacity * sizeof(*clients));
+        if (!clients)
+        {
+            golioth_sys_mutex_unlock(worker->lock);
+            status = GOLIOTH_ERR_MEM_ALLOC;
+            goto finish;
+        }
+        if (worker->clients)
+        {
+            memcpy(clients, worker->clients, worker->num_clients * sizeof(*clients));
+            GOLIOTH_HEAP_FREE(worker->clients);
+        }
+        worker->clients = clients;
+        worker->capacity = capacity;
+    }
+
+    worker->clients[worker->num_clients++] = client;
+    worker->generation++;
+    client->gw_worker = worker;
+    client->coap_thread_handle = worker->thread;
+
+    golioth_sys_mutex_unlock(worker->lock);
+
+finish:
+    golioth_sys_mutex_unlock(_gw_workers_lock);
+    return status;
+}
+
+static void client_io_detach(struct golioth_client *client)
+{
+    struct golioth_gateway_worker *worker = client->gw_worker;
+    if (!worker)
+    {
+        return;
+    }
+
+    // _gw_workers_lock is not taken, since the step waited for below may create a client
+    golioth_sys_mutex_lock(worker->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    for (size_t i = 0; i < worker->num_clients; i++)
+    {
+        if (worker->clients[i] == client)
+        {
+            worker->clients[i] = worker->clients[--worker->num_clients];
+            worker->generation++;
+            break;
+        }
+    }
+
+    // Removed clients are not stepped anymore, but the current step may still use it
+    while (worker->stepping == client)
+    {
+        worker->detach_waiting = true;
+        golioth_sys_mutex_unlock(worker->lock);
+        golioth_sys_sem_take(worker->step_done, GOLIOTH_SYS_WAIT_FOREVER);
+        golioth_sys_mutex_lock(worker->lock, GOLIOTH_SYS_WAIT_FOREVER);
+    }
+
+    golioth_sys_mutex_unlock(worker->lock);
+
+    // Only this thread uses the client now; a pending synchronous request is released without
+    // holding the lock
+    if (client->gw_context)
+    {
+        gateway_session_end(client);
+    }
+
+    // The I/O thread is shared, it must not be destroyed with the client
+    client->gw_worker = NULL;
+    client->coap_thread_handle = NULL;
+}
+
+#endif /* CONFIG_GOLIOTH_COAP_GATEWAY */
+
 struct golioth_client *golioth_client_create(const struct golioth_client_config *config)
 {
     if (!_initialized)
@@ -1308,7 +1930,8 @@ struct golioth_client *golioth_client_create(const struct golioth_client_config
         _initialized = true;
     }
 
-    struct golioth_client *new_client = golioth_sys_malloc(sizeof(struct golioth_client));
+    struct golioth_client *new_client =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, sizeof(struct golioth_client));
     if (!new_client)
     {
         GLTH_LOGE(TAG, "Failed to allocate memory for client");
@@ -1328,49 +1951,47 @@ struct golioth_client *golioth_client_create(const struct golioth_client_config
 
     golioth_coap_token_mutex_create();
 
+#if defined(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_EDF)
+    // Earliest deadline first
+    new_client->request_queue =
+        golioth_mbox_create_ordered(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS,
+                                    sizeof(struct golioth_coap_request_msg),
+                                    offsetof(struct golioth_coap_request_msg, ageout_ms));
+#else
     new_client->request_queue = golioth_mbox_create(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS,
                                                     sizeof(struct golioth_coap_request_msg));
+#endif
     if (!new_client->request_queue)
     {
         GLTH_LOGE(TAG, "Failed to create request queue");
         goto error;
     }
 
-    struct golioth_thread_config thread_cfg = {
-        .name = "coap_client",
-        .fn = golioth_coap_client_thread,
-        .user_arg = new_client,
-        .stack_size = CONFIG_GOLIOTH_COAP_THREAD_STACK_SIZE,
-        .prio = CONFIG_GOLIOTH_COAP_THREAD_PRIORITY,
-    };
-
-    new_client->coap_thread_handle = golioth_sys_thread_create(&thread_cfg);
-    if (!new_client->coap_thread_handle)
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+    if (golioth_log_batch_init(new_client, &new_client->log_batch) != GOLIOTH_OK)
     {
-        GLTH_LOGE(TAG, "Failed to create client thread");
+        GLTH_LOGE(TAG, "Failed to create log batch");
         goto error;
     }
+#endif
 
-    struct golioth_timer_config keepalive_timer_cfg = {
-        .name = "keepalive",
-        .expiration_ms = max(1000, 1000 * CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S),
-        .fn = on_keepalive,
-        .user_arg = new_client};
-
-    new_client->keepalive_timer = golioth_sys_timer_create(&keepalive_timer_cfg);
-    if (!new_client->keepalive_timer)
+#if defined(CONFIG_GOLIOTH_TX_WINDOW)
+    if (golioth_tx_window_init(new_client, &new_client->tx_window) != GOLIOTH_OK)
     {
-        GLTH_LOGE(TAG, "Failed to create keepalive timer");
+        GLTH_LOGE(TAG, "Failed to create transmission windows");
         goto error;
     }
+#endif
 
-    if (CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S > 0)
+    if (golioth_store_forward_init(new_client) != GOLIOTH_OK)
     {
-        if (!golioth_sys_timer_start(new_client->keepalive_timer))
-        {
-            GLTH_LOGE(TAG, "Failed to start keepalive timer");
-            goto error;
-        }
+        // Not fatal: requests are then sent as without store-and-forward
+        GLTH_LOGW(TAG, "Store-and-forward disabled");
+    }
+
+    if (client_io_attach(new_client) != GOLIOTH_OK)
+    {
+        goto error;
     }
 
     new_client->is_running = true;
@@ -1399,12 +2020,12 @@ static void purge_request_mbox(golioth_mbox_t request_mbox)
         if (request_msg.type == GOLIOTH_COAP_REQUEST_POST)
         {
             // free dynamically allocated user payload copy
-            golioth_sys_free(request_msg.post.payload);
+            GOLIOTH_HEAP_FREE(request_msg.post.payload);
         }
         else if (request_msg.type == GOLIOTH_COAP_REQUEST_POST_BLOCK)
         {
             // free dynamically allocated user payload copy
-            golioth_sys_free(request_msg.post_block.payload);
+            GOLIOTH_HEAP_FREE(request_msg.post_block.payload);
         }
     }
 }
@@ -1419,14 +2040,14 @@ void golioth_client_destroy(struct golioth_client *client)
     {
         golioth_client_stop(client);
     }
-    if (client->keepalive_timer)
-    {
-        golioth_sys_timer_destroy(client->keepalive_timer);
-    }
-    if (client->coap_thread_handle)
-    {
-        golioth_sys_thread_destroy(client->coap_thread_handle);
-    }
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+    golioth_log_batch_deinit(&client->log_batch);
+#endif
+#if defined(CONFIG_GOLIOTH_TX_WINDOW)
+    golioth_tx_window_deinit(&client->tx_window);
+#endif
+    golioth_store_forward_deinit(client);
+    client_io_detach(client);
     if (client->request_queue)
     {
         purge_request_mbox(client->request_queue);
@@ -1436,7 +2057,11 @@ void golioth_client_destroy(struct golioth_client *client)
     {
         golioth_sys_sem_destroy(client->run_sem);
     }
-    golioth_sys_free(client);
+    GOLIOTH_HEAP_FREE(client);
+
+#if CONFIG_GOLIOTH_HEAP_STATS_REPORT
+    golioth_heap_log_stats();
+#endif
 }
 
 enum golioth_status golioth_client_start(struct golioth_client *client)
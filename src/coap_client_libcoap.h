@@ -2,6 +2,16 @@
 
 #include "coap_client.h"
 #include "mbox.h"
+#include "log_batch.h"
+#include "tx_window.h"
+#include "lightdb_mirror.h"
+#include "lightdb_report.h"
+
+#if defined(CONFIG_GOLIOTH_COAP_GATEWAY)
+#include <coap3/coap.h>
+
+struct golioth_gateway_worker;
+#endif
 
 struct golioth_client
 {
@@ -17,6 +27,38 @@ struct golioth_client
     struct golioth_coap_observe_info observations[CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS];
     golioth_client_event_cb_fn event_callback;
     void *event_callback_arg;
+    golioth_client_queue_watermark_cb_fn queue_watermark_callback;
+    void *queue_watermark_callback_arg;
+    int32_t enqueue_timeout_ms;
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+    struct golioth_log_batch log_batch;
+#endif
+#if defined(CONFIG_GOLIOTH_TX_WINDOW)
+    struct golioth_tx_window tx_window;
+#endif
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR)
+    struct golioth_lightdb_mirror lightdb_mirror;
+#endif
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT)
+    struct golioth_lightdb_report *lightdb_reports_due;
+#endif
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+    struct golioth_client_stats stats;
+    uint64_t stats_session_start_ms;
+    uint64_t stats_last_tx_ms;
+#endif
+#if defined(CONFIG_GOLIOTH_COAP_GATEWAY)
+    /* Session state, owned by the shared gateway I/O thread */
+    struct golioth_gateway_worker *gw_worker;
+    coap_context_t *gw_context;
+    coap_session_t *gw_session;
+    struct golioth_coap_request_msg gw_req;
+    uint64_t gw_req_deadline_ms;
+    uint64_t gw_reconnect_ms;
+    uint64_t gw_last_activity_ms;
+    uint64_t gw_next_io_ms;
+    bool gw_io_ready;
+#endif
 };
 
 void golioth_cancel_all_observations_by_prefix(struct golioth_client *client, const char *prefix);
@@ -11,6 +11,10 @@
 #include "mbox.h"
 
 #include "coap_client_zephyr.h"
+#include "client_stats.h"
+#include "client_trace.h"
+#include "heap_accounting.h"
+#include "store_forward.h"
 #include "pathv.h"
 #include "zephyr_coap_req.h"
 #include "zephyr_coap_utils.h"
@@ -226,6 +230,30 @@ static int golioth_coap_cb(struct golioth_req_rsp *rsp)
     struct golioth_coap_request_msg *req = rsp->user_data;
     struct golioth_client *client = req->client;
 
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+    if (rsp->status == GOLIOTH_ERR_TIMEOUT)
+    {
+        GOLIOTH_STATS_TIMEOUT(client, req);
+    }
+    else if (rsp->status == GOLIOTH_OK || rsp->status == GOLIOTH_ERR_COAP_RESPONSE)
+    {
+        GOLIOTH_STATS_ADD(client, bytes_received, rsp->len);
+        GOLIOTH_STATS_RESPONSE(client, req);
+    }
+#endif
+
+#if defined(CONFIG_GOLIOTH_TRACE)
+    if (req->type != GOLIOTH_COAP_REQUEST_OBSERVE)
+    {
+        GOLIOTH_TRACE_REQUEST(client,
+                              (rsp->status == GOLIOTH_ERR_TIMEOUT) ? GOLIOTH_TRACE_TIMEOUT
+                                                                   : GOLIOTH_TRACE_RESPONSE,
+                              req,
+                              rsp->status);
+    }
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_BEGIN, req, rsp->status);
+#endif
+
     switch (req->type)
     {
         case GOLIOTH_COAP_REQUEST_EMPTY:
@@ -314,6 +342,8 @@ static int golioth_coap_cb(struct golioth_req_rsp *rsp)
             break;
     }
 
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_CALLBACK_END, req, rsp->status);
+
     if (CONFIG_GOLIOTH_COAP_KEEPALIVE_INTERVAL_S > 0)
     {
         if (!golioth_sys_timer_reset(client->keepalive_timer))
@@ -348,8 +378,10 @@ static int golioth_coap_cb(struct golioth_req_rsp *rsp)
 
     if (req->type != GOLIOTH_COAP_REQUEST_OBSERVE)
     {
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, req, rsp->status);
+
         /* don't free observations so we can reestablish later */
-        free(req);
+        GOLIOTH_HEAP_FREE(req);
     }
 
     return rsp->status;
@@ -646,12 +678,18 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client)
     struct golioth_coap_request_msg *req;
     int err = 0;
 
-    req = calloc(1, sizeof(*req));
+    req = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, sizeof(*req));
     if (!req)
     {
         err = -ENOMEM;
         goto free_req;
     }
+    memset(req, 0, sizeof(*req));
+
+    golioth_tx_window_poll(client);
+    golioth_log_batch_poll(client);
+    golioth_lightdb_report_poll(client);
+    golioth_store_forward_poll(client);
 
     // Wait for request message, with timeout
     bool got_request_msg =
@@ -662,40 +700,28 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client)
         goto free_req;
     }
 
+    GOLIOTH_STATS_DEQUEUED(client);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DEQUEUE, req, GOLIOTH_OK);
+
     // Make sure the request isn't too old
-    if (golioth_sys_now_ms() > req->ageout_ms)
+    if (golioth_coap_client_drop_if_aged_out(client, req))
     {
-        LOG_WRN("Ignoring request that has aged out, type %d, path %s",
-                req->type,
-                (req->path ? req->path : "N/A"));
-
-        if (req->type == GOLIOTH_COAP_REQUEST_POST && req->post.payload_size > 0)
-        {
-            golioth_sys_free(req->post.payload);
-        }
-
-        if (req->type == GOLIOTH_COAP_REQUEST_POST_BLOCK && req->post_block.payload_size > 0)
-        {
-            golioth_sys_free(req->post_block.payload);
-        }
-
-        if (req->request_complete_event)
-        {
-            golioth_event_group_destroy(req->request_complete_event);
-            golioth_sys_sem_destroy(req->request_complete_ack_sem);
-        }
-
         goto free_req;
     }
 
     req->client = client;
 
+    // Before the switch, which frees POST payloads
+    GOLIOTH_STATS_REQUEST_SENT(client, req);
+    GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_SEND, req, GOLIOTH_OK);
+
     // Handle message and send request to server
     switch (req->type)
     {
         case GOLIOTH_COAP_REQUEST_EMPTY:
             LOG_DBG("Handle EMPTY");
             err = golioth_send_coap_empty(req->client);
+            GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, req, golioth_err_to_status(err));
             goto free_req;
         case GOLIOTH_COAP_REQUEST_GET:
             LOG_DBG("Handle GET %s", req->path);
@@ -726,12 +752,12 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client)
                                       golioth_coap_cb,
                                       req,
                                       0);
-            golioth_sys_free(req->post.payload);
+            GOLIOTH_HEAP_FREE(req->post.payload);
             break;
         case GOLIOTH_COAP_REQUEST_POST_BLOCK:
             LOG_DBG("Handle POST_BLOCK %s", req->path);
             err = golioth_coap_post_block(req);
-            golioth_sys_free(req->post_block.payload);
+            GOLIOTH_HEAP_FREE(req->post_block.payload);
             break;
         case GOLIOTH_COAP_REQUEST_DELETE:
             LOG_DBG("Handle DELETE %s", req->path);
@@ -753,8 +779,11 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client)
             {
                 /* Observations are full, free the req but don't treat as a coap error */
                 err = GOLIOTH_OK;
+                GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, req, GOLIOTH_ERR_QUEUE_FULL);
                 goto free_req;
             }
+            /* Notifications are traced as callbacks of the observation */
+            GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, req, golioth_err_to_status(err));
             /* Need to free local req message; observations use client slots for req messages */
             goto free_req;
             break;
@@ -765,18 +794,20 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client)
         default:
             LOG_WRN("Unknown request_msg type: %u", req->type);
             err = -EINVAL;
+            GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, req, GOLIOTH_ERR_FAIL);
             goto free_req;
     }
 
     if (err)
     {
+        GOLIOTH_TRACE_REQUEST(client, GOLIOTH_TRACE_DONE, req, golioth_err_to_status(err));
         goto free_req;
     }
 
     return GOLIOTH_OK;
 
 free_req:
-    free(req);
+    GOLIOTH_HEAP_FREE(req);
 
     return golioth_err_to_status(err);
 }
@@ -784,7 +815,8 @@ free_req:
 static void on_keepalive(golioth_sys_timer_t timer, void *arg)
 {
     struct golioth_client *client = arg;
-    if (client->is_running && golioth_client_num_items_in_request_queue(client) == 0)
+    if (client->is_running && golioth_client_num_items_in_request_queue(client) == 0
+        && !golioth_tx_window_defer_keepalive(client))
     {
         golioth_coap_client_empty(client, false, GOLIOTH_SYS_WAIT_FOREVER);
     }
@@ -1227,6 +1259,10 @@ static void golioth_coap_client_thread(void *arg)
         /* Flush pending events */
         (void) eventfd_read(fds[POLLFD_EVENT].fd, &eventfd_value);
 
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+        uint64_t connect_start_ms = golioth_sys_now_ms();
+#endif
+
         err = golioth_connect(client);
         if (err)
         {
@@ -1236,6 +1272,7 @@ static void golioth_coap_client_thread(void *arg)
         }
 
         LOG_INF("Golioth CoAP client connected");
+        GOLIOTH_STATS_HANDSHAKE(client, golioth_sys_now_ms() - connect_start_ms);
         client->session_connected = true;
 
         golioth_sys_client_connected(client);
@@ -1245,6 +1282,7 @@ static void golioth_coap_client_thread(void *arg)
                                    GOLIOTH_CLIENT_EVENT_CONNECTED,
                                    client->event_callback_arg);
         }
+        golioth_store_forward_connected(client);
 
         recv_expiry = k_uptime_get() + RECV_TIMEOUT;
 
@@ -1347,6 +1385,7 @@ static void golioth_coap_client_thread(void *arg)
         LOG_INF("Ending session");
 
         golioth_sys_client_disconnected(client);
+        golioth_lightdb_mirror_disconnected(client);
         if (client->event_callback && client->session_connected)
         {
             client->event_callback(client,
@@ -1473,7 +1512,8 @@ struct golioth_client *golioth_client_create(const struct golioth_client_config
         _initialized = true;
     }
 
-    struct golioth_client *new_client = golioth_sys_malloc(sizeof(struct golioth_client));
+    struct golioth_client *new_client =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, sizeof(struct golioth_client));
     if (!new_client)
     {
         LOG_ERR("Failed to allocate memory for client");
@@ -1508,14 +1548,44 @@ struct golioth_client *golioth_client_create(const struct golioth_client_config
 
     golioth_coap_token_mutex_create();
 
+#if defined(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_EDF)
+    // Earliest deadline first
+    new_client->request_queue =
+        golioth_mbox_create_ordered(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS,
+                                    sizeof(struct golioth_coap_request_msg),
+                                    offsetof(struct golioth_coap_request_msg, ageout_ms));
+#else
     new_client->request_queue = golioth_mbox_create(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS,
                                                     sizeof(struct golioth_coap_request_msg));
+#endif
     if (!new_client->request_queue)
     {
         LOG_ERR("Failed to create request queue");
         goto error;
     }
 
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+    if (golioth_log_batch_init(new_client, &new_client->log_batch) != GOLIOTH_OK)
+    {
+        LOG_ERR("Failed to create log batch");
+        goto error;
+    }
+#endif
+
+#if defined(CONFIG_GOLIOTH_TX_WINDOW)
+    if (golioth_tx_window_init(new_client, &new_client->tx_window) != GOLIOTH_OK)
+    {
+        LOG_ERR("Failed to create transmission windows");
+        goto error;
+    }
+#endif
+
+    if (golioth_store_forward_init(new_client) != GOLIOTH_OK)
+    {
+        // Not fatal: requests are then sent as without store-and-forward
+        GLTH_LOGW(TAG, "Store-and-forward disabled");
+    }
+
     struct golioth_thread_config thread_cfg = {
         .name = "coap_client",
         .fn = golioth_coap_client_thread,
@@ -1579,12 +1649,12 @@ static void purge_request_mbox(golioth_mbox_t request_mbox)
         if (request_msg.type == GOLIOTH_COAP_REQUEST_POST)
         {
             // free dynamically allocated user payload copy
-            golioth_sys_free(request_msg.post.payload);
+            GOLIOTH_HEAP_FREE(request_msg.post.payload);
         }
         else if (request_msg.type == GOLIOTH_COAP_REQUEST_POST_BLOCK)
         {
             // free dynamically allocated user payload copy
-            golioth_sys_free(request_msg.post_block.payload);
+            GOLIOTH_HEAP_FREE(request_msg.post_block.payload);
         }
     }
 }
@@ -1609,6 +1679,13 @@ void golioth_client_destroy(struct golioth_client *client)
     {
         golioth_client_stop(client);
     }
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+    golioth_log_batch_deinit(&client->log_batch);
+#endif
+#if defined(CONFIG_GOLIOTH_TX_WINDOW)
+    golioth_tx_window_deinit(&client->tx_window);
+#endif
+    golioth_store_forward_deinit(client);
     if (client->keepalive_timer)
     {
         golioth_sys_timer_destroy(client->keepalive_timer);
@@ -1622,7 +1699,11 @@ void golioth_client_destroy(struct golioth_client *client)
         purge_request_mbox(client->request_queue);
         golioth_mbox_destroy(client->request_queue);
     }
-    golioth_sys_free(client);
+    GOLIOTH_HEAP_FREE(client);
+
+#if CONFIG_GOLIOTH_HEAP_STATS_REPORT
+    golioth_heap_log_stats();
+#endif
 }
 
 enum golioth_status golioth_client_start(struct golioth_client *client)
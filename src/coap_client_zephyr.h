@@ -8,6 +8,10 @@
 #include "coap_client.h"
 #include <golioth/client.h>
 #include "mbox.h"
+#include "log_batch.h"
+#include "tx_window.h"
+#include "lightdb_mirror.h"
+#include "lightdb_report.h"
 #include <golioth/golioth_sys.h>
 
 #include <stddef.h>
@@ -97,6 +101,26 @@ struct golioth_client
 
     golioth_client_event_cb_fn event_callback;
     void *event_callback_arg;
+    golioth_client_queue_watermark_cb_fn queue_watermark_callback;
+    void *queue_watermark_callback_arg;
+    int32_t enqueue_timeout_ms;
+
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+    struct golioth_log_batch log_batch;
+#endif
+#if defined(CONFIG_GOLIOTH_TX_WINDOW)
+    struct golioth_tx_window tx_window;
+#endif
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR)
+    struct golioth_lightdb_mirror lightdb_mirror;
+#endif
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT)
+    struct golioth_lightdb_report *lightdb_reports_due;
+#endif
+#if defined(CONFIG_GOLIOTH_CLIENT_STATS)
+    struct golioth_client_stats stats;
+    uint64_t stats_last_tx_ms;
+#endif
 };
 
 int golioth_send_coap(struct golioth_client *client, struct coap_packet *packet);
@@ -4,13 +4,15 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include "event_group.h"
+#include "heap_accounting.h"
 #include <golioth/golioth_sys.h>
 #include <string.h>  // memset
 
 golioth_event_group_t golioth_event_group_create(void)
 {
     golioth_event_group_t eg =
-        (golioth_event_group_t) golioth_sys_malloc(sizeof(struct golioth_event_group));
+        (golioth_event_group_t) GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT,
+                                                    sizeof(struct golioth_event_group));
     if (!eg)
     {
         return NULL;
@@ -37,7 +39,7 @@ cleanup_eg_with_mutex:
     golioth_sys_sem_destroy(eg->bitmap_mutex);
 
 cleanup_eg:
-    golioth_sys_free(eg);
+    GOLIOTH_HEAP_FREE(eg);
     return NULL;
 }
 
@@ -98,5 +100,5 @@ void golioth_event_group_destroy(golioth_event_group_t eg)
     }
     golioth_sys_sem_destroy(eg->bitmap_mutex);
     golioth_sys_sem_destroy(eg->sem);
-    golioth_sys_free(eg);
+    GOLIOTH_HEAP_FREE(eg);
 }
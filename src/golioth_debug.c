@@ -4,15 +4,329 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
 #include <golioth/log.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include "golioth_util.h"
+#include "heap_accounting.h"
+#include "log_dict.h"
 
 static enum golioth_debug_log_level _level = CONFIG_GOLIOTH_DEBUG_DEFAULT_LOG_LEVEL;
 static struct golioth_client *_client = NULL;
 static bool _cloud_log_enabled = CONFIG_GOLIOTH_AUTO_LOG_TO_CLOUD;
 
+// Set while a message is being sent to Golioth, to avoid re-entering golioth_debug_printf()
+// from GLTH_LOGX statements in the log path
+static bool _log_in_progress = false;
+
+/// Summary of messages suppressed by the rate limit
+struct rate_limit_summary
+{
+    enum golioth_debug_log_level level;
+    const char *tag;
+    const char *format;
+    uint32_t count;
+    uint64_t duration_ms;
+};
+
+#if defined(CONFIG_GOLIOTH_LOG_RATE_LIMIT)
+
+// Cloud log rate limiting
+//
+// Every message needs a token from the token bucket of its tag and from the one of its
+// callsite, identified by the format string. Messages from a callsite that are identical to
+// the previous one sent from there, within CONFIG_GOLIOTH_LOG_RATE_LIMIT_REPEAT_WINDOW_MS, are
+// collapsed. Both are counted per callsite and reported as one summary message, sent before the
+// next message that gets through from that callsite, or with any message once the oldest
+// suppressed message is older than the repeat window.
+//
+// Tags and callsites are tracked in small direct-mapped tables. When two share a slot, the
+// newer one takes it over, with a full bucket and without a pending summary.
+
+struct rate_limit_bucket
+{
+    const void *key;
+    /// Tokens, in thousandths
+    uint32_t tokens_milli;
+    uint64_t refill_ms;
+};
+
+struct rate_limit_callsite
+{
+    /// Key is the format string
+    struct rate_limit_bucket bucket;
+    const char *tag;
+    enum golioth_debug_log_level level;
+    /// Hash of the last message sent from this callsite (text messages only)
+    uint32_t last_hash;
+    uint64_t last_sent_ms;
+    bool has_sent;
+    /// Messages suppressed since the last summary
+    uint32_t suppressed;
+    uint64_t first_suppressed_ms;
+    bool summary_due;
+};
+
+static golioth_sys_mutex_t _rate_limit_lock;
+static struct rate_limit_bucket _tag_buckets[CONFIG_GOLIOTH_LOG_RATE_LIMIT_NUM_SLOTS];
+static struct rate_limit_callsite _callsites[CONFIG_GOLIOTH_LOG_RATE_LIMIT_NUM_SLOTS];
+static struct golioth_debug_log_stats _log_stats;
+
+static size_t rate_limit_slot(const void *key)
+{
+    // Multiplicative hash, the low bits of pointers to strings carry little information
+    return (uint32_t) (((uintptr_t) key >> 2) * 2654435761u)
+        % CONFIG_GOLIOTH_LOG_RATE_LIMIT_NUM_SLOTS;
+}
+
+/// Refill \p bucket, claiming it for \p key first if another key uses it
+static void rate_limit_refill(struct rate_limit_bucket *bucket,
+                              const void *key,
+                              uint32_t rate,
+                              uint32_t burst,
+                              uint64_t now_ms)
+{
+    if (bucket->key != key)
+    {
+        bucket->key = key;
+        bucket->tokens_milli = burst * 1000;
+        bucket->refill_ms = now_ms;
+        return;
+    }
+
+    // A token per 1000 / rate ms, i.e. rate thousandths of a token per ms
+    uint64_t tokens_milli = bucket->tokens_milli + (now_ms - bucket->refill_ms) * rate;
+    bucket->tokens_milli = (tokens_milli < burst * 1000) ? tokens_milli : burst * 1000;
+    bucket->refill_ms = now_ms;
+}
+
+static struct rate_limit_callsite *rate_limit_callsite(const char *format)
+{
+    return &_callsites[rate_limit_slot(format)];
+}
+
+static void rate_limit_suppress(struct rate_limit_callsite *callsite,
+                                enum golioth_debug_log_level level,
+                                uint64_t now_ms)
+{
+    if (callsite->suppressed++ == 0)
+    {
+        callsite->first_suppressed_ms = now_ms;
+    }
+    callsite->level = level;
+}
+
+/// Take a token for a message, before formatting it
+static bool rate_limit_check(enum golioth_debug_log_level level,
+                             const char *tag,
+                             const char *format,
+                             uint64_t now_ms)
+{
+    if (!_rate_limit_lock)
+    {
+        return true;
+    }
+
+    golioth_sys_mutex_lock(_rate_limit_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    struct rate_limit_bucket *tag_bucket = &_tag_buckets[rate_limit_slot(tag)];
+    struct rate_limit_callsite *callsite = rate_limit_callsite(format);
+
+    if (callsite->bucket.key != format)
+    {
+        *callsite = (struct rate_limit_callsite){0};
+        callsite->tag = tag;
+    }
+
+    rate_limit_refill(tag_bucket,
+                      tag,
+                      CONFIG_GOLIOTH_LOG_RATE_LIMIT_TAG_RATE,
+                      CONFIG_GOLIOTH_LOG_RATE_LIMIT_TAG_BURST,
+                      now_ms);
+    rate_limit_refill(&callsite->bucket,
+                      format,
+                      CONFIG_GOLIOTH_LOG_RATE_LIMIT_CALLSITE_RATE,
+                      CONFIG_GOLIOTH_LOG_RATE_LIMIT_CALLSITE_BURST,
+                      now_ms);
+
+    bool allowed = tag_bucket->tokens_milli >= 1000 && callsite->bucket.tokens_milli >= 1000;
+    if (allowed)
+    {
+        tag_bucket->tokens_milli -= 1000;
+        callsite->bucket.tokens_milli -= 1000;
+    }
+    else
+    {
+        rate_limit_suppress(callsite, level, now_ms);
+        _log_stats.rate_limited++;
+    }
+
+    golioth_sys_mutex_unlock(_rate_limit_lock);
+
+    return allowed;
+}
+
+/// Check whether a message that got a token repeats the previous one from its callsite.
+/// \p hash is NULL when the message is not formatted, then nothing is collapsed.
+static bool rate_limit_is_repeat(enum golioth_debug_log_level level,
+                                 const char *format,
+                                 const uint32_t *hash,
+                                 uint64_t now_ms)
+{
+    if (!_rate_limit_lock)
+    {
+        return false;
+    }
+
+    golioth_sys_mutex_lock(_rate_limit_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    struct rate_limit_callsite *callsite = rate_limit_callsite(format);
+    bool repeat = false;
+
+    if (callsite->bucket.key == format)
+    {
+        repeat = hash && callsite->has_sent && *hash == callsite->last_hash
+            && now_ms - callsite->last_sent_ms < CONFIG_GOLIOTH_LOG_RATE_LIMIT_REPEAT_WINDOW_MS;
+
+        if (repeat)
+        {
+            rate_limit_suppress(callsite, level, now_ms);
+            _log_stats.repeated++;
+        }
+        else
+        {
+            callsite->last_hash = hash ? *hash : 0;
+            callsite->last_sent_ms = now_ms;
+            callsite->has_sent = true;
+            callsite->summary_due = callsite->suppressed > 0;
+            _log_stats.sent++;
+        }
+    }
+
+    golioth_sys_mutex_unlock(_rate_limit_lock);
+
+    return repeat;
+}
+
+static bool rate_limit_take_summary(uint64_t now_ms, struct rate_limit_summary *summary)
+{
+    if (!_rate_limit_lock)
+    {
+        return false;
+    }
+
+    golioth_sys_mutex_lock(_rate_limit_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    bool found = false;
+    for (size_t i = 0; i < CONFIG_GOLIOTH_LOG_RATE_LIMIT_NUM_SLOTS && !found; i++)
+    {
+        struct rate_limit_callsite *callsite = &_callsites[i];
+        uint64_t duration_ms = now_ms - callsite->first_suppressed_ms;
+
+        if (callsite->suppressed > 0
+            && (callsite->summary_due
+                || duration_ms >= CONFIG_GOLIOTH_LOG_RATE_LIMIT_REPEAT_WINDOW_MS))
+        {
+            *summary = (struct rate_limit_summary){
+                .level = callsite->level,
+                .tag = callsite->tag,
+                .format = callsite->bucket.key,
+                .count = callsite->suppressed,
+                .duration_ms = duration_ms,
+            };
+            callsite->suppressed = 0;
+            callsite->summary_due = false;
+            _log_stats.summaries++;
+            found = true;
+        }
+    }
+
+    golioth_sys_mutex_unlock(_rate_limit_lock);
+
+    return found;
+}
+
+static uint32_t rate_limit_hash(const char *msg)
+{
+    return golioth_hash(msg, strlen(msg));
+}
+
+#else /* CONFIG_GOLIOTH_LOG_RATE_LIMIT */
+
+static inline bool rate_limit_check(enum golioth_debug_log_level level,
+                                    const char *tag,
+                                    const char *format,
+                                    uint64_t now_ms)
+{
+    return true;
+}
+
+static inline bool rate_limit_is_repeat(enum golioth_debug_log_level level,
+                                        const char *format,
+                                        const uint32_t *hash,
+                                        uint64_t now_ms)
+{
+    return false;
+}
+
+static inline bool rate_limit_take_summary(uint64_t now_ms, struct rate_limit_summary *summary)
+{
+    return false;
+}
+
+static inline uint32_t rate_limit_hash(const char *msg)
+{
+    return 0;
+}
+
+#endif /* CONFIG_GOLIOTH_LOG_RATE_LIMIT */
+
+// Send a formatted message. Called with _log_in_progress set.
+static void debug_log_send(enum golioth_debug_log_level level, const char *tag, const char *msg)
+{
+    switch (level)
+    {
+        case GOLIOTH_DEBUG_LOG_LEVEL_ERROR:
+            golioth_log_error_async(_client, tag, msg, NULL, NULL);
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_WARN:
+            golioth_log_warn_async(_client, tag, msg, NULL, NULL);
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_INFO:
+            golioth_log_info_async(_client, tag, msg, NULL, NULL);
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_VERBOSE:  // fallthrough
+        case GOLIOTH_DEBUG_LOG_LEVEL_DEBUG:
+            golioth_log_debug_async(_client, tag, msg, NULL, NULL);
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_NONE:  // fallthrough
+        default:
+            break;
+    }
+}
+
+// Send summaries of suppressed messages that are due. Called with _log_in_progress set.
+static void debug_log_send_summaries(uint64_t now_ms)
+{
+    struct rate_limit_summary summary;
+
+    while (rate_limit_take_summary(now_ms, &summary))
+    {
+        char msg[128];
+        snprintf(msg,
+                 sizeof(msg),
+                 "message \"%s\" repeated %" PRIu32 " times in %" PRIu32 " s",
+                 summary.format,
+                 summary.count,
+                 (uint32_t) ((summary.duration_ms + 500) / 1000));
+        debug_log_send(summary.level, summary.tag, msg);
+    }
+}
+
 void golioth_debug_set_log_level(enum golioth_debug_log_level level)
 {
     _level = level;
@@ -109,8 +423,14 @@ void golioth_debug_printf(uint64_t tstamp_ms,
     }
 
     // Avoid re-entering this function
-    static bool log_in_progress = false;
-    if (log_in_progress)
+    if (_log_in_progress)
+    {
+        return;
+    }
+
+    // Rate limited messages are dropped before spending time on formatting them
+    uint64_t now_ms = golioth_sys_now_ms();
+    if (!rate_limit_check(level, tag, format, now_ms))
     {
         return;
     }
@@ -127,7 +447,7 @@ void golioth_debug_printf(uint64_t tstamp_ms,
     }
 
     // Temporarily allocate a buffer to store the message
-    char *msg_buffer = golioth_sys_malloc(buffer_size);
+    char *msg_buffer = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_LOG, buffer_size);
     if (!msg_buffer)
     {
         return;
@@ -137,40 +457,74 @@ void golioth_debug_printf(uint64_t tstamp_ms,
     vsnprintf(msg_buffer, buffer_size, format, args);
     va_end(args);
 
+    uint32_t hash = rate_limit_hash(msg_buffer);
+    if (rate_limit_is_repeat(level, format, &hash, now_ms))
+    {
+        GOLIOTH_HEAP_FREE(msg_buffer);
+        return;
+    }
+
     // Log to Golioth asynchronously.
     //
     // Setting the "in progress" flag ensures that we can't re-enter this function
     // while calling the golioth_log_X_async functions, which might themselves
     // use GLTH_LOGX statements (which would cause infinite re-entrance).
-    log_in_progress = true;
-    switch (level)
-    {
-        case GOLIOTH_DEBUG_LOG_LEVEL_ERROR:
-            golioth_log_error_async(_client, tag, msg_buffer, NULL, NULL);
-            break;
-        case GOLIOTH_DEBUG_LOG_LEVEL_WARN:
-            golioth_log_warn_async(_client, tag, msg_buffer, NULL, NULL);
-            break;
-        case GOLIOTH_DEBUG_LOG_LEVEL_INFO:
-            golioth_log_info_async(_client, tag, msg_buffer, NULL, NULL);
-            break;
-        case GOLIOTH_DEBUG_LOG_LEVEL_VERBOSE:  // fallthrough
-        case GOLIOTH_DEBUG_LOG_LEVEL_DEBUG:
-            golioth_log_debug_async(_client, tag, msg_buffer, NULL, NULL);
-            break;
-        case GOLIOTH_DEBUG_LOG_LEVEL_NONE:  // fallthrough
-        default:
-            break;
-    }
-    log_in_progress = false;
+    _log_in_progress = true;
+    debug_log_send_summaries(now_ms);
+    debug_log_send(level, tag, msg_buffer);
+    _log_in_progress = false;
 
     // It's safe to free the message buffer, since the async log above
     // makes a copy of the message.
-    golioth_sys_free(msg_buffer);
+    GOLIOTH_HEAP_FREE(msg_buffer);
 }
 
+#if defined(CONFIG_GOLIOTH_LOG_DICTIONARY)
+
+// Important Note!
+//
+// Same as golioth_debug_printf(), do not use GLTH_LOGX statements in this function.
+void golioth_debug_printf_dict(uint64_t tstamp_ms,
+                               enum golioth_debug_log_level level,
+                               const char *tag,
+                               const char *format,
+                               ...)
+{
+    if (!_cloud_log_enabled || !_client || _log_in_progress)
+    {
+        return;
+    }
+
+    // Without the text, there is nothing to compare, so repeats are not collapsed
+    uint64_t now_ms = golioth_sys_now_ms();
+    if (!rate_limit_check(level, tag, format, now_ms)
+        || rate_limit_is_repeat(level, format, NULL, now_ms))
+    {
+        return;
+    }
+
+    // The arguments are encoded as they are, there is no formatting and no message buffer
+    va_list args;
+    va_start(args, format);
+    _log_in_progress = true;
+    debug_log_send_summaries(now_ms);
+    golioth_log_dict_async(_client, level, tag, format, args);
+    _log_in_progress = false;
+    va_end(args);
+}
+
+#endif /* CONFIG_GOLIOTH_LOG_DICTIONARY */
+
 void golioth_debug_set_client(struct golioth_client *client)
 {
+#if defined(CONFIG_GOLIOTH_LOG_RATE_LIMIT)
+    // Without the lock, messages are not rate limited
+    if (client && !_rate_limit_lock)
+    {
+        _rate_limit_lock = golioth_sys_mutex_create();
+    }
+#endif
+
     _client = client;
 }
 
@@ -178,3 +532,26 @@ void golioth_debug_set_cloud_log_enabled(bool enable)
 {
     _cloud_log_enabled = enable;
 }
+
+enum golioth_status golioth_debug_get_log_stats(struct golioth_debug_log_stats *stats)
+{
+#if defined(CONFIG_GOLIOTH_LOG_RATE_LIMIT)
+    if (!stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+    if (!_rate_limit_lock)
+    {
+        *stats = (struct golioth_debug_log_stats){0};
+        return GOLIOTH_OK;
+    }
+
+    golioth_sys_mutex_lock(_rate_limit_lock, GOLIOTH_SYS_WAIT_FOREVER);
+    *stats = _log_stats;
+    golioth_sys_mutex_unlock(_rate_limit_lock);
+
+    return GOLIOTH_OK;
+#else
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+#endif
+}
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <golioth/golioth_debug.h>
+#include "golioth_util.h"
+#include "heap_accounting.h"
+
+LOG_TAG_DEFINE(golioth_heap);
+
+static const char *const subsystem_names[GOLIOTH_HEAP_NUM_SUBSYSTEMS] = {
+    [GOLIOTH_HEAP_CLIENT] = "client",
+    [GOLIOTH_HEAP_BLOCKWISE] = "blockwise",
+    [GOLIOTH_HEAP_LIGHTDB] = "lightdb",
+    [GOLIOTH_HEAP_STREAM] = "stream",
+    [GOLIOTH_HEAP_SETTINGS] = "settings",
+    [GOLIOTH_HEAP_RPC] = "rpc",
+    [GOLIOTH_HEAP_LOG] = "log",
+    [GOLIOTH_HEAP_OTA] = "ota",
+};
+
+const char *golioth_heap_subsystem_name(enum golioth_heap_subsystem subsystem)
+{
+    if ((unsigned int) subsystem >= GOLIOTH_HEAP_NUM_SUBSYSTEMS)
+    {
+        return "unknown";
+    }
+
+    return subsystem_names[subsystem];
+}
+
+static void heap_stats_max(uint32_t *stat, uint32_t value)
+{
+    uint32_t old = __atomic_load_n(stat, __ATOMIC_RELAXED);
+
+    while (value > old
+           && !__atomic_compare_exchange_n(stat,
+                                           &old,
+                                           value,
+                                           true,
+                                           __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+    {
+    }
+}
+
+#if defined(CONFIG_GOLIOTH_HEAP_STATIC)
+
+// Static pools of fixed-size blocks.
+//
+// An allocation takes a block from the first pool (in configuration order, so smallest block
+// size first) whose blocks are large enough and which has a free block. Free blocks are tracked
+// in a bitmap per pool, and claimed and released with atomic operations, so allocation never
+// blocks and takes a bounded number of steps. Blocks are never split or merged, so the pools
+// cannot fragment.
+
+#define HEAP_BLOCK_SIZE(_size) \
+    (((_size) + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) * _Alignof(max_align_t))
+
+#define HEAP_POOL_STORAGE(_name, _block_size, _num_blocks)                                  \
+    static _Alignas(max_align_t) uint8_t                                                    \
+        _name##_blocks[((_num_blocks) ? (_num_blocks) : 1) * HEAP_BLOCK_SIZE(_block_size)]; \
+    static uint32_t _name##_in_use[((_num_blocks) + 31) / 32 + 1]
+
+#define HEAP_POOL(_name, _block_size, _num_blocks)  \
+    {                                               \
+        .blocks = _name##_blocks,                   \
+        .in_use = _name##_in_use,                   \
+        .block_size = HEAP_BLOCK_SIZE(_block_size), \
+        .num_blocks = (_num_blocks),                \
+    }
+
+struct heap_pool
+{
+    uint8_t *blocks;
+    uint32_t *in_use;
+    uint32_t block_size;
+    uint32_t num_blocks;
+    uint32_t used;
+    uint32_t used_peak;
+    uint32_t exhausted;
+};
+
+HEAP_POOL_STORAGE(small,
+                  CONFIG_GOLIOTH_HEAP_STATIC_SMALL_BLOCK_SIZE,
+                  CONFIG_GOLIOTH_HEAP_STATIC_SMALL_NUM_BLOCKS);
+HEAP_POOL_STORAGE(medium,
+                  CONFIG_GOLIOTH_HEAP_STATIC_MEDIUM_BLOCK_SIZE,
+                  CONFIG_GOLIOTH_HEAP_STATIC_MEDIUM_NUM_BLOCKS);
+HEAP_POOL_STORAGE(large,
+                  CONFIG_GOLIOTH_HEAP_STATIC_LARGE_BLOCK_SIZE,
+                  CONFIG_GOLIOTH_HEAP_STATIC_LARGE_NUM_BLOCKS);
+HEAP_POOL_STORAGE(xlarge,
+                  CONFIG_GOLIOTH_HEAP_STATIC_XLARGE_BLOCK_SIZE,
+                  CONFIG_GOLIOTH_HEAP_STATIC_XLARGE_NUM_BLOCKS);
+
+static struct heap_pool heap_pools[GOLIOTH_HEAP_NUM_POOLS] = {
+    HEAP_POOL(small,
+              CONFIG_GOLIOTH_HEAP_STATIC_SMALL_BLOCK_SIZE,
+              CONFIG_GOLIOTH_HEAP_STATIC_SMALL_NUM_BLOCKS),
+    HEAP_POOL(medium,
+              CONFIG_GOLIOTH_HEAP_STATIC_MEDIUM_BLOCK_SIZE,
+              CONFIG_GOLIOTH_HEAP_STATIC_MEDIUM_NUM_BLOCKS),
+    HEAP_POOL(large,
+              CONFIG_GOLIOTH_HEAP_STATIC_LARGE_BLOCK_SIZE,
+              CONFIG_GOLIOTH_HEAP_STATIC_LARGE_NUM_BLOCKS),
+    HEAP_POOL(xlarge,
+              CONFIG_GOLIOTH_HEAP_STATIC_XLARGE_BLOCK_SIZE,
+              CONFIG_GOLIOTH_HEAP_STATIC_XLARGE_NUM_BLOCKS),
+};
+
+static void *pool_alloc(struct heap_pool *pool)
+{
+    for (uint32_t word = 0; word * 32 < pool->num_blocks; word++)
+    {
+        uint32_t bits = __atomic_load_n(&pool->in_use[word], __ATOMIC_RELAXED);
+
+        while (bits != UINT32_MAX)
+        {
+            uint32_t bit = __builtin_ctz(~bits);
+            uint32_t index = word * 32 + bit;
+
+            if (index >= pool->num_blocks)
+            {
+                break;
+            }
+
+            // On failure, bits is reloaded and the next free bit is tried
+            if (__atomic_compare_exchange_n(&pool->in_use[word],
+                                            &bits,
+                                            bits | (1U << bit),
+                                            false,
+                                            __ATOMIC_ACQUIRE,
+                                            __ATOMIC_RELAXED))
+            {
+                uint32_t used = __atomic_add_fetch(&pool->used, 1, __ATOMIC_RELAXED);
+                heap_stats_max(&pool->used_peak, used);
+
+                return pool->blocks + (size_t) index * pool->block_size;
+            }
+        }
+    }
+
+    __atomic_fetch_add(&pool->exhausted, 1, __ATOMIC_RELAXED);
+
+    return NULL;
+}
+
+static void *heap_alloc(size_t size)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(heap_pools); i++)
+    {
+        if (size <= heap_pools[i].block_size)
+        {
+            void *block = pool_alloc(&heap_pools[i]);
+            if (block)
+            {
+                return block;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void heap_release(void *ptr)
+{
+    uint8_t *block = ptr;
+
+    for (size_t i = 0; i < ARRAY_SIZE(heap_pools); i++)
+    {
+        struct heap_pool *pool = &heap_pools[i];
+
+        if (block >= pool->blocks
+            && block < pool->blocks + (size_t) pool->num_blocks * pool->block_size)
+        {
+            uint32_t index = (block - pool->blocks) / pool->block_size;
+
+            __atomic_fetch_and(&pool->in_use[index / 32],
+                               ~(1U << (index % 32)),
+                               __ATOMIC_RELEASE);
+            __atomic_fetch_sub(&pool->used, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    // Not allocated from the pools
+    assert(false);
+}
+
+enum golioth_status golioth_heap_get_pool_stats(size_t pool,
+                                                struct golioth_heap_pool_stats *stats)
+{
+    if (!stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+    if (pool >= GOLIOTH_HEAP_NUM_POOLS)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    const struct heap_pool *src = &heap_pools[pool];
+
+    stats->block_size = src->block_size;
+    stats->num_blocks = src->num_blocks;
+    stats->used = __atomic_load_n(&src->used, __ATOMIC_RELAXED);
+    stats->used_peak = __atomic_load_n(&src->used_peak, __ATOMIC_RELAXED);
+    stats->exhausted = __atomic_load_n(&src->exhausted, __ATOMIC_RELAXED);
+
+    return GOLIOTH_OK;
+}
+
+#else /* CONFIG_GOLIOTH_HEAP_STATIC */
+
+#if defined(CONFIG_GOLIOTH_HEAP_STATS)
+
+static void *heap_alloc(size_t size)
+{
+    return golioth_sys_malloc(size);
+}
+
+static void heap_release(void *ptr)
+{
+    golioth_sys_free(ptr);
+}
+
+#endif /* CONFIG_GOLIOTH_HEAP_STATS */
+
+enum golioth_status golioth_heap_get_pool_stats(size_t pool,
+                                                struct golioth_heap_pool_stats *stats)
+{
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+#endif /* CONFIG_GOLIOTH_HEAP_STATIC */
+
+#if defined(CONFIG_GOLIOTH_HEAP_STATS)
+
+// Prepended to every allocation, so that golioth_heap_free() knows what to account for.
+// Padded to keep the memory returned to the caller suitably aligned for any type, which makes
+// it 8 bytes on Cortex-M targets and 16 bytes on 64-bit Linux.
+struct heap_header
+{
+    _Alignas(max_align_t) uint32_t size;
+    uint8_t subsystem;
+};
+
+static struct golioth_heap_stats heap_stats[GOLIOTH_HEAP_NUM_SUBSYSTEMS];
+
+void *golioth_heap_malloc(enum golioth_heap_subsystem subsystem, size_t size)
+{
+    struct golioth_heap_stats *stats = &heap_stats[subsystem];
+    struct heap_header *header = NULL;
+
+    if (size <= UINT32_MAX - sizeof(*header))
+    {
+        header = heap_alloc(sizeof(*header) + size);
+    }
+    if (!header)
+    {
+        __atomic_fetch_add(&stats->failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    header->size = size;
+    header->subsystem = subsystem;
+
+    uint32_t bytes = __atomic_add_fetch(&stats->bytes, size, __ATOMIC_RELAXED);
+    heap_stats_max(&stats->bytes_peak, bytes);
+
+    __atomic_fetch_add(&stats->blocks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->allocations, 1, __ATOMIC_RELAXED);
+
+    return header + 1;
+}
+
+void golioth_heap_free(void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    struct heap_header *header = (struct heap_header *) ptr - 1;
+    struct golioth_heap_stats *stats = &heap_stats[header->subsystem];
+
+    __atomic_fetch_sub(&stats->bytes, header->size, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&stats->blocks, 1, __ATOMIC_RELAXED);
+
+    heap_release(header);
+}
+
+enum golioth_status golioth_heap_get_stats(enum golioth_heap_subsystem subsystem,
+                                           struct golioth_heap_stats *stats)
+{
+    if (!stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+    if ((unsigned int) subsystem >= GOLIOTH_HEAP_NUM_SUBSYSTEMS)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    const struct golioth_heap_stats *src = &heap_stats[subsystem];
+
+    stats->bytes = __atomic_load_n(&src->bytes, __ATOMIC_RELAXED);
+    stats->bytes_peak = __atomic_load_n(&src->bytes_peak, __ATOMIC_RELAXED);
+    stats->blocks = __atomic_load_n(&src->blocks, __ATOMIC_RELAXED);
+    stats->allocations = __atomic_load_n(&src->allocations, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&src->failures, __ATOMIC_RELAXED);
+
+    return GOLIOTH_OK;
+}
+
+#else /* CONFIG_GOLIOTH_HEAP_STATS */
+
+#if defined(CONFIG_GOLIOTH_HEAP_STATIC)
+
+void *golioth_heap_malloc(enum golioth_heap_subsystem subsystem, size_t size)
+{
+    return heap_alloc(size);
+}
+
+void golioth_heap_free(void *ptr)
+{
+    if (ptr)
+    {
+        heap_release(ptr);
+    }
+}
+
+#endif /* CONFIG_GOLIOTH_HEAP_STATIC */
+
+enum golioth_status golioth_heap_get_stats(enum golioth_heap_subsystem subsystem,
+                                           struct golioth_heap_stats *stats)
+{
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+#endif /* CONFIG_GOLIOTH_HEAP_STATS */
+
+void golioth_heap_log_stats(void)
+{
+#if defined(CONFIG_GOLIOTH_HEAP_STATS)
+    struct golioth_heap_stats stats;
+
+    GLTH_LOGI(TAG,
+              "%-10s %10s %10s %8s %12s %8s",
+              "subsystem",
+              "bytes",
+              "peak",
+              "blocks",
+              "allocations",
+              "failures");
+
+    for (int i = 0; i < GOLIOTH_HEAP_NUM_SUBSYSTEMS; i++)
+    {
+        golioth_heap_get_stats(i, &stats);
+        GLTH_LOGI(TAG,
+                  "%-10s %10" PRIu32 " %10" PRIu32 " %8" PRIu32 " %12" PRIu32 " %8" PRIu32,
+                  subsystem_names[i],
+                  stats.bytes,
+                  stats.bytes_peak,
+                  stats.blocks,
+                  stats.allocations,
+                  stats.failures);
+    }
+#endif
+
+#if defined(CONFIG_GOLIOTH_HEAP_STATIC)
+    struct golioth_heap_pool_stats pool_stats;
+
+    GLTH_LOGI(TAG,
+              "%-10s %10s %10s %8s %8s %10s",
+              "pool",
+              "block size",
+              "blocks",
+              "used",
+              "peak",
+              "exhausted");
+
+    for (size_t i = 0; i < GOLIOTH_HEAP_NUM_POOLS; i++)
+    {
+        golioth_heap_get_pool_stats(i, &pool_stats);
+        GLTH_LOGI(TAG,
+                  "%-10zu %10" PRIu32 " %10" PRIu32 " %8" PRIu32 " %8" PRIu32 " %10" PRIu32,
+                  i,
+                  pool_stats.block_size,
+                  pool_stats.num_blocks,
+                  pool_stats.used,
+                  pool_stats.used_peak,
+                  pool_stats.exhausted);
+    }
+#endif
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <golioth/config.h>
+#include <golioth/golioth_sys.h>
+#include <golioth/heap_stats.h>
+
+// Heap accounting and static pools, see golioth/heap_stats.h.
+//
+// SDK code allocates with GOLIOTH_HEAP_MALLOC(), naming the subsystem the memory belongs to,
+// and releases with GOLIOTH_HEAP_FREE(). Memory allocated with one pair must never be released
+// with the other. With CONFIG_GOLIOTH_HEAP_STATIC, memory comes from static pools instead of the
+// heap, and running out of it is reported as a failed allocation, like the heap being full. When
+// neither CONFIG_GOLIOTH_HEAP_STATS nor CONFIG_GOLIOTH_HEAP_STATIC is enabled, they are plain
+// golioth_sys_malloc() and golioth_sys_free().
+
+#if defined(CONFIG_GOLIOTH_HEAP_STATS) || defined(CONFIG_GOLIOTH_HEAP_STATIC)
+
+void *golioth_heap_malloc(enum golioth_heap_subsystem subsystem, size_t size);
+void golioth_heap_free(void *ptr);
+
+#define GOLIOTH_HEAP_MALLOC(_subsystem, _size) golioth_heap_malloc((_subsystem), (_size))
+#define GOLIOTH_HEAP_FREE(_ptr) golioth_heap_free((_ptr))
+
+#else /* CONFIG_GOLIOTH_HEAP_STATS || CONFIG_GOLIOTH_HEAP_STATIC */
+
+#define GOLIOTH_HEAP_MALLOC(_subsystem, _size) golioth_sys_malloc((_size))
+#define GOLIOTH_HEAP_FREE(_ptr) golioth_sys_free((_ptr))
+
+#endif /* CONFIG_GOLIOTH_HEAP_STATS || CONFIG_GOLIOTH_HEAP_STATIC */
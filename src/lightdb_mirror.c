@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "lightdb_mirror.h"
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE)
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR)
+
+#include <string.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+#include "coap_client.h"
+#include "golioth_util.h"
+
+#ifdef __ZEPHYR__
+#include "coap_client_zephyr.h"
+#else
+#include "coap_client_libcoap.h"
+#endif
+
+LOG_TAG_DEFINE(lightdb_mirror);
+
+#define GOLIOTH_LIGHTDB_STATE_PATH_PREFIX ".d/"
+
+// A reader gives up after this many attempts, rather than waiting for the client thread, which
+// may have a lower priority, to finish writing the entry
+#define MIRROR_READ_ATTEMPTS 3
+
+static void stat_inc(uint32_t *counter)
+{
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static struct golioth_lightdb_mirror_entry *find_entry(struct golioth_lightdb_mirror *mirror,
+                                                       const char *path)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(mirror->entries); i++)
+    {
+        struct golioth_lightdb_mirror_entry *entry = &mirror->entries[i];
+
+        if (__atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) == LIGHTDB_MIRROR_ENTRY_ACTIVE
+            && strcmp(entry->path, path) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// Whether one path is the other, or contains it
+static bool paths_overlap(const char *a, const char *b)
+{
+    size_t a_len = strlen(a);
+    size_t b_len = strlen(b);
+    size_t len = min(a_len, b_len);
+
+    if (len == 0)
+    {
+        return true;
+    }
+
+    if (strncmp(a, b, len) != 0)
+    {
+        return false;
+    }
+
+    return a_len == b_len || (a_len > len ? a[len] : b[len]) == '/';
+}
+
+// Only called from the client thread
+static void entry_write_begin(struct golioth_lightdb_mirror_entry *entry)
+{
+    __atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void entry_write_end(struct golioth_lightdb_mirror_entry *entry)
+{
+    __atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void on_notify(struct golioth_client *client,
+                      enum golioth_status status,
+                      const struct golioth_coap_rsp_code *coap_rsp_code,
+                      const char *path,
+                      const uint8_t *payload,
+                      size_t payload_size,
+                      void *arg)
+{
+    struct golioth_lightdb_mirror_entry *entry = arg;
+    uint64_t now = golioth_sys_now_ms();
+
+    if (status == GOLIOTH_OK && payload_size > sizeof(entry->value))
+    {
+        GLTH_LOGW(TAG,
+                  "Value of %s too large to mirror: %zu > %zu",
+                  entry->path,
+                  payload_size,
+                  sizeof(entry->value));
+    }
+
+    entry_write_begin(entry);
+
+    if (status != GOLIOTH_OK)
+    {
+        // The observation failed, so the value is not updated anymore
+        if (entry->is_current)
+        {
+            entry->current_ms = now;
+            entry->is_current = false;
+        }
+    }
+    else if (payload_size > sizeof(entry->value))
+    {
+        entry->has_value = false;
+        entry->is_current = false;
+    }
+    else
+    {
+        memcpy(entry->value, payload, payload_size);
+        entry->len = payload_size;
+        entry->has_value = true;
+        entry->is_current = true;
+        entry->current_ms = now;
+        entry->value_writes = __atomic_load_n(&entry->writes, __ATOMIC_ACQUIRE);
+    }
+
+    entry_write_end(entry);
+
+    if (status == GOLIOTH_OK)
+    {
+        stat_inc(&client->lightdb_mirror.stats.updates);
+    }
+}
+
+// Whether the entry holds exactly this value. Called from any thread.
+static bool entry_has_value(struct golioth_lightdb_mirror_entry *entry,
+                            const uint8_t *payload,
+                            size_t payload_size)
+{
+    for (int attempt = 0; attempt < MIRROR_READ_ATTEMPTS; attempt++)
+    {
+        uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            continue;
+        }
+
+        bool equal = entry->has_value && entry->len == payload_size
+                  && memcmp(entry->value, payload, payload_size) == 0;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq)
+        {
+            return equal;
+        }
+    }
+
+    return false;
+}
+
+bool golioth_lightdb_mirror_read(struct golioth_client *client,
+                                 const char *path,
+                                 uint8_t *buf,
+                                 size_t *len)
+{
+    if (!client || !path)
+    {
+        return false;
+    }
+
+    struct golioth_lightdb_mirror *mirror = &client->lightdb_mirror;
+    struct golioth_lightdb_mirror_entry *entry = find_entry(mirror, path);
+    if (!entry)
+    {
+        return false;
+    }
+
+    bool has_value = false;
+    bool is_current = false;
+    uint64_t current_ms = 0;
+    uint32_t value_writes = 0;
+
+    for (int attempt = 0; attempt < MIRROR_READ_ATTEMPTS; attempt++)
+    {
+        if (__atomic_load_n(&entry->writes_pending, __ATOMIC_ACQUIRE) > 0)
+        {
+            break;
+        }
+
+        uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            continue;
+        }
+
+        has_value = entry->has_value;
+        is_current = entry->is_current;
+        current_ms = entry->current_ms;
+        value_writes = entry->value_writes;
+        *len = min(entry->len, sizeof(entry->value));
+        memcpy(buf, entry->value, *len);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq)
+        {
+            break;
+        }
+
+        has_value = false;
+    }
+
+    // The value was notified before a write completed, and may not include it
+    if (value_writes != __atomic_load_n(&entry->writes, __ATOMIC_ACQUIRE))
+    {
+        has_value = false;
+    }
+
+    if (has_value && is_current)
+    {
+        stat_inc(&mirror->stats.hits);
+        return true;
+    }
+
+    uint32_t max_stale_ms = __atomic_load_n(&entry->max_stale_ms, __ATOMIC_RELAXED);
+    if (has_value && golioth_sys_now_ms() - current_ms <= max_stale_ms)
+    {
+        stat_inc(&mirror->stats.stale_hits);
+        return true;
+    }
+
+    stat_inc(&mirror->stats.misses);
+    return false;
+}
+
+bool golioth_lightdb_mirror_write_begin(struct golioth_client *client, const char *path)
+{
+    if (!client || !path)
+    {
+        return false;
+    }
+
+    struct golioth_lightdb_mirror *mirror = &client->lightdb_mirror;
+    bool is_mirrored = false;
+
+    for (size_t i = 0; i < ARRAY_SIZE(mirror->entries); i++)
+    {
+        struct golioth_lightdb_mirror_entry *entry = &mirror->entries[i];
+
+        if (__atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) == LIGHTDB_MIRROR_ENTRY_ACTIVE
+            && paths_overlap(entry->path, path))
+        {
+            __atomic_fetch_add(&entry->writes_pending, 1, __ATOMIC_ACQ_REL);
+            is_mirrored = true;
+        }
+    }
+
+    return is_mirrored;
+}
+
+void golioth_lightdb_mirror_write_end(struct golioth_client *client,
+                                      const char *path,
+                                      enum golioth_content_type content_type,
+                                      const uint8_t *payload,
+                                      size_t payload_size,
+                                      enum golioth_status status)
+{
+    struct golioth_lightdb_mirror *mirror = &client->lightdb_mirror;
+
+    // The server rejected the request, or it was not sent. When it timed out, the server may
+    // still have received it.
+    bool may_change = (status == GOLIOTH_OK || status == GOLIOTH_ERR_TIMEOUT);
+
+    for (size_t i = 0; i < ARRAY_SIZE(mirror->entries); i++)
+    {
+        struct golioth_lightdb_mirror_entry *entry = &mirror->entries[i];
+        uint32_t pending;
+
+        // Entries added while the request was in flight did not count it
+        if (__atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) != LIGHTDB_MIRROR_ENTRY_ACTIVE
+            || !paths_overlap(entry->path, path)
+            || (pending = __atomic_load_n(&entry->writes_pending, __ATOMIC_ACQUIRE)) == 0)
+        {
+            continue;
+        }
+
+        // Setting the mirrored value again does not change it, and is not notified
+        bool is_unchanged = status == GOLIOTH_OK && payload
+                         && content_type == GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE
+                         && strcmp(entry->path, path) == 0
+                         && entry_has_value(entry, payload, payload_size);
+
+        if (may_change && !is_unchanged)
+        {
+            __atomic_fetch_add(&entry->writes, 1, __ATOMIC_ACQ_REL);
+        }
+
+        // Fails, and is retried, when another request completed meanwhile
+        while (pending > 0
+               && !__atomic_compare_exchange_n(&entry->writes_pending,
+                                               &pending,
+                                               pending - 1,
+                                               false,
+                                               __ATOMIC_ACQ_REL,
+                                               __ATOMIC_ACQUIRE))
+        {
+        }
+    }
+}
+
+void golioth_lightdb_mirror_disconnected(struct golioth_client *client)
+{
+    struct golioth_lightdb_mirror *mirror = &client->lightdb_mirror;
+    uint64_t now = golioth_sys_now_ms();
+
+    for (size_t i = 0; i < ARRAY_SIZE(mirror->entries); i++)
+    {
+        struct golioth_lightdb_mirror_entry *entry = &mirror->entries[i];
+
+        if (__atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) != LIGHTDB_MIRROR_ENTRY_ACTIVE
+            || !entry->is_current)
+        {
+            continue;
+        }
+
+        entry_write_begin(entry);
+        entry->current_ms = now;
+        entry->is_current = false;
+        entry_write_end(entry);
+    }
+}
+
+enum golioth_status golioth_lightdb_mirror_add(struct golioth_client *client,
+                                               const char *path,
+                                               uint32_t max_stale_ms)
+{
+    if (!client || !path)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    struct golioth_lightdb_mirror *mirror = &client->lightdb_mirror;
+    struct golioth_lightdb_mirror_entry *entry = find_entry(mirror, path);
+
+    if (entry)
+    {
+        __atomic_store_n(&entry->max_stale_ms, max_stale_ms, __ATOMIC_RELAXED);
+        return GOLIOTH_OK;
+    }
+
+    if (strlen(path) >= sizeof(entry->path))
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(mirror->entries) && !entry; i++)
+    {
+        uint32_t expected = LIGHTDB_MIRROR_ENTRY_FREE;
+
+        if (__atomic_compare_exchange_n(&mirror->entries[i].state,
+                                        &expected,
+                                        LIGHTDB_MIRROR_ENTRY_CLAIMED,
+                                        false,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED))
+        {
+            entry = &mirror->entries[i];
+        }
+    }
+
+    if (!entry)
+    {
+        GLTH_LOGE(TAG, "No space to mirror %s", path);
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    strcpy(entry->path, path);
+    entry->max_stale_ms = max_stale_ms;
+
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    golioth_coap_next_token(token);
+
+    enum golioth_status status = golioth_coap_client_observe(client,
+                                                             token,
+                                                             GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                                             entry->path,
+                                                             GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                                                             on_notify,
+                                                             entry);
+
+    __atomic_store_n(&entry->state,
+                     status == GOLIOTH_OK ? LIGHTDB_MIRROR_ENTRY_ACTIVE : LIGHTDB_MIRROR_ENTRY_FREE,
+                     __ATOMIC_RELEASE);
+
+    return status;
+}
+
+enum golioth_status golioth_lightdb_mirror_get_stats(struct golioth_client *client,
+                                                     struct golioth_lightdb_mirror_stats *stats)
+{
+    if (!client || !stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    *stats = client->lightdb_mirror.stats;
+
+    return GOLIOTH_OK;
+}
+
+#else /* CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR */
+
+enum golioth_status golioth_lightdb_mirror_add(struct golioth_client *client,
+                                               const char *path,
+                                               uint32_t max_stale_ms)
+{
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+enum golioth_status golioth_lightdb_mirror_get_stats(struct golioth_client *client,
+                                                     struct golioth_lightdb_mirror_stats *stats)
+{
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+#endif /* CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR */
+
+#endif /* CONFIG_GOLIOTH_LIGHTDB_STATE */
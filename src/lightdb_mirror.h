@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/client.h>
+#include <golioth/config.h>
+#include <golioth/lightdb_state.h>
+
+// Local mirror of LightDB State paths, see golioth_lightdb_mirror_add().
+//
+// Each mirrored path is observed with GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE, and every notification
+// is copied into its entry by the client thread, which is the only thread writing values. The
+// golioth_lightdb_get_*_sync() functions read entries with golioth_lightdb_mirror_read(), and only
+// fall back to a GET request when the entry cannot be served. Readers never block: each entry is
+// guarded by a sequence counter, which is odd while the entry is being written, and a read is
+// retried when the counter changed while the entry was copied.
+//
+// An entry is current while its observation is established: from a notification until the
+// session ends. The transports call golioth_lightdb_mirror_disconnected() when it does, and
+// observations are re-established with the next session, which refreshes all entries. Between
+// sessions, an entry may be served up to max_stale_ms after it was last current.
+//
+// So that the application reads its own writes, set and delete requests on a path overlapping an
+// entry are counted in writes_pending, and the entry is not served until they completed. A
+// completed request that may have changed the value increments writes, and the entry is then
+// only served once a notification is received after it, which stores writes in value_writes.
+// Notifications that were in flight before the request completed are thus not served.
+
+// Content type of the values written and read by the typed helpers, like
+// golioth_lightdb_set_int_async() and golioth_lightdb_get_int_sync()
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_CBOR)
+#define GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE GOLIOTH_CONTENT_TYPE_CBOR
+#else
+#define GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE GOLIOTH_CONTENT_TYPE_JSON
+#endif
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR)
+
+enum
+{
+    LIGHTDB_MIRROR_ENTRY_FREE,
+    /// Being added by golioth_lightdb_mirror_add()
+    LIGHTDB_MIRROR_ENTRY_CLAIMED,
+    LIGHTDB_MIRROR_ENTRY_ACTIVE,
+};
+
+struct golioth_lightdb_mirror_entry
+{
+    uint32_t state;
+    char path[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 1];
+    uint32_t max_stale_ms;
+    /// Set and delete requests in flight on an overlapping path
+    uint32_t writes_pending;
+    /// Completed set and delete requests which may have changed the value
+    uint32_t writes;
+    /// Odd while the fields below are written
+    uint32_t seq;
+    bool has_value;
+    /// A notification was received in the current session
+    bool is_current;
+    /// Time (since boot) in milliseconds when the value was last known to be current
+    uint64_t current_ms;
+    /// writes when the value was notified
+    uint32_t value_writes;
+    size_t len;
+    uint8_t value[CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_VALUE_LEN];
+};
+
+struct golioth_lightdb_mirror
+{
+    struct golioth_lightdb_mirror_entry entries[CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_PATHS];
+    struct golioth_lightdb_mirror_stats stats;
+};
+
+/// Copy the mirrored value of \p path into \p buf, which holds
+/// CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_VALUE_LEN bytes
+///
+/// @return true if the value was copied, false if the path must be read from the server
+bool golioth_lightdb_mirror_read(struct golioth_client *client,
+                                 const char *path,
+                                 uint8_t *buf,
+                                 size_t *len);
+
+/// A set or delete request is made on \p path
+///
+/// @return true if the request overlaps a mirrored path, and its completion must be reported with
+///         golioth_lightdb_mirror_write_end()
+bool golioth_lightdb_mirror_write_begin(struct golioth_client *client, const char *path);
+
+/// A set request with \p payload, or a delete request (\p payload is NULL), on \p path completed
+/// with \p status, or was not sent
+void golioth_lightdb_mirror_write_end(struct golioth_client *client,
+                                      const char *path,
+                                      enum golioth_content_type content_type,
+                                      const uint8_t *payload,
+                                      size_t payload_size,
+                                      enum golioth_status status);
+
+/// Called by the transport when a session ends
+void golioth_lightdb_mirror_disconnected(struct golioth_client *client);
+
+#else
+
+static inline bool golioth_lightdb_mirror_read(struct golioth_client *client,
+                                               const char *path,
+                                               uint8_t *buf,
+                                               size_t *len)
+{
+    return false;
+}
+
+static inline bool golioth_lightdb_mirror_write_begin(struct golioth_client *client,
+                                                      const char *path)
+{
+    return false;
+}
+
+static inline void golioth_lightdb_mirror_write_end(struct golioth_client *client,
+                                                    const char *path,
+                                                    enum golioth_content_type content_type,
+                                                    const uint8_t *payload,
+                                                    size_t payload_size,
+                                                    enum golioth_status status)
+{
+}
+
+static inline void golioth_lightdb_mirror_disconnected(struct golioth_client *client) {}
+
+#endif
@@ -0,0 +1,700 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <golioth/config.h>
+#include <golioth/lightdb_state.h>
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT)
+
+#include <string.h>
+#include <zcbor_encode.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+#include "coap_client.h"
+#include "golioth_util.h"
+#include "heap_accounting.h"
+#include "lightdb_report.h"
+
+LOG_TAG_DEFINE(lightdb_report);
+
+// Fields are updated by the application threads, and uploaded by whichever thread makes the
+// report due: the client thread once the timer expired (golioth_lightdb_report_poll()),
+// golioth_lightdb_report_set_*(), golioth_lightdb_report_flush(), or the callback of the
+// previous upload. All of them hold report->lock while they touch the fields, but not while
+// they enqueue the upload. Only one upload is in flight at a time (upload_in_flight), so the
+// payload buffer is not encoded again before it was copied into the request.
+//
+// The timer only pushes the report on the due list of the client, which is lock-free. is_due
+// keeps a report on the list at most once. It is cleared by the client thread with
+// report->lock held, so golioth_lightdb_report_deinit() knows whether the client thread still
+// holds a reference.
+
+// Largest encoding of a field: text string headers of up to 3 bytes, and a value of up to 9
+#define FIELD_MAX_ENCODED_LEN(key_len, str_len) ((key_len) + 3 + max((str_len) + 3, 9))
+
+// Map header and end, and one field
+#define REPORT_MIN_PAYLOAD_LEN                                                 \
+    (2                                                                         \
+     + FIELD_MAX_ENCODED_LEN(CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_KEY_LEN, \
+                             CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_STRING_LEN))
+
+_Static_assert(CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_PAYLOAD_LEN >= REPORT_MIN_PAYLOAD_LEN,
+               "CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_PAYLOAD_LEN is too small for one field");
+
+enum report_field_type
+{
+    REPORT_FIELD_INT,
+    REPORT_FIELD_BOOL,
+    REPORT_FIELD_FLOAT,
+    REPORT_FIELD_STRING,
+};
+
+struct report_field
+{
+    char key[CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_KEY_LEN + 1];
+    uint32_t hash;
+    enum report_field_type type;
+    union
+    {
+        int32_t i;
+        bool b;
+        float f;
+        char str[CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_STRING_LEN + 1];
+    };
+    size_t str_len;
+    /// Changed since it was last sent
+    bool is_dirty;
+    /// Sent with the upload in flight
+    bool is_in_flight;
+};
+
+struct golioth_lightdb_report
+{
+    struct golioth_client *client;
+    char path[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 1];
+    uint32_t interval_ms;
+    golioth_sys_mutex_t lock;
+    golioth_sys_timer_t timer;
+    struct report_field fields[CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_FIELDS];
+    size_t num_fields;
+    size_t num_dirty;
+    /// Time (since boot) in milliseconds when the oldest unsent change was made
+    uint64_t first_change_ms;
+    bool upload_in_flight;
+    size_t num_in_flight;
+    /// Send the remaining changes as soon as the upload in flight completes
+    bool flush_pending;
+    /// golioth_lightdb_report_deinit() was called while an upload was in flight, or while the
+    /// report was on the due list
+    bool is_released;
+    /// On the due list of the client
+    bool is_due;
+    struct golioth_lightdb_report *next_due;
+    struct golioth_lightdb_report_stats stats;
+    uint8_t payload[CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_PAYLOAD_LEN];
+};
+
+static void report_free(struct golioth_lightdb_report *report)
+{
+    if (report->timer)
+    {
+        golioth_sys_timer_destroy(report->timer);
+    }
+    if (report->lock)
+    {
+        golioth_sys_mutex_destroy(report->lock);
+    }
+    GOLIOTH_HEAP_FREE(report);
+}
+
+static struct report_field *find_field(struct golioth_lightdb_report *report,
+                                       const char *key,
+                                       uint32_t hash)
+{
+    for (size_t i = 0; i < report->num_fields; i++)
+    {
+        struct report_field *field = &report->fields[i];
+
+        if (field->hash == hash && strcmp(field->key, key) == 0)
+        {
+            return field;
+        }
+    }
+
+    return NULL;
+}
+
+static bool field_encode(zcbor_state_t *zse, const struct report_field *field)
+{
+    if (!zcbor_tstr_put_term(zse, field->key, sizeof(field->key)))
+    {
+        return false;
+    }
+
+    switch (field->type)
+    {
+        case REPORT_FIELD_INT:
+            return zcbor_int32_put(zse, field->i);
+        case REPORT_FIELD_BOOL:
+            return zcbor_bool_put(zse, field->b);
+        case REPORT_FIELD_FLOAT:
+            return zcbor_float64_put(zse, (double) field->f);
+        case REPORT_FIELD_STRING:
+            return zcbor_tstr_put_term(zse, field->str, sizeof(field->str));
+    }
+
+    return false;
+}
+
+/// Encode the changed fields into report->payload, and mark them in flight. Fields that do not
+/// fit stay changed, and are sent right after this upload. Called with report->lock held.
+///
+/// @return The length of the payload, or 0 if there is nothing to send
+static size_t report_take(struct golioth_lightdb_report *report)
+{
+    if (report->num_dirty == 0 || report->upload_in_flight)
+    {
+        return 0;
+    }
+
+    ZCBOR_STATE_E(zse, 1, report->payload, sizeof(report->payload), 1);
+    const uint8_t *payload_end = report->payload + sizeof(report->payload);
+    size_t num_encoded = 0;
+
+    if (!zcbor_map_start_encode(zse, report->num_dirty))
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < report->num_fields; i++)
+    {
+        struct report_field *field = &report->fields[i];
+
+        if (!field->is_dirty)
+        {
+            continue;
+        }
+
+        // Keep one byte to close the map
+        size_t str_len = (field->type == REPORT_FIELD_STRING) ? field->str_len : 0;
+        if ((size_t) (payload_end - zse->payload)
+            < 1 + FIELD_MAX_ENCODED_LEN(strlen(field->key), str_len))
+        {
+            report->flush_pending = true;
+            break;
+        }
+
+        if (!field_encode(zse, field))
+        {
+            GLTH_LOGE(TAG, "Failed to encode %s", field->key);
+            return 0;
+        }
+
+        field->is_dirty = false;
+        field->is_in_flight = true;
+        num_encoded++;
+    }
+
+    if (!zcbor_map_end_encode(zse, report->num_dirty))
+    {
+        GLTH_LOGE(TAG, "Failed to close report");
+        return 0;
+    }
+
+    report->num_dirty -= num_encoded;
+    report->upload_in_flight = true;
+    report->num_in_flight = num_encoded;
+    if (report->num_dirty > 0)
+    {
+        report->first_change_ms = golioth_sys_now_ms();
+    }
+
+    return zse->payload - report->payload;
+}
+
+/// The upload in flight completed. Fields it sent are marked changed again if it failed.
+/// Called with report->lock held.
+static void report_complete(struct golioth_lightdb_report *report, bool succeeded)
+{
+    for (size_t i = 0; i < report->num_fields; i++)
+    {
+        struct report_field *field = &report->fields[i];
+
+        if (!field->is_in_flight)
+        {
+            continue;
+        }
+
+        field->is_in_flight = false;
+        if (!succeeded && !field->is_dirty)
+        {
+            field->is_dirty = true;
+            if (report->num_dirty++ == 0)
+            {
+                report->first_change_ms = golioth_sys_now_ms();
+            }
+        }
+    }
+
+    report->upload_in_flight = false;
+    if (!succeeded)
+    {
+        report->stats.failed++;
+    }
+}
+
+static void on_upload(struct golioth_client *client,
+                      enum golioth_status status,
+                      const struct golioth_coap_rsp_code *coap_rsp_code,
+                      const char *path,
+                      void *arg);
+
+/// Enqueue the payload taken by report_take(). Called without report->lock held.
+static enum golioth_status report_send(struct golioth_lightdb_report *report, size_t payload_len)
+{
+    // Another upload may be taken as soon as this one completes, which can be before
+    // golioth_lightdb_set_async() returns
+    size_t num_fields = report->num_in_flight;
+
+    enum golioth_status status = golioth_lightdb_set_async(report->client,
+                                                           report->path,
+                                                           GOLIOTH_CONTENT_TYPE_CBOR,
+                                                           report->payload,
+                                                           payload_len,
+                                                           on_upload,
+                                                           report);
+
+    bool start_timer = false;
+
+    golioth_sys_mutex_lock(report->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (status == GOLIOTH_OK)
+    {
+        report->stats.uploads++;
+        report->stats.fields_uploaded += num_fields;
+    }
+    else
+    {
+        report_complete(report, false);
+        start_timer = report->timer != NULL;
+    }
+
+    golioth_sys_mutex_unlock(report->lock);
+
+    // Try again after another interval
+    if (start_timer)
+    {
+        golioth_sys_timer_start(report->timer);
+    }
+
+    return status;
+}
+
+static bool report_is_due(const struct golioth_lightdb_report *report)
+{
+    return report->num_dirty > 0 && report->interval_ms > 0
+        && golioth_sys_now_ms() - report->first_change_ms >= report->interval_ms;
+}
+
+static void on_upload(struct golioth_client *client,
+                      enum golioth_status status,
+                      const struct golioth_coap_rsp_code *coap_rsp_code,
+                      const char *path,
+                      void *arg)
+{
+    struct golioth_lightdb_report *report = arg;
+    size_t payload_len = 0;
+
+    if (status != GOLIOTH_OK)
+    {
+        GLTH_LOGW(TAG, "Failed to upload report to %s: %d", report->path, status);
+    }
+
+    golioth_sys_mutex_lock(report->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    report_complete(report, status == GOLIOTH_OK);
+
+    if (report->is_released)
+    {
+        // Otherwise freed by golioth_lightdb_report_poll()
+        bool is_due = __atomic_load_n(&report->is_due, __ATOMIC_RELAXED);
+
+        golioth_sys_mutex_unlock(report->lock);
+        if (!is_due)
+        {
+            report_free(report);
+        }
+        return;
+    }
+
+    if (report->flush_pending || report_is_due(report))
+    {
+        report->flush_pending = false;
+        payload_len = report_take(report);
+    }
+
+    // Changes made during the upload, or failed fields, wait for the next interval
+    bool start_timer = payload_len == 0 && report->num_dirty > 0 && report->timer;
+
+    golioth_sys_mutex_unlock(report->lock);
+
+    if (payload_len > 0)
+    {
+        report_send(report, payload_len);
+    }
+    else if (start_timer)
+    {
+        golioth_sys_timer_start(report->timer);
+    }
+}
+
+// Timer callbacks can run in interrupt or signal context, where nothing may lock or enqueue
+static void on_report_timer(golioth_sys_timer_t timer, void *arg)
+{
+    struct golioth_lightdb_report *report = arg;
+    struct golioth_lightdb_report **head =
+        golioth_coap_client_get_lightdb_reports_due(report->client);
+
+    if (__atomic_exchange_n(&report->is_due, true, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    report->next_due = __atomic_load_n(head, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(head,
+                                        &report->next_due,
+                                        report,
+                                        true,
+                                        __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED))
+    {
+    }
+}
+
+void golioth_lightdb_report_poll(struct golioth_client *client)
+{
+    struct golioth_lightdb_report **head = golioth_coap_client_get_lightdb_reports_due(client);
+    struct golioth_lightdb_report *report = __atomic_exchange_n(head, NULL, __ATOMIC_ACQUIRE);
+
+    while (report)
+    {
+        struct golioth_lightdb_report *next = report->next_due;
+        size_t payload_len = 0;
+
+        golioth_sys_mutex_lock(report->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+        __atomic_store_n(&report->is_due, false, __ATOMIC_RELAXED);
+
+        if (report->is_released)
+        {
+            // Otherwise freed by on_upload()
+            bool in_flight = report->upload_in_flight;
+
+            golioth_sys_mutex_unlock(report->lock);
+            if (!in_flight)
+            {
+                report_free(report);
+            }
+            report = next;
+            continue;
+        }
+
+        if (report_is_due(report))
+        {
+            payload_len = report_take(report);
+        }
+
+        golioth_sys_mutex_unlock(report->lock);
+
+        if (payload_len > 0)
+        {
+            report_send(report, payload_len);
+        }
+
+        report = next;
+    }
+}
+
+/// Update a field, creating it if needed. \p value points to the value of the field type, or
+/// to the string for REPORT_FIELD_STRING.
+static enum golioth_status report_set(struct golioth_lightdb_report *report,
+                                      const char *key,
+                                      enum report_field_type type,
+                                      const void *value,
+                                      size_t str_len)
+{
+    if (!report || !key || (type == REPORT_FIELD_STRING && !value))
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    size_t key_len = strlen(key);
+    if (key_len > CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_KEY_LEN
+        || str_len > CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_STRING_LEN)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    uint32_t hash = golioth_hash(key, key_len);
+    enum golioth_status status = GOLIOTH_OK;
+    size_t payload_len = 0;
+    bool start_timer = false;
+
+    golioth_sys_mutex_lock(report->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    struct report_field *field = find_field(report, key, hash);
+    bool changed = true;
+
+    if (field)
+    {
+        if (field->type == type)
+        {
+            switch (type)
+            {
+                case REPORT_FIELD_INT:
+                    changed = field->i != *(const int32_t *) value;
+                    break;
+                case REPORT_FIELD_BOOL:
+                    changed = field->b != *(const bool *) value;
+                    break;
+                case REPORT_FIELD_FLOAT:
+                    changed = memcmp(&field->f, value, sizeof(field->f)) != 0;
+                    break;
+                case REPORT_FIELD_STRING:
+                    changed = field->str_len != str_len || memcmp(field->str, value, str_len) != 0;
+                    break;
+            }
+        }
+    }
+    else if (report->num_fields < ARRAY_SIZE(report->fields))
+    {
+        field = &report->fields[report->num_fields++];
+        memset(field, 0, sizeof(*field));
+        memcpy(field->key, key, key_len);
+        field->hash = hash;
+    }
+    else
+    {
+        GLTH_LOGE(TAG, "No space for field %s", key);
+        status = GOLIOTH_ERR_MEM_ALLOC;
+        goto finish;
+    }
+
+    if (!changed)
+    {
+        report->stats.fields_unchanged++;
+        goto finish;
+    }
+
+    field->type = type;
+    switch (type)
+    {
+        case REPORT_FIELD_INT:
+            field->i = *(const int32_t *) value;
+            break;
+        case REPORT_FIELD_BOOL:
+            field->b = *(const bool *) value;
+            break;
+        case REPORT_FIELD_FLOAT:
+            field->f = *(const float *) value;
+            break;
+        case REPORT_FIELD_STRING:
+            memcpy(field->str, value, str_len);
+            field->str[str_len] = '\0';
+            field->str_len = str_len;
+            break;
+    }
+
+    if (!field->is_dirty)
+    {
+        field->is_dirty = true;
+        if (report->num_dirty++ == 0)
+        {
+            report->first_change_ms = golioth_sys_now_ms();
+            start_timer = report->timer && !report->upload_in_flight;
+        }
+    }
+
+    if (report_is_due(report))
+    {
+        payload_len = report_take(report);
+    }
+
+finish:
+    golioth_sys_mutex_unlock(report->lock);
+
+    // Not done with the lock held, since starting a timer can log
+    if (start_timer)
+    {
+        golioth_sys_timer_start(report->timer);
+    }
+
+    if (payload_len > 0)
+    {
+        report_send(report, payload_len);
+    }
+
+    return status;
+}
+
+struct golioth_lightdb_report *golioth_lightdb_report_init(struct golioth_client *client,
+                                                           const char *path,
+                                                           uint32_t interval_ms)
+{
+    if (!client || !path)
+    {
+        return NULL;
+    }
+
+    if (strlen(path) > CONFIG_GOLIOTH_COAP_MAX_PATH_LEN)
+    {
+        GLTH_LOGE(TAG, "Report path too long: %s", path);
+        return NULL;
+    }
+
+    struct golioth_lightdb_report *report =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_LIGHTDB, sizeof(struct golioth_lightdb_report));
+    if (!report)
+    {
+        return NULL;
+    }
+
+    memset(report, 0, sizeof(*report));
+    report->client = client;
+    strcpy(report->path, path);
+    report->interval_ms = interval_ms;
+
+    report->lock = golioth_sys_mutex_create();
+    if (!report->lock)
+    {
+        goto error;
+    }
+
+    if (interval_ms > 0)
+    {
+        struct golioth_timer_config timer_cfg = {
+            .name = "lightdb_report",
+            .expiration_ms = interval_ms,
+            .fn = on_report_timer,
+            .user_arg = report,
+        };
+        report->timer = golioth_sys_timer_create(&timer_cfg);
+        if (!report->timer)
+        {
+            goto error;
+        }
+    }
+
+    return report;
+
+error:
+    report_free(report);
+    return NULL;
+}
+
+enum golioth_status golioth_lightdb_report_deinit(struct golioth_lightdb_report *report)
+{
+    if (!report)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    if (report->timer)
+    {
+        golioth_sys_timer_destroy(report->timer);
+    }
+
+    golioth_sys_mutex_lock(report->lock, GOLIOTH_SYS_WAIT_FOREVER);
+    report->timer = NULL;
+    bool in_use =
+        report->upload_in_flight || __atomic_load_n(&report->is_due, __ATOMIC_RELAXED);
+    report->is_released = in_use;
+    golioth_sys_mutex_unlock(report->lock);
+
+    if (!in_use)
+    {
+        // Freed by the client thread otherwise, when the upload completes or the report is
+        // taken off the due list
+        report_free(report);
+    }
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_lightdb_report_set_int(struct golioth_lightdb_report *report,
+                                                   const char *key,
+                                                   int32_t value)
+{
+    return report_set(report, key, REPORT_FIELD_INT, &value, 0);
+}
+
+enum golioth_status golioth_lightdb_report_set_bool(struct golioth_lightdb_report *report,
+                                                    const char *key,
+                                                    bool value)
+{
+    return report_set(report, key, REPORT_FIELD_BOOL, &value, 0);
+}
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
+
+enum golioth_status golioth_lightdb_report_set_float(struct golioth_lightdb_report *report,
+                                                     const char *key,
+                                                     float value)
+{
+    return report_set(report, key, REPORT_FIELD_FLOAT, &value, 0);
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
+
+enum golioth_status golioth_lightdb_report_set_string(struct golioth_lightdb_report *report,
+                                                      const char *key,
+                                                      const char *str,
+                                                      size_t str_len)
+{
+    return report_set(report, key, REPORT_FIELD_STRING, str, str_len);
+}
+
+enum golioth_status golioth_lightdb_report_flush(struct golioth_lightdb_report *report)
+{
+    if (!report)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    golioth_sys_mutex_lock(report->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    size_t payload_len = report_take(report);
+    if (payload_len == 0 && report->upload_in_flight)
+    {
+        report->flush_pending = true;
+    }
+
+    golioth_sys_mutex_unlock(report->lock);
+
+    if (payload_len == 0)
+    {
+        return GOLIOTH_OK;
+    }
+
+    return report_send(report, payload_len);
+}
+
+enum golioth_status golioth_lightdb_report_get_stats(struct golioth_lightdb_report *report,
+                                                     struct golioth_lightdb_report_stats *stats)
+{
+    if (!report || !stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    golioth_sys_mutex_lock(report->lock, GOLIOTH_SYS_WAIT_FOREVER);
+    *stats = report->stats;
+    golioth_sys_mutex_unlock(report->lock);
+
+    return GOLIOTH_OK;
+}
+
+#endif /* CONFIG_GOLIOTH_LIGHTDB_STATE && CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT */
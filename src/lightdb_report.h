@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <golioth/client.h>
+#include <golioth/config.h>
+
+// Reported state documents, see golioth_lightdb_report_init().
+//
+// Report timers can run in interrupt or signal context, so they only push their report on a
+// per-client list of due reports. The client thread uploads them from
+// golioth_lightdb_report_poll().
+
+struct golioth_lightdb_report;
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE) && defined(CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT)
+
+/// Called by the client thread before it waits for requests. Uploads the reports whose timer
+/// expired.
+void golioth_lightdb_report_poll(struct golioth_client *client);
+
+#else
+
+static inline void golioth_lightdb_report_poll(struct golioth_client *client) {}
+
+#endif
@@ -5,10 +5,13 @@
  */
 #include <assert.h>
 #include <string.h>
+#include <zcbor_encode.h>
 #include "coap_client.h"
 #include <golioth/lightdb_state.h>
 #include <golioth/payload_utils.h>
 #include "golioth_util.h"
+#include "heap_accounting.h"
+#include "lightdb_mirror.h"
 #include <golioth/golioth_sys.h>
 
 #if defined(CONFIG_GOLIOTH_LIGHTDB_STATE)
@@ -37,32 +40,379 @@ typedef struct
         uint8_t *buf;
     };
     size_t buf_size;  // only applicable for string & binary types
+    enum golioth_content_type content_type;
     bool is_null;
+    bool is_invalid;
 } lightdb_get_response_t;
 
+// Large enough for any int, bool or float value, in JSON or CBOR
+#define LIGHTDB_SCALAR_BUF_LEN 48
+
+// Strings up to this size, once encoded, are encoded on the stack rather than the heap
+#define LIGHTDB_STRING_STACK_BUF_LEN 64
+
+// Largest CBOR text string header
+#define CBOR_TSTR_HEADER_MAX_LEN 9
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR)
+
+// Asynchronous set or delete request on a mirrored path, which reports its completion to the
+// mirror before calling the application's callback
+struct mirror_write
+{
+    golioth_set_cb_fn callback;
+    void *callback_arg;
+    enum golioth_content_type content_type;
+    /// Set requests only, with a value short enough to be mirrored
+    bool has_payload;
+    size_t payload_size;
+    uint8_t payload[];
+};
+
+static void on_mirror_write(struct golioth_client *client,
+                            enum golioth_status status,
+                            const struct golioth_coap_rsp_code *coap_rsp_code,
+                            const char *path,
+                            void *arg)
+{
+    struct mirror_write *write = arg;
+
+    golioth_lightdb_mirror_write_end(client,
+                                     path,
+                                     write->content_type,
+                                     write->has_payload ? write->payload : NULL,
+                                     write->payload_size,
+                                     status);
+
+    if (write->callback)
+    {
+        write->callback(client, status, coap_rsp_code, path, write->callback_arg);
+    }
+
+    GOLIOTH_HEAP_FREE(write);
+}
+
+static struct mirror_write *mirror_write_create(enum golioth_content_type content_type,
+                                                const uint8_t *payload,
+                                                size_t payload_size,
+                                                golioth_set_cb_fn callback,
+                                                void *callback_arg)
+{
+    bool has_payload =
+        payload && payload_size <= CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_VALUE_LEN;
+    size_t size = sizeof(struct mirror_write) + (has_payload ? payload_size : 0);
+
+    struct mirror_write *write = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_LIGHTDB, size);
+    if (!write)
+    {
+        return NULL;
+    }
+
+    write->callback = callback;
+    write->callback_arg = callback_arg;
+    write->content_type = content_type;
+    write->has_payload = has_payload;
+    write->payload_size = has_payload ? payload_size : 0;
+    if (has_payload)
+    {
+        memcpy(write->payload, payload, payload_size);
+    }
+
+    return write;
+}
+
+#endif /* CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR */
+
+// Set (GOLIOTH_COAP_REQUEST_POST) or delete (GOLIOTH_COAP_REQUEST_DELETE) request. Requests on
+// mirrored paths report their completion to the mirror: asynchronous requests from their
+// callback, synchronous requests when they return.
+static enum golioth_status lightdb_write(struct golioth_client *client,
+                                         enum golioth_coap_request_type type,
+                                         const char *path,
+                                         enum golioth_content_type content_type,
+                                         const uint8_t *buf,
+                                         size_t buf_len,
+                                         golioth_set_cb_fn callback,
+                                         void *callback_arg,
+                                         bool is_synchronous,
+                                         int32_t timeout_s)
+{
+    const uint8_t *payload = (type == GOLIOTH_COAP_REQUEST_POST ? buf : NULL);
+    bool is_mirrored = golioth_lightdb_mirror_write_begin(client, path);
+    enum golioth_status status;
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR)
+    struct mirror_write *write = NULL;
+
+    if (is_mirrored && !is_synchronous)
+    {
+        write = mirror_write_create(content_type, payload, buf_len, callback, callback_arg);
+        if (!write)
+        {
+            golioth_lightdb_mirror_write_end(client,
+                                             path,
+                                             content_type,
+                                             payload,
+                                             buf_len,
+                                             GOLIOTH_ERR_MEM_ALLOC);
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+
+        callback = on_mirror_write;
+        callback_arg = write;
+    }
+#endif
+
+    if (type == GOLIOTH_COAP_REQUEST_POST)
+    {
+        uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+        golioth_coap_next_token(token);
+
+        status = golioth_coap_client_set(client,
+                                         token,
+                                         GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                         path,
+                                         content_type,
+                                         buf,
+                                         buf_len,
+                                         callback,
+                                         callback_arg,
+                                         is_synchronous,
+                                         timeout_s);
+    }
+    else
+    {
+        status = golioth_coap_client_delete(client,
+                                            GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                            path,
+                                            callback,
+                                            callback_arg,
+                                            is_synchronous,
+                                            timeout_s);
+    }
+
+    // The callback of an asynchronous request is not called if it was not enqueued
+    if (is_mirrored && (is_synchronous || status != GOLIOTH_OK))
+    {
+        golioth_lightdb_mirror_write_end(client, path, content_type, payload, buf_len, status);
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR)
+        if (write)
+        {
+            GOLIOTH_HEAP_FREE(write);
+        }
+#endif
+    }
+
+    return status;
+}
+
+static enum golioth_status lightdb_set_payload(struct golioth_client *client,
+                                               const char *path,
+                                               enum golioth_content_type content_type,
+                                               const uint8_t *buf,
+                                               size_t buf_len,
+                                               golioth_set_cb_fn callback,
+                                               void *callback_arg,
+                                               bool is_synchronous,
+                                               int32_t timeout_s)
+{
+    return lightdb_write(client,
+                         GOLIOTH_COAP_REQUEST_POST,
+                         path,
+                         content_type,
+                         buf,
+                         buf_len,
+                         callback,
+                         callback_arg,
+                         is_synchronous,
+                         timeout_s);
+}
+
+static enum golioth_status lightdb_set_int(struct golioth_client *client,
+                                           const char *path,
+                                           enum golioth_content_type content_type,
+                                           int32_t value,
+                                           golioth_set_cb_fn callback,
+                                           void *callback_arg,
+                                           bool is_synchronous,
+                                           int32_t timeout_s)
+{
+    uint8_t buf[LIGHTDB_SCALAR_BUF_LEN];
+    size_t len;
+
+    if (content_type == GOLIOTH_CONTENT_TYPE_CBOR)
+    {
+        ZCBOR_STATE_E(zse, 0, buf, sizeof(buf), 1);
+        zcbor_int32_put(zse, value);
+        len = zse->payload - buf;
+    }
+    else
+    {
+        len = snprintf((char *) buf, sizeof(buf), "%" PRId32, value);
+    }
+
+    return lightdb_set_payload(client,
+                               path,
+                               content_type,
+                               buf,
+                               len,
+                               callback,
+                               callback_arg,
+                               is_synchronous,
+                               timeout_s);
+}
+
+static enum golioth_status lightdb_set_bool(struct golioth_client *client,
+                                            const char *path,
+                                            enum golioth_content_type content_type,
+                                            bool value,
+                                            golioth_set_cb_fn callback,
+                                            void *callback_arg,
+                                            bool is_synchronous,
+                                            int32_t timeout_s)
+{
+    uint8_t buf[LIGHTDB_SCALAR_BUF_LEN];
+    size_t len;
+
+    if (content_type == GOLIOTH_CONTENT_TYPE_CBOR)
+    {
+        ZCBOR_STATE_E(zse, 0, buf, sizeof(buf), 1);
+        zcbor_bool_put(zse, value);
+        len = zse->payload - buf;
+    }
+    else
+    {
+        const char *valuestr = (value ? "true" : "false");
+        len = strlen(valuestr);
+        memcpy(buf, valuestr, len);
+    }
+
+    return lightdb_set_payload(client,
+                               path,
+                               content_type,
+                               buf,
+                               len,
+                               callback,
+                               callback_arg,
+                               is_synchronous,
+                               timeout_s);
+}
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
+
+static enum golioth_status lightdb_set_float(struct golioth_client *client,
+                                             const char *path,
+                                             enum golioth_content_type content_type,
+                                             float value,
+                                             golioth_set_cb_fn callback,
+                                             void *callback_arg,
+                                             bool is_synchronous,
+                                             int32_t timeout_s)
+{
+    uint8_t buf[LIGHTDB_SCALAR_BUF_LEN];
+    size_t len;
+
+    if (content_type == GOLIOTH_CONTENT_TYPE_CBOR)
+    {
+        ZCBOR_STATE_E(zse, 0, buf, sizeof(buf), 1);
+        zcbor_float32_put(zse, value);
+        len = zse->payload - buf;
+    }
+    else
+    {
+        len = snprintf((char *) buf, sizeof(buf), "%f", (double) value);
+    }
+
+    return lightdb_set_payload(client,
+                               path,
+                               content_type,
+                               buf,
+                               len,
+                               callback,
+                               callback_arg,
+                               is_synchronous,
+                               timeout_s);
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
+
+static enum golioth_status lightdb_set_string(struct golioth_client *client,
+                                              const char *path,
+                                              enum golioth_content_type content_type,
+                                              const char *str,
+                                              size_t str_len,
+                                              golioth_set_cb_fn callback,
+                                              void *callback_arg,
+                                              bool is_synchronous,
+                                              int32_t timeout_s)
+{
+    uint8_t stack_buf[LIGHTDB_STRING_STACK_BUF_LEN];
+    uint8_t *buf = stack_buf;
+    size_t bufsize = str_len + CBOR_TSTR_HEADER_MAX_LEN;
+    size_t len;
+
+    if (bufsize > sizeof(stack_buf))
+    {
+        buf = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_LIGHTDB, bufsize);
+        if (!buf)
+        {
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+    }
+
+    if (content_type == GOLIOTH_CONTENT_TYPE_CBOR)
+    {
+        struct zcbor_string zstr = {
+            .value = (const uint8_t *) str,
+            .len = str_len,
+        };
+
+        ZCBOR_STATE_E(zse, 0, buf, bufsize, 1);
+        zcbor_tstr_encode(zse, &zstr);
+        len = zse->payload - buf;
+    }
+    else
+    {
+        // Server requires that non-JSON-formatted strings
+        // be surrounded with literal ".
+        buf[0] = '"';
+        memcpy(&buf[1], str, str_len);
+        buf[str_len + 1] = '"';
+        len = str_len + 2;
+    }
+
+    enum golioth_status status = lightdb_set_payload(client,
+                                                     path,
+                                                     content_type,
+                                                     buf,
+                                                     len,
+                                                     callback,
+                                                     callback_arg,
+                                                     is_synchronous,
+                                                     timeout_s);
+
+    if (buf != stack_buf)
+    {
+        GOLIOTH_HEAP_FREE(buf);
+    }
+    return status;
+}
+
 enum golioth_status golioth_lightdb_set_int_async(struct golioth_client *client,
                                                   const char *path,
                                                   int32_t value,
                                                   golioth_set_cb_fn callback,
                                                   void *callback_arg)
 {
-    char buf[16] = {};
-    snprintf(buf, sizeof(buf), "%" PRId32, value);
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) buf,
-                                   strlen(buf),
-                                   callback,
-                                   callback_arg,
-                                   false,
-                                   GOLIOTH_SYS_WAIT_FOREVER);
+    return lightdb_set_int(client,
+                           path,
+                           GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                           value,
+                           callback,
+                           callback_arg,
+                           false,
+                           GOLIOTH_SYS_WAIT_FOREVER);
 }
 
 enum golioth_status golioth_lightdb_set_bool_async(struct golioth_client *client,
@@ -71,22 +421,14 @@ enum golioth_status golioth_lightdb_set_bool_async(struct golioth_client *client
                                                    golioth_set_cb_fn callback,
                                                    void *callback_arg)
 {
-    const char *valuestr = (value ? "true" : "false");
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) valuestr,
-                                   strlen(valuestr),
-                                   callback,
-                                   callback_arg,
-                                   false,
-                                   GOLIOTH_SYS_WAIT_FOREVER);
+    return lightdb_set_bool(client,
+                            path,
+                            GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                            value,
+                            callback,
+                            callback_arg,
+                            false,
+                            GOLIOTH_SYS_WAIT_FOREVER);
 }
 
 #if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
@@ -97,23 +439,14 @@ enum golioth_status golioth_lightdb_set_float_async(struct golioth_client *clien
                                                     golioth_set_cb_fn callback,
                                                     void *callback_arg)
 {
-    char buf[32] = {};
-    snprintf(buf, sizeof(buf), "%f", (double) value);
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) buf,
-                                   strlen(buf),
-                                   callback,
-                                   callback_arg,
-                                   false,
-                                   GOLIOTH_SYS_WAIT_FOREVER);
+    return lightdb_set_float(client,
+                             path,
+                             GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                             value,
+                             callback,
+                             callback_arg,
+                             false,
+                             GOLIOTH_SYS_WAIT_FOREVER);
 }
 
 #endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
@@ -125,34 +458,15 @@ enum golioth_status golioth_lightdb_set_string_async(struct golioth_client *clie
                                                      golioth_set_cb_fn callback,
                                                      void *callback_arg)
 {
-    // Server requires that non-JSON-formatted strings
-    // be surrounded with literal ".
-    size_t bufsize = str_len + 3;  // two " and a NULL
-    char *buf = golioth_sys_malloc(bufsize);
-    if (!buf)
-    {
-        return GOLIOTH_ERR_MEM_ALLOC;
-    }
-    memset(buf, 0, bufsize);
-    snprintf(buf, bufsize, "\"%s\"", str);
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    enum golioth_status status = golioth_coap_client_set(client,
-                                                         token,
-                                                         GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                                         path,
-                                                         GOLIOTH_CONTENT_TYPE_JSON,
-                                                         (const uint8_t *) buf,
-                                                         bufsize - 1,  // excluding NULL
-                                                         callback,
-                                                         callback_arg,
-                                                         false,
-                                                         GOLIOTH_SYS_WAIT_FOREVER);
-
-    golioth_sys_free(buf);
-    return status;
+    return lightdb_set_string(client,
+                              path,
+                              GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                              str,
+                              str_len,
+                              callback,
+                              callback_arg,
+                              false,
+                              GOLIOTH_SYS_WAIT_FOREVER);
 }
 
 enum golioth_status golioth_lightdb_set_async(struct golioth_client *client,
@@ -163,20 +477,15 @@ enum golioth_status golioth_lightdb_set_async(struct golioth_client *client,
                                               golioth_set_cb_fn callback,
                                               void *callback_arg)
 {
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   content_type,
-                                   buf,
-                                   buf_len,
-                                   callback,
-                                   callback_arg,
-                                   false,
-                                   GOLIOTH_SYS_WAIT_FOREVER);
+    return lightdb_set_payload(client,
+                               path,
+                               content_type,
+                               buf,
+                               buf_len,
+                               callback,
+                               callback_arg,
+                               false,
+                               GOLIOTH_SYS_WAIT_FOREVER);
 }
 
 enum golioth_status golioth_lightdb_get_async(struct golioth_client *client,
@@ -204,13 +513,16 @@ enum golioth_status golioth_lightdb_delete_async(struct golioth_client *client,
                                                  golioth_set_cb_fn callback,
                                                  void *callback_arg)
 {
-    return golioth_coap_client_delete(client,
-                                      GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                      path,
-                                      callback,
-                                      callback_arg,
-                                      false,
-                                      GOLIOTH_SYS_WAIT_FOREVER);
+    return lightdb_write(client,
+                         GOLIOTH_COAP_REQUEST_DELETE,
+                         path,
+                         GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                         NULL,
+                         0,
+                         callback,
+                         callback_arg,
+                         false,
+                         GOLIOTH_SYS_WAIT_FOREVER);
 }
 
 enum golioth_status golioth_lightdb_observe_async(struct golioth_client *client,
@@ -236,23 +548,14 @@ enum golioth_status golioth_lightdb_set_int_sync(struct golioth_client *client,
                                                  int32_t value,
                                                  int32_t timeout_s)
 {
-    char buf[16] = {};
-    snprintf(buf, sizeof(buf), "%" PRId32, value);
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) buf,
-                                   strlen(buf),
-                                   NULL,
-                                   NULL,
-                                   true,
-                                   timeout_s);
+    return lightdb_set_int(client,
+                           path,
+                           GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                           value,
+                           NULL,
+                           NULL,
+                           true,
+                           timeout_s);
 }
 
 enum golioth_status golioth_lightdb_set_bool_sync(struct golioth_client *client,
@@ -260,22 +563,14 @@ enum golioth_status golioth_lightdb_set_bool_sync(struct golioth_client *client,
                                                   bool value,
                                                   int32_t timeout_s)
 {
-    const char *valuestr = (value ? "true" : "false");
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) valuestr,
-                                   strlen(valuestr),
-                                   NULL,
-                                   NULL,
-                                   true,
-                                   timeout_s);
+    return lightdb_set_bool(client,
+                            path,
+                            GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                            value,
+                            NULL,
+                            NULL,
+                            true,
+                            timeout_s);
 }
 
 #if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
@@ -285,23 +580,14 @@ enum golioth_status golioth_lightdb_set_float_sync(struct golioth_client *client
                                                    float value,
                                                    int32_t timeout_s)
 {
-    char buf[32] = {};
-    snprintf(buf, sizeof(buf), "%f", (double) value);
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) buf,
-                                   strlen(buf),
-                                   NULL,
-                                   NULL,
-                                   true,
-                                   timeout_s);
+    return lightdb_set_float(client,
+                             path,
+                             GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                             value,
+                             NULL,
+                             NULL,
+                             true,
+                             timeout_s);
 }
 
 #endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
@@ -312,34 +598,15 @@ enum golioth_status golioth_lightdb_set_string_sync(struct golioth_client *clien
                                                     size_t str_len,
                                                     int32_t timeout_s)
 {
-    // Server requires that non-JSON-formatted strings
-    // be surrounded with literal ".
-    size_t bufsize = str_len + 3;  // two " and a NULL
-    char *buf = golioth_sys_malloc(bufsize);
-    if (!buf)
-    {
-        return GOLIOTH_ERR_MEM_ALLOC;
-    }
-    memset(buf, 0, bufsize);
-    snprintf(buf, bufsize, "\"%s\"", str);
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    enum golioth_status status = golioth_coap_client_set(client,
-                                                         token,
-                                                         GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                                         path,
-                                                         GOLIOTH_CONTENT_TYPE_JSON,
-                                                         (const uint8_t *) buf,
-                                                         bufsize - 1,  // excluding NULL
-                                                         NULL,
-                                                         NULL,
-                                                         true,
-                                                         timeout_s);
-
-    golioth_sys_free(buf);
-    return status;
+    return lightdb_set_string(client,
+                              path,
+                              GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                              str,
+                              str_len,
+                              NULL,
+                              NULL,
+                              true,
+                              timeout_s);
 }
 
 enum golioth_status golioth_lightdb_set_sync(struct golioth_client *client,
@@ -349,20 +616,53 @@ enum golioth_status golioth_lightdb_set_sync(struct golioth_client *client,
                                              size_t buf_len,
                                              int32_t timeout_s)
 {
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
+    return lightdb_set_payload(client,
+                               path,
+                               content_type,
+                               buf,
+                               buf_len,
+                               NULL,
+                               NULL,
+                               true,
+                               timeout_s);
+}
 
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   content_type,
-                                   buf,
-                                   buf_len,
-                                   NULL,
-                                   NULL,
-                                   true,
-                                   timeout_s);
+static enum golioth_status decode_cbor_payload(lightdb_get_response_t *ldb_response,
+                                               const uint8_t *payload,
+                                               size_t payload_size)
+{
+    switch (ldb_response->type)
+    {
+        case LIGHTDB_GET_TYPE_INT:
+            return golioth_payload_cbor_as_int(payload, payload_size, ldb_response->i);
+        case LIGHTDB_GET_TYPE_FLOAT:
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
+            return golioth_payload_cbor_as_float(payload, payload_size, ldb_response->f);
+#else
+            GLTH_LOGE(TAG, "Float support disabled");
+            return GOLIOTH_ERR_NOT_IMPLEMENTED;
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
+        case LIGHTDB_GET_TYPE_BOOL:
+            return golioth_payload_cbor_as_bool(payload, payload_size, ldb_response->b);
+        case LIGHTDB_GET_TYPE_STRING:
+        {
+            const char *str;
+            size_t str_len;
+
+            enum golioth_status status =
+                golioth_payload_cbor_as_string(payload, payload_size, &str, &str_len);
+            if (status == GOLIOTH_OK)
+            {
+                size_t nbytes = min(ldb_response->buf_size - 1, str_len);
+                memcpy(ldb_response->buf, str, nbytes);
+                ldb_response->buf[nbytes] = 0;
+            }
+            return status;
+        }
+        default:
+            assert(false);
+            return GOLIOTH_ERR_NOT_IMPLEMENTED;
+    }
 }
 
 static void on_payload(struct golioth_client *client,
@@ -382,6 +682,22 @@ static void on_payload(struct golioth_client *client,
         return;
     }
 
+    if (ldb_response->content_type == GOLIOTH_CONTENT_TYPE_CBOR
+        && ldb_response->type != LIGHTDB_GET_TYPE_BINARY)
+    {
+        status = decode_cbor_payload(ldb_response, payload, payload_size);
+        if (status == GOLIOTH_ERR_NULL)
+        {
+            ldb_response->is_null = true;
+        }
+        else if (status != GOLIOTH_OK)
+        {
+            GLTH_LOGE(TAG, "Invalid CBOR value at %s", path);
+            ldb_response->is_invalid = true;
+        }
+        return;
+    }
+
     if (golioth_payload_is_null(payload, payload_size))
     {
         ldb_response->is_null = true;
@@ -420,15 +736,26 @@ static void on_payload(struct golioth_client *client,
     }
 }
 
-enum golioth_status golioth_lightdb_get_int_sync(struct golioth_client *client,
-                                                 const char *path,
-                                                 int32_t *value,
-                                                 int32_t timeout_s)
+static enum golioth_status lightdb_get_sync(struct golioth_client *client,
+                                            const char *path,
+                                            enum golioth_content_type content_type,
+                                            lightdb_get_response_t *response,
+                                            int32_t timeout_s)
 {
-    lightdb_get_response_t response = {
-        .type = LIGHTDB_GET_TYPE_INT,
-        .i = value,
-    };
+    response->content_type = content_type;
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR)
+    uint8_t value[CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR_MAX_VALUE_LEN];
+    size_t value_len;
+
+    // Values are mirrored with the content type of the typed helpers
+    if (content_type == GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE
+        && golioth_lightdb_mirror_read(client, path, value, &value_len))
+    {
+        on_payload(client, GOLIOTH_OK, NULL, path, value, value_len, response);
+        return response->is_invalid ? GOLIOTH_ERR_INVALID_FORMAT : GOLIOTH_OK;
+    }
+#endif
 
     uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
     golioth_coap_next_token(token);
@@ -437,11 +764,31 @@ enum golioth_status golioth_lightdb_get_int_sync(struct golioth_client *client,
                                                          token,
                                                          GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
                                                          path,
-                                                         GOLIOTH_CONTENT_TYPE_JSON,
+                                                         content_type,
                                                          on_payload,
-                                                         &response,
+                                                         response,
                                                          true,
                                                          timeout_s);
+
+    if (status == GOLIOTH_OK && response->is_invalid)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+    return status;
+}
+
+enum golioth_status golioth_lightdb_get_int_sync(struct golioth_client *client,
+                                                 const char *path,
+                                                 int32_t *value,
+                                                 int32_t timeout_s)
+{
+    lightdb_get_response_t response = {
+        .type = LIGHTDB_GET_TYPE_INT,
+        .i = value,
+    };
+
+    enum golioth_status status =
+        lightdb_get_sync(client, path, GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE, &response, timeout_s);
     if (status == GOLIOTH_OK && response.is_null)
     {
         return GOLIOTH_ERR_NULL;
@@ -459,18 +806,8 @@ enum golioth_status golioth_lightdb_get_bool_sync(struct golioth_client *client,
         .b = value,
     };
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    enum golioth_status status = golioth_coap_client_get(client,
-                                                         token,
-                                                         GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                                         path,
-                                                         GOLIOTH_CONTENT_TYPE_JSON,
-                                                         on_payload,
-                                                         &response,
-                                                         true,
-                                                         timeout_s);
+    enum golioth_status status =
+        lightdb_get_sync(client, path, GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE, &response, timeout_s);
     if (status == GOLIOTH_OK && response.is_null)
     {
         return GOLIOTH_ERR_NULL;
@@ -490,18 +827,8 @@ enum golioth_status golioth_lightdb_get_float_sync(struct golioth_client *client
         .f = value,
     };
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    enum golioth_status status = golioth_coap_client_get(client,
-                                                         token,
-                                                         GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                                         path,
-                                                         GOLIOTH_CONTENT_TYPE_JSON,
-                                                         on_payload,
-                                                         &response,
-                                                         true,
-                                                         timeout_s);
+    enum golioth_status status =
+        lightdb_get_sync(client, path, GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE, &response, timeout_s);
     if (status == GOLIOTH_OK && response.is_null)
     {
         return GOLIOTH_ERR_NULL;
@@ -523,18 +850,8 @@ enum golioth_status golioth_lightdb_get_string_sync(struct golioth_client *clien
         .buf_size = strbuf_size,
     };
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    enum golioth_status status = golioth_coap_client_get(client,
-                                                         token,
-                                                         GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                                         path,
-                                                         GOLIOTH_CONTENT_TYPE_JSON,
-                                                         on_payload,
-                                                         &response,
-                                                         true,
-                                                         timeout_s);
+    enum golioth_status status =
+        lightdb_get_sync(client, path, GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE, &response, timeout_s);
     if (status == GOLIOTH_OK && response.is_null)
     {
         return GOLIOTH_ERR_NULL;
@@ -555,18 +872,8 @@ enum golioth_status golioth_lightdb_get_sync(struct golioth_client *client,
         .buf_size = *buf_size,
     };
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    enum golioth_status status = golioth_coap_client_get(client,
-                                                         token,
-                                                         GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                                         path,
-                                                         content_type,
-                                                         on_payload,
-                                                         &response,
-                                                         true,
-                                                         timeout_s);
+    enum golioth_status status =
+        lightdb_get_sync(client, path, content_type, &response, timeout_s);
     *buf_size = response.buf_size;
     if (status == GOLIOTH_OK && response.is_null)
     {
@@ -579,13 +886,16 @@ enum golioth_status golioth_lightdb_delete_sync(struct golioth_client *client,
                                                 const char *path,
                                                 int32_t timeout_s)
 {
-    return golioth_coap_client_delete(client,
-                                      GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                      path,
-                                      NULL,
-                                      NULL,
-                                      true,
-                                      timeout_s);
+    return lightdb_write(client,
+                         GOLIOTH_COAP_REQUEST_DELETE,
+                         path,
+                         GOLIOTH_LIGHTDB_TYPED_CONTENT_TYPE,
+                         NULL,
+                         0,
+                         NULL,
+                         NULL,
+                         true,
+                         timeout_s);
 }
 
 #endif  // CONFIG_GOLIOTH_LIGHTDB_STATE
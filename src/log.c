@@ -4,8 +4,14 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
 #include <zcbor_encode.h>
 #include "coap_client.h"
+#include "heap_accounting.h"
+#include "log_batch.h"
+#include "log_dict.h"
 #include <golioth/log.h>
 #include <golioth/golioth_debug.h>
 #include <golioth/zcbor_utils.h>
@@ -35,68 +41,673 @@ static const char *_level_to_str[GOLIOTH_LOG_LEVEL_DEBUG + 1] = {
     [GOLIOTH_LOG_LEVEL_INFO] = "info",
     [GOLIOTH_LOG_LEVEL_DEBUG] = "debug"};
 
-static enum golioth_status golioth_log_internal(struct golioth_client *client,
-                                                golioth_log_level_t level,
-                                                const char *tag,
-                                                const char *log_message,
-                                                bool is_synchronous,
-                                                int32_t timeout_s,
-                                                golioth_set_cb_fn callback,
-                                                void *callback_arg)
+/// A log message
+struct log_record
 {
-    assert(level <= GOLIOTH_LOG_LEVEL_DEBUG);
+    golioth_log_level_t level;
+    const char *tag;
+    /// Message text, NULL for a dictionary record
+    const char *msg;
+#if defined(CONFIG_GOLIOTH_LOG_DICTIONARY)
+    /// Format string in the dictionary section, and its arguments
+    const char *format;
+    va_list *args;
+#endif
+};
 
-    uint8_t *cbor_buf = malloc(CBOR_LOG_MAX_LEN);
-    enum golioth_status status = GOLIOTH_ERR_SERIALIZE;
-    bool ok;
+#if defined(CONFIG_GOLIOTH_LOG_DICTIONARY)
 
-    if (!cbor_buf)
+// Keeps the dictionary section, and so its start symbol, in builds without any GLTH_LOGX
+// statement
+static const char log_dict_anchor[]
+    __attribute__((section(GOLIOTH_LOG_DICT_SECTION), used, aligned(1))) = "";
+
+/// Upper bound for the number of arguments of a format string
+#define LOG_DICT_MAX_ARGS 32
+
+/// Encode the arguments of a printf() format string as a CBOR array, in order. Integers are
+/// encoded as integers, floating point numbers as float64 and strings as text strings.
+/// Arguments for '*' widths and precisions are encoded like the other integers.
+///
+/// Only the types of the arguments are needed, so the format string is scanned but nothing is
+/// formatted.
+static bool log_encode_args(zcbor_state_t *zse, const char *format, va_list args)
+{
+    if (!zcbor_list_start_encode(zse, LOG_DICT_MAX_ARGS))
     {
-        return GOLIOTH_ERR_MEM_ALLOC;
+        return false;
     }
 
-    ZCBOR_STATE_E(zse, 1, cbor_buf, CBOR_LOG_MAX_LEN, 1);
+    size_t num_args = 0;
+    bool ok = true;
 
-    ok = zcbor_map_start_encode(zse, 3);
-    if (!ok)
+    for (const char *c = format; ok && *c; c++)
     {
-        goto cleanup;
+        if (*c != '%')
+        {
+            continue;
+        }
+
+        c++;
+        if (*c == '%')
+        {
+            continue;
+        }
+
+        // Flags
+        while (*c == '-' || *c == '+' || *c == ' ' || *c == '#' || *c == '0')
+        {
+            c++;
+        }
+
+        // Width
+        if (*c == '*')
+        {
+            ok = ok && zcbor_int64_put(zse, va_arg(args, int));
+            num_args++;
+            c++;
+        }
+        while (*c >= '0' && *c <= '9')
+        {
+            c++;
+        }
+
+        // Precision, which limits the length of strings
+        size_t precision = SIZE_MAX;
+        if (*c == '.')
+        {
+            c++;
+            if (*c == '*')
+            {
+                int arg = va_arg(args, int);
+                ok = ok && zcbor_int64_put(zse, arg);
+                num_args++;
+                precision = (arg >= 0) ? (size_t) arg : SIZE_MAX;
+                c++;
+            }
+            else
+            {
+                precision = 0;
+                while (*c >= '0' && *c <= '9')
+                {
+                    precision = precision * 10 + (*c - '0');
+                    c++;
+                }
+            }
+        }
+
+        // Length modifier
+        char length = 0;
+        if (*c == 'h' || *c == 'l')
+        {
+            length = *c++;
+            if (*c == length)
+            {
+                // 'H' for hh, 'L' for ll
+                length = (length == 'h') ? 'H' : 'L';
+                c++;
+            }
+        }
+        else if (*c == 'j' || *c == 'z' || *c == 't' || *c == 'L')
+        {
+            length = *c++;
+        }
+
+        switch (*c)
+        {
+            case 'd':
+            case 'i':
+            {
+                int64_t value;
+                switch (length)
+                {
+                    case 'l':
+                        value = va_arg(args, long);
+                        break;
+                    case 'L':
+                        value = va_arg(args, long long);
+                        break;
+                    case 'j':
+                        value = va_arg(args, intmax_t);
+                        break;
+                    case 'z':
+                        value = (int64_t) va_arg(args, size_t);
+                        break;
+                    case 't':
+                        value = va_arg(args, ptrdiff_t);
+                        break;
+                    default:
+                        value = va_arg(args, int);
+                        break;
+                }
+                ok = zcbor_int64_put(zse, value);
+                break;
+            }
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+            case 'c':
+            {
+                uint64_t value;
+                switch (length)
+                {
+                    case 'l':
+                        value = va_arg(args, unsigned long);
+                        break;
+                    case 'L':
+                        value = va_arg(args, unsigned long long);
+                        break;
+                    case 'j':
+                        value = va_arg(args, uintmax_t);
+                        break;
+                    case 'z':
+                        value = va_arg(args, size_t);
+                        break;
+                    case 't':
+                        value = (uint64_t) va_arg(args, ptrdiff_t);
+                        break;
+                    default:
+                        value = va_arg(args, unsigned int);
+                        break;
+                }
+                ok = zcbor_uint64_put(zse, value);
+                break;
+            }
+            case 'p':
+                ok = zcbor_uint64_put(zse, (uintptr_t) va_arg(args, void *));
+                break;
+            case 's':
+            {
+                const char *str = va_arg(args, const char *);
+                ok = zcbor_tstr_put_term(zse, str ? str : "(null)", precision);
+                break;
+            }
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (length == 'L')
+                {
+                    ok = zcbor_float64_put(zse, (double) va_arg(args, long double));
+                }
+                else
+                {
+                    ok = zcbor_float64_put(zse, va_arg(args, double));
+                }
+                break;
+            default:
+                // %n, or not a conversion the host tool could expand either
+                return false;
+        }
+        num_args++;
     }
 
-    ok = zcbor_tstr_put_lit(zse, "level") && zcbor_tstr_put_term(zse, _level_to_str[level], 5)
-        && zcbor_tstr_put_lit(zse, "module") && zcbor_tstr_put_term(zse, tag, SIZE_MAX)
-        && zcbor_tstr_put_lit(zse, "msg") && zcbor_tstr_put_term(zse, log_message, SIZE_MAX);
+    return ok && num_args <= LOG_DICT_MAX_ARGS
+        && zcbor_list_end_encode(zse, LOG_DICT_MAX_ARGS);
+}
+
+#endif /* CONFIG_GOLIOTH_LOG_DICTIONARY */
+
+/// Encode \p record as a map. With \p uptime_us, for batched records, that is added to the map.
+static bool log_record_encode(zcbor_state_t *zse,
+                              const struct log_record *record,
+                              const uint64_t *uptime_us)
+{
+    // level, module, msg (or format ID and arguments) and uptime
+    const size_t max_keys = 5;
+
+    bool ok = zcbor_map_start_encode(zse, max_keys) && zcbor_tstr_put_lit(zse, "level")
+        && zcbor_tstr_put_term(zse, _level_to_str[record->level], 5)
+        && zcbor_tstr_put_lit(zse, "module") && zcbor_tstr_put_term(zse, record->tag, SIZE_MAX);
     if (!ok)
     {
-        goto cleanup;
+        return false;
     }
 
-    ok = zcbor_map_end_encode(zse, 3);
-    if (!ok)
+#if defined(CONFIG_GOLIOTH_LOG_DICTIONARY)
+    if (!record->msg)
+    {
+        va_list args;
+        va_copy(args, *record->args);
+        ok = zcbor_tstr_put_lit(zse, "fmt_id")
+            && zcbor_uint32_put(zse, golioth_log_dict_format_id(record->format))
+            && zcbor_tstr_put_lit(zse, "args") && log_encode_args(zse, record->format, args);
+        va_end(args);
+    }
+    else
+#endif
+    {
+        ok = zcbor_tstr_put_lit(zse, "msg") && zcbor_tstr_put_term(zse, record->msg, SIZE_MAX);
+    }
+
+    if (ok && uptime_us)
     {
-        goto cleanup;
+        ok = zcbor_tstr_put_lit(zse, "uptime") && zcbor_uint64_put(zse, *uptime_us);
     }
 
+    return ok && zcbor_map_end_encode(zse, max_keys);
+}
+
+static enum golioth_status golioth_log_send(struct golioth_client *client,
+                                            const uint8_t *payload,
+                                            size_t payload_size,
+                                            bool is_synchronous,
+                                            int32_t timeout_s,
+                                            golioth_set_cb_fn callback,
+                                            void *callback_arg)
+{
     uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
     golioth_coap_next_token(token);
 
-    status = golioth_coap_client_set(client,
-                                     token,
-                                     "",  // path-prefix unused
-                                     "logs",
-                                     GOLIOTH_CONTENT_TYPE_CBOR,
-                                     cbor_buf,
-                                     zse->payload - cbor_buf,
-                                     callback,
-                                     callback_arg,
-                                     is_synchronous,
-                                     timeout_s);
-
-cleanup:
-    free(cbor_buf);
+    return golioth_coap_client_set(client,
+                                   token,
+                                   "",  // path-prefix unused
+                                   "logs",
+                                   GOLIOTH_CONTENT_TYPE_CBOR,
+                                   payload,
+                                   payload_size,
+                                   callback,
+                                   callback_arg,
+                                   is_synchronous,
+                                   timeout_s);
+}
+
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+
+// Log batching
+//
+// Records are encoded back to back in batch->records, each as a map with the same keys as a
+// single log message plus "uptime" (microseconds). They are sent as one CBOR array, by
+// prefixing the definite-length array header when the batch is taken out. A batch is sent:
+//
+// - when the next record does not fit
+// - when an error is logged, or a record more severe than all records in the batch
+// - when the oldest record is CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS old, by the client thread
+//   (golioth_log_batch_poll(), once the timer marked the batch as due) or the next log call
+//
+// The lock only protects the buffer. Sending happens after releasing it, because enqueueing
+// a request can log, and that log message can come back here.
+
+static size_t log_batch_array_header(uint8_t *buf, uint16_t num_records)
+{
+    if (num_records < 24)
+    {
+        buf[0] = 0x80 | num_records;
+        return 1;
+    }
+    if (num_records <= UINT8_MAX)
+    {
+        buf[0] = 0x98;
+        buf[1] = num_records;
+        return 2;
+    }
+
+    buf[0] = 0x99;
+    buf[1] = num_records >> 8;
+    buf[2] = num_records & 0xff;
+    return 3;
+}
+
+/// Take the records out of the batch, as a CBOR array. Called with batch->lock held.
+///
+/// Returns NULL if the batch is empty. The records are dropped if no memory is available.
+static uint8_t *log_batch_take(struct golioth_log_batch *batch, size_t *payload_size)
+{
+    if (batch->num_records == 0)
+    {
+        return NULL;
+    }
+
+    uint8_t *payload =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_LOG, GOLIOTH_LOG_BATCH_ARRAY_HEADER_MAX_LEN + batch->len);
+    if (payload)
+    {
+        size_t header_len = log_batch_array_header(payload, batch->num_records);
+        memcpy(&payload[header_len], batch->records, batch->len);
+        *payload_size = header_len + batch->len;
+    }
+
+    batch->len = 0;
+    batch->num_records = 0;
+    batch->most_severe_level = GOLIOTH_LOG_LEVEL_DEBUG;
+
+    return payload;
+}
+
+static void log_batch_send(struct golioth_client *client, uint8_t *payload, size_t payload_size)
+{
+    if (!payload)
+    {
+        return;
+    }
+
+    // Nobody waits for the result, a batch that can't be enqueued is dropped
+    golioth_log_send(client,
+                     payload,
+                     payload_size,
+                     false,
+                     GOLIOTH_SYS_WAIT_FOREVER,
+                     NULL,
+                     NULL);
+    GOLIOTH_HEAP_FREE(payload);
+}
+
+static bool log_batch_is_old(const struct golioth_log_batch *batch)
+{
+    return batch->num_records > 0
+        && golioth_sys_now_ms() - batch->first_record_ms >= CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS;
+}
+
+/// Encode a record at the end of the batch. Called with batch->lock held.
+static bool log_batch_encode(struct golioth_log_batch *batch,
+                             const struct log_record *record,
+                             uint64_t now_ms)
+{
+    ZCBOR_STATE_E(zse,
+                  1,
+                  &batch->records[batch->len],
+                  sizeof(batch->records) - batch->len,
+                  1);
+    uint64_t uptime_us = now_ms * 1000;
+
+    if (!log_record_encode(zse, record, &uptime_us))
+    {
+        return false;
+    }
+
+    if (batch->num_records == 0)
+    {
+        batch->first_record_ms = now_ms;
+    }
+
+    batch->len = zse->payload - batch->records;
+    batch->num_records++;
+
+    return true;
+}
+
+static enum golioth_status log_batch_add(struct golioth_client *client,
+                                         const struct log_record *record)
+{
+    struct golioth_log_batch *batch = golioth_coap_client_get_log_batch(client);
+    uint64_t now_ms = golioth_sys_now_ms();
+    uint8_t *full_payload = NULL;
+    size_t full_payload_size = 0;
+    uint8_t *payload = NULL;
+    size_t payload_size = 0;
+
+    golioth_sys_mutex_lock(batch->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (log_batch_is_old(batch) || batch->num_records == UINT16_MAX)
+    {
+        full_payload = log_batch_take(batch, &full_payload_size);
+    }
+
+    golioth_log_level_t level = record->level;
+    bool escalation = batch->num_records > 0 && level < batch->most_severe_level;
+
+    bool added = log_batch_encode(batch, record, now_ms);
+    if (!added && batch->num_records > 0)
+    {
+        full_payload = log_batch_take(batch, &full_payload_size);
+        added = log_batch_encode(batch, record, now_ms);
+    }
+
+    if (added)
+    {
+        if (level < batch->most_severe_level)
+        {
+            batch->most_severe_level = level;
+        }
+
+        if (level == GOLIOTH_LOG_LEVEL_ERROR || escalation)
+        {
+            payload = log_batch_take(batch, &payload_size);
+        }
+    }
+
+    // First record of a new batch, time its age. Not done with the lock held, since
+    // starting a timer can log.
+    bool start_timer = batch->num_records == 1;
+
+    golioth_sys_mutex_unlock(batch->lock);
+
+    if (start_timer)
+    {
+        golioth_sys_timer_start(batch->timer);
+    }
+
+    log_batch_send(client, full_payload, full_payload_size);
+    log_batch_send(client, payload, payload_size);
+
+    // Does not fit in an empty batch, the caller sends it on its own
+    return added ? GOLIOTH_OK : GOLIOTH_ERR_MEM_ALLOC;
+}
+
+static void log_batch_flush(struct golioth_client *client)
+{
+    struct golioth_log_batch *batch = golioth_coap_client_get_log_batch(client);
+    uint8_t *payload;
+    size_t payload_size = 0;
+
+    golioth_sys_mutex_lock(batch->lock, GOLIOTH_SYS_WAIT_FOREVER);
+    payload = log_batch_take(batch, &payload_size);
+    golioth_sys_mutex_unlock(batch->lock);
+
+    log_batch_send(client, payload, payload_size);
+}
+
+// Timer callbacks can run in interrupt or signal context, where nothing may allocate, lock or
+// enqueue. The client thread sends the batch from golioth_log_batch_poll().
+static void on_log_batch_timer(golioth_sys_timer_t timer, void *arg)
+{
+    struct golioth_client *client = arg;
+    struct golioth_log_batch *batch = golioth_coap_client_get_log_batch(client);
+
+    __atomic_store_n(&batch->is_due, true, __ATOMIC_RELAXED);
+}
+
+void golioth_log_batch_poll(struct golioth_client *client)
+{
+    struct golioth_log_batch *batch = golioth_coap_client_get_log_batch(client);
+    uint8_t *payload = NULL;
+    size_t payload_size = 0;
+
+    if (!__atomic_exchange_n(&batch->is_due, false, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    golioth_sys_mutex_lock(batch->lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (log_batch_is_old(batch))
+    {
+        payload = log_batch_take(batch, &payload_size);
+    }
+
+    golioth_sys_mutex_unlock(batch->lock);
+
+    log_batch_send(client, payload, payload_size);
+}
+
+enum golioth_status golioth_log_batch_init(struct golioth_client *client,
+                                           struct golioth_log_batch *batch)
+{
+    batch->len = 0;
+    batch->num_records = 0;
+    batch->most_severe_level = GOLIOTH_LOG_LEVEL_DEBUG;
+    batch->is_due = false;
+
+    batch->lock = golioth_sys_mutex_create();
+    if (!batch->lock)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    struct golioth_timer_config timer_cfg = {
+        .name = "log_batch",
+        .expiration_ms = CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS,
+        .fn = on_log_batch_timer,
+        .user_arg = client,
+    };
+    batch->timer = golioth_sys_timer_create(&timer_cfg);
+    if (!batch->timer)
+    {
+        golioth_sys_mutex_destroy(batch->lock);
+        batch->lock = NULL;
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    return GOLIOTH_OK;
+}
+
+void golioth_log_batch_deinit(struct golioth_log_batch *batch)
+{
+    if (batch->timer)
+    {
+        golioth_sys_timer_destroy(batch->timer);
+        batch->timer = NULL;
+    }
+    if (batch->lock)
+    {
+        golioth_sys_mutex_destroy(batch->lock);
+        batch->lock = NULL;
+    }
+}
+
+#endif /* CONFIG_GOLIOTH_LOG_BATCH */
+
+static enum golioth_status golioth_log_record(struct golioth_client *client,
+                                              const struct log_record *record,
+                                              bool is_synchronous,
+                                              int32_t timeout_s,
+                                              golioth_set_cb_fn callback,
+                                              void *callback_arg)
+{
+    assert(record->level <= GOLIOTH_LOG_LEVEL_DEBUG);
+
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+    if (!client)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    if (!is_synchronous && !callback)
+    {
+        if (log_batch_add(client, record) == GOLIOTH_OK)
+        {
+            return GOLIOTH_OK;
+        }
+    }
+    else
+    {
+        // Keep the order of log messages, send what is batched first
+        log_batch_flush(client);
+    }
+#endif
+
+    uint8_t *cbor_buf = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_LOG, CBOR_LOG_MAX_LEN);
+    enum golioth_status status = GOLIOTH_ERR_SERIALIZE;
+
+    if (!cbor_buf)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    ZCBOR_STATE_E(zse, 1, cbor_buf, CBOR_LOG_MAX_LEN, 1);
+
+    if (log_record_encode(zse, record, NULL))
+    {
+        status = golioth_log_send(client,
+                                  cbor_buf,
+                                  zse->payload - cbor_buf,
+                                  is_synchronous,
+                                  timeout_s,
+                                  callback,
+                                  callback_arg);
+    }
+
+    GOLIOTH_HEAP_FREE(cbor_buf);
+    return status;
+}
+
+static enum golioth_status golioth_log_internal(struct golioth_client *client,
+                                                golioth_log_level_t level,
+                                                const char *tag,
+                                                const char *log_message,
+                                                bool is_synchronous,
+                                                int32_t timeout_s,
+                                                golioth_set_cb_fn callback,
+                                                void *callback_arg)
+{
+    struct log_record record = {
+        .level = level,
+        .tag = tag,
+        .msg = log_message,
+    };
+
+    return golioth_log_record(client,
+                              &record,
+                              is_synchronous,
+                              timeout_s,
+                              callback,
+                              callback_arg);
+}
+
+#if defined(CONFIG_GOLIOTH_LOG_DICTIONARY)
+
+enum golioth_status golioth_log_dict_async(struct golioth_client *client,
+                                           enum golioth_debug_log_level level,
+                                           const char *tag,
+                                           const char *format,
+                                           va_list args)
+{
+    // A va_list parameter may be a pointer, copy it to have a va_list object to point to
+    va_list args_copy;
+    va_copy(args_copy, args);
+
+    struct log_record record = {
+        .tag = tag,
+        .format = format,
+        .args = &args_copy,
+    };
+
+    switch (level)
+    {
+        case GOLIOTH_DEBUG_LOG_LEVEL_ERROR:
+            record.level = GOLIOTH_LOG_LEVEL_ERROR;
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_WARN:
+            record.level = GOLIOTH_LOG_LEVEL_WARN;
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_INFO:
+            record.level = GOLIOTH_LOG_LEVEL_INFO;
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_DEBUG:
+        case GOLIOTH_DEBUG_LOG_LEVEL_VERBOSE:
+            record.level = GOLIOTH_LOG_LEVEL_DEBUG;
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_NONE:
+        default:
+            va_end(args_copy);
+            return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    enum golioth_status status =
+        golioth_log_record(client, &record, false, GOLIOTH_SYS_WAIT_FOREVER, NULL, NULL);
+
+    va_end(args_copy);
+
     return status;
 }
 
+#endif /* CONFIG_GOLIOTH_LOG_DICTIONARY */
+
 enum golioth_status golioth_log_error_async(struct golioth_client *client,
                                             const char *tag,
                                             const char *log_message,
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/config.h>
+#include <golioth/golioth_status.h>
+#include <golioth/golioth_sys.h>
+
+// Cloud log batching.
+//
+// With CONFIG_GOLIOTH_LOG_BATCH, asynchronous log messages without a callback are encoded into
+// a per-client buffer and uploaded together, as one CBOR array per CoAP request, instead of one
+// request each. See log.c for when a batch is sent.
+
+struct golioth_client;
+
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+
+/// Largest definite-length CBOR array header of a batch
+#define GOLIOTH_LOG_BATCH_ARRAY_HEADER_MAX_LEN 3
+
+/// Records that fit in one request with their array header. A batch is sent as a single
+/// request, not blockwise, so it must fit in CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE.
+#define GOLIOTH_LOG_BATCH_BLOCK_MAX_LEN \
+    (CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE - GOLIOTH_LOG_BATCH_ARRAY_HEADER_MAX_LEN)
+
+/// Size of golioth_log_batch::records
+#define GOLIOTH_LOG_BATCH_RECORDS_MAX_LEN                                   \
+    ((CONFIG_GOLIOTH_LOG_BATCH_MAX_BYTES < GOLIOTH_LOG_BATCH_BLOCK_MAX_LEN) \
+         ? CONFIG_GOLIOTH_LOG_BATCH_MAX_BYTES                               \
+         : GOLIOTH_LOG_BATCH_BLOCK_MAX_LEN)
+
+struct golioth_log_batch
+{
+    golioth_sys_mutex_t lock;
+    golioth_sys_timer_t timer;
+    /// Time (since boot) in milliseconds when the oldest record in the batch was added
+    uint64_t first_record_ms;
+    /// Encoded records, back to back
+    uint8_t records[GOLIOTH_LOG_BATCH_RECORDS_MAX_LEN];
+    size_t len;
+    uint16_t num_records;
+    /// Most severe level (lowest value) of the records in the batch
+    uint8_t most_severe_level;
+    /// The timer expired; the client thread sends the batch if it is old enough
+    bool is_due;
+};
+
+/// Called by golioth_client_create(), with \p batch embedded in \p client
+enum golioth_status golioth_log_batch_init(struct golioth_client *client,
+                                           struct golioth_log_batch *batch);
+
+/// Called by golioth_client_destroy(). Records that were not sent yet are discarded.
+void golioth_log_batch_deinit(struct golioth_log_batch *batch);
+
+/// Called by the client thread before it waits for requests. Sends the batch when the timer
+/// marked it as due.
+void golioth_log_batch_poll(struct golioth_client *client);
+
+#else /* CONFIG_GOLIOTH_LOG_BATCH */
+
+static inline void golioth_log_batch_poll(struct golioth_client *client) {}
+
+#endif /* CONFIG_GOLIOTH_LOG_BATCH */
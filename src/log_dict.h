@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <golioth/config.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_status.h>
+
+// Dictionary (deferred formatting) cloud logging.
+//
+// With CONFIG_GOLIOTH_LOG_DICTIONARY, GLTH_LOGX places its format string in the
+// GOLIOTH_LOG_DICT_SECTION section, and the cloud log record carries the offset of the format
+// string within that section and the CBOR encoded arguments, instead of the formatted text.
+// scripts/log_dictionary/log_dictionary.py builds the dictionary from the ELF file and expands
+// the records on the host.
+//
+// The IDs are relative to GOLIOTH_LOG_DICT_SECTION_START, which the linker must define:
+// - GNU ld defines __start_golioth_log_fmt for the orphan section on Linux
+// - on ESP-IDF, the linker fragment of the golioth_sdk component places the section in flash
+//   and defines _golioth_log_fmt_start
+// - on ModusToolbox, the linker script of the application includes
+//   port/modus_toolbox/golioth_log_fmt.ld
+// The reference is not weak, so that the link fails if the symbol is missing, rather than IDs
+// being absolute addresses.
+
+#if defined(CONFIG_GOLIOTH_LOG_DICTIONARY)
+
+struct golioth_client;
+
+#ifndef GOLIOTH_LOG_DICT_SECTION_START
+#define GOLIOTH_LOG_DICT_SECTION_START __start_golioth_log_fmt
+#endif
+
+extern const char GOLIOTH_LOG_DICT_SECTION_START[];
+
+/// ID of a format string in the dictionary section
+static inline uint32_t golioth_log_dict_format_id(const char *format)
+{
+    return (uint32_t) (format - GOLIOTH_LOG_DICT_SECTION_START);
+}
+
+/// Log \p format, which must be in the dictionary section, and its arguments to Golioth
+/// asynchronously.
+enum golioth_status golioth_log_dict_async(struct golioth_client *client,
+                                           enum golioth_debug_log_level level,
+                                           const char *tag,
+                                           const char *format,
+                                           va_list args);
+
+#endif /* CONFIG_GOLIOTH_LOG_DICTIONARY */
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include "mbox.h"
+#include "heap_accounting.h"
 #include <golioth/golioth_debug.h>
 #include <golioth/golioth_sys.h>
 #include <assert.h>
@@ -13,20 +14,42 @@ LOG_TAG_DEFINE(golioth_mbox);
 
 golioth_mbox_t golioth_mbox_create(size_t num_items, size_t item_size)
 {
-    golioth_mbox_t new_mbox = (golioth_mbox_t) golioth_sys_malloc(sizeof(struct golioth_mbox));
-    assert(new_mbox);
+    golioth_mbox_t new_mbox =
+        (golioth_mbox_t) GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, sizeof(struct golioth_mbox));
+    if (!new_mbox)
+    {
+        GLTH_LOGE(TAG, "Failed to allocate mbox");
+        return NULL;
+    }
     memset(new_mbox, 0, sizeof(struct golioth_mbox));
 
     // Allocate storage for the items in the ringbuffer
     size_t bufsize = RINGBUF_BUFFER_SIZE(item_size, num_items);
-    new_mbox->ringbuf.buffer = (uint8_t *) golioth_sys_malloc(bufsize);
-    assert(new_mbox->ringbuf.buffer);
+    new_mbox->ringbuf.buffer = (uint8_t *) GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, bufsize);
+    if (!new_mbox->ringbuf.buffer)
+    {
+        GLTH_LOGE(TAG, "Failed to allocate mbox buffer of %" PRIu32 " bytes", (uint32_t) bufsize);
+        goto free_mbox;
+    }
     memset(new_mbox->ringbuf.buffer, 0, bufsize);
 
     new_mbox->ringbuf.buffer_size = bufsize;
     new_mbox->ringbuf.item_size = item_size;
     new_mbox->fill_count_sem = golioth_sys_sem_create(num_items, 0);
+    if (!new_mbox->fill_count_sem)
+    {
+        goto free_buffer;
+    }
+    new_mbox->space_count_sem = golioth_sys_sem_create(num_items, num_items);
+    if (!new_mbox->space_count_sem)
+    {
+        goto free_fill_count_sem;
+    }
     new_mbox->ringbuf_mutex = golioth_sys_sem_create(1, 1);
+    if (!new_mbox->ringbuf_mutex)
+    {
+        goto free_space_count_sem;
+    }
 
     assert(ringbuf_capacity(&new_mbox->ringbuf) == num_items);
     assert(ringbuf_size(&new_mbox->ringbuf) == 0);
@@ -38,6 +61,53 @@ golioth_mbox_t golioth_mbox_create(size_t num_items, size_t item_size)
               (uint32_t) item_size);
 
     return new_mbox;
+
+free_space_count_sem:
+    golioth_sys_sem_destroy(new_mbox->space_count_sem);
+free_fill_count_sem:
+    golioth_sys_sem_destroy(new_mbox->fill_count_sem);
+free_buffer:
+    GOLIOTH_HEAP_FREE(new_mbox->ringbuf.buffer);
+free_mbox:
+    GOLIOTH_HEAP_FREE(new_mbox);
+    return NULL;
+}
+
+golioth_mbox_t golioth_mbox_create_ordered(size_t num_items, size_t item_size, size_t key_offset)
+{
+    assert(key_offset + sizeof(uint64_t) <= item_size);
+
+    golioth_mbox_t new_mbox = golioth_mbox_create(num_items, item_size);
+    if (new_mbox)
+    {
+        new_mbox->is_ordered = true;
+        new_mbox->key_offset = key_offset;
+    }
+
+    return new_mbox;
+}
+
+// Index of the oldest item with the smallest key. Called with ringbuf_mutex held.
+static size_t ordered_next_index(golioth_mbox_t mbox)
+{
+    size_t num_items = ringbuf_size(&mbox->ringbuf);
+    size_t next_index = 0;
+    uint64_t next_key = UINT64_MAX;
+
+    for (size_t i = 0; i < num_items; i++)
+    {
+        const uint8_t *item = ringbuf_item_at(&mbox->ringbuf, i);
+        uint64_t key;
+
+        memcpy(&key, item + mbox->key_offset, sizeof(key));
+        if (i == 0 || key < next_key)
+        {
+            next_index = i;
+            next_key = key;
+        }
+    }
+
+    return next_index;
 }
 
 size_t golioth_mbox_num_messages(golioth_mbox_t mbox)
@@ -46,13 +116,38 @@ size_t golioth_mbox_num_messages(golioth_mbox_t mbox)
     return ringbuf_size(&mbox->ringbuf);
 }
 
+size_t golioth_mbox_capacity(golioth_mbox_t mbox)
+{
+    assert(mbox);
+    return ringbuf_capacity(&mbox->ringbuf);
+}
+
 bool golioth_mbox_try_send(golioth_mbox_t mbox, const void *item)
+{
+    return golioth_mbox_send(mbox, item, 0);
+}
+
+bool golioth_mbox_send(golioth_mbox_t mbox, const void *item, int32_t timeout_ms)
 {
     assert(mbox);
 
+    if (!golioth_sys_sem_take(mbox->space_count_sem, timeout_ms))
+    {
+        return false;
+    }
+
     bool ret = golioth_sys_sem_take(mbox->ringbuf_mutex, GOLIOTH_SYS_WAIT_FOREVER);
     assert(ret);
     bool sent = ringbuf_put(&mbox->ringbuf, item);
+    bool reached_high = false;
+    golioth_mbox_watermark_fn watermark_fn = mbox->watermark_fn;
+    void *watermark_arg = mbox->watermark_arg;
+    if (sent && watermark_fn && !mbox->above_high_watermark
+        && ringbuf_size(&mbox->ringbuf) >= mbox->high_watermark)
+    {
+        mbox->above_high_watermark = true;
+        reached_high = true;
+    }
     golioth_sys_sem_give(mbox->ringbuf_mutex);
 
     if (sent)
@@ -60,6 +155,15 @@ bool golioth_mbox_try_send(golioth_mbox_t mbox, const void *item)
         ret = golioth_sys_sem_give(mbox->fill_count_sem);
         assert(ret);
     }
+    else
+    {
+        golioth_sys_sem_give(mbox->space_count_sem);
+    }
+
+    if (reached_high)
+    {
+        watermark_fn(true, watermark_arg);
+    }
 
     return sent;
 }
@@ -70,20 +174,75 @@ bool golioth_mbox_recv(golioth_mbox_t mbox, void *item, int32_t timeout_ms)
     bool received = golioth_sys_sem_take(mbox->fill_count_sem, timeout_ms);
     if (received)
     {
-        bool ret = ringbuf_get(&mbox->ringbuf, item);
+        bool ret;
+        if (mbox->is_ordered)
+        {
+            golioth_sys_sem_take(mbox->ringbuf_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+            ret = ringbuf_get_at(&mbox->ringbuf, ordered_next_index(mbox), item);
+            golioth_sys_sem_give(mbox->ringbuf_mutex);
+        }
+        else
+        {
+            ret = ringbuf_get(&mbox->ringbuf, item);
+        }
         (void) ret;
         assert(ret);
+
+        // Only take the mutex when the low watermark can have been crossed
+        if (mbox->above_high_watermark)
+        {
+            bool reached_low = false;
+            golioth_mbox_watermark_fn watermark_fn;
+            void *watermark_arg;
+
+            golioth_sys_sem_take(mbox->ringbuf_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+            watermark_fn = mbox->watermark_fn;
+            watermark_arg = mbox->watermark_arg;
+            if (watermark_fn && mbox->above_high_watermark
+                && ringbuf_size(&mbox->ringbuf) <= mbox->low_watermark)
+            {
+                mbox->above_high_watermark = false;
+                reached_low = true;
+            }
+            golioth_sys_sem_give(mbox->ringbuf_mutex);
+
+            if (reached_low)
+            {
+                watermark_fn(false, watermark_arg);
+            }
+        }
+
+        golioth_sys_sem_give(mbox->space_count_sem);
     }
     return received;
 }
 
+void golioth_mbox_set_watermarks(golioth_mbox_t mbox,
+                                 size_t high,
+                                 size_t low,
+                                 golioth_mbox_watermark_fn fn,
+                                 void *arg)
+{
+    assert(mbox);
+    assert(low < high && high <= ringbuf_capacity(&mbox->ringbuf));
+
+    golioth_sys_sem_take(mbox->ringbuf_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    mbox->high_watermark = high;
+    mbox->low_watermark = low;
+    mbox->watermark_fn = fn;
+    mbox->watermark_arg = arg;
+    mbox->above_high_watermark = fn && ringbuf_size(&mbox->ringbuf) >= high;
+    golioth_sys_sem_give(mbox->ringbuf_mutex);
+}
+
 void golioth_mbox_destroy(golioth_mbox_t mbox)
 {
     assert(mbox);
     // free stuff in the mbox
-    golioth_sys_free(mbox->ringbuf.buffer);
+    GOLIOTH_HEAP_FREE(mbox->ringbuf.buffer);
     golioth_sys_sem_destroy(mbox->fill_count_sem);
+    golioth_sys_sem_destroy(mbox->space_count_sem);
     golioth_sys_sem_destroy(mbox->ringbuf_mutex);
     // free the mbox itself
-    golioth_sys_free(mbox);
+    GOLIOTH_HEAP_FREE(mbox);
 }
@@ -12,19 +12,51 @@
 ///
 /// This is basically a ringbuffer+semaphore+mutex. The semaphore is for
 /// signaling when queue has items, so the consumer can be efficiently notified.
+/// A second semaphore counts the free slots, so producers can wait for space.
 /// The mutex is for preventing multiple producers from accessing the ringbuffer
 /// at once.
+///
+/// Optionally, a callback is called when the number of items reaches a high
+/// watermark, and again when it then drops to a low watermark.
+///
+/// An ordered mbox (golioth_mbox_create_ordered()) returns the item with the
+/// smallest uint64_t key first, and items with equal keys in the order they were
+/// sent. The consumer then takes the mutex too, to search and remove the item.
+
+/// Called from the producer that filled the queue up to the high watermark
+/// (is_high true), or from the consumer that emptied it down to the low
+/// watermark (is_high false).
+typedef void (*golioth_mbox_watermark_fn)(bool is_high, void *arg);
 
 struct golioth_mbox
 {
     ringbuf_t ringbuf;
     golioth_sys_sem_t fill_count_sem;
+    golioth_sys_sem_t space_count_sem;
     golioth_sys_sem_t ringbuf_mutex;
+    size_t high_watermark;
+    size_t low_watermark;
+    bool above_high_watermark;
+    golioth_mbox_watermark_fn watermark_fn;
+    void *watermark_arg;
+    bool is_ordered;
+    size_t key_offset;
 };
 typedef struct golioth_mbox *golioth_mbox_t;
 
 golioth_mbox_t golioth_mbox_create(size_t num_items, size_t item_size);
+/// Create an ordered mbox, with the uint64_t key of each item at key_offset
+golioth_mbox_t golioth_mbox_create_ordered(size_t num_items, size_t item_size, size_t key_offset);
 size_t golioth_mbox_num_messages(golioth_mbox_t mbox);
+size_t golioth_mbox_capacity(golioth_mbox_t mbox);
 bool golioth_mbox_try_send(golioth_mbox_t mbox, const void *item);
+/// Like golioth_mbox_try_send(), but waits up to timeout_ms for space
+bool golioth_mbox_send(golioth_mbox_t mbox, const void *item, int32_t timeout_ms);
 bool golioth_mbox_recv(golioth_mbox_t mbox, void *item, int32_t timeout_ms);
+/// Set the watermarks, low < high <= capacity. A NULL fn disables the callback.
+void golioth_mbox_set_watermarks(golioth_mbox_t mbox,
+                                 size_t high,
+                                 size_t low,
+                                 golioth_mbox_watermark_fn fn,
+                                 void *arg);
 void golioth_mbox_destroy(golioth_mbox_t mbox);
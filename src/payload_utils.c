@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zcbor_decode.h>
 
 #include <golioth/payload_utils.h>
 
@@ -56,3 +57,100 @@ bool golioth_payload_is_null(const uint8_t *payload, size_t payload_size)
     }
     return false;
 }
+
+// CBOR null is the single byte 0xf6 (simple value 22)
+static bool cbor_payload_is_null(const uint8_t *payload, size_t payload_size)
+{
+    return !payload || payload_size == 0 || payload[0] == 0xf6;
+}
+
+enum golioth_status golioth_payload_cbor_as_int(const uint8_t *payload,
+                                                size_t payload_size,
+                                                int32_t *value)
+{
+    int64_t value_int;
+
+    if (cbor_payload_is_null(payload, payload_size))
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    ZCBOR_STATE_D(zsd, 0, payload, payload_size, 1, 0);
+
+    if (!zcbor_int64_decode(zsd, &value_int) || value_int < INT32_MIN || value_int > INT32_MAX)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    *value = (int32_t) value_int;
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_payload_cbor_as_float(const uint8_t *payload,
+                                                  size_t payload_size,
+                                                  float *value)
+{
+    double value_double;
+    int64_t value_int;
+
+    if (cbor_payload_is_null(payload, payload_size))
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    ZCBOR_STATE_D(zsd, 0, payload, payload_size, 1, 0);
+
+    // Whole numbers may be stored as integers
+    if (zcbor_float_decode(zsd, &value_double))
+    {
+        *value = (float) value_double;
+    }
+    else if (zcbor_int64_decode(zsd, &value_int))
+    {
+        *value = (float) value_int;
+    }
+    else
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_payload_cbor_as_bool(const uint8_t *payload,
+                                                 size_t payload_size,
+                                                 bool *value)
+{
+    if (cbor_payload_is_null(payload, payload_size))
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    ZCBOR_STATE_D(zsd, 0, payload, payload_size, 1, 0);
+
+    return zcbor_bool_decode(zsd, value) ? GOLIOTH_OK : GOLIOTH_ERR_INVALID_FORMAT;
+}
+
+enum golioth_status golioth_payload_cbor_as_string(const uint8_t *payload,
+                                                   size_t payload_size,
+                                                   const char **str,
+                                                   size_t *str_len)
+{
+    struct zcbor_string value;
+
+    if (cbor_payload_is_null(payload, payload_size))
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    ZCBOR_STATE_D(zsd, 0, payload, payload_size, 1, 0);
+
+    if (!zcbor_tstr_decode(zsd, &value))
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    *str = (const char *) value.value;
+    *str_len = value.len;
+    return GOLIOTH_OK;
+}
@@ -80,6 +80,46 @@ bool ringbuf_peek(ringbuf_t *ringbuf, void *item)
     return ringbuf_get_internal(ringbuf, item, false);
 }
 
+static uint8_t *slot(const ringbuf_t *ringbuf, size_t index)
+{
+    size_t slot_index = (ringbuf->read_index + index) % total_items(ringbuf);
+
+    return ringbuf->buffer + slot_index * ringbuf->item_size;
+}
+
+const void *ringbuf_item_at(const ringbuf_t *ringbuf, size_t index)
+{
+    if (index >= ringbuf_size(ringbuf))
+    {
+        return NULL;
+    }
+
+    return slot(ringbuf, index);
+}
+
+bool ringbuf_get_at(ringbuf_t *ringbuf, size_t index, void *item)
+{
+    if (index >= ringbuf_size(ringbuf))
+    {
+        return false;
+    }
+
+    if (item)
+    {
+        memcpy(item, slot(ringbuf, index), ringbuf->item_size);
+    }
+
+    // Move the older items up by one, over the removed item
+    for (size_t i = index; i > 0; i--)
+    {
+        memcpy(slot(ringbuf, i), slot(ringbuf, i - 1), ringbuf->item_size);
+    }
+
+    ringbuf->read_index = (ringbuf->read_index + 1) % total_items(ringbuf);
+
+    return true;
+}
+
 size_t ringbuf_size(const ringbuf_t *ringbuf)
 {
     ringbuf_index_t write_index = ringbuf->write_index;
@@ -37,6 +37,10 @@ typedef struct
 bool ringbuf_put(ringbuf_t *ringbuf, const void *item);
 bool ringbuf_get(ringbuf_t *ringbuf, void *item);
 bool ringbuf_peek(ringbuf_t *ringbuf, void *item);
+// The index-th oldest item, or NULL if there are not that many items
+const void *ringbuf_item_at(const ringbuf_t *ringbuf, size_t index);
+// Remove the index-th oldest item. The order of the other items is kept.
+bool ringbuf_get_at(ringbuf_t *ringbuf, size_t index, void *item);
 size_t ringbuf_size(const ringbuf_t *ringbuf);
 bool ringbuf_is_empty(const ringbuf_t *ringbuf);
 bool ringbuf_is_full(const ringbuf_t *ringbuf);
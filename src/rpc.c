@@ -8,6 +8,8 @@
 #include <zcbor_decode.h>
 #include <zcbor_encode.h>
 #include "coap_client.h"
+#include "heap_accounting.h"
+#include "mbox.h"
 #include <golioth/config.h>
 #include <golioth/rpc.h>
 #include "golioth_util.h"
@@ -36,21 +38,91 @@ LOG_TAG_DEFINE(golioth_rpc);
 
 #define GOLIOTH_RPC_PATH_PREFIX ".rpc/"
 
+// Backups needed to encode the response: the root map and the detail map
+#define RESPONSE_NUM_BACKUPS 1
+
+// Enough for a response without detail, with the id of a request made by the Golioth cloud
+#define RESPONSE_STATUS_MAX_LEN 96
+
+// Calls with a longer id are not de-duplicated
+#define DEDUP_ID_MAX_LEN 40
+
+// Slots of the method index. At most half are used, which keeps probe sequences short.
+#define METHOD_INDEX_SIZE (2 * CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS)
+
 /// Private struct to contain data about a single registered method
 struct golioth_rpc_method
 {
     const char *method;
+    size_t method_len;
+    uint32_t hash;
     uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
     golioth_rpc_cb_fn callback;
+    golioth_rpc_deferred_cb_fn deferred_callback;
     void *callback_arg;
 };
 
+#if CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE > 0
+
+/// A recent call, which is answered again without calling the method when it is received again
+///
+/// Entries are only accessed from the client thread. The response of a call answered with
+/// golioth_rpc_respond() is kept in the call, which is shared with the responder (see
+/// golioth_rpc_call::refs).
+struct rpc_dedup_entry
+{
+    /// NULL for an unused entry
+    const struct golioth_rpc_method *method;
+    uint8_t id[DEDUP_ID_MAX_LEN];
+    size_t id_len;
+    uint64_t expires_ms;
+    /// Value of golioth_rpc::dedup_clock when the entry was last used
+    uint32_t last_used;
+    /// Response of a method called on the client thread
+    uint8_t *response;
+    size_t response_len;
+    /// Call dispatched to a worker or a deferred method
+    struct golioth_rpc_call *call;
+};
+
+#endif /* CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE > 0 */
+
 /// Private struct to contain RPC state data
 struct golioth_rpc
 {
     struct golioth_client *client;
     int num_rpcs;
     struct golioth_rpc_method rpcs[CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS];
+    /// Open addressing hash table of methods, by name. 1 + index into rpcs, or 0 for a free slot.
+    uint16_t method_index[METHOD_INDEX_SIZE];
+#if CONFIG_GOLIOTH_RPC_NUM_WORKERS > 0
+    /// Calls waiting for a worker, as pointers to struct golioth_rpc_call
+    golioth_mbox_t calls;
+    golioth_sys_sem_t workers_stopped;
+    golioth_sys_thread_t workers[CONFIG_GOLIOTH_RPC_NUM_WORKERS];
+#endif
+#if CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE > 0
+    struct rpc_dedup_entry dedup_cache[CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE];
+    uint32_t dedup_clock;
+#endif
+};
+
+/// A call which is not answered from the CoAP thread, see golioth_rpc_respond()
+struct golioth_rpc_call
+{
+    struct golioth_client *client;
+    const struct golioth_rpc_method *method;
+    /// 2 while the call is in the dedup cache, 1 otherwise. Freed by whoever drops the last
+    /// reference.
+    uint8_t refs;
+    /// Set by golioth_rpc_respond(), once response_len is valid
+    bool responded;
+    /// Inside the detail map of response_buf
+    zcbor_state_t zse[RESPONSE_NUM_BACKUPS + 2];
+    uint8_t response_buf[CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN];
+    size_t response_len;
+    size_t request_len;
+    uint8_t request[];
 };
 
 static int params_decode(zcbor_state_t *zsd, void *value)
@@ -87,6 +159,480 @@ static int params_decode(zcbor_state_t *zsd, void *value)
     return 0;
 }
 
+static int request_decode(zcbor_state_t *zsd,
+                          struct zcbor_string *id,
+                          struct zcbor_string *method,
+                          zcbor_state_t *params_zsd)
+{
+    struct zcbor_map_entry map_entries[] = {
+        ZCBOR_TSTR_LIT_MAP_ENTRY("id", zcbor_map_tstr_decode, id),
+        ZCBOR_TSTR_LIT_MAP_ENTRY("method", zcbor_map_tstr_decode, method),
+        ZCBOR_TSTR_LIT_MAP_ENTRY("params", params_decode, params_zsd),
+    };
+
+    return zcbor_map_decode(zsd, map_entries, ARRAY_SIZE(map_entries));
+}
+
+static const struct golioth_rpc_method *method_find(const struct golioth_rpc *grpc,
+                                                    const struct zcbor_string *method)
+{
+    uint32_t hash = golioth_hash(method->value, method->len);
+
+    // Methods registered twice are found in registration order, so the first one wins
+    for (size_t slot = hash % METHOD_INDEX_SIZE; grpc->method_index[slot] != 0;
+         slot = (slot + 1) % METHOD_INDEX_SIZE)
+    {
+        const struct golioth_rpc_method *rpc = &grpc->rpcs[grpc->method_index[slot] - 1];
+        if (rpc->hash == hash && rpc->method_len == method->len
+            && memcmp(rpc->method, method->value, method->len) == 0)
+        {
+            return rpc;
+        }
+    }
+
+    return NULL;
+}
+
+static void method_index_add(struct golioth_rpc *grpc, int index)
+{
+    size_t slot = grpc->rpcs[index].hash % METHOD_INDEX_SIZE;
+
+    while (grpc->method_index[slot] != 0)
+    {
+        slot = (slot + 1) % METHOD_INDEX_SIZE;
+    }
+
+    grpc->method_index[slot] = index + 1;
+}
+
+/// Remove the most recently added method. Methods removed in the reverse order in which they were
+/// added leave the table as it was before they were added, since each of them filled a free slot.
+static void method_index_remove_last(struct golioth_rpc *grpc)
+{
+    int index = grpc->num_rpcs - 1;
+    size_t slot = grpc->rpcs[index].hash % METHOD_INDEX_SIZE;
+
+    while (grpc->method_index[slot] != index + 1)
+    {
+        slot = (slot + 1) % METHOD_INDEX_SIZE;
+    }
+
+    grpc->method_index[slot] = 0;
+}
+
+/// Encode the start of a response: the root map, the id and, for a registered method, the start
+/// of the detail map
+static bool response_begin(zcbor_state_t *zse, const struct zcbor_string *id, bool with_detail)
+{
+    bool ok;
+
+    ok = zcbor_map_start_encode(zse, 1);
+    if (!ok)
+    {
+        GLTH_LOGE(TAG, "Failed to encode RPC response map");
+        return false;
+    }
+
+    ok = zcbor_tstr_put_lit(zse, "id") && zcbor_tstr_encode(zse, id);
+    if (!ok)
+    {
+        GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "id");
+        return false;
+    }
+
+    if (!with_detail)
+    {
+        return true;
+    }
+
+    ok = zcbor_tstr_put_lit(zse, "detail");
+    if (!ok)
+    {
+        GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "detail");
+        return false;
+    }
+
+    ok = zcbor_map_start_encode(zse, SIZE_MAX);
+    if (!ok)
+    {
+        GLTH_LOGE(TAG, "Did not start CBOR map correctly");
+        return false;
+    }
+
+    return true;
+}
+
+/// Encode the end of a response started with response_begin()
+static bool response_end(zcbor_state_t *zse, enum golioth_rpc_status rpc_status, bool with_detail)
+{
+    bool ok;
+
+    if (with_detail)
+    {
+        ok = zcbor_map_end_encode(zse, SIZE_MAX);
+        if (!ok)
+        {
+            GLTH_LOGE(TAG, "Failed to close '%s'", "detail");
+            return false;
+        }
+    }
+
+    ok = zcbor_tstr_put_lit(zse, "statusCode") && zcbor_uint64_put(zse, rpc_status);
+    if (!ok)
+    {
+        GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "statusCode");
+        return false;
+    }
+
+    /* root response map */
+    ok = zcbor_map_end_encode(zse, 1);
+    if (!ok)
+    {
+        GLTH_LOGE(TAG, "Failed to close '%s'", "root");
+        return false;
+    }
+
+    return true;
+}
+
+static void response_send(struct golioth_client *client, const uint8_t *response, size_t len)
+{
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    golioth_coap_next_token(token);
+
+    golioth_coap_client_set(client,
+                            token,
+                            GOLIOTH_RPC_PATH_PREFIX,
+                            "status",
+                            GOLIOTH_CONTENT_TYPE_CBOR,
+                            response,
+                            len,
+                            NULL,
+                            NULL,
+                            false,
+                            GOLIOTH_SYS_WAIT_FOREVER);
+}
+
+/// Respond to a call without calling its method, e.g. when it could not be dispatched
+static void response_send_status(struct golioth_client *client,
+                                 const struct zcbor_string *id,
+                                 enum golioth_rpc_status rpc_status)
+{
+    uint8_t response_buf[RESPONSE_STATUS_MAX_LEN];
+    ZCBOR_STATE_E(zse, RESPONSE_NUM_BACKUPS, response_buf, sizeof(response_buf), 1);
+
+    if (response_begin(zse, id, false) && response_end(zse, rpc_status, false))
+    {
+        response_send(client, response_buf, zse->payload - response_buf);
+    }
+}
+
+static void call_put(struct golioth_rpc_call *call)
+{
+    if (__atomic_sub_fetch(&call->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        GOLIOTH_HEAP_FREE(call);
+    }
+}
+
+#if CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE > 0
+
+static void dedup_entry_clear(struct rpc_dedup_entry *entry)
+{
+    if (entry->response)
+    {
+        GOLIOTH_HEAP_FREE(entry->response);
+    }
+    if (entry->call)
+    {
+        call_put(entry->call);
+    }
+
+    memset(entry, 0, sizeof(*entry));
+}
+
+static struct rpc_dedup_entry *dedup_find(struct golioth_rpc *grpc,
+                                          const struct golioth_rpc_method *rpc,
+                                          const struct zcbor_string *id)
+{
+    uint64_t now_ms = golioth_sys_now_ms();
+
+    for (int i = 0; i < CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE; i++)
+    {
+        struct rpc_dedup_entry *entry = &grpc->dedup_cache[i];
+
+        if (entry->method && now_ms >= entry->expires_ms)
+        {
+            dedup_entry_clear(entry);
+        }
+
+        if (entry->method == rpc && entry->id_len == id->len
+            && memcmp(entry->id, id->value, id->len) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/// Take an entry for a new call, evicting the least recently used one if needed
+static struct rpc_dedup_entry *dedup_add(struct golioth_rpc *grpc,
+                                         const struct golioth_rpc_method *rpc,
+                                         const struct zcbor_string *id)
+{
+    if (id->len > DEDUP_ID_MAX_LEN)
+    {
+        return NULL;
+    }
+
+    struct rpc_dedup_entry *entry = &grpc->dedup_cache[0];
+
+    for (int i = 0; i < CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE; i++)
+    {
+        if (!grpc->dedup_cache[i].method)
+        {
+            entry = &grpc->dedup_cache[i];
+            break;
+        }
+
+        // Unsigned difference, so that wrapping dedup_clock is harmless
+        if (grpc->dedup_clock - grpc->dedup_cache[i].last_used
+            > grpc->dedup_clock - entry->last_used)
+        {
+            entry = &grpc->dedup_cache[i];
+        }
+    }
+
+    dedup_entry_clear(entry);
+
+    entry->method = rpc;
+    memcpy(entry->id, id->value, id->len);
+    entry->id_len = id->len;
+    entry->expires_ms = golioth_sys_now_ms() + 1000 * (uint64_t) CONFIG_GOLIOTH_RPC_DEDUP_TTL_S;
+    entry->last_used = ++grpc->dedup_clock;
+
+    return entry;
+}
+
+/// Answer a call that was received before again, without calling its method
+///
+/// @return true if the call is a duplicate
+static bool dedup_resend(struct golioth_client *client,
+                         struct golioth_rpc *grpc,
+                         const struct golioth_rpc_method *rpc,
+                         const struct zcbor_string *id)
+{
+    struct rpc_dedup_entry *entry = dedup_find(grpc, rpc, id);
+    if (!entry)
+    {
+        return false;
+    }
+
+    entry->last_used = ++grpc->dedup_clock;
+
+    // Otherwise the method is still running, and responds when done
+    if (entry->response)
+    {
+        response_send(client, entry->response, entry->response_len);
+    }
+    else if (__atomic_load_n(&entry->call->responded, __ATOMIC_ACQUIRE)
+             && entry->call->response_len > 0)
+    {
+        response_send(client, entry->call->response_buf, entry->call->response_len);
+    }
+
+    GLTH_LOGD(TAG, "Duplicate RPC call id :%.*s", (int) id->len, id->value);
+
+    return true;
+}
+
+static void dedup_add_response(struct golioth_rpc *grpc,
+                               const struct golioth_rpc_method *rpc,
+                               const struct zcbor_string *id,
+                               const uint8_t *response,
+                               size_t response_len)
+{
+    uint8_t *copy = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_RPC, response_len);
+    if (!copy)
+    {
+        return;
+    }
+
+    struct rpc_dedup_entry *entry = dedup_add(grpc, rpc, id);
+    if (!entry)
+    {
+        GOLIOTH_HEAP_FREE(copy);
+        return;
+    }
+
+    memcpy(copy, response, response_len);
+    entry->response = copy;
+    entry->response_len = response_len;
+}
+
+static struct rpc_dedup_entry *dedup_add_call(struct golioth_rpc *grpc,
+                                              const struct golioth_rpc_method *rpc,
+                                              const struct zcbor_string *id,
+                                              struct golioth_rpc_call *call)
+{
+    struct rpc_dedup_entry *entry = dedup_add(grpc, rpc, id);
+    if (entry)
+    {
+        call->refs++;
+        entry->call = call;
+    }
+
+    return entry;
+}
+
+static void dedup_deinit(struct golioth_rpc *grpc)
+{
+    for (int i = 0; i < CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE; i++)
+    {
+        dedup_entry_clear(&grpc->dedup_cache[i]);
+    }
+}
+
+#else /* CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE > 0 */
+
+struct rpc_dedup_entry;
+
+static inline bool dedup_resend(struct golioth_client *client,
+                                struct golioth_rpc *grpc,
+                                const struct golioth_rpc_method *rpc,
+                                const struct zcbor_string *id)
+{
+    return false;
+}
+
+static inline void dedup_add_response(struct golioth_rpc *grpc,
+                                      const struct golioth_rpc_method *rpc,
+                                      const struct zcbor_string *id,
+                                      const uint8_t *response,
+                                      size_t response_len)
+{
+}
+
+static inline struct rpc_dedup_entry *dedup_add_call(struct golioth_rpc *grpc,
+                                                     const struct golioth_rpc_method *rpc,
+                                                     const struct zcbor_string *id,
+                                                     struct golioth_rpc_call *call)
+{
+    return NULL;
+}
+
+static inline void dedup_entry_clear(struct rpc_dedup_entry *entry) {}
+
+static inline void dedup_deinit(struct golioth_rpc *grpc) {}
+
+#endif /* CONFIG_GOLIOTH_RPC_DEDUP_CACHE_SIZE > 0 */
+
+// Runs the method of a call that was dispatched by call_dispatch(). The request is decoded again,
+// since decode states can't be kept once the function that created them returns.
+static void call_run(struct golioth_rpc_call *call)
+{
+    ZCBOR_STATE_D(zsd, 2, call->request, call->request_len, 1, 0);
+    zcbor_state_t params_zsd;
+    struct zcbor_string id, method;
+    const struct golioth_rpc_method *rpc = call->method;
+
+    if (request_decode(zsd, &id, &method, &params_zsd))
+    {
+        golioth_rpc_respond(call, GOLIOTH_RPC_INTERNAL);
+        return;
+    }
+
+    GLTH_LOGD(TAG, "Calling registered RPC method: %s", rpc->method);
+
+    if (rpc->deferred_callback)
+    {
+        rpc->deferred_callback(call, &params_zsd, rpc->callback_arg);
+        return;
+    }
+
+    golioth_rpc_respond(call, rpc->callback(&params_zsd, call->zse, rpc->callback_arg));
+}
+
+// Copies the request into a new call, with its own response buffer, and hands it to the workers.
+// Deferred methods without workers are called right away.
+static void call_dispatch(struct golioth_client *client,
+                          struct golioth_rpc *grpc,
+                          const struct golioth_rpc_method *rpc,
+                          const struct zcbor_string *id,
+                          const uint8_t *payload,
+                          size_t payload_size)
+{
+    struct golioth_rpc_call *call =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_RPC, sizeof(struct golioth_rpc_call) + payload_size);
+    if (!call)
+    {
+        GLTH_LOGE(TAG, "Failed to allocate RPC call");
+        response_send_status(client, id, GOLIOTH_RPC_RESOURCE_EXHAUSTED);
+        return;
+    }
+
+    call->client = client;
+    call->method = rpc;
+    call->refs = 1;
+    call->responded = false;
+    call->response_len = 0;
+    call->request_len = payload_size;
+    memcpy(call->request, payload, payload_size);
+
+    zcbor_new_encode_state(call->zse,
+                           ARRAY_SIZE(call->zse),
+                           call->response_buf,
+                           sizeof(call->response_buf),
+                           1);
+    if (!response_begin(call->zse, id, true))
+    {
+        // CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN is too small for the id; the status response has its
+        // own buffer
+        GOLIOTH_HEAP_FREE(call);
+        response_send_status(client, id, GOLIOTH_RPC_INTERNAL);
+        return;
+    }
+
+    // Before the call is handed over, since the responder may free it
+    struct rpc_dedup_entry *dedup_entry = dedup_add_call(grpc, rpc, id, call);
+
+#if CONFIG_GOLIOTH_RPC_NUM_WORKERS > 0
+    if (grpc->calls)
+    {
+        if (!golioth_mbox_try_send(grpc->calls, &call))
+        {
+            GLTH_LOGW(TAG, "RPC workers busy, rejecting %s", rpc->method);
+            // A retransmission of the request is a new attempt
+            if (dedup_entry)
+            {
+                dedup_entry_clear(dedup_entry);
+            }
+            call_put(call);
+            response_send_status(client, id, GOLIOTH_RPC_RESOURCE_EXHAUSTED);
+        }
+        return;
+    }
+#else
+    (void) dedup_entry;
+#endif
+
+    call_run(call);
+}
+
+static bool call_is_dispatched(const struct golioth_rpc *grpc,
+                               const struct golioth_rpc_method *rpc)
+{
+#if CONFIG_GOLIOTH_RPC_NUM_WORKERS > 0
+    if (grpc->calls)
+    {
+        return true;
+    }
+#endif
+
+    return rpc->deferred_callback != NULL;
+}
+
 static void on_rpc(struct golioth_client *client,
                    enum golioth_status status,
                    const struct golioth_coap_rsp_code *coap_rsp_code,
@@ -98,13 +644,7 @@ static void on_rpc(struct golioth_client *client,
     ZCBOR_STATE_D(zsd, 2, payload, payload_size, 1, 0);
     zcbor_state_t params_zsd;
     struct zcbor_string id, method;
-    struct zcbor_map_entry map_entries[] = {
-        ZCBOR_TSTR_LIT_MAP_ENTRY("id", zcbor_map_tstr_decode, &id),
-        ZCBOR_TSTR_LIT_MAP_ENTRY("method", zcbor_map_tstr_decode, &method),
-        ZCBOR_TSTR_LIT_MAP_ENTRY("params", params_decode, &params_zsd),
-    };
     int err;
-    bool ok;
 
     if (status != GOLIOTH_OK)
     {
@@ -122,45 +662,37 @@ static void on_rpc(struct golioth_client *client,
     }
 
     /* Decode request */
-    err = zcbor_map_decode(zsd, map_entries, ARRAY_SIZE(map_entries));
+    err = request_decode(zsd, &id, &method, &params_zsd);
     if (err)
     {
         GLTH_LOGE(TAG, "Failed to parse tstr map");
         return;
     }
 
-    /* Start encoding response */
-    static uint8_t response_buf[CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN];
-    ZCBOR_STATE_E(zse, 1, response_buf, sizeof(response_buf), 1);
+    struct golioth_rpc *grpc = arg;
 
-    ok = zcbor_map_start_encode(zse, 1);
-    if (!ok)
+    const struct golioth_rpc_method *matching_rpc = method_find(grpc, &method);
+    enum golioth_rpc_status rpc_status = GOLIOTH_RPC_UNKNOWN;
+
+    /* Retransmitted or replayed by the server */
+    if (matching_rpc && dedup_resend(client, grpc, matching_rpc, &id))
     {
-        GLTH_LOGE(TAG, "Failed to encode RPC response map");
         return;
     }
 
-    ok = zcbor_tstr_put_lit(zse, "id") && zcbor_tstr_encode(zse, &id);
-    if (!ok)
+    if (matching_rpc && call_is_dispatched(grpc, matching_rpc))
     {
-        GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "id");
+        call_dispatch(client, grpc, matching_rpc, &id, payload, payload_size);
         return;
     }
 
-    struct golioth_rpc *grpc = arg;
-
-    const struct golioth_rpc_method *matching_rpc = NULL;
-    enum golioth_rpc_status rpc_status = GOLIOTH_RPC_UNKNOWN;
+    /* Start encoding response */
+    static uint8_t response_buf[CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN];
+    ZCBOR_STATE_E(zse, RESPONSE_NUM_BACKUPS, response_buf, sizeof(response_buf), 1);
 
-    for (int i = 0; i < grpc->num_rpcs; i++)
+    if (!response_begin(zse, &id, matching_rpc != NULL))
     {
-        const struct golioth_rpc_method *rpc = &grpc->rpcs[i];
-        if (strlen(rpc->method) == method.len
-            && strncmp(rpc->method, (char *) method.value, method.len) == 0)
-        {
-            matching_rpc = rpc;
-            break;
-        }
+        return;
     }
 
     if (matching_rpc)
@@ -171,30 +703,9 @@ static void on_rpc(struct golioth_client *client,
          * Call callback while decode context is inside the params array
          * and encode context is inside the detail map.
          */
-        ok = zcbor_tstr_put_lit(zse, "detail");
-        if (!ok)
-        {
-            GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "detail");
-            return;
-        }
-
-        ok = zcbor_map_start_encode(zse, SIZE_MAX);
-        if (!ok)
-        {
-            GLTH_LOGE(TAG, "Did not start CBOR map correctly");
-            return;
-        }
-
         rpc_status = matching_rpc->callback(&params_zsd, zse, matching_rpc->callback_arg);
 
         GLTH_LOGD(TAG, "RPC status code %d for call id :%.*s", rpc_status, (int) id.len, id.value);
-
-        ok = zcbor_map_end_encode(zse, SIZE_MAX);
-        if (!ok)
-        {
-            GLTH_LOGE(TAG, "Failed to close '%s'", "detail");
-            return;
-        }
     }
     else
     {
@@ -202,45 +713,168 @@ static void on_rpc(struct golioth_client *client,
         GLTH_LOGW(TAG, "Method %.*s not registered", (int) method.len, method.value);
     }
 
-    ok = zcbor_tstr_put_lit(zse, "statusCode") && zcbor_uint64_put(zse, rpc_status);
-    if (!ok)
+    if (!response_end(zse, rpc_status, matching_rpc != NULL))
     {
-        GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "statusCode");
         return;
     }
 
-    /* root response map */
-    ok = zcbor_map_end_encode(zse, 1);
-    if (!ok)
+    if (matching_rpc)
+    {
+        dedup_add_response(grpc, matching_rpc, &id, response_buf, zse->payload - response_buf);
+    }
+
+    response_send(client, response_buf, zse->payload - response_buf);
+}
+
+zcbor_state_t *golioth_rpc_call_detail(struct golioth_rpc_call *call)
+{
+    return call->zse;
+}
+
+enum golioth_status golioth_rpc_respond(struct golioth_rpc_call *call,
+                                        enum golioth_rpc_status rpc_status)
+{
+    if (!call)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    enum golioth_status status = GOLIOTH_ERR_SERIALIZE;
+
+    if (response_end(call->zse, rpc_status, true))
+    {
+        call->response_len = call->zse->payload - call->response_buf;
+        response_send(call->client, call->response_buf, call->response_len);
+        status = GOLIOTH_OK;
+    }
+
+    __atomic_store_n(&call->responded, true, __ATOMIC_RELEASE);
+    call_put(call);
+
+    return status;
+}
+
+#if CONFIG_GOLIOTH_RPC_NUM_WORKERS > 0
+
+static void rpc_worker(void *arg)
+{
+    struct golioth_rpc *grpc = arg;
+    struct golioth_rpc_call *call;
+
+    while (golioth_mbox_recv(grpc->calls, &call, GOLIOTH_SYS_WAIT_FOREVER) && call)
+    {
+        call_run(call);
+    }
+
+    // A NULL call stops the worker. Threads can't return on every port, so wait to be destroyed.
+    golioth_sys_sem_give(grpc->workers_stopped);
+    while (true)
+    {
+        golioth_sys_msleep(1000);
+    }
+}
+
+static enum golioth_status rpc_workers_start(struct golioth_rpc *grpc)
+{
+    grpc->calls = golioth_mbox_create(CONFIG_GOLIOTH_RPC_WORKER_QUEUE_LEN,
+                                      sizeof(struct golioth_rpc_call *));
+    if (!grpc->calls)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    grpc->workers_stopped = golioth_sys_sem_create(CONFIG_GOLIOTH_RPC_NUM_WORKERS, 0);
+    if (!grpc->workers_stopped)
+    {
+        golioth_mbox_destroy(grpc->calls);
+        grpc->calls = NULL;
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    for (int i = 0; i < CONFIG_GOLIOTH_RPC_NUM_WORKERS; i++)
+    {
+        struct golioth_thread_config thread_cfg = {
+            .name = "rpc_worker",
+            .fn = rpc_worker,
+            .user_arg = grpc,
+            .stack_size = CONFIG_GOLIOTH_RPC_WORKER_STACK_SIZE,
+            .prio = CONFIG_GOLIOTH_RPC_WORKER_PRIORITY,
+        };
+        grpc->workers[i] = golioth_sys_thread_create(&thread_cfg);
+        if (!grpc->workers[i])
+        {
+            GLTH_LOGE(TAG, "Failed to create RPC worker");
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+    }
+
+    return GOLIOTH_OK;
+}
+
+// Stops the workers once they finished the calls already dispatched to them. Calls that were not
+// run yet are answered with GOLIOTH_RPC_CANCELED.
+static void rpc_workers_stop(struct golioth_rpc *grpc)
+{
+    struct golioth_rpc_call *call = NULL;
+    int num_workers = 0;
+
+    if (!grpc->calls)
     {
-        GLTH_LOGE(TAG, "Failed to close '%s'", "root");
         return;
     }
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
+    while (num_workers < CONFIG_GOLIOTH_RPC_NUM_WORKERS && grpc->workers[num_workers])
+    {
+        num_workers++;
+    }
 
-    golioth_coap_client_set(client,
-                            token,
-                            GOLIOTH_RPC_PATH_PREFIX,
-                            "status",
-                            GOLIOTH_CONTENT_TYPE_CBOR,
-                            response_buf,
-                            zse->payload - response_buf,
-                            NULL,
-                            NULL,
-                            false,
-                            GOLIOTH_SYS_WAIT_FOREVER);
+    // Take the calls out, so that there is space for one stop request per worker
+    golioth_mbox_t calls = grpc->calls;
+    while (golioth_mbox_recv(calls, &call, 0))
+    {
+        golioth_rpc_respond(call, GOLIOTH_RPC_CANCELED);
+    }
+
+    call = NULL;
+    for (int i = 0; i < num_workers; i++)
+    {
+        golioth_mbox_send(calls, &call, GOLIOTH_SYS_WAIT_FOREVER);
+    }
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        golioth_sys_sem_take(grpc->workers_stopped, GOLIOTH_SYS_WAIT_FOREVER);
+        golioth_sys_thread_destroy(grpc->workers[i]);
+        grpc->workers[i] = NULL;
+    }
+
+    grpc->calls = NULL;
+    golioth_mbox_destroy(calls);
+    golioth_sys_sem_destroy(grpc->workers_stopped);
+    grpc->workers_stopped = NULL;
 }
 
+#endif /* CONFIG_GOLIOTH_RPC_NUM_WORKERS > 0 */
+
 struct golioth_rpc *golioth_rpc_init(struct golioth_client *client)
 {
-    struct golioth_rpc *grpc = golioth_sys_malloc(sizeof(struct golioth_rpc));
+    struct golioth_rpc *grpc = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_RPC, sizeof(struct golioth_rpc));
 
     if (grpc != NULL)
     {
+        memset(grpc, 0, sizeof(*grpc));
         grpc->client = client;
         grpc->num_rpcs = 0;
+
+#if CONFIG_GOLIOTH_RPC_NUM_WORKERS > 0
+        if (rpc_workers_start(grpc) != GOLIOTH_OK)
+        {
+            GLTH_LOGE(TAG, "Failed to start RPC workers");
+            rpc_workers_stop(grpc);
+            GOLIOTH_HEAP_FREE(grpc);
+            return NULL;
+        }
+#endif
     }
 
     return grpc;
@@ -256,14 +890,20 @@ enum golioth_status golioth_rpc_deinit(struct golioth_rpc *grpc)
     }
 
     golioth_coap_client_cancel_observations_by_prefix(grpc->client, GOLIOTH_RPC_PATH_PREFIX);
-    free(grpc);
+#if CONFIG_GOLIOTH_RPC_NUM_WORKERS > 0
+    rpc_workers_stop(grpc);
+#endif
+    dedup_deinit(grpc);
+    GOLIOTH_HEAP_FREE(grpc);
     return GOLIOTH_OK;
 }
 
-enum golioth_status golioth_rpc_register(struct golioth_rpc *grpc,
-                                         const char *method,
-                                         golioth_rpc_cb_fn callback,
-                                         void *callback_arg)
+static enum golioth_status rpc_register(struct golioth_rpc *grpc,
+                                        const char *method,
+                                        size_t method_len,
+                                        golioth_rpc_cb_fn callback,
+                                        golioth_rpc_deferred_cb_fn deferred_callback,
+                                        void *callback_arg)
 {
     if (grpc->num_rpcs >= CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS)
     {
@@ -276,10 +916,14 @@ enum golioth_status golioth_rpc_register(struct golioth_rpc *grpc,
     struct golioth_rpc_method *rpc = &grpc->rpcs[grpc->num_rpcs];
 
     rpc->method = method;
+    rpc->method_len = method_len;
+    rpc->hash = golioth_hash(method, method_len);
     rpc->callback = callback;
+    rpc->deferred_callback = deferred_callback;
     rpc->callback_arg = callback_arg;
     golioth_coap_next_token(rpc->token);
 
+    method_index_add(grpc, grpc->num_rpcs);
     grpc->num_rpcs++;
     if (grpc->num_rpcs == 1)
     {
@@ -294,4 +938,57 @@ enum golioth_status golioth_rpc_register(struct golioth_rpc *grpc,
     return GOLIOTH_OK;
 }
 
+enum golioth_status golioth_rpc_register(struct golioth_rpc *grpc,
+                                         const char *method,
+                                         golioth_rpc_cb_fn callback,
+                                         void *callback_arg)
+{
+    return rpc_register(grpc, method, strlen(method), callback, NULL, callback_arg);
+}
+
+enum golioth_status golioth_rpc_register_methods(struct golioth_rpc *grpc,
+                                                 const struct golioth_rpc_method_desc *methods,
+                                                 size_t num_methods)
+{
+    if (num_methods > CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS - grpc->num_rpcs)
+    {
+        GLTH_LOGE(TAG,
+                  "Unable to register, can't register more than %d methods",
+                  CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS);
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    int num_rpcs = grpc->num_rpcs;
+
+    for (size_t i = 0; i < num_methods; i++)
+    {
+        enum golioth_status status = rpc_register(grpc,
+                                                  methods[i].method,
+                                                  methods[i].method_len,
+                                                  methods[i].callback,
+                                                  NULL,
+                                                  methods[i].callback_arg);
+        if (status != GOLIOTH_OK)
+        {
+            // E.g. the observation could not be started; unregister the methods of this call
+            while (grpc->num_rpcs > num_rpcs)
+            {
+                method_index_remove_last(grpc);
+                grpc->num_rpcs--;
+            }
+            return status;
+        }
+    }
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_rpc_register_deferred(struct golioth_rpc *grpc,
+                                                  const char *method,
+                                                  golioth_rpc_deferred_cb_fn callback,
+                                                  void *callback_arg)
+{
+    return rpc_register(grpc, method, strlen(method), NULL, callback, callback_arg);
+}
+
 #endif  // CONFIG_GOLIOTH_RPC
@@ -7,9 +7,10 @@
 #include <golioth/settings.h>
 #include "golioth_util.h"
 #include "coap_client.h"
+#include "heap_accounting.h"
 #include <golioth/golioth_debug.h>
-#include <golioth/zcbor_utils.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <math.h>  // modf
 #include <zcbor_decode.h>
 #include <zcbor_encode.h>
@@ -44,11 +45,16 @@ LOG_TAG_DEFINE(golioth_settings);
 
 #define GOLIOTH_SETTINGS_MAX_NAME_LEN 63 /* not including NULL */
 
+// Open-addressing hash table of registered settings, at most half full
+#define SETTING_INDEX_SIZE (2 * CONFIG_GOLIOTH_MAX_NUM_SETTINGS)
+
 /// Private struct for storing a single setting
 struct golioth_setting
 {
     bool is_valid;
     const char *key;  // aka name
+    size_t key_len;
+    uint32_t hash;
     enum golioth_settings_value_type type;
     union
     {
@@ -60,6 +66,10 @@ struct golioth_setting
     int32_t int_min_val;  // applies only to integers
     int32_t int_max_val;  // applies only to integers
     void *cb_arg;
+    /// The last value was applied successfully; its callback is skipped until the value changes
+    bool has_value;
+    /// Hash of the CBOR encoding of the last value
+    uint32_t value_hash;
 };
 
 /// Private struct to contain settings state data
@@ -69,78 +79,447 @@ struct golioth_settings
     uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
     size_t num_settings;
     struct golioth_setting settings[CONFIG_GOLIOTH_MAX_NUM_SETTINGS];
+    /// Index in settings + 1 of each setting, by key hash; 0 for unused slots
+    uint16_t setting_index[SETTING_INDEX_SIZE];
+    /// Block-wise transfer of a settings document in progress, see stream_continue()
+    struct settings_stream *stream;
+    /// All settings of this version were applied successfully
+    bool has_applied_version;
+    int64_t applied_version;
+    struct golioth_settings_stats stats;
+#if defined(CONFIG_GOLIOTH_SETTINGS_SNAPSHOT)
+    /// Serializes applying settings from the snapshot (on the threads registering them) and from
+    /// documents (on the client thread)
+    golioth_sys_mutex_t lock;
+    /// Snapshot loaded by golioth_settings_init(), until the first document is applied
+    uint8_t *snapshot;
+    size_t snapshot_len;
+    int64_t snapshot_version;
+#endif
 };
 
+// Responses that don't fit in one block are uploaded block-wise, starting with the largest block
+// size that fits in CONFIG_GOLIOTH_SETTINGS_MAX_RESPONSE_LEN. The server may ask for smaller
+// blocks.
+#define RESPONSE_BLOCK_SIZE_MAX \
+    min(CONFIG_GOLIOTH_SETTINGS_MAX_RESPONSE_LEN, CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE)
+#define RESPONSE_BLOCK_SIZE                     \
+    ((RESPONSE_BLOCK_SIZE_MAX >= 1024)   ? 1024 \
+     : (RESPONSE_BLOCK_SIZE_MAX >= 512)  ? 512  \
+     : (RESPONSE_BLOCK_SIZE_MAX >= 256)  ? 256  \
+     : (RESPONSE_BLOCK_SIZE_MAX >= 128)  ? 128  \
+     : (RESPONSE_BLOCK_SIZE_MAX >= 64)   ? 64   \
+     : (RESPONSE_BLOCK_SIZE_MAX >= 32)   ? 32   \
+                                         : 16)
+
+_Static_assert(CONFIG_GOLIOTH_SETTINGS_MAX_RESPONSE_LEN >= 16,
+               "GOLIOTH_SETTINGS_MAX_RESPONSE_LEN must be at least 16");
+
+// Largest part of a response that is encoded at once: one entry of "errors", with the start of
+// the list
+#define RESPONSE_FRAGMENT_MAX_LEN (48 + GOLIOTH_SETTINGS_MAX_NAME_LEN)
+
+#define CBOR_INDEFINITE_MAP 0xBF
+#define CBOR_INDEFINITE_LIST 0x9F
+#define CBOR_BREAK 0xFF
+#define CBOR_NIL 0xF6
+
+/// Block-wise upload of a status report
+///
+/// The report is encoded on the client thread while the document is decoded, so the upload
+/// cannot wait for the server to acknowledge a block. Encoded bytes are buffered here instead,
+/// and each block is sent from the response callback of the previous one, in the block size the
+/// server negotiated. The upload frees itself once it is done.
+struct settings_upload
+{
+    struct golioth_client *client;
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    /// Encoded bytes, from the start of the next block to send
+    uint8_t *buf;
+    size_t len;
+    size_t buf_size;
+    uint32_t block_idx;
+    size_t block_size;
+    /// Size of the block waiting for its response, 0 if none is
+    size_t in_flight;
+    /// The whole report was encoded
+    bool is_complete;
+    /// The report was dropped before it was complete
+    bool is_abandoned;
+    bool failed;
+};
+
+/// The status report of a settings document
 struct settings_response
 {
-    zcbor_state_t zse[1 /* num_backups */ + 2];
-    uint8_t buf[CONFIG_GOLIOTH_SETTINGS_MAX_RESPONSE_LEN];
+    /// Created with the first bytes of the report, see response_reserve()
+    struct settings_upload *upload;
     size_t num_errors;
+    bool failed;
+    /// Errors are only counted, for documents that are not reported to the server
+    bool is_local;
     struct golioth_settings *settings;
 };
 
+/// Where the settings document is being decoded
+enum settings_stream_state
+{
+    STREAM_ROOT_MAP,
+    /// A key of the root map, or its end
+    STREAM_ROOT_ENTRY,
+    /// A setting, or the end of the settings map
+    STREAM_SETTING,
+    STREAM_DONE,
+};
+
+#define STREAM_INDEFINITE UINT32_MAX
+
+/// Decodes a settings document as it is received, in one payload or in blocks
+struct settings_stream
+{
+    enum settings_stream_state state;
+    /// Entries left in the root and settings maps, or STREAM_INDEFINITE
+    uint32_t root_remaining;
+    uint32_t settings_remaining;
+    bool has_settings;
+    bool has_version;
+    int64_t version;
+    /// The version was applied before, so the settings were not decoded
+    bool unchanged;
+    /// Start of an entry that was cut off by the end of a block
+    uint8_t carry[CONFIG_GOLIOTH_SETTINGS_STREAM_BUF_LEN];
+    size_t carry_len;
+    /// Offset and size of the next block to request
+    size_t offset;
+    size_t block_size;
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    struct settings_response response;
+#if defined(CONFIG_GOLIOTH_SETTINGS_SNAPSHOT)
+    /// Snapshot of the current settings being written, see snapshot_add()
+    uint8_t *snapshot;
+    size_t snapshot_len;
+    /// The snapshot could not be written, so the previous one is out of date
+    bool snapshot_failed;
+#endif
+};
+
+static struct settings_upload *upload_create(struct golioth_client *client)
+{
+    struct settings_upload *upload = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_SETTINGS, sizeof(*upload));
+    if (!upload)
+    {
+        return NULL;
+    }
+
+    memset(upload, 0, sizeof(*upload));
+    upload->buf_size = RESPONSE_BLOCK_SIZE + RESPONSE_FRAGMENT_MAX_LEN;
+    upload->buf = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_SETTINGS, upload->buf_size);
+    if (!upload->buf)
+    {
+        GOLIOTH_HEAP_FREE(upload);
+        return NULL;
+    }
+
+    upload->client = client;
+    upload->block_size = RESPONSE_BLOCK_SIZE;
+    golioth_coap_next_token(upload->token);
+
+    return upload;
+}
+
+/// Free \p upload, unless it has more blocks to send or is still being written
+static void upload_free_if_done(struct settings_upload *upload)
+{
+    if (upload->in_flight > 0)
+    {
+        return;
+    }
+
+    if (upload->failed || upload->is_abandoned || (upload->is_complete && upload->len == 0))
+    {
+        GOLIOTH_HEAP_FREE(upload->buf);
+        GOLIOTH_HEAP_FREE(upload);
+    }
+}
+
+static void on_upload_block_sent(struct golioth_client *client,
+                                 enum golioth_status status,
+                                 const struct golioth_coap_rsp_code *coap_rsp_code,
+                                 const char *path,
+                                 size_t block_size,
+                                 void *arg);
+
+/// Send the next block, if it is complete and no other block is waiting for its response
+static void upload_send_next(struct settings_upload *upload)
+{
+    if (upload->in_flight > 0 || upload->failed || upload->is_abandoned || upload->len == 0)
+    {
+        return;
+    }
+
+    /* Until the report is complete, at least one byte is kept for the last block */
+    bool is_last = upload->is_complete && upload->len <= upload->block_size;
+    if (!is_last && upload->len <= upload->block_size)
+    {
+        return;
+    }
+
+    size_t len = is_last ? upload->len : upload->block_size;
+
+    enum golioth_status status =
+        golioth_coap_client_set_block(upload->client,
+                                      upload->token,
+                                      SETTINGS_PATH_PREFIX,
+                                      SETTINGS_STATUS_PATH,
+                                      is_last,
+                                      GOLIOTH_CONTENT_TYPE_CBOR,
+                                      upload->block_idx,
+                                      BLOCKSIZE_TO_SZX(upload->block_size),
+                                      upload->buf,
+                                      len,
+                                      on_upload_block_sent,
+                                      upload,
+                                      false,
+                                      GOLIOTH_SYS_WAIT_FOREVER);
+    if (status != GOLIOTH_OK)
+    {
+        GLTH_LOGE(TAG, "Failed to send a response block to server: %d", status);
+        upload->failed = true;
+        return;
+    }
+
+    upload->in_flight = len;
+}
+
+static void on_upload_block_sent(struct golioth_client *client,
+                                 enum golioth_status status,
+                                 const struct golioth_coap_rsp_code *coap_rsp_code,
+                                 const char *path,
+                                 size_t block_size,
+                                 void *arg)
+{
+    struct settings_upload *upload = arg;
+    size_t sent = upload->in_flight;
+
+    upload->in_flight = 0;
+
+    if (status != GOLIOTH_OK)
+    {
+        GLTH_LOGE(TAG, "Failed to send a response block to server: %d", status);
+        upload->failed = true;
+    }
+    else
+    {
+        upload->len -= sent;
+        memmove(upload->buf, &upload->buf[sent], upload->len);
+
+        if (BLOCKSIZE_TO_SZX(block_size) != -1 && block_size < upload->block_size)
+        {
+            /* Continue after the block that was sent, in the smaller size the server asked for */
+            upload->block_idx = (upload->block_idx + 1) * (upload->block_size / block_size);
+            upload->block_size = block_size;
+        }
+        else
+        {
+            upload->block_idx++;
+        }
+    }
+
+    upload_send_next(upload);
+    upload_free_if_done(upload);
+}
+
+/// The report was encoded completely; send what was not sent yet
+///
+/// @return 0 on success, or a negative error code
+static int upload_finish(struct settings_upload *upload)
+{
+    int err = 0;
+
+    upload->is_complete = true;
+
+    if (upload->block_idx == 0 && upload->in_flight == 0 && upload->len <= upload->block_size)
+    {
+        /* The report fits in a single request */
+        enum golioth_status status = golioth_coap_client_set(upload->client,
+                                                             upload->token,
+                                                             SETTINGS_PATH_PREFIX,
+                                                             SETTINGS_STATUS_PATH,
+                                                             GOLIOTH_CONTENT_TYPE_CBOR,
+                                                             upload->buf,
+                                                             upload->len,
+                                                             NULL,
+                                                             NULL,
+                                                             false,
+                                                             GOLIOTH_SYS_WAIT_FOREVER);
+        if (status != GOLIOTH_OK)
+        {
+            err = -EIO;
+        }
+        upload->len = 0;
+    }
+    else
+    {
+        upload_send_next(upload);
+        if (upload->failed)
+        {
+            err = -EIO;
+        }
+    }
+
+    upload_free_if_done(upload);
+
+    return err;
+}
+
 static void response_init(struct settings_response *response, struct golioth_settings *settings)
 {
     memset(response, 0, sizeof(*response));
 
     response->settings = settings;
+}
+
+/// Make room for up to \p len bytes of the report
+///
+/// @return where to encode them, or NULL if the report failed
+static uint8_t *response_reserve(struct settings_response *response, size_t len)
+{
+    struct settings_upload *upload = response->upload;
+
+    if (response->failed)
+    {
+        return NULL;
+    }
+
+    if (!upload)
+    {
+        upload = upload_create(response->settings->client);
+        if (!upload)
+        {
+            GLTH_LOGE(TAG, "Failed to allocate settings response");
+            response->failed = true;
+            return NULL;
+        }
+        response->upload = upload;
+
+        /* Open the root map */
+        upload->buf[upload->len++] = CBOR_INDEFINITE_MAP;
+    }
+
+    if (upload->failed)
+    {
+        response->failed = true;
+        return NULL;
+    }
+
+    if (upload->len + len > upload->buf_size)
+    {
+        size_t buf_size = max(2 * upload->buf_size, upload->len + len);
+        uint8_t *buf = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_SETTINGS, buf_size);
+        if (!buf)
+        {
+            GLTH_LOGE(TAG, "Failed to allocate settings response");
+            response->failed = true;
+            return NULL;
+        }
+
+        memcpy(buf, upload->buf, upload->len);
+        GOLIOTH_HEAP_FREE(upload->buf);
+        upload->buf = buf;
+        upload->buf_size = buf_size;
+    }
 
-    zcbor_new_encode_state(response->zse,
-                           ARRAY_SIZE(response->zse),
-                           response->buf,
-                           sizeof(response->buf),
-                           1);
+    return &upload->buf[upload->len];
+}
+
+/// Add \p len bytes, encoded after response_reserve(), to the report
+static void response_commit(struct settings_response *response, size_t len)
+{
+    response->upload->len += len;
+    upload_send_next(response->upload);
+}
 
-    /* Initialize the map */
-    zcbor_map_start_encode(response->zse, ZCBOR_MAX_ELEM_COUNT);
+/// Drop a report that was not finished
+static void response_abandon(struct settings_response *response)
+{
+    if (response->upload)
+    {
+        response->upload->is_abandoned = true;
+        upload_free_if_done(response->upload);
+        response->upload = NULL;
+    }
 }
 
 static void add_error_to_response(struct settings_response *response,
                                   const char *key,
                                   enum golioth_settings_status code)
 {
-    if (response->num_errors == 0)
+    uint8_t *buf = (response->is_local ? NULL
+                                       : response_reserve(response, RESPONSE_FRAGMENT_MAX_LEN));
+    size_t len = 0;
+
+    if (buf)
     {
-        zcbor_tstr_put_lit(response->zse, "errors");
-        zcbor_list_start_encode(response->zse, ZCBOR_MAX_ELEM_COUNT);
-    }
+        if (response->num_errors == 0)
+        {
+            ZCBOR_STATE_E(zse, 0, buf, RESPONSE_FRAGMENT_MAX_LEN, 1);
+            zcbor_tstr_put_lit(zse, "errors");
+            len = zse->payload - buf;
+            buf[len++] = CBOR_INDEFINITE_LIST;
+        }
 
-    zcbor_map_start_encode(response->zse, 2);
+        ZCBOR_STATE_E(zse, 1, &buf[len], RESPONSE_FRAGMENT_MAX_LEN - len, 1);
 
-    zcbor_tstr_put_lit(response->zse, "setting_key");
-    zcbor_tstr_put_term(response->zse, key, SIZE_MAX);
+        zcbor_map_start_encode(zse, 2);
 
-    zcbor_tstr_put_lit(response->zse, "error_code");
-    zcbor_int64_put(response->zse, code);
+        zcbor_tstr_put_lit(zse, "setting_key");
+        zcbor_tstr_put_term(zse, key, SIZE_MAX);
 
-    zcbor_map_end_encode(response->zse, 2);
+        zcbor_tstr_put_lit(zse, "error_code");
+        zcbor_int64_put(zse, code);
+
+        zcbor_map_end_encode(zse, 2);
+
+        response_commit(response, zse->payload - buf);
+    }
 
     response->num_errors++;
 }
 
 static struct golioth_setting *find_registered_setting(struct golioth_settings *gsettings,
-                                                       const char *key)
+                                                       const char *key,
+                                                       size_t key_len)
 {
-    for (size_t i = 0; i < gsettings->num_settings; i++)
+    uint32_t hash = golioth_hash(key, key_len);
+
+    // Settings registered twice are found in registration order, so the first one wins
+    for (size_t slot = hash % SETTING_INDEX_SIZE; gsettings->setting_index[slot] != 0;
+         slot = (slot + 1) % SETTING_INDEX_SIZE)
     {
-        struct golioth_setting *s = &gsettings->settings[i];
-        if (!s->is_valid)
-        {
-            continue;
-        }
-        if (strcmp(s->key, key) == 0)
+        struct golioth_setting *s = &gsettings->settings[gsettings->setting_index[slot] - 1];
+        if (s->is_valid && s->hash == hash && s->key_len == key_len
+            && memcmp(s->key, key, key_len) == 0)
         {
             return s;
         }
     }
+
     return NULL;
 }
 
-static int finalize_and_send_response(struct golioth_client *client,
-                                      struct settings_response *response,
-                                      int64_t version)
+// End of "errors", "version" and its value, and the end of the root map
+#define RESPONSE_TRAILER_MAX_LEN (1 + sizeof("version") + 9 + 1)
+
+static int finalize_and_send_response(struct settings_response *response, int64_t version)
 {
-    bool ok;
+    uint8_t *buf = response_reserve(response, RESPONSE_TRAILER_MAX_LEN);
+    size_t len = 0;
+
+    if (!buf)
+    {
+        response_abandon(response);
+        return -EIO;
+    }
 
     /*
      * If there were errors, then the "errors" array is still open,
@@ -148,224 +527,817 @@ static int finalize_and_send_response(struct golioth_client *client,
      */
     if (response->num_errors > 0)
     {
-        ok = zcbor_list_end_encode(response->zse, SIZE_MAX);
-        if (!ok)
-        {
-            return -ENOMEM;
-        }
+        buf[len++] = CBOR_BREAK;
     }
 
     /* Set version */
-    ok = zcbor_tstr_put_lit(response->zse, "version") && zcbor_int64_put(response->zse, version);
-    if (!ok)
+    ZCBOR_STATE_E(zse, 0, &buf[len], RESPONSE_TRAILER_MAX_LEN - len, 1);
+    if (!zcbor_tstr_put_lit(zse, "version") || !zcbor_int64_put(zse, version))
     {
+        response_abandon(response);
         return -ENOMEM;
     }
+    len = zse->payload - buf;
 
     /* Close the root map */
-    ok = zcbor_map_end_encode(response->zse, 1);
-    if (!ok)
-    {
-        return -ENOMEM;
-    }
+    buf[len++] = CBOR_BREAK;
 
-    GLTH_LOG_BUFFER_HEXDUMP(TAG,
-                            response->buf,
-                            response->zse->payload - response->buf,
-                            GOLIOTH_DEBUG_LOG_LEVEL_DEBUG);
+    struct settings_upload *upload = response->upload;
+    response->upload = NULL;
+    upload->len += len;
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
+    GLTH_LOG_BUFFER_HEXDUMP(TAG, upload->buf, upload->len, GOLIOTH_DEBUG_LOG_LEVEL_DEBUG);
 
-    return golioth_coap_client_set(client,
-                                   token,
-                                   SETTINGS_PATH_PREFIX,
-                                   SETTINGS_STATUS_PATH,
-                                   GOLIOTH_CONTENT_TYPE_CBOR,
-                                   response->buf,
-                                   response->zse->payload - response->buf,
-                                   NULL,
-                                   NULL,
-                                   false,
-                                   GOLIOTH_SYS_WAIT_FOREVER);
+    return upload_finish(upload);
 }
 
-static int settings_decode(zcbor_state_t *zsd, void *value)
+/// Apply a received setting, with \p zsd at its value
+///
+/// The callback is skipped if the setting was applied with the same value (\p value_hash) before.
+///
+/// @return 0 on success, including settings rejected with an error in the response
+/// @return -EBADMSG if the value could not be skipped
+static int setting_apply(struct settings_response *settings_response,
+                         const char *key,
+                         uint32_t value_hash,
+                         zcbor_state_t *zsd)
 {
-    struct settings_response *settings_response = value;
     struct golioth_settings *gsettings = settings_response->settings;
-    struct zcbor_string label;
     enum golioth_settings_status setting_status = GOLIOTH_SETTINGS_SUCCESS;
+    bool data_type_valid = true;
     bool ok;
 
-    if (zcbor_nil_expect(zsd, NULL))
+    zcbor_major_type_t major_type = ZCBOR_MAJOR_TYPE(*zsd->payload);
+
+    GLTH_LOGD(TAG, "key = %s, major_type = %d", key, major_type);
+
+    struct golioth_setting *registered_setting =
+        find_registered_setting(gsettings, key, strlen(key));
+    if (!registered_setting)
+    {
+        add_error_to_response(settings_response, key, GOLIOTH_SETTINGS_KEY_NOT_RECOGNIZED);
+
+        ok = zcbor_any_skip(zsd, NULL);
+        if (!ok)
+        {
+            GLTH_LOGE(TAG, "Failed to skip unrecognized key");
+            return -EBADMSG;
+        }
+
+        return 0;
+    }
+
+    if (registered_setting->has_value && registered_setting->value_hash == value_hash)
+    {
+        GLTH_LOGD(TAG, "key = %s unchanged", key);
+        gsettings->stats.skipped++;
+        return 0;
+    }
+
+    switch (major_type)
+    {
+        case ZCBOR_MAJOR_TYPE_TSTR:
+        {
+            struct zcbor_string str;
+
+            if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_STRING)
+            {
+                data_type_valid = false;
+                break;
+            }
+
+            ok = zcbor_tstr_decode(zsd, &str);
+            if (!ok)
+            {
+                data_type_valid = false;
+                break;
+            }
+
+            setting_status = registered_setting->string_cb((char *) str.value,
+                                                           str.len,
+                                                           registered_setting->cb_arg);
+            break;
+        }
+        case ZCBOR_MAJOR_TYPE_PINT:
+        case ZCBOR_MAJOR_TYPE_NINT:
+        {
+            int64_t value;
+
+            if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_INT)
+            {
+                data_type_valid = false;
+                break;
+            }
+
+            ok = zcbor_int64_decode(zsd, &value);
+            if (!ok)
+            {
+                data_type_valid = false;
+                break;
+            }
+
+            if ((value < registered_setting->int_min_val)
+                || (value > registered_setting->int_max_val))
+            {
+                setting_status = GOLIOTH_SETTINGS_VALUE_OUTSIDE_RANGE;
+                break;
+            }
+
+            setting_status =
+                registered_setting->int_cb((int32_t) value, registered_setting->cb_arg);
+            break;
+        }
+        case ZCBOR_MAJOR_TYPE_SIMPLE:
+        {
+            bool value_bool;
+            double value_double;
+
+            if (zcbor_float_decode(zsd, &value_double))
+            {
+                if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT)
+                {
+                    data_type_valid = false;
+                    break;
+                }
+
+                setting_status =
+                    registered_setting->float_cb((float) value_double, registered_setting->cb_arg);
+            }
+            else if (zcbor_bool_decode(zsd, &value_bool))
+            {
+                if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_BOOL)
+                {
+                    data_type_valid = false;
+                    break;
+                }
+
+                setting_status =
+                    registered_setting->bool_cb(value_bool, registered_setting->cb_arg);
+            }
+            else
+            {
+                break;
+            }
+            break;
+        }
+        default:
+            data_type_valid = false;
+            break;
+    }
+
+    /* Values that failed are applied again, even if they don't change */
+    registered_setting->has_value = data_type_valid && setting_status == GOLIOTH_SETTINGS_SUCCESS;
+    registered_setting->value_hash = value_hash;
+
+    if (data_type_valid)
+    {
+        if (setting_status != GOLIOTH_SETTINGS_SUCCESS)
+        {
+            add_error_to_response(settings_response, key, setting_status);
+        }
+        else
+        {
+            gsettings->stats.applied++;
+        }
+    }
+    else
+    {
+        add_error_to_response(settings_response, key, GOLIOTH_SETTINGS_VALUE_FORMAT_NOT_VALID);
+
+        ok = zcbor_any_skip(zsd, NULL);
+        if (!ok)
+        {
+            GLTH_LOGE(TAG, "Failed to skip unsupported type");
+            return -EBADMSG;
+        }
+    }
+
+    return 0;
+}
+
+static void stream_init(struct settings_stream *stream, struct golioth_settings *settings)
+{
+    stream->state = STREAM_ROOT_MAP;
+    stream->has_settings = false;
+    stream->has_version = false;
+    stream->unchanged = false;
+    stream->carry_len = 0;
+    stream->offset = 0;
+    response_init(&stream->response, settings);
+#if defined(CONFIG_GOLIOTH_SETTINGS_SNAPSHOT)
+    stream->snapshot = NULL;
+    stream->snapshot_failed = false;
+#endif
+}
+
+#if defined(CONFIG_GOLIOTH_SETTINGS_SNAPSHOT)
+
+// Snapshots have the format of the documents from the server, with indefinite-length maps:
+// {"settings": {...}, "version": ...}
+static const uint8_t snapshot_header[] = {
+    CBOR_INDEFINITE_MAP, 0x68, 's', 'e', 't', 't', 'i', 'n', 'g', 's', CBOR_INDEFINITE_MAP,
+};
+
+// End of the settings map, "version", its value and end of the root map
+#define SNAPSHOT_TRAILER_LEN (1 + sizeof("version") + 9 + 1)
+
+static void settings_lock(struct golioth_settings *settings)
+{
+    golioth_sys_mutex_lock(settings->lock, GOLIOTH_SYS_WAIT_FOREVER);
+}
+
+static void settings_unlock(struct golioth_settings *settings)
+{
+    golioth_sys_mutex_unlock(settings->lock);
+}
+
+/// Start a snapshot of the settings applied from the document decoded by \p stream
+static void snapshot_begin(struct settings_stream *stream)
+{
+    stream->snapshot =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_SETTINGS, CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN);
+    if (!stream->snapshot)
+    {
+        GLTH_LOGW(TAG, "Failed to allocate settings snapshot");
+        stream->snapshot_failed = true;
+        return;
+    }
+
+    memcpy(stream->snapshot, snapshot_header, sizeof(snapshot_header));
+    stream->snapshot_len = sizeof(snapshot_header);
+}
+
+static void snapshot_discard(struct settings_stream *stream)
+{
+    GOLIOTH_HEAP_FREE(stream->snapshot);
+    stream->snapshot = NULL;
+}
+
+/// Add a setting (key and value, as received) to the snapshot, if its value is applied
+static void snapshot_add(struct settings_stream *stream,
+                         const char *key,
+                         const uint8_t *entry,
+                         size_t entry_len)
+{
+    if (!stream->snapshot)
+    {
+        return;
+    }
+
+    const struct golioth_setting *setting =
+        find_registered_setting(stream->response.settings, key, strlen(key));
+    if (!setting || !setting->has_value)
+    {
+        return;
+    }
+
+    if (stream->snapshot_len + entry_len + SNAPSHOT_TRAILER_LEN
+        > CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN)
+    {
+        GLTH_LOGW(TAG,
+                  "Settings snapshot larger than %d bytes",
+                  CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN);
+        snapshot_discard(stream);
+        stream->snapshot_failed = true;
+        return;
+    }
+
+    memcpy(&stream->snapshot[stream->snapshot_len], entry, entry_len);
+    stream->snapshot_len += entry_len;
+}
+
+/// Remove the saved snapshot, which no longer matches the settings applied
+static void snapshot_invalidate(void)
+{
+    enum golioth_status status = golioth_settings_snapshot_save(NULL, 0);
+    if (status != GOLIOTH_OK)
+    {
+        GLTH_LOGE(TAG, "Failed to remove outdated settings snapshot: %d", status);
+    }
+}
+
+/// Save the snapshot of a document that was decoded completely, replacing the previous one
+static void snapshot_end(struct settings_stream *stream)
+{
+    struct golioth_settings *settings = stream->response.settings;
+    bool saved = false;
+
+    /* Only needed until the first document is applied */
+    GOLIOTH_HEAP_FREE(settings->snapshot);
+    settings->snapshot = NULL;
+
+    if (stream->unchanged)
+    {
+        snapshot_discard(stream);
+        return;
+    }
+
+    if (stream->snapshot && stream->has_settings)
+    {
+        stream->snapshot[stream->snapshot_len++] = CBOR_BREAK;
+
+        ZCBOR_STATE_E(zse,
+                      0,
+                      &stream->snapshot[stream->snapshot_len],
+                      CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN - stream->snapshot_len,
+                      1);
+        if (zcbor_tstr_put_lit(zse, "version") && zcbor_int64_put(zse, stream->version))
+        {
+            stream->snapshot_len = zse->payload - stream->snapshot;
+            stream->snapshot[stream->snapshot_len++] = CBOR_BREAK;
+
+            enum golioth_status status =
+                golioth_settings_snapshot_save(stream->snapshot, stream->snapshot_len);
+            if (status == GOLIOTH_OK)
+            {
+                saved = true;
+            }
+            else
+            {
+                GLTH_LOGW(TAG, "Failed to save settings snapshot: %d", status);
+            }
+        }
+    }
+
+    /* Without settings in the document, the previous snapshot is out of date as well */
+    if (!saved)
+    {
+        snapshot_invalidate();
+    }
+
+    snapshot_discard(stream);
+}
+
+#else /* CONFIG_GOLIOTH_SETTINGS_SNAPSHOT */
+
+static inline void settings_lock(struct golioth_settings *settings) {}
+
+static inline void settings_unlock(struct golioth_settings *settings) {}
+
+static inline void snapshot_begin(struct settings_stream *stream) {}
+
+static inline void snapshot_discard(struct settings_stream *stream) {}
+
+static inline void snapshot_add(struct settings_stream *stream,
+                                const char *key,
+                                const uint8_t *entry,
+                                size_t entry_len)
+{
+}
+
+static inline void snapshot_end(struct settings_stream *stream) {}
+
+#endif /* CONFIG_GOLIOTH_SETTINGS_SNAPSHOT */
+
+/// Decode the header of a map
+///
+/// @return number of bytes of the header, or -EAGAIN if \p len is too short
+static int map_header_decode(const uint8_t *buf, size_t len, uint32_t *num_entries)
+{
+    static const uint8_t arg_len[] = {1, 2, 4};
+
+    if (len < 1)
+    {
+        return -EAGAIN;
+    }
+
+    if (ZCBOR_MAJOR_TYPE(buf[0]) != ZCBOR_MAJOR_TYPE_MAP)
+    {
+        GLTH_LOGW(TAG, "Did not start CBOR list correctly");
+        return -EBADMSG;
+    }
+
+    uint8_t additional = buf[0] & 0x1F;
+    if (additional < 24)
+    {
+        *num_entries = additional;
+        return 1;
+    }
+    if (additional == 31)
+    {
+        *num_entries = STREAM_INDEFINITE;
+        return 1;
+    }
+    if (additional > 26)
+    {
+        return -EBADMSG;
+    }
+
+    size_t n = arg_len[additional - 24];
+    if (len < 1 + n)
+    {
+        return -EAGAIN;
+    }
+
+    *num_entries = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        *num_entries = (*num_entries << 8) | buf[1 + i];
+    }
+
+    return 1 + n;
+}
+
+/// Whether the end of a map with \p remaining entries left is at \p buf
+///
+/// @return number of bytes of the end, 0 if the map does not end, or -EAGAIN
+static int map_end_decode(const uint8_t *buf, size_t len, uint32_t remaining)
+{
+    if (remaining != STREAM_INDEFINITE)
+    {
+        return remaining == 0 ? 0 : -ENOENT;
+    }
+    if (len < 1)
+    {
+        return -EAGAIN;
+    }
+
+    return buf[0] == CBOR_BREAK ? 1 : -ENOENT;
+}
+
+/// Decode one entry of the root map
+static int stream_root_entry(struct settings_stream *stream, const uint8_t *buf, size_t len)
+{
+    ZCBOR_STATE_D(zsd, 2, buf, len, 2, 0);
+    struct zcbor_string label;
+
+    if (!zcbor_tstr_decode(zsd, &label))
+    {
+        return -EAGAIN;
+    }
+
+    if (label.len == sizeof("settings") - 1 && memcmp(label.value, "settings", label.len) == 0)
+    {
+        const uint8_t *value = zsd->payload;
+        size_t value_len = len - (value - buf);
+
+        if (value_len < 1)
+        {
+            return -EAGAIN;
+        }
+
+        if (value[0] == CBOR_NIL)
+        {
+            /* No settings are set */
+            return -ENOENT;
+        }
+
+        int ret = map_header_decode(value, value_len, &stream->settings_remaining);
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        stream->has_settings = true;
+        stream->state = STREAM_SETTING;
+        return (value - buf) + ret;
+    }
+
+    if (label.len == sizeof("version") - 1 && memcmp(label.value, "version", label.len) == 0)
+    {
+        if (!zcbor_int64_decode(zsd, &stream->version))
+        {
+            return -EAGAIN;
+        }
+
+        stream->has_version = true;
+
+        struct golioth_settings *settings = stream->response.settings;
+        if (!stream->has_settings && settings->has_applied_version
+            && settings->applied_version == stream->version)
+        {
+            /* Nothing changed since the last document, so only acknowledge it */
+            GLTH_LOGD(TAG, "Version %" PRId64 " already applied", stream->version);
+            settings->stats.documents_skipped++;
+            stream->unchanged = true;
+            stream->state = STREAM_DONE;
+        }
+    }
+    else if (!zcbor_any_skip(zsd, NULL))
     {
-        /* No settings are set */
-        return -ENOENT;
+        return -EAGAIN;
     }
 
-    ok = zcbor_map_start_decode(zsd);
-    if (!ok)
-    {
-        GLTH_LOGW(TAG, "Did not start CBOR list correctly");
-        return -EBADMSG;
+    return zsd->payload - buf;
+}
+
+/// Decode one setting, once it was received completely
+static int stream_setting(struct settings_stream *stream, const uint8_t *buf, size_t len)
+{
+    ZCBOR_STATE_D(zsd, 2, buf, len, 2, 0);
+    struct zcbor_string label;
+
+    if (!zcbor_tstr_decode(zsd, &label))
+    {
+        return -EAGAIN;
+    }
+
+    const uint8_t *value = zsd->payload;
+
+    /* The callback is only called once the whole value was received */
+    if (!zcbor_any_skip(zsd, NULL))
+    {
+        return -EAGAIN;
+    }
+
+    size_t entry_len = zsd->payload - buf;
+
+    char key[GOLIOTH_SETTINGS_MAX_NAME_LEN + 1] = {};
+
+    /* Copy setting label/name and ensure it's NULL-terminated */
+    memcpy(key, label.value, MIN(GOLIOTH_SETTINGS_MAX_NAME_LEN, label.len));
+
+    size_t value_len = entry_len - (value - buf);
+    ZCBOR_STATE_D(value_zsd, 2, value, value_len, 1, 0);
+    int err = setting_apply(&stream->response, key, golioth_hash(value, value_len), value_zsd);
+    if (err)
+    {
+        return err;
+    }
+
+    snapshot_add(stream, key, buf, entry_len);
+
+    return entry_len;
+}
+
+/// Decode as much of \p buf as possible
+///
+/// @return number of bytes consumed, or a negative error code
+static int stream_decode(struct settings_stream *stream, const uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+
+    while (stream->state != STREAM_DONE)
+    {
+        const uint8_t *p = &buf[pos];
+        size_t left = len - pos;
+        int ret;
+
+        switch (stream->state)
+        {
+            case STREAM_ROOT_MAP:
+                ret = map_header_decode(p, left, &stream->root_remaining);
+                if (ret > 0)
+                {
+                    stream->state = STREAM_ROOT_ENTRY;
+                }
+                break;
+            case STREAM_ROOT_ENTRY:
+                ret = map_end_decode(p, left, stream->root_remaining);
+                if (ret >= 0)
+                {
+                    stream->state = STREAM_DONE;
+                }
+                else if (ret == -ENOENT)
+                {
+                    ret = stream_root_entry(stream, p, left);
+                    if (ret > 0 && stream->root_remaining != STREAM_INDEFINITE)
+                    {
+                        stream->root_remaining--;
+                    }
+                }
+                break;
+            case STREAM_SETTING:
+                ret = map_end_decode(p, left, stream->settings_remaining);
+                if (ret >= 0)
+                {
+                    stream->state = STREAM_ROOT_ENTRY;
+                }
+                else if (ret == -ENOENT)
+                {
+                    ret = stream_setting(stream, p, left);
+                    if (ret > 0 && stream->settings_remaining != STREAM_INDEFINITE)
+                    {
+                        stream->settings_remaining--;
+                    }
+                }
+                break;
+            default:
+                ret = -EINVAL;
+                break;
+        }
+
+        if (ret == -EAGAIN)
+        {
+            break;
+        }
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        pos += ret;
     }
 
-    while (!zcbor_list_or_map_end(zsd))
+    return pos;
+}
+
+/// Decode the next part of the settings document
+///
+/// Entries cut off at the end of \p len are kept until the next call.
+///
+/// @return 0 on success, or a negative error code
+static int stream_feed(struct settings_stream *stream, const uint8_t *data, size_t len)
+{
+    stream->offset += len;
+
+    while (len > 0 && stream->state != STREAM_DONE)
     {
-        /* Handle item */
-        ok = zcbor_tstr_decode(zsd, &label);
-        if (!ok)
+        if (stream->carry_len == 0)
         {
-            GLTH_LOGE(TAG, "Failed to get label");
-            return -EBADMSG;
-        }
+            int ret = stream_decode(stream, data, len);
+            if (ret < 0)
+            {
+                return ret;
+            }
 
-        char key[GOLIOTH_SETTINGS_MAX_NAME_LEN + 1] = {};
+            data += ret;
+            len -= ret;
 
-        /* Copy setting label/name and ensure it's NULL-terminated */
-        memcpy(key, label.value, MIN(GOLIOTH_SETTINGS_MAX_NAME_LEN, label.len));
+            if (stream->state == STREAM_DONE)
+            {
+                break;
+            }
+
+            if (len > sizeof(stream->carry))
+            {
+                GLTH_LOGE(TAG, "Setting larger than %zu bytes", sizeof(stream->carry));
+                return -ENOMEM;
+            }
 
-        bool data_type_valid = true;
+            memcpy(stream->carry, data, len);
+            stream->carry_len = len;
+            break;
+        }
 
-        zcbor_major_type_t major_type = ZCBOR_MAJOR_TYPE(*zsd->payload);
+        size_t old_carry_len = stream->carry_len;
+        size_t take = min(len, sizeof(stream->carry) - old_carry_len);
 
-        GLTH_LOGD(TAG, "key = %s, major_type = %d", key, major_type);
+        memcpy(&stream->carry[old_carry_len], data, take);
+        stream->carry_len += take;
 
-        const struct golioth_setting *registered_setting = find_registered_setting(gsettings, key);
-        if (!registered_setting)
+        int ret = stream_decode(stream, stream->carry, stream->carry_len);
+        if (ret < 0)
         {
-            add_error_to_response(settings_response, key, GOLIOTH_SETTINGS_KEY_NOT_RECOGNIZED);
+            return ret;
+        }
 
-            ok = zcbor_any_skip(zsd, NULL);
-            if (!ok)
+        if ((size_t) ret < old_carry_len)
+        {
+            /* Still incomplete, so the new data was appended completely or the entry is too big */
+            if (take < len)
             {
-                GLTH_LOGE(TAG, "Failed to skip unrecognized key");
-                return -EBADMSG;
+                GLTH_LOGE(TAG, "Setting larger than %zu bytes", sizeof(stream->carry));
+                return -ENOMEM;
             }
 
-            continue;
+            memmove(stream->carry, &stream->carry[ret], stream->carry_len - ret);
+            stream->carry_len -= ret;
+            break;
         }
 
-        switch (major_type)
-        {
-            case ZCBOR_MAJOR_TYPE_TSTR:
-            {
-                struct zcbor_string str;
+        /* The entry that was cut off is complete; decode the rest of data in place */
+        size_t consumed = ret - old_carry_len;
+        data += consumed;
+        len -= consumed;
+        stream->carry_len = 0;
+    }
 
-                if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_STRING)
-                {
-                    data_type_valid = false;
-                    break;
-                }
+    return 0;
+}
 
-                ok = zcbor_tstr_decode(zsd, &str);
-                if (!ok)
-                {
-                    data_type_valid = false;
-                    break;
-                }
+static void stream_finish(struct settings_stream *stream)
+{
+    if (stream->state != STREAM_DONE || !stream->has_version || stream->carry_len > 0)
+    {
+        GLTH_LOGE(TAG, "Failed to parse tstr map");
+        snapshot_discard(stream);
+        return;
+    }
 
-                setting_status = registered_setting->string_cb((char *) str.value,
-                                                               str.len,
-                                                               registered_setting->cb_arg);
-                break;
-            }
-            case ZCBOR_MAJOR_TYPE_PINT:
-            case ZCBOR_MAJOR_TYPE_NINT:
-            {
-                int64_t value;
+    struct golioth_settings *settings = stream->response.settings;
+    settings->has_applied_version = (stream->response.num_errors == 0);
+    settings->applied_version = stream->version;
 
-                if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_INT)
-                {
-                    data_type_valid = false;
-                    break;
-                }
+    int err = finalize_and_send_response(&stream->response, stream->version);
+    if (err)
+    {
+        GLTH_LOGE(TAG, "Failed to send a response to server: %d", err);
+    }
 
-                ok = zcbor_int64_decode(zsd, &value);
-                if (!ok)
-                {
-                    data_type_valid = false;
-                    break;
-                }
+    snapshot_end(stream);
+}
 
-                if ((value < registered_setting->int_min_val)
-                    || (value > registered_setting->int_max_val))
-                {
-                    setting_status = GOLIOTH_SETTINGS_VALUE_OUTSIDE_RANGE;
-                    break;
-                }
+static void stream_free(struct settings_stream *stream)
+{
+    response_abandon(&stream->response);
+    snapshot_discard(stream);
+    GOLIOTH_HEAP_FREE(stream);
+}
 
-                setting_status =
-                    registered_setting->int_cb((int32_t) value, registered_setting->cb_arg);
-                break;
-            }
-            case ZCBOR_MAJOR_TYPE_SIMPLE:
-            {
-                bool value_bool;
-                double value_double;
+static enum golioth_status stream_request_block(struct golioth_client *client,
+                                                struct settings_stream *stream);
+
+static void on_settings_block(struct golioth_client *client,
+                              enum golioth_status status,
+                              const struct golioth_coap_rsp_code *coap_rsp_code,
+                              const char *path,
+                              const uint8_t *payload,
+                              size_t payload_size,
+                              bool is_last,
+                              void *arg)
+{
+    struct settings_stream *stream = arg;
+    struct golioth_settings *settings = stream->response.settings;
 
-                if (zcbor_float_decode(zsd, &value_double))
-                {
-                    if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT)
-                    {
-                        data_type_valid = false;
-                        break;
-                    }
+    /* Replaced by a newer notification, or the settings service was deinitialized */
+    if (!settings || settings->stream != stream)
+    {
+        stream_free(stream);
+        return;
+    }
 
-                    setting_status = registered_setting->float_cb((float) value_double,
-                                                                  registered_setting->cb_arg);
-                }
-                else if (zcbor_bool_decode(zsd, &value_bool))
-                {
-                    if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_BOOL)
-                    {
-                        data_type_valid = false;
-                        break;
-                    }
+    int err = 0;
 
-                    setting_status =
-                        registered_setting->bool_cb(value_bool, registered_setting->cb_arg);
-                }
-                else
-                {
-                    break;
-                }
-                break;
-            }
-            default:
-                data_type_valid = false;
-                break;
+    if (status != GOLIOTH_OK)
+    {
+        GLTH_LOGE(TAG, "Failed to get settings block: %d", status);
+        err = -EIO;
+    }
+    else
+    {
+        settings_lock(settings);
+        err = stream_feed(stream, payload, payload_size);
+        settings_unlock(settings);
+        if (err && err != -ENOENT)
+        {
+            GLTH_LOGE(TAG, "Failed to parse tstr map");
         }
+    }
 
-        if (data_type_valid)
+    if (err == 0 && !is_last && stream->state != STREAM_DONE)
+    {
+        if (stream_request_block(client, stream) == GOLIOTH_OK)
         {
-            if (setting_status != GOLIOTH_SETTINGS_SUCCESS)
-            {
-                add_error_to_response(settings_response, key, setting_status);
-            }
+            return;
         }
-        else
-        {
-            add_error_to_response(settings_response, key, GOLIOTH_SETTINGS_VALUE_FORMAT_NOT_VALID);
+        GLTH_LOGE(TAG, "Failed to request settings block");
+        err = -EIO;
+    }
 
-            ok = zcbor_any_skip(zsd, NULL);
-            if (!ok)
-            {
-                GLTH_LOGE(TAG, "Failed to skip unsupported type");
-                return -EBADMSG;
-            }
-        }
+    if (err == 0)
+    {
+        settings_lock(settings);
+        stream_finish(stream);
+        settings_unlock(settings);
     }
 
-    ok = zcbor_map_end_decode(zsd);
-    if (!ok)
+    settings->stream = NULL;
+    stream_free(stream);
+}
+
+static enum golioth_status stream_request_block(struct golioth_client *client,
+                                                struct settings_stream *stream)
+{
+    return golioth_coap_client_get_block(client,
+                                         stream->token,
+                                         SETTINGS_PATH_PREFIX,
+                                         "",
+                                         GOLIOTH_CONTENT_TYPE_CBOR,
+                                         stream->offset / stream->block_size,
+                                         stream->block_size,
+                                         on_settings_block,
+                                         stream,
+                                         false,
+                                         GOLIOTH_SYS_WAIT_FOREVER);
+}
+
+/// Continue with a block-wise transfer of the settings, after the first block was received in
+/// \p stream, which the transfer takes over
+static void stream_continue(struct golioth_client *client,
+                            struct golioth_settings *settings,
+                            struct settings_stream *stream)
+{
+    // The first block is as large as the server's blocks
+    size_t block_size = min(stream->offset, CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE);
+    if (BLOCKSIZE_TO_SZX(block_size) == -1)
     {
-        GLTH_LOGW(TAG, "Did not end CBOR list correctly");
-        return -EBADMSG;
+        GLTH_LOGE(TAG, "Unsupported settings block size: %zu", block_size);
+        stream_free(stream);
+        return;
     }
 
-    return 0;
+    stream->block_size = block_size;
+    golioth_coap_next_token(stream->token);
+
+    settings->stream = stream;
+
+    if (stream_request_block(client, stream) != GOLIOTH_OK)
+    {
+        GLTH_LOGE(TAG, "Failed to request settings block");
+        settings->stream = NULL;
+        stream_free(stream);
+    }
 }
 
 static void on_settings(struct golioth_client *client,
@@ -393,14 +1365,8 @@ static void on_settings(struct golioth_client *client,
         return;
     }
 
-    ZCBOR_STATE_D(zsd, 2, payload, payload_size, 1, 0);
-    int64_t version;
     struct golioth_settings *settings = arg;
-    struct settings_response settings_response;
-    struct zcbor_map_entry map_entries[] = {
-        ZCBOR_TSTR_LIT_MAP_ENTRY("settings", settings_decode, &settings_response),
-        ZCBOR_TSTR_LIT_MAP_ENTRY("version", zcbor_map_int64_decode, &version),
-    };
+    struct settings_stream *stream;
     int err;
 
     GLTH_LOG_BUFFER_HEXDUMP(TAG, payload, payload_size, GOLIOTH_DEBUG_LOG_LEVEL_DEBUG);
@@ -413,27 +1379,60 @@ static void on_settings(struct golioth_client *client,
 
     GLTH_LOG_BUFFER_HEXDUMP(TAG, payload, min(64, payload_size), GOLIOTH_DEBUG_LOG_LEVEL_DEBUG);
 
-    response_init(&settings_response, settings);
+    /* A newer version replaces a transfer in progress, which is dropped when its block arrives */
+    settings->stream = NULL;
 
-    err = zcbor_map_decode(zsd, map_entries, ARRAY_SIZE(map_entries));
+    /* Kept off the stack of the client thread, and taken over by a block-wise transfer */
+    stream = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_SETTINGS, sizeof(*stream));
+    if (!stream)
+    {
+        GLTH_LOGE(TAG, "Failed to allocate settings stream");
+        return;
+    }
+
+    stream_init(stream, settings);
+    snapshot_begin(stream);
+
+    settings_lock(settings);
+    err = stream_feed(stream, payload, payload_size);
+    settings_unlock(settings);
     if (err)
     {
         if (err != -ENOENT)
         {
             GLTH_LOGE(TAG, "Failed to parse tstr map");
         }
+        stream_free(stream);
         return;
     }
 
-    err = finalize_and_send_response(client, &settings_response, version);
-    if (err)
+    if (stream->state != STREAM_DONE)
     {
-        GLTH_LOGE(TAG, "Failed to send a response to server: %d", err);
+        /* Only the first block of a larger document (Block2) */
+        stream_continue(client, settings, stream);
         return;
     }
+
+    settings_lock(settings);
+    stream_finish(stream);
+    settings_unlock(settings);
+    stream_free(stream);
+}
+
+static void setting_index_add(struct golioth_settings *settings, size_t index)
+{
+    size_t slot = settings->settings[index].hash % SETTING_INDEX_SIZE;
+
+    while (settings->setting_index[slot] != 0)
+    {
+        slot = (slot + 1) % SETTING_INDEX_SIZE;
+    }
+
+    settings->setting_index[slot] = index + 1;
 }
 
-static struct golioth_setting *alloc_setting(struct golioth_settings *settings)
+static struct golioth_setting *alloc_setting(struct golioth_settings *settings,
+                                             const char *setting_name)
 {
     if (settings->num_settings == CONFIG_GOLIOTH_MAX_NUM_SETTINGS)
     {
@@ -443,7 +1442,20 @@ static struct golioth_setting *alloc_setting(struct golioth_settings *settings)
         return NULL;
     }
 
-    return &settings->settings[settings->num_settings++];
+    size_t index = settings->num_settings++;
+    struct golioth_setting *new_setting = &settings->settings[index];
+
+    new_setting->is_valid = true;
+    new_setting->key = setting_name;
+    new_setting->key_len = strlen(setting_name);
+    new_setting->hash = golioth_hash(setting_name, new_setting->key_len);
+    new_setting->has_value = false;
+    setting_index_add(settings, index);
+
+    /* The new setting gets its value from the next document, even if the version is the same */
+    settings->has_applied_version = false;
+
+    return new_setting;
 }
 
 static enum golioth_status request_settings(struct golioth_settings *settings)
@@ -462,9 +1474,187 @@ static enum golioth_status request_settings(struct golioth_settings *settings)
                                    GOLIOTH_SYS_WAIT_FOREVER);
 }
 
+#if defined(CONFIG_GOLIOTH_SETTINGS_SNAPSHOT)
+
+/// Find the entries of the settings map of the snapshot, up to \p end, and the version
+///
+/// @return false if the snapshot is not valid
+static bool snapshot_parse(const uint8_t *buf, size_t len, const uint8_t **end, int64_t *version)
+{
+    const uint8_t *buf_end = buf + len;
+    const uint8_t *p = buf + sizeof(snapshot_header);
+
+    if (len < sizeof(snapshot_header) || memcmp(buf, snapshot_header, sizeof(snapshot_header)))
+    {
+        return false;
+    }
+
+    while (p < buf_end && *p != CBOR_BREAK)
+    {
+        ZCBOR_STATE_D(zsd, 2, p, buf_end - p, 2, 0);
+        struct zcbor_string label;
+
+        if (!zcbor_tstr_decode(zsd, &label) || !zcbor_any_skip(zsd, NULL))
+        {
+            return false;
+        }
+        p = zsd->payload;
+    }
+
+    if (p == buf_end)
+    {
+        return false;
+    }
+    *end = p++;
+
+    ZCBOR_STATE_D(zsd, 2, p, buf_end - p, 2, 0);
+    struct zcbor_string label;
+
+    return zcbor_tstr_decode(zsd, &label) && label.len == sizeof("version") - 1
+        && memcmp(label.value, "version", label.len) == 0 && zcbor_int64_decode(zsd, version)
+        && zsd->payload < buf_end && *zsd->payload == CBOR_BREAK;
+}
+
+/// Load the snapshot saved from the last document, e.g. before a reboot
+static void snapshot_load(struct golioth_settings *settings)
+{
+    size_t len = CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN;
+    uint8_t *buf = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_SETTINGS, len);
+    const uint8_t *end;
+
+    if (!buf)
+    {
+        GLTH_LOGW(TAG, "Failed to allocate settings snapshot");
+        return;
+    }
+
+    enum golioth_status status = golioth_settings_snapshot_load(buf, &len);
+    if (status != GOLIOTH_OK)
+    {
+        if (status != GOLIOTH_ERR_NO_MORE_DATA)
+        {
+            GLTH_LOGW(TAG, "Failed to load settings snapshot: %d", status);
+        }
+        GOLIOTH_HEAP_FREE(buf);
+        return;
+    }
+
+    if (!snapshot_parse(buf, len, &end, &settings->snapshot_version))
+    {
+        GLTH_LOGW(TAG, "Invalid settings snapshot");
+        GOLIOTH_HEAP_FREE(buf);
+        return;
+    }
+
+    settings->snapshot = buf;
+    settings->snapshot_len = end - buf;
+}
+
+/// Apply the value of \p setting from the snapshot, unless a document was applied already
+static void snapshot_apply(struct golioth_settings *settings, struct golioth_setting *setting)
+{
+    struct settings_response response = {
+        .is_local = true,
+        .settings = settings,
+    };
+
+    settings_lock(settings);
+
+    if (!settings->snapshot)
+    {
+        settings_unlock(settings);
+        return;
+    }
+
+    const uint8_t *p = settings->snapshot + sizeof(snapshot_header);
+    const uint8_t *end = settings->snapshot + settings->snapshot_len;
+
+    while (p < end)
+    {
+        ZCBOR_STATE_D(zsd, 2, p, end - p, 2, 0);
+        struct zcbor_string label;
+
+        zcbor_tstr_decode(zsd, &label);
+        const uint8_t *value = zsd->payload;
+        zcbor_any_skip(zsd, NULL);
+        p = zsd->payload;
+
+        if (label.len != setting->key_len || memcmp(label.value, setting->key, label.len) != 0)
+        {
+            continue;
+        }
+
+        char key[GOLIOTH_SETTINGS_MAX_NAME_LEN + 1] = {};
+        memcpy(key, label.value, MIN(GOLIOTH_SETTINGS_MAX_NAME_LEN, label.len));
+
+        size_t value_len = p - value;
+        ZCBOR_STATE_D(value_zsd, 2, value, value_len, 1, 0);
+        setting_apply(&response, key, golioth_hash(value, value_len), value_zsd);
+        break;
+    }
+
+    /* The server's document of the same version only has to be acknowledged, if it has nothing
+     * else to apply */
+    bool complete = true;
+    for (size_t i = 0; i < settings->num_settings; i++)
+    {
+        complete = complete && settings->settings[i].has_value;
+    }
+    settings->has_applied_version = complete;
+    settings->applied_version = settings->snapshot_version;
+
+    settings_unlock(settings);
+}
+
+static bool snapshot_init(struct golioth_settings *settings)
+{
+    settings->lock = golioth_sys_mutex_create();
+    if (!settings->lock)
+    {
+        return false;
+    }
+
+    settings->snapshot = NULL;
+    snapshot_load(settings);
+
+    return true;
+}
+
+static void snapshot_deinit(struct golioth_settings *settings)
+{
+    GOLIOTH_HEAP_FREE(settings->snapshot);
+    golioth_sys_mutex_destroy(settings->lock);
+}
+
+#else /* CONFIG_GOLIOTH_SETTINGS_SNAPSHOT */
+
+static inline bool snapshot_init(struct golioth_settings *settings)
+{
+    return true;
+}
+
+static inline void snapshot_deinit(struct golioth_settings *settings) {}
+
+static inline void snapshot_apply(struct golioth_settings *settings,
+                                  struct golioth_setting *setting)
+{
+}
+
+#endif /* CONFIG_GOLIOTH_SETTINGS_SNAPSHOT */
+
+/// Apply the snapshot to a new setting, then request its value from the server
+static enum golioth_status on_setting_registered(struct golioth_settings *settings,
+                                                 struct golioth_setting *setting)
+{
+    snapshot_apply(settings, setting);
+
+    return request_settings(settings);
+}
+
 struct golioth_settings *golioth_settings_init(struct golioth_client *client)
 {
-    struct golioth_settings *gsettings = golioth_sys_malloc(sizeof(struct golioth_settings));
+    struct golioth_settings *gsettings =
+        GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_SETTINGS, sizeof(struct golioth_settings));
 
     if (gsettings == NULL)
     {
@@ -473,8 +1663,19 @@ struct golioth_settings *golioth_settings_init(struct golioth_client *client)
 
     gsettings->client = client;
     gsettings->num_settings = 0;
+    gsettings->stream = NULL;
+    memset(gsettings->setting_index, 0, sizeof(gsettings->setting_index));
+    gsettings->has_applied_version = false;
+    memset(&gsettings->stats, 0, sizeof(gsettings->stats));
     golioth_coap_next_token(gsettings->token);
 
+    if (!snapshot_init(gsettings))
+    {
+        GOLIOTH_HEAP_FREE(gsettings);
+        gsettings = NULL;
+        goto finish;
+    }
+
     enum golioth_status status = golioth_coap_client_observe(client,
                                                              gsettings->token,
                                                              SETTINGS_PATH_PREFIX,
@@ -486,7 +1687,8 @@ struct golioth_settings *golioth_settings_init(struct golioth_client *client)
     if (status != GOLIOTH_OK)
     {
         GLTH_LOGE(TAG, "Failed to observe settings");
-        golioth_sys_free(gsettings);
+        snapshot_deinit(gsettings);
+        GOLIOTH_HEAP_FREE(gsettings);
         gsettings = NULL;
     }
 
@@ -504,7 +1706,13 @@ enum golioth_status golioth_settings_deinit(struct golioth_settings *settings)
     }
 
     golioth_coap_client_cancel_observations_by_prefix(settings->client, SETTINGS_PATH_PREFIX);
-    free(settings);
+    if (settings->stream)
+    {
+        /* Freed when its block arrives */
+        settings->stream->response.settings = NULL;
+    }
+    snapshot_deinit(settings);
+    GOLIOTH_HEAP_FREE(settings);
     return GOLIOTH_OK;
 }
 
@@ -534,21 +1742,19 @@ enum golioth_status golioth_settings_register_int_with_range(struct golioth_sett
         return GOLIOTH_ERR_NULL;
     }
 
-    struct golioth_setting *new_setting = alloc_setting(settings);
+    struct golioth_setting *new_setting = alloc_setting(settings, setting_name);
     if (!new_setting)
     {
         return GOLIOTH_ERR_MEM_ALLOC;
     }
 
-    new_setting->is_valid = true;
-    new_setting->key = setting_name;
     new_setting->type = GOLIOTH_SETTINGS_VALUE_TYPE_INT;
     new_setting->int_cb = callback;
     new_setting->int_min_val = min_val;
     new_setting->int_max_val = max_val;
     new_setting->cb_arg = callback_arg;
 
-    return request_settings(settings);
+    return on_setting_registered(settings, new_setting);
 }
 
 enum golioth_status golioth_settings_register_bool(struct golioth_settings *settings,
@@ -562,19 +1768,17 @@ enum golioth_status golioth_settings_register_bool(struct golioth_settings *sett
         return GOLIOTH_ERR_NULL;
     }
 
-    struct golioth_setting *new_setting = alloc_setting(settings);
+    struct golioth_setting *new_setting = alloc_setting(settings, setting_name);
     if (!new_setting)
     {
         return GOLIOTH_ERR_MEM_ALLOC;
     }
 
-    new_setting->is_valid = true;
-    new_setting->key = setting_name;
     new_setting->type = GOLIOTH_SETTINGS_VALUE_TYPE_BOOL;
     new_setting->bool_cb = callback;
     new_setting->cb_arg = callback_arg;
 
-    return request_settings(settings);
+    return on_setting_registered(settings, new_setting);
 }
 
 enum golioth_status golioth_settings_register_float(struct golioth_settings *settings,
@@ -588,19 +1792,17 @@ enum golioth_status golioth_settings_register_float(struct golioth_settings *set
         return GOLIOTH_ERR_NULL;
     }
 
-    struct golioth_setting *new_setting = alloc_setting(settings);
+    struct golioth_setting *new_setting = alloc_setting(settings, setting_name);
     if (!new_setting)
     {
         return GOLIOTH_ERR_MEM_ALLOC;
     }
 
-    new_setting->is_valid = true;
-    new_setting->key = setting_name;
     new_setting->type = GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT;
     new_setting->float_cb = callback;
     new_setting->cb_arg = callback_arg;
 
-    return request_settings(settings);
+    return on_setting_registered(settings, new_setting);
 }
 
 enum golioth_status golioth_settings_register_string(struct golioth_settings *settings,
@@ -614,18 +1816,29 @@ enum golioth_status golioth_settings_register_string(struct golioth_settings *se
         return GOLIOTH_ERR_NULL;
     }
 
-    struct golioth_setting *new_setting = alloc_setting(settings);
+    struct golioth_setting *new_setting = alloc_setting(settings, setting_name);
     if (!new_setting)
     {
         return GOLIOTH_ERR_MEM_ALLOC;
     }
 
-    new_setting->is_valid = true;
-    new_setting->key = setting_name;
     new_setting->type = GOLIOTH_SETTINGS_VALUE_TYPE_STRING;
     new_setting->string_cb = callback;
     new_setting->cb_arg = callback_arg;
 
-    return request_settings(settings);
+    return on_setting_registered(settings, new_setting);
+}
+
+enum golioth_status golioth_settings_get_stats(struct golioth_settings *settings,
+                                               struct golioth_settings_stats *stats)
+{
+    if (!settings || !stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    *stats = settings->stats;
+
+    return GOLIOTH_OK;
 }
 #endif  // CONFIG_GOLIOTH_SETTINGS
@@ -0,0 +1,728 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <golioth/store_forward.h>
+#include "store_forward.h"
+
+#if defined(CONFIG_GOLIOTH_STORE_FORWARD)
+
+#include <string.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+#include "coap_client.h"
+
+LOG_TAG_DEFINE(golioth_store_forward);
+
+// Stored requests are records of the port's store (see golioth/store_forward.h):
+//
+//   +---------+--------------+--------+----------+------+---------+
+//   | version | content type | prefix | path len | path | payload |
+//   +---------+--------------+--------+----------+------+---------+
+//
+// with one byte for each of the first four fields. Only the path prefixes of eligible requests
+// are stored, as an index into path_prefixes[].
+//
+// Requests are forwarded in order, from read_pos. Each CoAP request sent occupies a slot until
+// its callback is called; slots are indexed by a sequence number, and the records of completed
+// slots at the front are released from the store. A slot that gets no response stops forwarding
+// until the other slots complete, then forwarding restarts from the head of the store after
+// CONFIG_GOLIOTH_STORE_FORWARD_RETRY_MS, or on the next connection. Slots from before a
+// (re)connection are abandoned the same way; their callbacks are recognized by the sequence
+// number and ignored. Retries, and requests that could not be queued, are sent by the client
+// thread from golioth_store_forward_poll().
+//
+// Nothing in this file may log while holding the lock: cloud logs go through
+// golioth_coap_client_set(), which may call back into this file.
+
+#define RECORD_VERSION 1
+#define RECORD_HEADER_LEN 4
+
+#define LOGS_PATH "logs"
+#define STREAM_PATH_PREFIX ".s/"
+
+/// Largest definite-length CBOR array header
+#define CBOR_ARRAY_HEADER_MAX_LEN 3
+
+static const char *const path_prefixes[] = {
+    "",
+    STREAM_PATH_PREFIX,
+};
+
+enum slot_state
+{
+    SLOT_PENDING,
+    SLOT_DONE,
+    SLOT_FAILED,
+};
+
+struct forward_slot
+{
+    /// Store position after the last record sent in this slot
+    uint64_t end;
+    uint16_t num_records;
+    enum slot_state state;
+};
+
+struct forward_request
+{
+    const char *path_prefix;
+    char path[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 1];
+    enum golioth_content_type content_type;
+    const uint8_t *payload;
+    size_t payload_size;
+    uint16_t num_records;
+};
+
+static golioth_sys_mutex_t _lock;
+
+static struct
+{
+    struct golioth_client *client;
+    /// Store position of the next record to forward
+    uint64_t read_pos;
+    /// Sequence number of the oldest slot
+    uint32_t first_seq;
+    /// Sequence number of the next slot
+    uint32_t next_seq;
+    struct forward_slot slots[CONFIG_GOLIOTH_STORE_FORWARD_MAX_IN_FLIGHT];
+    /// Time (since boot) in milliseconds before which forwarding is not restarted
+    uint64_t retry_ms;
+    /// Forwarding stopped before the store was drained; golioth_store_forward_poll() restarts it
+    /// at retry_ms
+    bool retry_pending;
+    /// A thread is in forward(); request and payload below belong to it
+    bool forwarding;
+    struct forward_request request;
+    uint8_t payload[CBOR_ARRAY_HEADER_MAX_LEN + CONFIG_GOLIOTH_STORE_FORWARD_MAX_RECORD_SIZE];
+    uint8_t record[RECORD_HEADER_LEN + CONFIG_GOLIOTH_COAP_MAX_PATH_LEN
+                   + CONFIG_GOLIOTH_STORE_FORWARD_MAX_RECORD_SIZE];
+    struct golioth_store_forward_stats stats;
+} _sf;
+
+static int path_prefix_index(const char *path_prefix)
+{
+    for (size_t i = 0; i < sizeof(path_prefixes) / sizeof(path_prefixes[0]); i++)
+    {
+        if (strcmp(path_prefix, path_prefixes[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static bool is_logs(const char *path_prefix, const char *path)
+{
+    return path_prefix[0] == '\0' && strcmp(path, LOGS_PATH) == 0;
+}
+
+static struct forward_slot *slot(uint32_t seq)
+{
+    return &_sf.slots[seq % CONFIG_GOLIOTH_STORE_FORWARD_MAX_IN_FLIGHT];
+}
+
+static uint32_t num_slots(void)
+{
+    return _sf.next_seq - _sf.first_seq;
+}
+
+static void abandon_slots(void)
+{
+    _sf.first_seq = _sf.next_seq;
+    _sf.read_pos = golioth_store_head();
+}
+
+// Parse a record read into _sf.record. Returns false if it is not a valid request.
+static bool record_parse(size_t len,
+                         const char **path_prefix,
+                         const char **path,
+                         size_t *path_len,
+                         enum golioth_content_type *content_type,
+                         const uint8_t **payload,
+                         size_t *payload_size)
+{
+    const uint8_t *record = _sf.record;
+
+    if (len < RECORD_HEADER_LEN || record[0] != RECORD_VERSION
+        || record[2] >= sizeof(path_prefixes) / sizeof(path_prefixes[0])
+        || record[3] > CONFIG_GOLIOTH_COAP_MAX_PATH_LEN || len < RECORD_HEADER_LEN + record[3]
+        || len - RECORD_HEADER_LEN - record[3] > CONFIG_GOLIOTH_STORE_FORWARD_MAX_RECORD_SIZE)
+    {
+        return false;
+    }
+
+    *content_type = record[1];
+    *path_prefix = path_prefixes[record[2]];
+    *path = (const char *) &record[RECORD_HEADER_LEN];
+    *path_len = record[3];
+    *payload = &record[RECORD_HEADER_LEN + record[3]];
+    *payload_size = len - RECORD_HEADER_LEN - record[3];
+
+    return true;
+}
+
+// Find the items of a CBOR log payload, which is either a map (one message) or a definite-length
+// array of maps, as sent by log.c.
+static bool log_items(const uint8_t *payload,
+                      size_t payload_size,
+                      const uint8_t **items,
+                      size_t *items_len,
+                      size_t *num_items)
+{
+    size_t header_len;
+
+    if (payload_size == 0)
+    {
+        return false;
+    }
+
+    uint8_t major = payload[0] >> 5;
+    uint8_t info = payload[0] & 0x1f;
+
+    if (major == 5)
+    {
+        *items = payload;
+        *items_len = payload_size;
+        *num_items = 1;
+        return true;
+    }
+    if (major != 4)
+    {
+        return false;
+    }
+
+    if (info < 24)
+    {
+        header_len = 1;
+        *num_items = info;
+    }
+    else if (info == 24 && payload_size >= 2)
+    {
+        header_len = 2;
+        *num_items = payload[1];
+    }
+    else if (info == 25 && payload_size >= 3)
+    {
+        header_len = 3;
+        *num_items = ((size_t) payload[1] << 8) | payload[2];
+    }
+    else
+    {
+        return false;
+    }
+
+    *items = payload + header_len;
+    *items_len = payload_size - header_len;
+    return true;
+}
+
+// Write a CBOR array header for num_items items, ending right before end. Returns its start.
+static uint8_t *log_array_header(uint8_t *end, size_t num_items)
+{
+    if (num_items < 24)
+    {
+        end[-1] = 0x80 | num_items;
+        return end - 1;
+    }
+    if (num_items <= UINT8_MAX)
+    {
+        end[-2] = 0x98;
+        end[-1] = num_items;
+        return end - 2;
+    }
+
+    end[-3] = 0x99;
+    end[-2] = num_items >> 8;
+    end[-1] = num_items & 0xff;
+    return end - 3;
+}
+
+// Read the next record from *pos into _sf.request, merging the log records that follow it.
+// Records that cannot be forwarded are skipped. Called with the lock held.
+static enum golioth_status take_request(uint64_t *pos)
+{
+    struct forward_request *request = &_sf.request;
+    const char *path;
+    size_t path_len;
+    const uint8_t *payload;
+    size_t payload_size;
+    size_t len;
+    enum golioth_status status;
+
+    do
+    {
+        len = sizeof(_sf.record);
+        status = golioth_store_read(pos, _sf.record, &len);
+        if (status == GOLIOTH_ERR_MEM_ALLOC)
+        {
+            _sf.stats.dropped++;
+            continue;
+        }
+        if (status != GOLIOTH_OK)
+        {
+            return status;
+        }
+        if (record_parse(len,
+                         &request->path_prefix,
+                         &path,
+                         &path_len,
+                         &request->content_type,
+                         &payload,
+                         &payload_size))
+        {
+            break;
+        }
+
+        _sf.stats.dropped++;
+    } while (true);
+
+    memcpy(request->path, path, path_len);
+    request->path[path_len] = '\0';
+    request->num_records = 1;
+
+    uint8_t *items_start = &_sf.payload[CBOR_ARRAY_HEADER_MAX_LEN];
+    const uint8_t *items;
+    size_t items_len;
+    size_t num_items;
+
+    if (!is_logs(request->path_prefix, request->path)
+        || request->content_type != GOLIOTH_CONTENT_TYPE_CBOR
+        || !log_items(payload, payload_size, &items, &items_len, &num_items))
+    {
+        memcpy(_sf.payload, payload, payload_size);
+        request->payload = _sf.payload;
+        request->payload_size = payload_size;
+        return GOLIOTH_OK;
+    }
+
+    memcpy(items_start, items, items_len);
+    size_t total_len = items_len;
+    size_t total_items = num_items;
+
+    while (true)
+    {
+        uint64_t next_pos = *pos;
+        const char *next_prefix;
+        enum golioth_content_type next_content_type;
+
+        len = sizeof(_sf.record);
+        if (golioth_store_read(&next_pos, _sf.record, &len) != GOLIOTH_OK
+            || !record_parse(len,
+                             &next_prefix,
+                             &path,
+                             &path_len,
+                             &next_content_type,
+                             &payload,
+                             &payload_size)
+            || path_len != strlen(LOGS_PATH) || memcmp(path, LOGS_PATH, path_len) != 0
+            || next_prefix[0] != '\0' || next_content_type != GOLIOTH_CONTENT_TYPE_CBOR
+            || !log_items(payload, payload_size, &items, &items_len, &num_items)
+            || total_len + items_len > CONFIG_GOLIOTH_STORE_FORWARD_MAX_RECORD_SIZE
+            || total_items + num_items > UINT16_MAX || request->num_records == UINT16_MAX)
+        {
+            break;
+        }
+
+        memcpy(&items_start[total_len], items, items_len);
+        total_len += items_len;
+        total_items += num_items;
+        request->num_records++;
+        *pos = next_pos;
+    }
+
+    request->payload = log_array_header(items_start, total_items);
+    request->payload_size = (items_start - request->payload) + total_len;
+
+    return GOLIOTH_OK;
+}
+
+static void on_forwarded(struct golioth_client *client,
+                         enum golioth_status status,
+                         const struct golioth_coap_rsp_code *coap_rsp_code,
+                         const char *path,
+                         void *arg);
+
+// Send stored requests until the slots are full or the store is drained
+static void forward(void)
+{
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (_sf.forwarding || !_sf.client)
+    {
+        golioth_sys_mutex_unlock(_lock);
+        return;
+    }
+    _sf.forwarding = true;
+
+    while (num_slots() < CONFIG_GOLIOTH_STORE_FORWARD_MAX_IN_FLIGHT
+           && golioth_sys_now_ms() >= _sf.retry_ms)
+    {
+        bool failed = false;
+
+        for (uint32_t seq = _sf.first_seq; seq != _sf.next_seq; seq++)
+        {
+            failed |= (slot(seq)->state == SLOT_FAILED);
+        }
+        if (failed)
+        {
+            break;
+        }
+
+        uint64_t start_pos = _sf.read_pos;
+        uint64_t end_pos = start_pos;
+
+        if (take_request(&end_pos) != GOLIOTH_OK)
+        {
+            _sf.read_pos = end_pos;
+            break;
+        }
+
+        uint32_t seq = _sf.next_seq++;
+        *slot(seq) = (struct forward_slot){
+            .end = end_pos,
+            .num_records = _sf.request.num_records,
+            .state = SLOT_PENDING,
+        };
+        _sf.read_pos = end_pos;
+
+        struct golioth_client *client = _sf.client;
+
+        golioth_sys_mutex_unlock(_lock);
+
+        uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+        golioth_coap_next_token(token);
+
+        enum golioth_status status = golioth_coap_client_set(client,
+                                                             token,
+                                                             _sf.request.path_prefix,
+                                                             _sf.request.path,
+                                                             _sf.request.content_type,
+                                                             _sf.request.payload,
+                                                             _sf.request.payload_size,
+                                                             on_forwarded,
+                                                             (void *) (uintptr_t) seq,
+                                                             false,
+                                                             GOLIOTH_SYS_WAIT_FOREVER);
+
+        golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+        if (status == GOLIOTH_OK)
+        {
+            _sf.stats.requests++;
+            continue;
+        }
+
+        // Not queued (e.g. the request queue is full). Unless the slots were abandoned in the
+        // meantime, this is still the newest slot; retry it on the next call.
+        if (seq - _sf.first_seq < num_slots() && _sf.next_seq == seq + 1)
+        {
+            _sf.next_seq = seq;
+            _sf.read_pos = start_pos;
+        }
+        _sf.retry_pending = true;
+        break;
+    }
+
+    _sf.forwarding = false;
+    golioth_sys_mutex_unlock(_lock);
+}
+
+static void on_forwarded(struct golioth_client *client,
+                         enum golioth_status status,
+                         const struct golioth_coap_rsp_code *coap_rsp_code,
+                         const char *path,
+                         void *arg)
+{
+    uint32_t seq = (uintptr_t) arg;
+    uint64_t release_pos = 0;
+    bool release = false;
+
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (seq - _sf.first_seq >= num_slots())
+    {
+        // Abandoned slot
+        golioth_sys_mutex_unlock(_lock);
+        return;
+    }
+
+    struct forward_slot *s = slot(seq);
+
+    if (status == GOLIOTH_OK)
+    {
+        s->state = SLOT_DONE;
+        _sf.stats.forwarded += s->num_records;
+    }
+    else if (status == GOLIOTH_ERR_COAP_RESPONSE)
+    {
+        // The server got the request and refused it; sending it again would not help
+        s->state = SLOT_DONE;
+        _sf.stats.rejected += s->num_records;
+    }
+    else
+    {
+        s->state = SLOT_FAILED;
+    }
+
+    while (num_slots() > 0 && slot(_sf.first_seq)->state == SLOT_DONE)
+    {
+        release_pos = slot(_sf.first_seq)->end;
+        release = true;
+        _sf.first_seq++;
+    }
+    if (release)
+    {
+        golioth_store_release(release_pos);
+    }
+
+    bool failed = false;
+    bool pending = false;
+
+    for (uint32_t i = _sf.first_seq; i != _sf.next_seq; i++)
+    {
+        failed |= (slot(i)->state == SLOT_FAILED);
+        pending |= (slot(i)->state == SLOT_PENDING);
+    }
+    if (failed && !pending)
+    {
+        abandon_slots();
+        _sf.retry_ms = golioth_sys_now_ms() + CONFIG_GOLIOTH_STORE_FORWARD_RETRY_MS;
+        _sf.retry_pending = true;
+        _sf.stats.retries++;
+    }
+
+    golioth_sys_mutex_unlock(_lock);
+
+    forward();
+}
+
+enum golioth_status golioth_store_forward_init(struct golioth_client *client)
+{
+    // Created once, never destroyed
+    if (!_lock)
+    {
+        _lock = golioth_sys_mutex_create();
+        if (!_lock)
+        {
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+    }
+
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (_sf.client)
+    {
+        golioth_sys_mutex_unlock(_lock);
+        GLTH_LOGW(TAG, "Store-and-forward is already used by another client");
+        return GOLIOTH_OK;
+    }
+
+    enum golioth_status status = golioth_store_open();
+    if (status == GOLIOTH_OK)
+    {
+        _sf.client = client;
+        _sf.first_seq = _sf.next_seq;
+        _sf.read_pos = golioth_store_head();
+        _sf.retry_ms = 0;
+        _sf.retry_pending = false;
+    }
+
+    golioth_sys_mutex_unlock(_lock);
+
+    if (status != GOLIOTH_OK)
+    {
+        GLTH_LOGE(TAG, "Failed to open store: %d", status);
+    }
+
+    return status;
+}
+
+void golioth_store_forward_deinit(struct golioth_client *client)
+{
+    if (!_lock)
+    {
+        return;
+    }
+
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (_sf.client == client)
+    {
+        golioth_store_close();
+        _sf.client = NULL;
+        _sf.first_seq = _sf.next_seq;
+    }
+
+    golioth_sys_mutex_unlock(_lock);
+}
+
+bool golioth_store_forward_is_eligible(const char *path_prefix,
+                                       const char *path,
+                                       golioth_set_cb_fn callback,
+                                       bool is_synchronous)
+{
+    if (is_synchronous || callback || !path_prefix || !path)
+    {
+        return false;
+    }
+
+    return is_logs(path_prefix, path) || strcmp(path_prefix, STREAM_PATH_PREFIX) == 0;
+}
+
+bool golioth_store_forward_should_store(struct golioth_client *client)
+{
+    bool should_store = false;
+
+    if (!_lock || !client)
+    {
+        return false;
+    }
+
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (_sf.client == client)
+    {
+        should_store = !golioth_client_is_connected(client)
+                    || golioth_store_head() != golioth_store_tail();
+    }
+
+    golioth_sys_mutex_unlock(_lock);
+
+    return should_store;
+}
+
+enum golioth_status golioth_store_forward_append(struct golioth_client *client,
+                                                 const char *path_prefix,
+                                                 const char *path,
+                                                 enum golioth_content_type content_type,
+                                                 const uint8_t *payload,
+                                                 size_t payload_size)
+{
+    size_t path_len = strlen(path);
+    int prefix_index = path_prefix_index(path_prefix);
+    enum golioth_status status;
+
+    if (!_lock || !client)
+    {
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+    if (prefix_index < 0 || path_len > CONFIG_GOLIOTH_COAP_MAX_PATH_LEN
+        || payload_size > CONFIG_GOLIOTH_STORE_FORWARD_MAX_RECORD_SIZE)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (_sf.client != client)
+    {
+        golioth_sys_mutex_unlock(_lock);
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    _sf.record[0] = RECORD_VERSION;
+    _sf.record[1] = content_type;
+    _sf.record[2] = prefix_index;
+    _sf.record[3] = path_len;
+    memcpy(&_sf.record[RECORD_HEADER_LEN], path, path_len);
+    memcpy(&_sf.record[RECORD_HEADER_LEN + path_len], payload, payload_size);
+
+    status = golioth_store_append(_sf.record, RECORD_HEADER_LEN + path_len + payload_size);
+    if (status == GOLIOTH_OK)
+    {
+        _sf.stats.stored++;
+    }
+    else
+    {
+        _sf.stats.dropped++;
+    }
+
+    golioth_sys_mutex_unlock(_lock);
+
+    if (status == GOLIOTH_OK && golioth_client_is_connected(client))
+    {
+        forward();
+    }
+
+    return status;
+}
+
+void golioth_store_forward_connected(struct golioth_client *client)
+{
+    if (!_lock)
+    {
+        return;
+    }
+
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (_sf.client != client)
+    {
+        golioth_sys_mutex_unlock(_lock);
+        return;
+    }
+
+    // Requests sent on the previous session may never complete; send them again
+    abandon_slots();
+    _sf.retry_ms = 0;
+    _sf.retry_pending = false;
+
+    golioth_sys_mutex_unlock(_lock);
+
+    forward();
+}
+
+void golioth_store_forward_poll(struct golioth_client *client)
+{
+    if (!_lock)
+    {
+        return;
+    }
+
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+
+    bool due = _sf.client == client && _sf.retry_pending && golioth_sys_now_ms() >= _sf.retry_ms;
+    if (due)
+    {
+        _sf.retry_pending = false;
+    }
+
+    golioth_sys_mutex_unlock(_lock);
+
+    if (due && golioth_client_is_connected(client))
+    {
+        forward();
+    }
+}
+
+enum golioth_status golioth_store_forward_get_stats(struct golioth_store_forward_stats *stats)
+{
+    if (!stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+    if (!_lock)
+    {
+        *stats = (struct golioth_store_forward_stats){0};
+        return GOLIOTH_OK;
+    }
+
+    golioth_sys_mutex_lock(_lock, GOLIOTH_SYS_WAIT_FOREVER);
+    *stats = _sf.stats;
+    golioth_sys_mutex_unlock(_lock);
+
+    return GOLIOTH_OK;
+}
+
+#else /* CONFIG_GOLIOTH_STORE_FORWARD */
+
+enum golioth_status golioth_store_forward_get_stats(struct golioth_store_forward_stats *stats)
+{
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+#endif /* CONFIG_GOLIOTH_STORE_FORWARD */
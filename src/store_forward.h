@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/client.h>
+#include <golioth/config.h>
+#include <golioth/golioth_status.h>
+
+// Store-and-forward of stream and log requests, see golioth/store_forward.h.
+//
+// golioth_coap_client_set() stores eligible requests with golioth_store_forward_append() when
+// golioth_store_forward_should_store() says so, or when they cannot be queued. The transports call
+// golioth_store_forward_connected() when a session is established. When
+// CONFIG_GOLIOTH_STORE_FORWARD is disabled, no request is eligible and the other functions do
+// nothing.
+
+#if defined(CONFIG_GOLIOTH_STORE_FORWARD)
+
+/// Called by golioth_client_create(). Opens the store. When this fails, the client is created
+/// anyway, and store-and-forward is disabled for it.
+enum golioth_status golioth_store_forward_init(struct golioth_client *client);
+
+/// Called by golioth_client_destroy(). Closes the store, keeping the requests that were not
+/// forwarded.
+void golioth_store_forward_deinit(struct golioth_client *client);
+
+/// Whether a set request may be stored: asynchronous, without a callback, and to stream or logs
+bool golioth_store_forward_is_eligible(const char *path_prefix,
+                                       const char *path,
+                                       golioth_set_cb_fn callback,
+                                       bool is_synchronous);
+
+/// Whether an eligible request must be stored rather than queued: the client is not connected,
+/// or earlier requests are still in the store
+bool golioth_store_forward_should_store(struct golioth_client *client);
+
+/// Store a request, to be forwarded later
+enum golioth_status golioth_store_forward_append(struct golioth_client *client,
+                                                 const char *path_prefix,
+                                                 const char *path,
+                                                 enum golioth_content_type content_type,
+                                                 const uint8_t *payload,
+                                                 size_t payload_size);
+
+/// Called by the transport when a session is established. Starts forwarding.
+void golioth_store_forward_connected(struct golioth_client *client);
+
+/// Called by the client thread before it waits for requests. Restarts forwarding
+/// CONFIG_GOLIOTH_STORE_FORWARD_RETRY_MS after a request got no response, or as soon as the
+/// request queue has space again.
+void golioth_store_forward_poll(struct golioth_client *client);
+
+#else /* CONFIG_GOLIOTH_STORE_FORWARD */
+
+static inline enum golioth_status golioth_store_forward_init(struct golioth_client *client)
+{
+    return GOLIOTH_OK;
+}
+
+static inline void golioth_store_forward_deinit(struct golioth_client *client) {}
+
+static inline bool golioth_store_forward_is_eligible(const char *path_prefix,
+                                                     const char *path,
+                                                     golioth_set_cb_fn callback,
+                                                     bool is_synchronous)
+{
+    return false;
+}
+
+static inline bool golioth_store_forward_should_store(struct golioth_client *client)
+{
+    return false;
+}
+
+static inline enum golioth_status golioth_store_forward_append(
+    struct golioth_client *client,
+    const char *path_prefix,
+    const char *path,
+    enum golioth_content_type content_type,
+    const uint8_t *payload,
+    size_t payload_size)
+{
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+static inline void golioth_store_forward_connected(struct golioth_client *client) {}
+
+static inline void golioth_store_forward_poll(struct golioth_client *client) {}
+
+#endif /* CONFIG_GOLIOTH_STORE_FORWARD */
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "tx_window.h"
+
+#if defined(CONFIG_GOLIOTH_TX_WINDOW)
+
+#include <string.h>
+#include <golioth/golioth_debug.h>
+#include "golioth_util.h"
+#include "heap_accounting.h"
+
+#ifdef __ZEPHYR__
+#include "coap_client_zephyr.h"
+#else
+#include "coap_client_libcoap.h"
+#endif
+
+LOG_TAG_DEFINE(golioth_tx_window);
+
+// golioth_tx_window_hold() is called from the threads making requests, so it never blocks.
+// Releasing held requests is serialized by release_lock, which is only ever tried: if a release
+// is in progress, there is nothing else to do. Nothing in this file may log while holding the
+// lock: cloud logs are requests themselves.
+//
+// The window timer runs in interrupt (Zephyr) or signal (Linux) context, so it only marks the
+// window as due. The client thread opens it, and sends a deferred keepalive, from
+// golioth_tx_window_poll().
+
+// RPC responses and settings acknowledgements are awaited by the server, so they are never held.
+static const char *const urgent_path_prefixes[] = {
+    ".rpc/",
+    ".c/",
+};
+
+static void stat_inc(uint32_t *counter)
+{
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+// Only uploads are held: requests with a response the device is waiting for (synchronous
+// requests, GETs, location queries made with golioth_coap_client_post()) are not.
+static bool is_deferrable(const struct golioth_coap_request_msg *req)
+{
+    if (req->type != GOLIOTH_COAP_REQUEST_POST || req->post.callback_is_post
+        || req->request_complete_event)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; req->path_prefix && i < ARRAY_SIZE(urgent_path_prefixes); i++)
+    {
+        if (strcmp(req->path_prefix, urgent_path_prefixes[i]) == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Move held requests to the request queue, as long as there is space. Called with release_lock
+// held. Returns the number of requests moved.
+//
+// A request that fits neither in the request queue nor back in the hold queue (both were
+// filled by other threads in the meantime) is stored in \p dropped, and *has_dropped is set.
+// The caller completes it with golioth_coap_client_drop() once the lock is released.
+static size_t release_held(struct golioth_client *client,
+                           struct golioth_tx_window *window,
+                           struct golioth_coap_request_msg *dropped,
+                           bool *has_dropped)
+{
+    struct golioth_coap_request_msg request_msg;
+    size_t num_released = 0;
+
+    while (golioth_mbox_num_messages(client->request_queue)
+               < golioth_mbox_capacity(client->request_queue)
+           && golioth_mbox_recv(window->held, &request_msg, 0))
+    {
+        if (!golioth_mbox_try_send(client->request_queue, &request_msg))
+        {
+            // Another thread took the space; keep the request for later
+            if (!golioth_mbox_try_send(window->held, &request_msg))
+            {
+                *dropped = request_msg;
+                *has_dropped = true;
+            }
+            break;
+        }
+
+        num_released++;
+    }
+
+    return num_released;
+}
+
+static void open_window(struct golioth_client *client, uint32_t *reason)
+{
+    struct golioth_tx_window *window = &client->tx_window;
+    struct golioth_coap_request_msg dropped;
+    bool has_dropped = false;
+
+    if (!golioth_sys_mutex_lock(window->release_lock, 0))
+    {
+        return;
+    }
+
+    window->open_until_ms = golioth_sys_now_ms() + CONFIG_GOLIOTH_TX_WINDOW_DURATION_MS;
+    window->stats.windows++;
+    if (reason)
+    {
+        (*reason)++;
+    }
+
+    // Held requests keep the session alive just as well
+    if (release_held(client, window, &dropped, &has_dropped) > 0)
+    {
+        window->keepalive_due = false;
+    }
+
+    golioth_sys_mutex_unlock(window->release_lock);
+
+    if (has_dropped)
+    {
+        golioth_coap_client_drop(client, &dropped, GOLIOTH_ERR_QUEUE_FULL);
+    }
+}
+
+static void on_window_timer(golioth_sys_timer_t timer, void *arg)
+{
+    struct golioth_client *client = arg;
+
+    __atomic_store_n(&client->tx_window.open_due, true, __ATOMIC_RELAXED);
+
+    // Timers are one-shot on some platforms (e.g. Zephyr)
+    golioth_sys_timer_reset(timer);
+}
+
+bool golioth_tx_window_hold(struct golioth_client *client,
+                            const struct golioth_coap_request_msg *request_msg)
+{
+    struct golioth_tx_window *window = &client->tx_window;
+
+    if (!is_deferrable(request_msg))
+    {
+        return false;
+    }
+
+    // While a release is in progress, hold the request: it is released with the others, or by
+    // the next golioth_tx_window_poll()
+    if (golioth_sys_mutex_lock(window->release_lock, 0))
+    {
+        bool is_open = golioth_sys_now_ms() < window->open_until_ms
+                    && golioth_mbox_num_messages(window->held) == 0;
+
+        golioth_sys_mutex_unlock(window->release_lock);
+
+        if (is_open)
+        {
+            return false;
+        }
+    }
+
+    if (golioth_mbox_try_send(window->held, request_msg))
+    {
+        stat_inc(&window->stats.held);
+        return true;
+    }
+
+    // The hold queue is full, so the radio has to wake up anyway
+    open_window(client, &window->stats.hold_full);
+
+    if (golioth_mbox_try_send(window->held, request_msg))
+    {
+        stat_inc(&window->stats.held);
+        return true;
+    }
+
+    return false;
+}
+
+void golioth_tx_window_queued(struct golioth_client *client,
+                              const struct golioth_coap_request_msg *request_msg)
+{
+    struct golioth_tx_window *window = &client->tx_window;
+
+    if (!is_deferrable(request_msg) && golioth_mbox_num_messages(window->held) > 0)
+    {
+        open_window(client, &window->stats.piggybacked);
+    }
+}
+
+void golioth_tx_window_poll(struct golioth_client *client)
+{
+    struct golioth_tx_window *window = &client->tx_window;
+    struct golioth_coap_request_msg dropped;
+    bool has_dropped = false;
+    bool send_keepalive = false;
+
+    if (__atomic_exchange_n(&window->open_due, false, __ATOMIC_RELAXED))
+    {
+        open_window(client, NULL);
+    }
+
+    if (!golioth_sys_mutex_lock(window->release_lock, 0))
+    {
+        return;
+    }
+
+    if (golioth_sys_now_ms() < window->open_until_ms)
+    {
+        if (golioth_mbox_num_messages(window->held) > 0)
+        {
+            release_held(client, window, &dropped, &has_dropped);
+        }
+
+        send_keepalive = window->keepalive_due
+                      && golioth_mbox_num_messages(client->request_queue) == 0;
+        if (send_keepalive)
+        {
+            window->keepalive_due = false;
+        }
+    }
+
+    golioth_sys_mutex_unlock(window->release_lock);
+
+    if (has_dropped)
+    {
+        golioth_coap_client_drop(client, &dropped, GOLIOTH_ERR_QUEUE_FULL);
+    }
+
+    if (send_keepalive && client->is_running)
+    {
+        golioth_coap_client_empty(client, false, GOLIOTH_SYS_WAIT_FOREVER);
+    }
+}
+
+bool golioth_tx_window_defer_keepalive(struct golioth_client *client)
+{
+    struct golioth_tx_window *window = &client->tx_window;
+
+    // Without periodic windows, the next window could be too late to keep the session alive
+    if (CONFIG_GOLIOTH_TX_WINDOW_PERIOD_S == 0)
+    {
+        return false;
+    }
+
+    window->keepalive_due = true;
+    stat_inc(&window->stats.keepalives_deferred);
+
+    return true;
+}
+
+enum golioth_status golioth_tx_window_init(struct golioth_client *client,
+                                           struct golioth_tx_window *window)
+{
+    memset(window, 0, sizeof(*window));
+
+    window->held = golioth_mbox_create(CONFIG_GOLIOTH_TX_WINDOW_MAX_ITEMS,
+                                       sizeof(struct golioth_coap_request_msg));
+    if (!window->held)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    window->release_lock = golioth_sys_mutex_create();
+    if (!window->release_lock)
+    {
+        goto error;
+    }
+
+    if (CONFIG_GOLIOTH_TX_WINDOW_PERIOD_S > 0)
+    {
+        struct golioth_timer_config timer_cfg = {
+            .name = "tx_window",
+            .expiration_ms = 1000 * CONFIG_GOLIOTH_TX_WINDOW_PERIOD_S,
+            .fn = on_window_timer,
+            .user_arg = client,
+        };
+        window->timer = golioth_sys_timer_create(&timer_cfg);
+        if (!window->timer || !golioth_sys_timer_start(window->timer))
+        {
+            GLTH_LOGE(TAG, "Failed to start transmission window timer");
+            goto error;
+        }
+    }
+
+    return GOLIOTH_OK;
+
+error:
+    golioth_tx_window_deinit(window);
+    return GOLIOTH_ERR_MEM_ALLOC;
+}
+
+void golioth_tx_window_deinit(struct golioth_tx_window *window)
+{
+    struct golioth_coap_request_msg request_msg;
+
+    if (window->timer)
+    {
+        golioth_sys_timer_destroy(window->timer);
+        window->timer = NULL;
+    }
+    if (window->release_lock)
+    {
+        golioth_sys_mutex_destroy(window->release_lock);
+        window->release_lock = NULL;
+    }
+    if (window->held)
+    {
+        while (golioth_mbox_recv(window->held, &request_msg, 0))
+        {
+            if (request_msg.post.payload_size > 0)
+            {
+                GOLIOTH_HEAP_FREE(request_msg.post.payload);
+            }
+        }
+        golioth_mbox_destroy(window->held);
+        window->held = NULL;
+    }
+}
+
+enum golioth_status golioth_client_tx_window_open(struct golioth_client *client)
+{
+    if (!client)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    open_window(client, NULL);
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_client_get_tx_window_stats(struct golioth_client *client,
+                                                       struct golioth_client_tx_window_stats *stats)
+{
+    if (!client || !stats)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    *stats = client->tx_window.stats;
+
+    return GOLIOTH_OK;
+}
+
+#else /* CONFIG_GOLIOTH_TX_WINDOW */
+
+enum golioth_status golioth_client_tx_window_open(struct golioth_client *client)
+{
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+enum golioth_status golioth_client_get_tx_window_stats(struct golioth_client *client,
+                                                       struct golioth_client_tx_window_stats *stats)
+{
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+#endif /* CONFIG_GOLIOTH_TX_WINDOW */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <golioth/client.h>
+#include <golioth/config.h>
+#include <golioth/golioth_status.h>
+#include <golioth/golioth_sys.h>
+#include "coap_client.h"
+#include "mbox.h"
+
+// Transmission windows, see golioth_client_tx_window_open().
+//
+// With CONFIG_GOLIOTH_TX_WINDOW, request_queue_send() in coap_client.c passes every request to
+// golioth_tx_window_hold() first. Deferrable requests are held in a separate queue until a
+// window opens, and then moved to the request queue together. A window opens:
+// - every CONFIG_GOLIOTH_TX_WINDOW_PERIOD_S, from a timer (opened by the client thread),
+// - when the application calls golioth_client_tx_window_open(),
+// - when an urgent request is queued while requests are held, since the radio wakes up anyway,
+// - when the hold queue is full.
+// While a window is open, deferrable requests are not held.
+//
+// Held requests are released by whoever opens the window. Requests that do not fit in the
+// request queue stay held, and the client thread releases them with golioth_tx_window_poll()
+// as the request queue drains. Deferred keepalives are sent by golioth_tx_window_poll() too.
+
+#if defined(CONFIG_GOLIOTH_TX_WINDOW)
+
+struct golioth_tx_window
+{
+    /// Deferrable requests, waiting for the next window
+    golioth_mbox_t held;
+    golioth_sys_mutex_t release_lock;
+    golioth_sys_timer_t timer;
+    /// Time (since boot) in milliseconds when the current window closes
+    uint64_t open_until_ms;
+    /// An idle keepalive is due, and will be sent in the next window
+    bool keepalive_due;
+    /// The window timer expired; the client thread opens the window
+    bool open_due;
+    struct golioth_client_tx_window_stats stats;
+};
+
+/// Called by golioth_client_create(), with \p window embedded in \p client
+enum golioth_status golioth_tx_window_init(struct golioth_client *client,
+                                           struct golioth_tx_window *window);
+
+/// Called by golioth_client_destroy(). Held requests are freed without being sent.
+void golioth_tx_window_deinit(struct golioth_tx_window *window);
+
+/// Hold a request until the next window, if it is deferrable and no window is open
+///
+/// @return true if the request was held, false if it must be queued now
+bool golioth_tx_window_hold(struct golioth_client *client,
+                            const struct golioth_coap_request_msg *request_msg);
+
+/// A request was queued; opens a window if it was urgent and requests are held
+void golioth_tx_window_queued(struct golioth_client *client,
+                              const struct golioth_coap_request_msg *request_msg);
+
+/// Called by the client thread before it waits for requests. Opens the window when the window
+/// timer expired, releases requests that did not fit in the request queue when the window
+/// opened, and sends a deferred keepalive.
+void golioth_tx_window_poll(struct golioth_client *client);
+
+/// Called when the keepalive interval expired on an idle session
+///
+/// @return true if the keepalive was deferred to the next window, false if it must be sent now
+bool golioth_tx_window_defer_keepalive(struct golioth_client *client);
+
+#else /* CONFIG_GOLIOTH_TX_WINDOW */
+
+static inline bool golioth_tx_window_hold(struct golioth_client *client,
+                                          const struct golioth_coap_request_msg *request_msg)
+{
+    return false;
+}
+
+static inline void golioth_tx_window_queued(struct golioth_client *client,
+                                            const struct golioth_coap_request_msg *request_msg)
+{
+}
+
+static inline void golioth_tx_window_poll(struct golioth_client *client) {}
+
+static inline bool golioth_tx_window_defer_keepalive(struct golioth_client *client)
+{
+    return false;
+}
+
+#endif /* CONFIG_GOLIOTH_TX_WINDOW */
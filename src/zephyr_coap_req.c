@@ -9,10 +9,13 @@
 LOG_MODULE_DECLARE(golioth_coap_client);
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/random/random.h>
 
 #include "coap_client.h"
+#include "client_stats.h"
+#include "heap_accounting.h"
 #include "zephyr_coap_req.h"
 #include "zephyr_coap_utils.h"
 
@@ -77,8 +80,8 @@ static void golioth_coap_req_cancel_and_free(struct golioth_coap_req *req)
     LOG_DBG("cancel and free req %p data %p", (void *) req, (void *) req->request.data);
 
     golioth_coap_req_cancel(req);
-    free(req->request.data);
-    free(req);
+    GOLIOTH_HEAP_FREE(req->request.data);
+    GOLIOTH_HEAP_FREE(req);
 }
 
 /* Reordering according to RFC7641 section 3.4 */
@@ -459,14 +462,15 @@ int golioth_coap_req_new(struct golioth_coap_req **req,
     uint8_t *buffer;
     int err;
 
-    *req = calloc(1, sizeof(**req));
+    *req = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, sizeof(**req));
     if (!(*req))
     {
         LOG_ERR("Failed to allocate request");
         return -ENOMEM;
     }
+    memset(*req, 0, sizeof(**req));
 
-    buffer = malloc(buffer_len);
+    buffer = GOLIOTH_HEAP_MALLOC(GOLIOTH_HEAP_CLIENT, buffer_len);
     if (!buffer)
     {
         LOG_ERR("Failed to allocate packet buffer");
@@ -492,18 +496,18 @@ int golioth_coap_req_new(struct golioth_coap_req **req,
     return 0;
 
 free_buffer:
-    free(buffer);
+    GOLIOTH_HEAP_FREE(buffer);
 
 free_req:
-    free(*req);
+    GOLIOTH_HEAP_FREE(*req);
 
     return err;
 }
 
 void golioth_coap_req_free(struct golioth_coap_req *req)
 {
-    free(req->request.data); /* buffer */
-    free(req);
+    GOLIOTH_HEAP_FREE(req->request.data); /* buffer */
+    GOLIOTH_HEAP_FREE(req);
 }
 
 int golioth_coap_req_cb(struct golioth_client *client,
@@ -689,6 +693,7 @@ static int64_t golioth_coap_req_poll_prepare(struct golioth_coap_req *req, uint3
                     (int) req->pending.retries);
 
             req->client->resend_report_count++;
+            GOLIOTH_STATS_INC(req->client, retransmissions);
         }
 
         err = golioth_coap_req_send(req);
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// UDP relay which sits between the devices and the libcoap server and applies
+// latency, jitter, loss, reordering and a bandwidth cap to every datagram.
+//
+// The relay works on raw datagrams, so DTLS records pass through untouched.
+// Each device address gets its own upstream socket, which means the server
+// sees one distinct session per device.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mock_server.h"
+
+#define RELAY_MAX_DATAGRAM 2048
+#define RELAY_POLL_MAX_MS 100
+
+struct relay_flow
+{
+    struct sockaddr_in device_addr;
+    int upstream_fd;
+};
+
+struct relay_packet
+{
+    struct relay_packet *next;
+    uint64_t release_ms;
+    enum mock_direction dir;
+    struct relay_flow *flow;
+    size_t len;
+    uint8_t data[];
+};
+
+struct relay_link
+{
+    struct mock_impairment impairment;
+    uint64_t free_at_ms;
+    size_t queued_bytes;
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t dropped_loss;
+    uint64_t dropped_queue;
+    uint64_t reordered;
+};
+
+static struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    volatile bool running;
+    int public_fd;
+    struct sockaddr_in server_addr;
+    struct relay_flow **flows;
+    size_t num_flows;
+    struct relay_packet *queue;
+    struct relay_link links[MOCK_DIR_COUNT];
+    struct pollfd *pollfds;
+    size_t pollfds_capacity;
+} relay = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .public_fd = -1,
+};
+
+static bool chance(double pct)
+{
+    return pct > 0 && (mock_rand() % 10000) < (uint32_t) (pct * 100);
+}
+
+static struct relay_flow *flow_get(const struct sockaddr_in *addr)
+{
+    for (size_t i = 0; i < relay.num_flows; i++)
+    {
+        struct relay_flow *flow = relay.flows[i];
+        if (flow->device_addr.sin_port == addr->sin_port
+            && flow->device_addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+        {
+            return flow;
+        }
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        perror("relay: socket");
+        return NULL;
+    }
+    if (connect(fd, (struct sockaddr *) &relay.server_addr, sizeof(relay.server_addr)) < 0)
+    {
+        perror("relay: connect");
+        close(fd);
+        return NULL;
+    }
+
+    struct relay_flow **flows = realloc(relay.flows, (relay.num_flows + 1) * sizeof(*flows));
+    struct relay_flow *flow = malloc(sizeof(*flow));
+    if (!flows || !flow)
+    {
+        free(flow);
+        close(fd);
+        return NULL;
+    }
+
+    flow->device_addr = *addr;
+    flow->upstream_fd = fd;
+    relay.flows = flows;
+    relay.flows[relay.num_flows++] = flow;
+
+    return flow;
+}
+
+/// Decide the fate of a datagram and queue it for release. Must hold relay.lock.
+static void enqueue(enum mock_direction dir,
+                    struct relay_flow *flow,
+                    const uint8_t *data,
+                    size_t len,
+                    uint64_t now)
+{
+    struct relay_link *link = &relay.links[dir];
+    const struct mock_impairment *imp = &link->impairment;
+
+    link->packets++;
+    link->bytes += len;
+
+    if (chance(imp->loss_pct))
+    {
+        link->dropped_loss++;
+        return;
+    }
+
+    uint64_t release = now + imp->latency_ms;
+    if (imp->jitter_ms > 0)
+    {
+        int64_t jitter = (int64_t) (mock_rand() % (2 * imp->jitter_ms + 1)) - imp->jitter_ms;
+        release = (jitter < 0 && (uint64_t) -jitter > release - now) ? now : release + jitter;
+    }
+
+    if (imp->rate_bps > 0)
+    {
+        // Serialize onto the link after whatever is already in flight
+        if (link->queued_bytes + len > imp->queue_bytes)
+        {
+            link->dropped_queue++;
+            return;
+        }
+
+        uint64_t start = (link->free_at_ms > now) ? link->free_at_ms : now;
+        link->free_at_ms = start + (len * 1000 + imp->rate_bps - 1) / imp->rate_bps;
+        link->queued_bytes += len;
+        release += link->free_at_ms - now;
+    }
+
+    if (chance(imp->reorder_pct))
+    {
+        link->reordered++;
+        release += imp->reorder_delay_ms;
+    }
+
+    struct relay_packet *pkt = malloc(sizeof(*pkt) + len);
+    if (!pkt)
+    {
+        link->dropped_queue++;
+        return;
+    }
+    pkt->release_ms = release;
+    pkt->dir = dir;
+    pkt->flow = flow;
+    pkt->len = len;
+    memcpy(pkt->data, data, len);
+
+    // Keep the queue sorted by release time; equal times keep arrival order
+    struct relay_packet **pos = &relay.queue;
+    while (*pos && (*pos)->release_ms <= release)
+    {
+        pos = &(*pos)->next;
+    }
+    pkt->next = *pos;
+    *pos = pkt;
+}
+
+static void release_due(uint64_t now)
+{
+    while (relay.queue && relay.queue->release_ms <= now)
+    {
+        struct relay_packet *pkt = relay.queue;
+        relay.queue = pkt->next;
+
+        if (relay.links[pkt->dir].impairment.rate_bps > 0)
+        {
+            relay.links[pkt->dir].queued_bytes -= pkt->len;
+        }
+
+        if (pkt->dir == MOCK_DIR_UP)
+        {
+            send(pkt->flow->upstream_fd, pkt->data, pkt->len, 0);
+        }
+        else
+        {
+            sendto(relay.public_fd,
+                   pkt->data,
+                   pkt->len,
+                   0,
+                   (struct sockaddr *) &pkt->flow->device_addr,
+                   sizeof(pkt->flow->device_addr));
+        }
+
+        free(pkt);
+    }
+}
+
+static int reserve_pollfds(size_t count)
+{
+    if (count <= relay.pollfds_capacity)
+    {
+        return 0;
+    }
+
+    struct pollfd *pollfds = realloc(relay.pollfds, count * sizeof(*pollfds));
+    if (!pollfds)
+    {
+        return -ENOMEM;
+    }
+    relay.pollfds = pollfds;
+    relay.pollfds_capacity = count;
+
+    return 0;
+}
+
+static void *relay_thread(void *arg)
+{
+    uint8_t buf[RELAY_MAX_DATAGRAM];
+
+    while (relay.running)
+    {
+        pthread_mutex_lock(&relay.lock);
+
+        size_t nfds = relay.num_flows + 1;
+        if (reserve_pollfds(nfds) < 0)
+        {
+            pthread_mutex_unlock(&relay.lock);
+            break;
+        }
+
+        relay.pollfds[0] = (struct pollfd) {.fd = relay.public_fd, .events = POLLIN};
+        for (size_t i = 0; i < relay.num_flows; i++)
+        {
+            relay.pollfds[i + 1] = (struct pollfd) {
+                .fd = relay.flows[i]->upstream_fd,
+                .events = POLLIN,
+            };
+        }
+
+        int timeout = RELAY_POLL_MAX_MS;
+        if (relay.queue)
+        {
+            uint64_t now = mock_now_ms();
+            uint64_t wait = (relay.queue->release_ms > now) ? relay.queue->release_ms - now : 0;
+            timeout = (wait < (uint64_t) timeout) ? (int) wait : timeout;
+        }
+
+        pthread_mutex_unlock(&relay.lock);
+
+        int ret = poll(relay.pollfds, nfds, timeout);
+        if (ret < 0 && errno != EINTR)
+        {
+            perror("relay: poll");
+            break;
+        }
+
+        pthread_mutex_lock(&relay.lock);
+
+        uint64_t now = mock_now_ms();
+
+        if (ret > 0 && (relay.pollfds[0].revents & POLLIN))
+        {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t len =
+                recvfrom(relay.public_fd, buf, sizeof(buf), 0, (struct sockaddr *) &from, &from_len);
+            if (len > 0)
+            {
+                struct relay_flow *flow = flow_get(&from);
+                if (flow)
+                {
+                    enqueue(MOCK_DIR_UP, flow, buf, len, now);
+                }
+            }
+        }
+
+        for (size_t i = 1; ret > 0 && i < nfds; i++)
+        {
+            if (relay.pollfds[i].revents & POLLIN)
+            {
+                ssize_t len = recv(relay.pollfds[i].fd, buf, sizeof(buf), 0);
+                if (len > 0)
+                {
+                    enqueue(MOCK_DIR_DOWN, relay.flows[i - 1], buf, len, now);
+                }
+            }
+        }
+
+        release_due(now);
+
+        pthread_mutex_unlock(&relay.lock);
+    }
+
+    return NULL;
+}
+
+int mock_relay_start(uint16_t public_port, uint16_t server_port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(public_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    relay.server_addr = (struct sockaddr_in) {
+        .sin_family = AF_INET,
+        .sin_port = htons(server_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+
+    for (int dir = 0; dir < MOCK_DIR_COUNT; dir++)
+    {
+        relay.links[dir].impairment.reorder_delay_ms = 50;
+        relay.links[dir].impairment.queue_bytes = 64 * 1024;
+    }
+
+    relay.public_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (relay.public_fd < 0)
+    {
+        perror("relay: socket");
+        return -errno;
+    }
+
+    int one = 1;
+    setsockopt(relay.public_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(relay.public_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+        perror("relay: bind");
+        close(relay.public_fd);
+        return -errno;
+    }
+
+    relay.running = true;
+    int err = pthread_create(&relay.thread, NULL, relay_thread, NULL);
+    if (err)
+    {
+        relay.running = false;
+        close(relay.public_fd);
+        return -err;
+    }
+
+    return 0;
+}
+
+void mock_relay_stop(void)
+{
+    if (!relay.running)
+    {
+        return;
+    }
+
+    relay.running = false;
+    pthread_join(relay.thread, NULL);
+
+    while (relay.queue)
+    {
+        struct relay_packet *pkt = relay.queue;
+        relay.queue = pkt->next;
+        free(pkt);
+    }
+
+    for (size_t i = 0; i < relay.num_flows; i++)
+    {
+        close(relay.flows[i]->upstream_fd);
+        free(relay.flows[i]);
+    }
+    free(relay.flows);
+    free(relay.pollfds);
+    close(relay.public_fd);
+}
+
+void mock_relay_get_impairment(enum mock_direction dir, struct mock_impairment *impairment)
+{
+    pthread_mutex_lock(&relay.lock);
+    *impairment = relay.links[dir].impairment;
+    pthread_mutex_unlock(&relay.lock);
+}
+
+void mock_relay_set_impairment(enum mock_direction dir, const struct mock_impairment *impairment)
+{
+    pthread_mutex_lock(&relay.lock);
+    relay.links[dir].impairment = *impairment;
+    pthread_mutex_unlock(&relay.lock);
+}
+
+void mock_relay_print_counters(void)
+{
+    static const char *names[MOCK_DIR_COUNT] = {"up", "down"};
+
+    pthread_mutex_lock(&relay.lock);
+
+    printf("{\"flows\": %zu", relay.num_flows);
+    for (int dir = 0; dir < MOCK_DIR_COUNT; dir++)
+    {
+        const struct relay_link *link = &relay.links[dir];
+        printf(", \"%s\": {\"packets\": %" PRIu64 ", \"bytes\": %" PRIu64
+               ", \"dropped_loss\": %" PRIu64 ", \"dropped_queue\": %" PRIu64
+               ", \"reordered\": %" PRIu64 "}",
+               names[dir],
+               link->packets,
+               link->bytes,
+               link->dropped_loss,
+               link->dropped_queue,
+               link->reordered);
+    }
+    printf("}");
+
+    pthread_mutex_unlock(&relay.lock);
+}
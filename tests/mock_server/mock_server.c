@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Mock Golioth CoAP server for offline throughput and latency tests.
+//
+// Usage: golioth_mock_server [options]
+//
+//   -p, --port PORT            public (device facing) UDP port (default 5684)
+//   -s, --server-port PORT     loopback port of the CoAP server behind the relay
+//                              (default: public port + 10000)
+//   -k, --psk PSK              PSK accepted for any PSK-ID (default "mock-psk")
+//   -f, --script FILE          scenario file to run
+//   -i, --stdin                read scenario commands (without timestamps) from stdin
+//   -d, --duration SECONDS     exit after this long (default: run until exit/SIGINT)
+//   -r, --report SECONDS       print counters periodically (default: only on exit)
+//   -S, --seed SEED            seed for loss/jitter/reorder decisions (default 1)
+//   -n, --no-relay             serve the public port directly, without impairment
+//   -u, --udp                  plain CoAP instead of CoAP over DTLS
+//   -v, --verbose              print every request
+//   -h, --help                 print usage
+
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mock_server.h"
+
+#define DEFAULT_PORT 5684
+#define DEFAULT_PSK "mock-psk"
+#define IO_PROCESS_MAX_MS 100
+
+volatile sig_atomic_t mock_quit;
+
+static uint64_t start_ms;
+static uint64_t rand_state = 1;
+static pthread_mutex_t rand_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static coap_bin_const_t psk_key;
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t mock_now_ms(void)
+{
+    return monotonic_ms() - start_ms;
+}
+
+void mock_rand_seed(uint64_t seed)
+{
+    rand_state = seed ? seed : 1;
+}
+
+uint32_t mock_rand(void)
+{
+    // xorshift64*, shared by the relay thread and the main loop
+    pthread_mutex_lock(&rand_lock);
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    uint32_t value = (rand_state * 0x2545F4914F6CDD1DULL) >> 32;
+    pthread_mutex_unlock(&rand_lock);
+
+    return value;
+}
+
+static void on_signal(int sig)
+{
+    mock_quit = 1;
+}
+
+static const coap_bin_const_t *validate_psk_id(coap_bin_const_t *identity,
+                                               coap_session_t *session,
+                                               void *arg)
+{
+    // Every identity is a valid device; they only need to share the PSK
+    return &psk_key;
+}
+
+static int on_event(coap_session_t *session, const coap_event_t event)
+{
+    if (event == COAP_EVENT_DTLS_CONNECTED
+        || (event == COAP_EVENT_SERVER_SESSION_NEW
+            && coap_session_get_proto(session) == COAP_PROTO_UDP))
+    {
+        mock_counters.sessions++;
+    }
+
+    return 0;
+}
+
+static coap_context_t *server_create(uint16_t port, bool dtls, const char *psk)
+{
+    coap_context_t *ctx = coap_new_context(NULL);
+    if (!ctx)
+    {
+        return NULL;
+    }
+
+    coap_context_set_block_mode(ctx, COAP_BLOCK_USE_LIBCOAP | COAP_BLOCK_SINGLE_BODY);
+    coap_register_event_handler(ctx, on_event);
+
+    if (dtls)
+    {
+        psk_key.s = (const uint8_t *) psk;
+        psk_key.length = strlen(psk);
+
+        coap_dtls_spsk_t setup = {
+            .version = COAP_DTLS_SPSK_SETUP_VERSION,
+            .validate_id_call_back = validate_psk_id,
+            .psk_info.key = psk_key,
+        };
+        if (!coap_context_set_psk2(ctx, &setup))
+        {
+            fprintf(stderr, "Failed to set up PSK, is libcoap built with DTLS?\n");
+            coap_free_context(ctx);
+            return NULL;
+        }
+    }
+
+    coap_address_t addr;
+    coap_address_init(&addr);
+    addr.addr.sin.sin_family = AF_INET;
+    addr.addr.sin.sin_port = htons(port);
+    addr.size = sizeof(struct sockaddr_in);
+
+    if (!coap_new_endpoint(ctx, &addr, dtls ? COAP_PROTO_DTLS : COAP_PROTO_UDP))
+    {
+        fprintf(stderr, "Failed to listen on port %u\n", port);
+        coap_free_context(ctx);
+        return NULL;
+    }
+
+    mock_resources_init(ctx);
+
+    return ctx;
+}
+
+static void read_stdin_commands(void)
+{
+    static char line[1024];
+    static size_t len;
+
+    struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+    while (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLIN | POLLHUP)))
+    {
+        ssize_t n = read(STDIN_FILENO, &line[len], sizeof(line) - 1 - len);
+        if (n <= 0)
+        {
+            // stdin closed; keep serving until the duration or a signal ends us
+            close(STDIN_FILENO);
+            return;
+        }
+        len += n;
+        line[len] = '\0';
+
+        char *nl;
+        while ((nl = strchr(line, '\n')) != NULL)
+        {
+            *nl = '\0';
+            mock_script_exec(line);
+            len -= (nl + 1 - line);
+            memmove(line, nl + 1, len + 1);
+        }
+
+        if (len == sizeof(line) - 1)
+        {
+            fprintf(stderr, "Command too long, discarded\n");
+            len = 0;
+        }
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-p port] [-s server_port] [-k psk] [-f script] [-i] [-d seconds]\n"
+            "          [-r seconds] [-S seed] [-n] [-u] [-v] [-h]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"server-port", required_argument, NULL, 's'},
+        {"psk", required_argument, NULL, 'k'},
+        {"script", required_argument, NULL, 'f'},
+        {"stdin", no_argument, NULL, 'i'},
+        {"duration", required_argument, NULL, 'd'},
+        {"report", required_argument, NULL, 'r'},
+        {"seed", required_argument, NULL, 'S'},
+        {"no-relay", no_argument, NULL, 'n'},
+        {"udp", no_argument, NULL, 'u'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    uint16_t port = DEFAULT_PORT;
+    uint16_t server_port = 0;
+    const char *psk = DEFAULT_PSK;
+    const char *script = NULL;
+    bool use_stdin = false;
+    unsigned int duration_s = 0;
+    unsigned int report_s = 0;
+    bool use_relay = true;
+    bool dtls = true;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "p:s:k:f:id:r:S:nuvh", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                port = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                server_port = strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                psk = optarg;
+                break;
+            case 'f':
+                script = optarg;
+                break;
+            case 'i':
+                use_stdin = true;
+                break;
+            case 'd':
+                duration_s = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                report_s = strtoul(optarg, NULL, 0);
+                break;
+            case 'S':
+                mock_rand_seed(strtoull(optarg, NULL, 0));
+                break;
+            case 'n':
+                use_relay = false;
+                break;
+            case 'u':
+                dtls = false;
+                break;
+            case 'v':
+                mock_verbose = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (server_port == 0)
+    {
+        server_port = port + 10000;
+    }
+
+    start_ms = monotonic_ms();
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    coap_startup();
+    coap_set_log_level(mock_verbose ? COAP_LOG_INFO : COAP_LOG_WARN);
+
+    coap_context_t *ctx = server_create(use_relay ? server_port : port, dtls, psk);
+    if (!ctx)
+    {
+        return 1;
+    }
+
+    if (use_relay && mock_relay_start(port, server_port) < 0)
+    {
+        coap_free_context(ctx);
+        return 1;
+    }
+
+    if (script && mock_script_load(script) < 0)
+    {
+        mock_relay_stop();
+        coap_free_context(ctx);
+        return 1;
+    }
+
+    fprintf(stderr,
+            "Listening on %s://0.0.0.0:%u%s\n",
+            dtls ? "coaps" : "coap",
+            port,
+            use_relay ? " (through impairment relay)" : "");
+
+    uint64_t next_report_ms = report_s * 1000;
+
+    while (!mock_quit)
+    {
+        uint64_t now = mock_now_ms();
+        int timeout = IO_PROCESS_MAX_MS;
+
+        int next_line = mock_script_run_due(now);
+        if (next_line >= 0 && next_line < timeout)
+        {
+            timeout = next_line;
+        }
+
+        if (use_stdin)
+        {
+            read_stdin_commands();
+        }
+
+        coap_io_process(ctx, timeout);
+
+        now = mock_now_ms();
+        if (report_s && now >= next_report_ms)
+        {
+            mock_counters_print();
+            next_report_ms += report_s * 1000;
+        }
+        if (duration_s && now >= (uint64_t) duration_s * 1000)
+        {
+            break;
+        }
+    }
+
+    mock_counters_print();
+
+    mock_relay_stop();
+    coap_free_context(ctx);
+    coap_cleanup();
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <coap3/coap.h>
+
+/// Milliseconds since the server started
+uint64_t mock_now_ms(void);
+
+/// Set by SIGINT/SIGTERM or the "exit" command
+extern volatile sig_atomic_t mock_quit;
+
+/// Deterministic PRNG shared by the relay and the script runner, so that a run
+/// can be repeated with --seed.
+void mock_rand_seed(uint64_t seed);
+uint32_t mock_rand(void);
+
+/*--------------------------------------------------
+ * Resources (resources.c)
+ *------------------------------------------------*/
+
+enum mock_value_type
+{
+    MOCK_VALUE_NULL,
+    MOCK_VALUE_BOOL,
+    MOCK_VALUE_INT,
+    MOCK_VALUE_FLOAT,
+    MOCK_VALUE_STRING,
+};
+
+struct mock_value
+{
+    enum mock_value_type type;
+    union
+    {
+        bool b;
+        int64_t i;
+        double f;
+    };
+    char *s;
+};
+
+struct mock_counters
+{
+    uint64_t sessions;
+    uint64_t lightdb_get;
+    uint64_t lightdb_set;
+    uint64_t lightdb_delete;
+    uint64_t lightdb_observe;
+    uint64_t stream;
+    uint64_t settings_get;
+    uint64_t settings_status;
+    uint64_t rpc_observe;
+    uint64_t rpc_status;
+    uint64_t ota_manifest;
+    uint64_t ota_block;
+    uint64_t logs;
+    uint64_t not_found;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t block1_transfers;
+    uint64_t notifications;
+    uint64_t rpc_sent;
+    uint64_t rpc_answered;
+    uint64_t rpc_latency_total_ms;
+    uint64_t rpc_latency_max_ms;
+};
+
+extern struct mock_counters mock_counters;
+extern bool mock_verbose;
+
+/// Register all Golioth endpoints on the context
+void mock_resources_init(coap_context_t *ctx);
+
+/// Scenario actions
+void mock_lightdb_set(const char *path, const struct mock_value *value);
+void mock_lightdb_delete(const char *path);
+void mock_settings_set(const char *key, const struct mock_value *value);
+void mock_rpc_call(const char *method, const struct mock_value *params, size_t num_params);
+int mock_ota_add(const char *package, const char *version, const char *source);
+
+/// Print counters as a single JSON line
+void mock_counters_print(void);
+
+/*--------------------------------------------------
+ * Impairment relay (impair.c)
+ *------------------------------------------------*/
+
+enum mock_direction
+{
+    MOCK_DIR_UP,   // device -> server
+    MOCK_DIR_DOWN, // server -> device
+    MOCK_DIR_COUNT,
+};
+
+struct mock_impairment
+{
+    uint32_t latency_ms;
+    uint32_t jitter_ms;
+    /// Percentages, 0..100
+    double loss_pct;
+    double reorder_pct;
+    /// Extra delay given to a reordered datagram
+    uint32_t reorder_delay_ms;
+    /// Link rate in bytes/s, 0 for unlimited
+    uint32_t rate_bps;
+    /// Bytes which may be queued on a rate-limited link before tail drop
+    uint32_t queue_bytes;
+};
+
+/// Start the relay thread: datagrams received on public_port are forwarded to
+/// server_port on loopback, with one upstream socket per device address.
+int mock_relay_start(uint16_t public_port, uint16_t server_port);
+void mock_relay_stop(void);
+
+void mock_relay_get_impairment(enum mock_direction dir, struct mock_impairment *impairment);
+void mock_relay_set_impairment(enum mock_direction dir, const struct mock_impairment *impairment);
+
+/// Print relay counters as a JSON object (no newline)
+void mock_relay_print_counters(void);
+
+/*--------------------------------------------------
+ * Scenario scripts (script.c)
+ *------------------------------------------------*/
+
+/// Parse a scenario token ("true", "12", "1.5", "\"text\"", "null", bare text)
+void mock_value_parse(const char *token, struct mock_value *value);
+void mock_value_free(struct mock_value *value);
+
+/// Load a scenario file of "<time_ms> <command> [args...]" lines
+int mock_script_load(const char *filename);
+
+/// Run all scenario lines which are due.
+///
+/// @return milliseconds until the next line is due, or -1 if none remain
+int mock_script_run_due(uint64_t elapsed_ms);
+
+/// Execute a single command (without the leading timestamp)
+///
+/// @return 0 on success, -1 on error
+int mock_script_exec(const char *line);
@@ -0,0 +1,1048 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Golioth endpoints served by the mock:
+//
+//   .d/<path>          LightDB State: GET (observable), POST, DELETE
+//   .s/<path>          LightDB Stream: POST
+//   .c                 Settings: GET (observable)
+//   .c/status          Settings status report: POST
+//   .rpc               RPC calls: GET (observable)
+//   .rpc/status        RPC responses: POST
+//   .u/desired         OTA manifest: GET (observable)
+//   .u/c/<pkg>@<ver>   OTA artifact: GET (Block2)
+//   logs               Logs: POST
+//
+// Block1 uploads are reassembled by libcoap before they reach the handlers,
+// and Block2 downloads are served by libcoap from the complete body.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <zcbor_decode.h>
+#include <zcbor_encode.h>
+
+#include "mock_server.h"
+
+#define CONTENT_FORMAT_OCTET_STREAM 42
+#define CONTENT_FORMAT_JSON 50
+#define CONTENT_FORMAT_CBOR 60
+
+#define MAX_PENDING_RPCS 64
+
+struct mock_counters mock_counters;
+bool mock_verbose;
+
+struct lightdb_entry
+{
+    struct lightdb_entry *next;
+    char *path;
+    coap_resource_t *resource;
+    uint8_t *data;
+    size_t len;
+    uint16_t content_format;
+    bool present;
+};
+
+struct setting_entry
+{
+    char *key;
+    struct mock_value value;
+};
+
+struct ota_artifact
+{
+    unsigned int refcount;
+    uint8_t *data;
+    size_t size;
+};
+
+struct ota_component
+{
+    char *package;
+    char *version;
+    char hash[2 * 32 + 1];
+    struct ota_artifact *artifact;
+};
+
+struct pending_rpc
+{
+    unsigned int id;
+    uint64_t sent_ms;
+};
+
+static coap_context_t *context;
+static coap_resource_t *r_unknown;
+static coap_resource_t *r_settings;
+static coap_resource_t *r_rpc;
+static coap_resource_t *r_manifest;
+
+static struct lightdb_entry *lightdb;
+
+static struct setting_entry *settings;
+static size_t num_settings;
+static int64_t settings_version;
+
+static uint8_t *rpc_payload;
+static size_t rpc_payload_len;
+static unsigned int rpc_next_id = 1;
+static struct pending_rpc pending_rpcs[MAX_PENDING_RPCS];
+
+static struct ota_component *components;
+static size_t num_components;
+static int64_t manifest_seq;
+
+/* CBOR encoding of the text string "OK", sent by the cloud on observe */
+static const uint8_t cbor_ok[] = {0x62, 'O', 'K'};
+static const uint8_t cbor_null[] = {0xf6};
+static const uint8_t json_null[] = {'n', 'u', 'l', 'l'};
+
+static void release_copy(coap_session_t *session, void *app_ptr)
+{
+    free(app_ptr);
+}
+
+static void release_artifact(coap_session_t *session, void *app_ptr)
+{
+    struct ota_artifact *artifact = app_ptr;
+
+    if (--artifact->refcount == 0)
+    {
+        free(artifact->data);
+        free(artifact);
+    }
+}
+
+/// Respond with a copy of data, letting libcoap apply Block2 when needed
+static void respond(coap_resource_t *resource,
+                    coap_session_t *session,
+                    const coap_pdu_t *request,
+                    const coap_string_t *query,
+                    coap_pdu_t *response,
+                    uint16_t content_format,
+                    const uint8_t *data,
+                    size_t len)
+{
+    uint8_t *copy = malloc(len ? len : 1);
+    if (!copy)
+    {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_INTERNAL_ERROR);
+        return;
+    }
+    memcpy(copy, data, len);
+
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+    coap_add_data_large_response(resource,
+                                 session,
+                                 request,
+                                 response,
+                                 query,
+                                 content_format,
+                                 -1,
+                                 0,
+                                 len,
+                                 copy,
+                                 release_copy,
+                                 copy);
+
+    mock_counters.bytes_out += len;
+}
+
+static int option_uint(const coap_pdu_t *pdu, coap_option_num_t num, unsigned int *value)
+{
+    coap_opt_iterator_t opt_iter;
+    coap_opt_t *opt = coap_check_option(pdu, num, &opt_iter);
+    if (!opt)
+    {
+        return -1;
+    }
+
+    *value = coap_decode_var_bytes(coap_opt_value(opt), coap_opt_length(opt));
+    return 0;
+}
+
+static bool is_observe(const coap_pdu_t *request)
+{
+    unsigned int observe;
+
+    return option_uint(request, COAP_OPTION_OBSERVE, &observe) == 0
+        && observe == COAP_OBSERVE_ESTABLISH;
+}
+
+static void get_body(coap_session_t *session,
+                     const coap_pdu_t *request,
+                     const uint8_t **data,
+                     size_t *len)
+{
+    size_t offset;
+    size_t total;
+
+    *data = NULL;
+    *len = 0;
+    coap_get_data_large(request, len, data, &offset, &total);
+
+    coap_block_b_t block;
+    if (coap_get_block_b(session, request, COAP_OPTION_BLOCK1, &block))
+    {
+        mock_counters.block1_transfers++;
+    }
+
+    mock_counters.bytes_in += *len;
+}
+
+static bool has_prefix(const char *path, const char *prefix)
+{
+    return strncmp(path, prefix, strlen(prefix)) == 0;
+}
+
+/*--------------------------------------------------
+ * LightDB State
+ *------------------------------------------------*/
+
+static void handle_request(coap_resource_t *resource,
+                           coap_session_t *session,
+                           const coap_pdu_t *request,
+                           const coap_string_t *query,
+                           coap_pdu_t *response);
+
+static struct lightdb_entry *lightdb_find(const char *path, bool create)
+{
+    for (struct lightdb_entry *entry = lightdb; entry; entry = entry->next)
+    {
+        if (strcmp(entry->path, path) == 0)
+        {
+            return entry;
+        }
+    }
+
+    if (!create)
+    {
+        return NULL;
+    }
+
+    struct lightdb_entry *entry = calloc(1, sizeof(*entry));
+    if (!entry)
+    {
+        return NULL;
+    }
+    entry->path = strdup(path);
+
+    // A dedicated resource per path lets observers be notified individually
+    entry->resource =
+        coap_resource_init(coap_new_str_const((const uint8_t *) path, strlen(path)),
+                           COAP_RESOURCE_FLAGS_RELEASE_URI);
+    coap_register_handler(entry->resource, COAP_REQUEST_GET, handle_request);
+    coap_register_handler(entry->resource, COAP_REQUEST_POST, handle_request);
+    coap_register_handler(entry->resource, COAP_REQUEST_PUT, handle_request);
+    coap_register_handler(entry->resource, COAP_REQUEST_DELETE, handle_request);
+    coap_resource_set_get_observable(entry->resource, 1);
+    coap_add_resource(context, entry->resource);
+
+    entry->next = lightdb;
+    lightdb = entry;
+
+    return entry;
+}
+
+static void lightdb_notify(struct lightdb_entry *entry)
+{
+    coap_resource_notify_observers(entry->resource, NULL);
+
+    // Observations registered before the path existed live on the catch-all
+    coap_resource_notify_observers(r_unknown, NULL);
+
+    mock_counters.notifications++;
+}
+
+static void lightdb_store(struct lightdb_entry *entry,
+                          const uint8_t *data,
+                          size_t len,
+                          uint16_t content_format)
+{
+    uint8_t *copy = malloc(len ? len : 1);
+    if (!copy)
+    {
+        return;
+    }
+    memcpy(copy, data, len);
+
+    free(entry->data);
+    entry->data = copy;
+    entry->len = len;
+    entry->content_format = content_format;
+    entry->present = true;
+
+    lightdb_notify(entry);
+}
+
+static void handle_lightdb(coap_resource_t *resource,
+                           coap_session_t *session,
+                           const coap_pdu_t *request,
+                           const coap_string_t *query,
+                           coap_pdu_t *response,
+                           const char *path)
+{
+    coap_pdu_code_t code = coap_pdu_get_code(request);
+    struct lightdb_entry *entry;
+
+    if (code == COAP_REQUEST_CODE_GET)
+    {
+        unsigned int accept = CONTENT_FORMAT_JSON;
+        option_uint(request, COAP_OPTION_ACCEPT, &accept);
+
+        if (is_observe(request))
+        {
+            mock_counters.lightdb_observe++;
+        }
+        else
+        {
+            mock_counters.lightdb_get++;
+        }
+
+        // Values are served in the format they were written in
+        entry = lightdb_find(path, false);
+        if (entry && entry->present)
+        {
+            respond(resource,
+                    session,
+                    request,
+                    query,
+                    response,
+                    entry->content_format,
+                    entry->data,
+                    entry->len);
+        }
+        else if (accept == CONTENT_FORMAT_CBOR)
+        {
+            respond(resource, session, request, query, response, accept, cbor_null, 1);
+        }
+        else
+        {
+            respond(resource,
+                    session,
+                    request,
+                    query,
+                    response,
+                    CONTENT_FORMAT_JSON,
+                    json_null,
+                    sizeof(json_null));
+        }
+        return;
+    }
+
+    if (code == COAP_REQUEST_CODE_POST || code == COAP_REQUEST_CODE_PUT)
+    {
+        const uint8_t *data;
+        size_t len;
+        unsigned int content_format = CONTENT_FORMAT_JSON;
+
+        mock_counters.lightdb_set++;
+        get_body(session, request, &data, &len);
+        option_uint(request, COAP_OPTION_CONTENT_FORMAT, &content_format);
+
+        entry = lightdb_find(path, true);
+        if (!entry)
+        {
+            coap_pdu_set_code(response, COAP_RESPONSE_CODE_INTERNAL_ERROR);
+            return;
+        }
+
+        lightdb_store(entry, data, len, content_format);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+        return;
+    }
+
+    if (code == COAP_REQUEST_CODE_DELETE)
+    {
+        mock_counters.lightdb_delete++;
+
+        // The resource itself stays registered, as it may be the one handling
+        // this request
+        entry = lightdb_find(path, false);
+        if (entry && entry->present)
+        {
+            entry->present = false;
+            lightdb_notify(entry);
+        }
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_DELETED);
+        return;
+    }
+
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_NOT_ALLOWED);
+}
+
+void mock_lightdb_set(const char *path, const struct mock_value *value)
+{
+    char full_path[256];
+    char json[512];
+    int len;
+
+    snprintf(full_path, sizeof(full_path), ".d/%s", path);
+
+    switch (value->type)
+    {
+        case MOCK_VALUE_BOOL:
+            len = snprintf(json, sizeof(json), "%s", value->b ? "true" : "false");
+            break;
+        case MOCK_VALUE_INT:
+            len = snprintf(json, sizeof(json), "%" PRId64, value->i);
+            break;
+        case MOCK_VALUE_FLOAT:
+            len = snprintf(json, sizeof(json), "%g", value->f);
+            break;
+        case MOCK_VALUE_STRING:
+            len = snprintf(json, sizeof(json), "\"%s\"", value->s);
+            break;
+        default:
+            len = snprintf(json, sizeof(json), "null");
+            break;
+    }
+
+    struct lightdb_entry *entry = lightdb_find(full_path, true);
+    if (entry)
+    {
+        lightdb_store(entry, (const uint8_t *) json, len, CONTENT_FORMAT_JSON);
+    }
+}
+
+void mock_lightdb_delete(const char *path)
+{
+    char full_path[256];
+
+    snprintf(full_path, sizeof(full_path), ".d/%s", path);
+
+    struct lightdb_entry *entry = lightdb_find(full_path, false);
+    if (entry && entry->present)
+    {
+        entry->present = false;
+        lightdb_notify(entry);
+    }
+}
+
+/*--------------------------------------------------
+ * Settings
+ *------------------------------------------------*/
+
+static bool value_encode(zcbor_state_t *zse, const struct mock_value *value)
+{
+    switch (value->type)
+    {
+        case MOCK_VALUE_BOOL:
+            return zcbor_bool_put(zse, value->b);
+        case MOCK_VALUE_INT:
+            return zcbor_int64_put(zse, value->i);
+        case MOCK_VALUE_FLOAT:
+            return zcbor_float64_put(zse, value->f);
+        case MOCK_VALUE_STRING:
+            return zcbor_tstr_put_term(zse, value->s, SIZE_MAX);
+        default:
+            return zcbor_nil_put(zse, NULL);
+    }
+}
+
+static size_t value_encoded_len_max(const struct mock_value *value)
+{
+    return 16 + (value->type == MOCK_VALUE_STRING ? strlen(value->s) : 0);
+}
+
+static void handle_settings(coap_resource_t *resource,
+                            coap_session_t *session,
+                            const coap_pdu_t *request,
+                            const coap_string_t *query,
+                            coap_pdu_t *response)
+{
+    mock_counters.settings_get++;
+
+    if (num_settings == 0)
+    {
+        respond(resource,
+                session,
+                request,
+                query,
+                response,
+                CONTENT_FORMAT_CBOR,
+                cbor_ok,
+                sizeof(cbor_ok));
+        return;
+    }
+
+    size_t buf_len = 64;
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        buf_len += 16 + strlen(settings[i].key) + value_encoded_len_max(&settings[i].value);
+    }
+
+    uint8_t *buf = malloc(buf_len);
+    if (!buf)
+    {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_INTERNAL_ERROR);
+        return;
+    }
+
+    ZCBOR_STATE_E(zse, 2, buf, buf_len, 1);
+    bool ok = zcbor_map_start_encode(zse, 2) && zcbor_tstr_put_lit(zse, "version")
+           && zcbor_int64_put(zse, settings_version) && zcbor_tstr_put_lit(zse, "settings")
+           && zcbor_map_start_encode(zse, num_settings);
+    for (size_t i = 0; ok && i < num_settings; i++)
+    {
+        ok = zcbor_tstr_put_term(zse, settings[i].key, SIZE_MAX)
+          && value_encode(zse, &settings[i].value);
+    }
+    ok = ok && zcbor_map_end_encode(zse, num_settings) && zcbor_map_end_encode(zse, 2);
+
+    if (ok)
+    {
+        respond(resource,
+                session,
+                request,
+                query,
+                response,
+                CONTENT_FORMAT_CBOR,
+                buf,
+                zse->payload - buf);
+    }
+    else
+    {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_INTERNAL_ERROR);
+    }
+
+    free(buf);
+}
+
+void mock_settings_set(const char *key, const struct mock_value *value)
+{
+    struct setting_entry *entry = NULL;
+
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        if (strcmp(settings[i].key, key) == 0)
+        {
+            entry = &settings[i];
+            mock_value_free(&entry->value);
+            break;
+        }
+    }
+
+    if (!entry)
+    {
+        struct setting_entry *grown = realloc(settings, (num_settings + 1) * sizeof(*settings));
+        if (!grown)
+        {
+            return;
+        }
+        settings = grown;
+        entry = &settings[num_settings++];
+        entry->key = strdup(key);
+    }
+
+    entry->value = *value;
+    if (value->type == MOCK_VALUE_STRING)
+    {
+        entry->value.s = strdup(value->s);
+    }
+
+    settings_version++;
+    coap_resource_notify_observers(r_settings, NULL);
+    mock_counters.notifications++;
+}
+
+/*--------------------------------------------------
+ * RPC
+ *------------------------------------------------*/
+
+static void handle_rpc(coap_resource_t *resource,
+                       coap_session_t *session,
+                       const coap_pdu_t *request,
+                       const coap_string_t *query,
+                       coap_pdu_t *response)
+{
+    mock_counters.rpc_observe++;
+
+    if (!rpc_payload)
+    {
+        respond(resource,
+                session,
+                request,
+                query,
+                response,
+                CONTENT_FORMAT_CBOR,
+                cbor_ok,
+                sizeof(cbor_ok));
+        return;
+    }
+
+    respond(resource,
+            session,
+            request,
+            query,
+            response,
+            CONTENT_FORMAT_CBOR,
+            rpc_payload,
+            rpc_payload_len);
+}
+
+void mock_rpc_call(const char *method, const struct mock_value *params, size_t num_params)
+{
+    size_t buf_len = 64 + strlen(method);
+    for (size_t i = 0; i < num_params; i++)
+    {
+        buf_len += value_encoded_len_max(&params[i]);
+    }
+
+    uint8_t *buf = malloc(buf_len);
+    if (!buf)
+    {
+        return;
+    }
+
+    unsigned int id = rpc_next_id++;
+    char id_str[16];
+    snprintf(id_str, sizeof(id_str), "%u", id);
+
+    ZCBOR_STATE_E(zse, 2, buf, buf_len, 1);
+    bool ok = zcbor_map_start_encode(zse, 3) && zcbor_tstr_put_lit(zse, "id")
+           && zcbor_tstr_put_term(zse, id_str, sizeof(id_str))
+           && zcbor_tstr_put_lit(zse, "method") && zcbor_tstr_put_term(zse, method, SIZE_MAX)
+           && zcbor_tstr_put_lit(zse, "params") && zcbor_list_start_encode(zse, num_params);
+    for (size_t i = 0; ok && i < num_params; i++)
+    {
+        ok = value_encode(zse, &params[i]);
+    }
+    ok = ok && zcbor_list_end_encode(zse, num_params) && zcbor_map_end_encode(zse, 3);
+
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to encode RPC %s\n", method);
+        free(buf);
+        return;
+    }
+
+    free(rpc_payload);
+    rpc_payload = buf;
+    rpc_payload_len = zse->payload - buf;
+
+    struct pending_rpc *slot = &pending_rpcs[id % MAX_PENDING_RPCS];
+    slot->id = id;
+    slot->sent_ms = mock_now_ms();
+
+    coap_resource_notify_observers(r_rpc, NULL);
+    mock_counters.notifications++;
+    mock_counters.rpc_sent++;
+}
+
+static void rpc_status_received(const uint8_t *data, size_t len)
+{
+    ZCBOR_STATE_D(zsd, 2, data, len, 1, 0);
+    struct zcbor_string key;
+    struct zcbor_string id = {0};
+
+    if (!zcbor_map_start_decode(zsd))
+    {
+        return;
+    }
+
+    while (!zcbor_array_at_end(zsd))
+    {
+        if (!zcbor_tstr_decode(zsd, &key))
+        {
+            return;
+        }
+
+        if (key.len == 2 && memcmp(key.value, "id", 2) == 0)
+        {
+            if (!zcbor_tstr_decode(zsd, &id))
+            {
+                return;
+            }
+        }
+        else if (!zcbor_any_skip(zsd, NULL))
+        {
+            return;
+        }
+    }
+
+    char id_str[16] = {0};
+    memcpy(id_str, id.value, id.len < sizeof(id_str) - 1 ? id.len : sizeof(id_str) - 1);
+    unsigned int rpc_id = strtoul(id_str, NULL, 10);
+
+    struct pending_rpc *slot = &pending_rpcs[rpc_id % MAX_PENDING_RPCS];
+    if (rpc_id == 0 || slot->id != rpc_id)
+    {
+        return;
+    }
+
+    uint64_t latency = mock_now_ms() - slot->sent_ms;
+    mock_counters.rpc_answered++;
+    mock_counters.rpc_latency_total_ms += latency;
+    if (latency > mock_counters.rpc_latency_max_ms)
+    {
+        mock_counters.rpc_latency_max_ms = latency;
+    }
+    slot->id = 0;
+}
+
+/*--------------------------------------------------
+ * OTA
+ *------------------------------------------------*/
+
+static void handle_manifest(coap_resource_t *resource,
+                            coap_session_t *session,
+                            const coap_pdu_t *request,
+                            const coap_string_t *query,
+                            coap_pdu_t *response)
+{
+    mock_counters.ota_manifest++;
+
+    size_t buf_len = 64;
+    for (size_t i = 0; i < num_components; i++)
+    {
+        buf_len += 128 + 2 * (strlen(components[i].package) + strlen(components[i].version));
+    }
+
+    uint8_t *buf = malloc(buf_len);
+    if (!buf)
+    {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_INTERNAL_ERROR);
+        return;
+    }
+
+    // Manifest hash: the hash of the first component is good enough for a mock
+    const char *manifest_hash = num_components ? components[0].hash : "";
+
+    ZCBOR_STATE_E(zse, 3, buf, buf_len, 1);
+    bool ok = zcbor_map_start_encode(zse, 3) && zcbor_uint32_put(zse, 1)
+           && zcbor_int64_put(zse, manifest_seq) && zcbor_uint32_put(zse, 2)
+           && zcbor_tstr_put_term(zse, manifest_hash, SIZE_MAX) && zcbor_uint32_put(zse, 3)
+           && zcbor_list_start_encode(zse, num_components);
+    for (size_t i = 0; ok && i < num_components; i++)
+    {
+        const struct ota_component *c = &components[i];
+        char uri[128];
+
+        snprintf(uri, sizeof(uri), ".u/c/%s@%s", c->package, c->version);
+
+        ok = zcbor_map_start_encode(zse, 5) && zcbor_uint32_put(zse, 1)
+          && zcbor_tstr_put_term(zse, c->package, SIZE_MAX) && zcbor_uint32_put(zse, 2)
+          && zcbor_tstr_put_term(zse, c->version, SIZE_MAX) && zcbor_uint32_put(zse, 3)
+          && zcbor_tstr_put_term(zse, c->hash, sizeof(c->hash)) && zcbor_uint32_put(zse, 4)
+          && zcbor_int64_put(zse, c->artifact->size) && zcbor_uint32_put(zse, 5)
+          && zcbor_tstr_put_term(zse, uri, sizeof(uri)) && zcbor_map_end_encode(zse, 5);
+    }
+    ok = ok && zcbor_list_end_encode(zse, num_components) && zcbor_map_end_encode(zse, 3);
+
+    if (ok)
+    {
+        respond(resource,
+                session,
+                request,
+                query,
+                response,
+                CONTENT_FORMAT_CBOR,
+                buf,
+                zse->payload - buf);
+    }
+    else
+    {
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_INTERNAL_ERROR);
+    }
+
+    free(buf);
+}
+
+static void handle_artifact(coap_resource_t *resource,
+                            coap_session_t *session,
+                            const coap_pdu_t *request,
+                            const coap_string_t *query,
+                            coap_pdu_t *response,
+                            const char *name)
+{
+    mock_counters.ota_block++;
+
+    for (size_t i = 0; i < num_components; i++)
+    {
+        const struct ota_component *c = &components[i];
+        size_t pkg_len = strlen(c->package);
+
+        if (strncmp(name, c->package, pkg_len) != 0 || name[pkg_len] != '@'
+            || strcmp(&name[pkg_len + 1], c->version) != 0)
+        {
+            continue;
+        }
+
+        struct ota_artifact *artifact = c->artifact;
+        coap_block_b_t block;
+        if (coap_get_block_b(session, request, COAP_OPTION_BLOCK2, &block))
+        {
+            size_t block_size = 1u << (block.szx + 4);
+            size_t offset = (size_t) block.num * block_size;
+            if (offset < artifact->size)
+            {
+                size_t remaining = artifact->size - offset;
+                mock_counters.bytes_out += remaining < block_size ? remaining : block_size;
+            }
+        }
+
+        // The artifact outlives a replacing "ota" command until libcoap is done
+        artifact->refcount++;
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+        coap_add_data_large_response(resource,
+                                     session,
+                                     request,
+                                     response,
+                                     query,
+                                     CONTENT_FORMAT_OCTET_STREAM,
+                                     -1,
+                                     0,
+                                     artifact->size,
+                                     artifact->data,
+                                     release_artifact,
+                                     artifact);
+        return;
+    }
+
+    coap_pdu_set_code(response, COAP_RESPONSE_CODE_NOT_FOUND);
+}
+
+static int artifact_load(const char *source, struct ota_artifact *artifact)
+{
+    if (has_prefix(source, "size:"))
+    {
+        artifact->size = strtoul(source + strlen("size:"), NULL, 0);
+        artifact->data = malloc(artifact->size ? artifact->size : 1);
+        if (!artifact->data)
+        {
+            return -1;
+        }
+
+        for (size_t i = 0; i < artifact->size; i++)
+        {
+            artifact->data[i] = mock_rand();
+        }
+        return 0;
+    }
+
+    FILE *f = fopen(source, "rb");
+    if (!f)
+    {
+        perror(source);
+        return -1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    artifact->size = size > 0 ? size : 0;
+    artifact->data = malloc(artifact->size ? artifact->size : 1);
+    if (!artifact->data || fread(artifact->data, 1, artifact->size, f) != artifact->size)
+    {
+        free(artifact->data);
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+int mock_ota_add(const char *package, const char *version, const char *source)
+{
+    struct ota_artifact *artifact = calloc(1, sizeof(*artifact));
+    if (!artifact || artifact_load(source, artifact) < 0)
+    {
+        free(artifact);
+        return -1;
+    }
+    artifact->refcount = 1;
+
+    struct ota_component *c = NULL;
+    for (size_t i = 0; i < num_components; i++)
+    {
+        if (strcmp(components[i].package, package) == 0)
+        {
+            c = &components[i];
+            free(c->version);
+            release_artifact(NULL, c->artifact);
+            break;
+        }
+    }
+
+    if (!c)
+    {
+        struct ota_component *grown =
+            realloc(components, (num_components + 1) * sizeof(*components));
+        if (!grown)
+        {
+            release_artifact(NULL, artifact);
+            return -1;
+        }
+        components = grown;
+        c = &components[num_components++];
+        c->package = strdup(package);
+    }
+
+    c->version = strdup(version);
+    c->artifact = artifact;
+
+    uint8_t digest[32];
+    unsigned int digest_len = sizeof(digest);
+    EVP_Digest(artifact->data, artifact->size, digest, &digest_len, EVP_sha256(), NULL);
+    for (unsigned int i = 0; i < digest_len; i++)
+    {
+        snprintf(&c->hash[2 * i], 3, "%02x", digest[i]);
+    }
+
+    manifest_seq++;
+    coap_resource_notify_observers(r_manifest, NULL);
+    mock_counters.notifications++;
+
+    return 0;
+}
+
+/*--------------------------------------------------
+ * Dispatch
+ *------------------------------------------------*/
+
+static void handle_request(coap_resource_t *resource,
+                           coap_session_t *session,
+                           const coap_pdu_t *request,
+                           const coap_string_t *query,
+                           coap_pdu_t *response)
+{
+    coap_string_t *uri_path = coap_get_uri_path(request);
+    char path[256] = {0};
+
+    if (uri_path)
+    {
+        size_t len = uri_path->length < sizeof(path) - 1 ? uri_path->length : sizeof(path) - 1;
+        memcpy(path, uri_path->s, len);
+        coap_delete_string(uri_path);
+    }
+
+    if (mock_verbose)
+    {
+        printf("%u.%02u %s\n",
+               coap_pdu_get_code(request) >> 5,
+               coap_pdu_get_code(request) & 0x1f,
+               path);
+    }
+
+    coap_pdu_code_t code = coap_pdu_get_code(request);
+    const uint8_t *data;
+    size_t len;
+
+    if (has_prefix(path, ".d/"))
+    {
+        handle_lightdb(resource, session, request, query, response, path);
+    }
+    else if (has_prefix(path, ".s/") || strcmp(path, ".s") == 0)
+    {
+        mock_counters.stream++;
+        get_body(session, request, &data, &len);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+    }
+    else if (strcmp(path, ".c/status") == 0 && code == COAP_REQUEST_CODE_POST)
+    {
+        mock_counters.settings_status++;
+        get_body(session, request, &data, &len);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+    }
+    else if (strcmp(path, ".rpc/status") == 0 && code == COAP_REQUEST_CODE_POST)
+    {
+        mock_counters.rpc_status++;
+        get_body(session, request, &data, &len);
+        rpc_status_received(data, len);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+    }
+    else if (has_prefix(path, ".u/c/") && code == COAP_REQUEST_CODE_GET)
+    {
+        handle_artifact(resource, session, request, query, response, path + strlen(".u/c/"));
+    }
+    else if (strcmp(path, "logs") == 0 && code == COAP_REQUEST_CODE_POST)
+    {
+        mock_counters.logs++;
+        get_body(session, request, &data, &len);
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+    }
+    else
+    {
+        mock_counters.not_found++;
+        coap_pdu_set_code(response, COAP_RESPONSE_CODE_NOT_FOUND);
+    }
+}
+
+static coap_resource_t *add_observable(const char *uri, coap_method_handler_t handler)
+{
+    coap_resource_t *resource = coap_resource_init(coap_make_str_const(uri), 0);
+
+    coap_register_handler(resource, COAP_REQUEST_GET, handler);
+    coap_resource_set_get_observable(resource, 1);
+    coap_add_resource(context, resource);
+
+    return resource;
+}
+
+void mock_resources_init(coap_context_t *ctx)
+{
+    context = ctx;
+
+    r_settings = add_observable(".c", handle_settings);
+    r_rpc = add_observable(".rpc", handle_rpc);
+    r_manifest = add_observable(".u/desired", handle_manifest);
+
+    // Everything else, including LightDB paths which have not been written yet
+    r_unknown = coap_resource_unknown_init2(handle_request, 0);
+    coap_register_handler(r_unknown, COAP_REQUEST_GET, handle_request);
+    coap_register_handler(r_unknown, COAP_REQUEST_POST, handle_request);
+    coap_register_handler(r_unknown, COAP_REQUEST_DELETE, handle_request);
+    coap_resource_set_get_observable(r_unknown, 1);
+    coap_add_resource(ctx, r_unknown);
+}
+
+void mock_counters_print(void)
+{
+    const struct mock_counters *c = &mock_counters;
+
+    printf("{\"t_ms\": %" PRIu64 ", \"sessions\": %" PRIu64 ", \"requests\": {"
+           "\"lightdb_get\": %" PRIu64 ", \"lightdb_set\": %" PRIu64
+           ", \"lightdb_delete\": %" PRIu64 ", \"lightdb_observe\": %" PRIu64
+           ", \"stream\": %" PRIu64 ", \"settings_get\": %" PRIu64
+           ", \"settings_status\": %" PRIu64 ", \"rpc_observe\": %" PRIu64
+           ", \"rpc_status\": %" PRIu64 ", \"ota_manifest\": %" PRIu64 ", \"ota_block\": %" PRIu64
+           ", \"logs\": %" PRIu64 ", \"not_found\": %" PRIu64 "}, \"bytes_in\": %" PRIu64
+           ", \"bytes_out\": %" PRIu64 ", \"block1_transfers\": %" PRIu64
+           ", \"notifications\": %" PRIu64 ", \"rpc_sent\": %" PRIu64 ", \"rpc_answered\": %" PRIu64
+           ", \"rpc_latency_avg_ms\": %" PRIu64 ", \"rpc_latency_max_ms\": %" PRIu64
+           ", \"relay\": ",
+           mock_now_ms(),
+           c->sessions,
+           c->lightdb_get,
+           c->lightdb_set,
+           c->lightdb_delete,
+           c->lightdb_observe,
+           c->stream,
+           c->settings_get,
+           c->settings_status,
+           c->rpc_observe,
+           c->rpc_status,
+           c->ota_manifest,
+           c->ota_block,
+           c->logs,
+           c->not_found,
+           c->bytes_in,
+           c->bytes_out,
+           c->block1_transfers,
+           c->notifications,
+           c->rpc_sent,
+           c->rpc_answered,
+           c->rpc_answered ? c->rpc_latency_total_ms / c->rpc_answered : 0,
+           c->rpc_latency_max_ms);
+    mock_relay_print_counters();
+    printf("}\n");
+    fflush(stdout);
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Scenario commands, one per line. In a scenario file every line starts with
+// the time in milliseconds (relative to server start) at which it runs; on
+// stdin the timestamp is omitted and commands run immediately.
+//
+//   lightdb set <path> <value>
+//   lightdb delete <path>
+//   settings <KEY>=<value> [<KEY>=<value> ...]
+//   rpc <method> [<param> ...]
+//   ota <package> <version> <file | size:N>
+//   impair [up|down|both] [latency=MS] [jitter=MS] [loss=PCT] [reorder=PCT]
+//          [reorder_delay=MS] [rate=BYTES_PER_S] [queue=BYTES]
+//   impair reset
+//   stats
+//   echo <text>
+//   exit
+//
+// Values are JSON-like scalars: true, false, null, integers, floats and
+// strings (quoted, or bare when not otherwise a number or keyword).
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mock_server.h"
+
+#define MAX_TOKENS 32
+
+struct script_line
+{
+    uint64_t time_ms;
+    char *command;
+};
+
+static struct script_line *lines;
+static size_t num_lines;
+static size_t next_line;
+
+void mock_value_parse(const char *token, struct mock_value *value)
+{
+    char *end;
+
+    memset(value, 0, sizeof(*value));
+
+    if (token[0] == '"')
+    {
+        size_t len = strlen(token);
+        value->type = MOCK_VALUE_STRING;
+        value->s = strndup(token + 1, (len >= 2 && token[len - 1] == '"') ? len - 2 : len - 1);
+        return;
+    }
+
+    if (strcmp(token, "true") == 0 || strcmp(token, "false") == 0)
+    {
+        value->type = MOCK_VALUE_BOOL;
+        value->b = (token[0] == 't');
+        return;
+    }
+
+    if (strcmp(token, "null") == 0)
+    {
+        value->type = MOCK_VALUE_NULL;
+        return;
+    }
+
+    errno = 0;
+    long long i = strtoll(token, &end, 0);
+    if (*token && *end == '\0' && errno == 0)
+    {
+        value->type = MOCK_VALUE_INT;
+        value->i = i;
+        return;
+    }
+
+    double f = strtod(token, &end);
+    if (*token && *end == '\0')
+    {
+        value->type = MOCK_VALUE_FLOAT;
+        value->f = f;
+        return;
+    }
+
+    value->type = MOCK_VALUE_STRING;
+    value->s = strdup(token);
+}
+
+void mock_value_free(struct mock_value *value)
+{
+    if (value->type == MOCK_VALUE_STRING)
+    {
+        free(value->s);
+        value->s = NULL;
+    }
+}
+
+/// Split line in place on whitespace. Double-quoted sections are kept together,
+/// quotes included, so that mock_value_parse() can tell "12" from 12.
+static size_t tokenize(char *line, char *tokens[], size_t max_tokens)
+{
+    size_t count = 0;
+    char *p = line;
+
+    while (count < max_tokens)
+    {
+        while (isspace((unsigned char) *p))
+        {
+            p++;
+        }
+        if (*p == '\0' || *p == '#')
+        {
+            break;
+        }
+
+        tokens[count++] = p;
+
+        bool quoted = false;
+        while (*p && (quoted || !isspace((unsigned char) *p)))
+        {
+            if (*p == '"')
+            {
+                quoted = !quoted;
+            }
+            p++;
+        }
+        if (*p)
+        {
+            *p++ = '\0';
+        }
+    }
+
+    return count;
+}
+
+static int exec_impair(char *tokens[], size_t count)
+{
+    bool dirs[MOCK_DIR_COUNT] = {true, true};
+    size_t first = 1;
+
+    if (count > 1 && strcmp(tokens[1], "up") == 0)
+    {
+        dirs[MOCK_DIR_DOWN] = false;
+        first++;
+    }
+    else if (count > 1 && strcmp(tokens[1], "down") == 0)
+    {
+        dirs[MOCK_DIR_UP] = false;
+        first++;
+    }
+    else if (count > 1 && strcmp(tokens[1], "both") == 0)
+    {
+        first++;
+    }
+
+    for (int dir = 0; dir < MOCK_DIR_COUNT; dir++)
+    {
+        if (!dirs[dir])
+        {
+            continue;
+        }
+
+        struct mock_impairment imp;
+        mock_relay_get_impairment(dir, &imp);
+
+        for (size_t i = first; i < count; i++)
+        {
+            char *eq = strchr(tokens[i], '=');
+            double value = eq ? strtod(eq + 1, NULL) : 0;
+
+            if (strcmp(tokens[i], "reset") == 0)
+            {
+                imp.latency_ms = 0;
+                imp.jitter_ms = 0;
+                imp.loss_pct = 0;
+                imp.reorder_pct = 0;
+                imp.rate_bps = 0;
+            }
+            else if (!eq)
+            {
+                fprintf(stderr, "impair: expected key=value, got %s\n", tokens[i]);
+                return -1;
+            }
+            else if (strncmp(tokens[i], "latency=", 8) == 0)
+            {
+                imp.latency_ms = value;
+            }
+            else if (strncmp(tokens[i], "jitter=", 7) == 0)
+            {
+                imp.jitter_ms = value;
+            }
+            else if (strncmp(tokens[i], "loss=", 5) == 0)
+            {
+                imp.loss_pct = value;
+            }
+            else if (strncmp(tokens[i], "reorder=", 8) == 0)
+            {
+                imp.reorder_pct = value;
+            }
+            else if (strncmp(tokens[i], "reorder_delay=", 14) == 0)
+            {
+                imp.reorder_delay_ms = value;
+            }
+            else if (strncmp(tokens[i], "rate=", 5) == 0)
+            {
+                imp.rate_bps = value;
+            }
+            else if (strncmp(tokens[i], "queue=", 6) == 0)
+            {
+                imp.queue_bytes = value;
+            }
+            else
+            {
+                fprintf(stderr, "impair: unknown parameter %s\n", tokens[i]);
+                return -1;
+            }
+        }
+
+        mock_relay_set_impairment(dir, &imp);
+    }
+
+    return 0;
+}
+
+int mock_script_exec(const char *line)
+{
+    char *tokens[MAX_TOKENS];
+    char *buf = strdup(line);
+    int ret = 0;
+
+    if (!buf)
+    {
+        return -1;
+    }
+
+    size_t count = tokenize(buf, tokens, MAX_TOKENS);
+    if (count == 0)
+    {
+        goto finish;
+    }
+
+    const char *cmd = tokens[0];
+    struct mock_value value;
+
+    if (strcmp(cmd, "lightdb") == 0 && count == 4 && strcmp(tokens[1], "set") == 0)
+    {
+        mock_value_parse(tokens[3], &value);
+        mock_lightdb_set(tokens[2], &value);
+        mock_value_free(&value);
+    }
+    else if (strcmp(cmd, "lightdb") == 0 && count == 3 && strcmp(tokens[1], "delete") == 0)
+    {
+        mock_lightdb_delete(tokens[2]);
+    }
+    else if (strcmp(cmd, "settings") == 0 && count > 1)
+    {
+        for (size_t i = 1; i < count; i++)
+        {
+            char *eq = strchr(tokens[i], '=');
+            if (!eq)
+            {
+                fprintf(stderr, "settings: expected KEY=value, got %s\n", tokens[i]);
+                ret = -1;
+                break;
+            }
+            *eq = '\0';
+            mock_value_parse(eq + 1, &value);
+            mock_settings_set(tokens[i], &value);
+            mock_value_free(&value);
+        }
+    }
+    else if (strcmp(cmd, "rpc") == 0 && count > 1)
+    {
+        struct mock_value params[MAX_TOKENS];
+        size_t num_params = count - 2;
+
+        for (size_t i = 0; i < num_params; i++)
+        {
+            mock_value_parse(tokens[i + 2], &params[i]);
+        }
+        mock_rpc_call(tokens[1], params, num_params);
+        for (size_t i = 0; i < num_params; i++)
+        {
+            mock_value_free(&params[i]);
+        }
+    }
+    else if (strcmp(cmd, "ota") == 0 && count == 4)
+    {
+        ret = mock_ota_add(tokens[1], tokens[2], tokens[3]);
+    }
+    else if (strcmp(cmd, "impair") == 0)
+    {
+        ret = exec_impair(tokens, count);
+    }
+    else if (strcmp(cmd, "stats") == 0)
+    {
+        mock_counters_print();
+    }
+    else if (strcmp(cmd, "echo") == 0)
+    {
+        const char *text = strstr(line, "echo") + strlen("echo");
+        printf("%s\n", text + strspn(text, " \t"));
+        fflush(stdout);
+    }
+    else if (strcmp(cmd, "exit") == 0)
+    {
+        mock_quit = 1;
+    }
+    else
+    {
+        fprintf(stderr, "Invalid command: %s\n", line);
+        ret = -1;
+    }
+
+finish:
+    free(buf);
+    return ret;
+}
+
+int mock_script_load(const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t line_size = 0;
+    unsigned int line_no = 0;
+
+    while (getline(&line, &line_size, f) > 0)
+    {
+        char *end;
+        line_no++;
+
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0')
+        {
+            continue;
+        }
+
+        unsigned long long time_ms = strtoull(p, &end, 10);
+        if (end == p)
+        {
+            fprintf(stderr, "%s:%u: missing timestamp\n", filename, line_no);
+            free(line);
+            fclose(f);
+            return -1;
+        }
+
+        struct script_line *grown = realloc(lines, (num_lines + 1) * sizeof(*lines));
+        if (!grown)
+        {
+            free(line);
+            fclose(f);
+            return -ENOMEM;
+        }
+        lines = grown;
+        lines[num_lines].time_ms = time_ms;
+        lines[num_lines].command = strndup(end, strcspn(end, "\r\n"));
+        num_lines++;
+    }
+
+    free(line);
+    fclose(f);
+
+    // Stable insertion sort, so lines with equal timestamps keep file order
+    for (size_t i = 1; i < num_lines; i++)
+    {
+        struct script_line tmp = lines[i];
+        size_t j = i;
+        while (j > 0 && lines[j - 1].time_ms > tmp.time_ms)
+        {
+            lines[j] = lines[j - 1];
+            j--;
+        }
+        lines[j] = tmp;
+    }
+
+    return 0;
+}
+
+int mock_script_run_due(uint64_t elapsed_ms)
+{
+    while (next_line < num_lines && lines[next_line].time_ms <= elapsed_ms)
+    {
+        mock_script_exec(lines[next_line++].command);
+    }
+
+    if (next_line >= num_lines)
+    {
+        return -1;
+    }
+
+    return lines[next_line].time_ms - elapsed_ms;
+}
@@ -23,6 +23,55 @@ DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
                        void *,
                        bool,
                        int32_t);
+DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
+                       golioth_coap_client_set_block,
+                       struct golioth_client *,
+                       const uint8_t *,
+                       const char *,
+                       const char *,
+                       bool,
+                       uint32_t,
+                       size_t,
+                       size_t,
+                       const uint8_t *,
+                       size_t,
+                       golioth_set_block_cb_fn,
+                       void *,
+                       bool,
+                       int32_t);
+DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
+                       golioth_coap_client_delete,
+                       struct golioth_client *,
+                       const char *,
+                       const char *,
+                       golioth_set_cb_fn,
+                       void *,
+                       bool,
+                       int32_t);
+DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
+                       golioth_coap_client_get,
+                       struct golioth_client *,
+                       const uint8_t *,
+                       const char *,
+                       const char *,
+                       uint32_t,
+                       golioth_get_cb_fn,
+                       void *,
+                       bool,
+                       int32_t);
+DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
+                       golioth_coap_client_get_block,
+                       struct golioth_client *,
+                       const uint8_t *,
+                       const char *,
+                       const char *,
+                       uint32_t,
+                       size_t,
+                       size_t,
+                       golioth_get_block_cb_fn,
+                       void *,
+                       bool,
+                       int32_t);
 DEFINE_FAKE_VOID_FUNC(golioth_coap_client_cancel_observations_by_prefix,
                       struct golioth_client *,
                       const char *);
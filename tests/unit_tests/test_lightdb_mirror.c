@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_CBOR
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_MIRROR
+#define CONFIG_GOLIOTH_DEBUG_LOG
+#define GLTH_LOGX(...)
+#define GLTH_LOG_BUFFER_HEXDUMP(...)
+#define GLTH_LOGE(TAG, msg, ...)
+#define GLTH_LOGW(TAG, msg, ...)
+
+#include "fakes/coap_client_fake.h"
+#include "../../src/lightdb_state.c"
+
+/* Both sources define these; the mirror reuses the definitions of lightdb_state.c */
+#undef GOLIOTH_LIGHTDB_STATE_PATH_PREFIX
+#undef LOG_TAG_DEFINE
+#define LOG_TAG_DEFINE(tag)
+#include "../../src/lightdb_mirror.c"
+
+FAKE_VALUE_FUNC(uint64_t, golioth_sys_now_ms);
+FAKE_VOID_FUNC(test_set_cb,
+               struct golioth_client *,
+               enum golioth_status,
+               const struct golioth_coap_rsp_code *,
+               const char *,
+               void *);
+
+#define MIRRORED_PATH "setpoint"
+
+/* CBOR encoding of 5 and 7 */
+static const uint8_t value_5[] = {0x05};
+static const uint8_t value_7[] = {0x07};
+
+static struct golioth_client client;
+static golioth_get_cb_fn notify_callback;
+static void *notify_arg;
+static golioth_set_cb_fn write_callback;
+static void *write_callback_arg;
+
+static enum golioth_status golioth_coap_client_observe_custom_fake(
+    struct golioth_client *client,
+    const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+    const char *path_prefix,
+    const char *path,
+    uint32_t content_type,
+    golioth_get_cb_fn callback,
+    void *arg)
+{
+    notify_callback = callback;
+    notify_arg = arg;
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status golioth_coap_client_set_custom_fake(
+    struct golioth_client *client,
+    const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+    const char *path_prefix,
+    const char *path,
+    uint32_t content_type,
+    const uint8_t *payload,
+    size_t payload_size,
+    golioth_set_cb_fn callback,
+    void *callback_arg,
+    bool is_synchronous,
+    int32_t timeout_s)
+{
+    write_callback = callback;
+    write_callback_arg = callback_arg;
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status golioth_coap_client_delete_custom_fake(struct golioth_client *client,
+                                                                  const char *path_prefix,
+                                                                  const char *path,
+                                                                  golioth_set_cb_fn callback,
+                                                                  void *callback_arg,
+                                                                  bool is_synchronous,
+                                                                  int32_t timeout_s)
+{
+    write_callback = callback;
+    write_callback_arg = callback_arg;
+
+    return GOLIOTH_OK;
+}
+
+static void notify(const uint8_t *payload, size_t payload_size)
+{
+    notify_callback(&client, GOLIOTH_OK, NULL, MIRRORED_PATH, payload, payload_size, notify_arg);
+}
+
+/* Complete the asynchronous request in flight, as the client thread does */
+static void complete_write(enum golioth_status status)
+{
+    TEST_ASSERT_NOT_NULL(write_callback);
+
+    golioth_set_cb_fn callback = write_callback;
+    write_callback = NULL;
+    callback(&client, status, NULL, MIRRORED_PATH, write_callback_arg);
+}
+
+static struct golioth_lightdb_mirror_entry *mirrored_entry(void)
+{
+    return find_entry(&client.lightdb_mirror, MIRRORED_PATH);
+}
+
+/* Whether the mirrored value is served, rather than read from the server */
+static bool is_served(void)
+{
+    int32_t value;
+    unsigned int gets = golioth_coap_client_get_fake.call_count;
+
+    golioth_lightdb_get_int_sync(&client, MIRRORED_PATH, &value, 1);
+
+    return golioth_coap_client_get_fake.call_count == gets;
+}
+
+void setUp(void)
+{
+    RESET_FAKE(golioth_coap_client_observe);
+    RESET_FAKE(golioth_coap_client_set);
+    RESET_FAKE(golioth_coap_client_delete);
+    RESET_FAKE(golioth_coap_client_get);
+    RESET_FAKE(golioth_sys_now_ms);
+    RESET_FAKE(test_set_cb);
+
+    golioth_coap_client_observe_fake.custom_fake = golioth_coap_client_observe_custom_fake;
+    golioth_coap_client_set_fake.custom_fake = golioth_coap_client_set_custom_fake;
+    golioth_coap_client_delete_fake.custom_fake = golioth_coap_client_delete_custom_fake;
+    golioth_coap_client_get_fake.return_val = GOLIOTH_ERR_TIMEOUT;
+
+    memset(&client, 0, sizeof(client));
+    write_callback = NULL;
+    write_callback_arg = NULL;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_mirror_add(&client, MIRRORED_PATH, 0));
+    notify(value_5, sizeof(value_5));
+    TEST_ASSERT_TRUE(is_served());
+}
+
+void tearDown(void) {}
+
+void test_set_ends_write_on_completion(void)
+{
+    struct golioth_lightdb_mirror_entry *entry = mirrored_entry();
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_lightdb_set_int_async(&client, MIRRORED_PATH, 7, test_set_cb, NULL));
+
+    /* Read from the server while the request is in flight */
+    TEST_ASSERT_EQUAL(1, entry->writes_pending);
+    TEST_ASSERT_FALSE(is_served());
+
+    complete_write(GOLIOTH_OK);
+
+    TEST_ASSERT_EQUAL(0, entry->writes_pending);
+    TEST_ASSERT_EQUAL(1, entry->writes);
+    TEST_ASSERT_EQUAL(1, test_set_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, test_set_cb_fake.arg1_val);
+
+    /* The mirrored value predates the write, until the server notifies the change */
+    TEST_ASSERT_FALSE(is_served());
+    notify(value_7, sizeof(value_7));
+    TEST_ASSERT_TRUE(is_served());
+}
+
+void test_delete_ends_write_on_completion(void)
+{
+    struct golioth_lightdb_mirror_entry *entry = mirrored_entry();
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_lightdb_delete_async(&client, MIRRORED_PATH, test_set_cb, NULL));
+
+    TEST_ASSERT_EQUAL(1, entry->writes_pending);
+    TEST_ASSERT_FALSE(is_served());
+
+    complete_write(GOLIOTH_OK);
+
+    TEST_ASSERT_EQUAL(0, entry->writes_pending);
+    TEST_ASSERT_EQUAL(1, entry->writes);
+    TEST_ASSERT_EQUAL(1, test_set_cb_fake.call_count);
+    TEST_ASSERT_FALSE(is_served());
+}
+
+void test_write_to_parent_path_ends_on_completion(void)
+{
+    struct golioth_lightdb_mirror_entry *entry = mirrored_entry();
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_delete_async(&client, "", test_set_cb, NULL));
+    TEST_ASSERT_EQUAL(1, entry->writes_pending);
+
+    complete_write(GOLIOTH_OK);
+
+    TEST_ASSERT_EQUAL(0, entry->writes_pending);
+    TEST_ASSERT_EQUAL(1, entry->writes);
+}
+
+void test_set_to_mirrored_value_is_served(void)
+{
+    struct golioth_lightdb_mirror_entry *entry = mirrored_entry();
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_lightdb_set_int_async(&client, MIRRORED_PATH, 5, test_set_cb, NULL));
+    complete_write(GOLIOTH_OK);
+
+    /* Not notified by the server, since the value did not change */
+    TEST_ASSERT_EQUAL(0, entry->writes_pending);
+    TEST_ASSERT_EQUAL(0, entry->writes);
+    TEST_ASSERT_TRUE(is_served());
+}
+
+void test_rejected_write_is_served(void)
+{
+    struct golioth_lightdb_mirror_entry *entry = mirrored_entry();
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_lightdb_set_int_async(&client, MIRRORED_PATH, 7, test_set_cb, NULL));
+    complete_write(GOLIOTH_ERR_FAIL);
+
+    /* The value did not change */
+    TEST_ASSERT_EQUAL(0, entry->writes_pending);
+    TEST_ASSERT_EQUAL(0, entry->writes);
+    TEST_ASSERT_EQUAL(1, test_set_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_FAIL, test_set_cb_fake.arg1_val);
+    TEST_ASSERT_TRUE(is_served());
+}
+
+void test_timed_out_write_is_not_served(void)
+{
+    struct golioth_lightdb_mirror_entry *entry = mirrored_entry();
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_lightdb_set_int_async(&client, MIRRORED_PATH, 7, test_set_cb, NULL));
+    complete_write(GOLIOTH_ERR_TIMEOUT);
+
+    /* The server may have received it */
+    TEST_ASSERT_EQUAL(0, entry->writes_pending);
+    TEST_ASSERT_EQUAL(1, entry->writes);
+    TEST_ASSERT_FALSE(is_served());
+}
+
+void test_write_not_enqueued_ends_write(void)
+{
+    struct golioth_lightdb_mirror_entry *entry = mirrored_entry();
+
+    golioth_coap_client_set_fake.custom_fake = NULL;
+    golioth_coap_client_set_fake.return_val = GOLIOTH_ERR_QUEUE_FULL;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_QUEUE_FULL,
+                      golioth_lightdb_set_int_async(&client, MIRRORED_PATH, 7, test_set_cb, NULL));
+
+    /* The callback is not called for a request that was not enqueued */
+    TEST_ASSERT_EQUAL(0, entry->writes_pending);
+    TEST_ASSERT_EQUAL(0, entry->writes);
+    TEST_ASSERT_EQUAL(0, test_set_cb_fake.call_count);
+    TEST_ASSERT_TRUE(is_served());
+}
+
+void test_sync_write_ends_on_return(void)
+{
+    struct golioth_lightdb_mirror_entry *entry = mirrored_entry();
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_set_int_sync(&client, MIRRORED_PATH, 7, 1));
+
+    TEST_ASSERT_EQUAL(0, entry->writes_pending);
+    TEST_ASSERT_EQUAL(1, entry->writes);
+    TEST_ASSERT_FALSE(is_served());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_set_ends_write_on_completion);
+    RUN_TEST(test_delete_ends_write_on_completion);
+    RUN_TEST(test_write_to_parent_path_ends_on_completion);
+    RUN_TEST(test_set_to_mirrored_value_is_served);
+    RUN_TEST(test_rejected_write_is_served);
+    RUN_TEST(test_timed_out_write_is_not_served);
+    RUN_TEST(test_write_not_enqueued_ends_write);
+    RUN_TEST(test_sync_write_ends_on_return);
+    return UNITY_END();
+}
@@ -0,0 +1,330 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT
+#define CONFIG_GOLIOTH_DEBUG_LOG
+#define GLTH_LOGX(...)
+#define GLTH_LOG_BUFFER_HEXDUMP(...)
+#define GLTH_LOGE(TAG, msg, ...)
+#define GLTH_LOGW(TAG, msg, ...)
+
+#include "fakes/coap_client_fake.h"
+#include "../../src/lightdb_report.c"
+
+FAKE_VALUE_FUNC(golioth_sys_mutex_t, golioth_sys_mutex_create);
+FAKE_VOID_FUNC(golioth_sys_mutex_destroy, golioth_sys_mutex_t);
+FAKE_VALUE_FUNC(bool, golioth_sys_mutex_lock, golioth_sys_mutex_t, int32_t);
+FAKE_VALUE_FUNC(bool, golioth_sys_mutex_unlock, golioth_sys_mutex_t);
+FAKE_VALUE_FUNC(golioth_sys_timer_t, golioth_sys_timer_create, const struct golioth_timer_config *);
+FAKE_VALUE_FUNC(bool, golioth_sys_timer_start, golioth_sys_timer_t);
+FAKE_VOID_FUNC(golioth_sys_timer_destroy, golioth_sys_timer_t);
+FAKE_VALUE_FUNC(uint64_t, golioth_sys_now_ms);
+FAKE_VALUE_FUNC(struct golioth_lightdb_report **,
+                golioth_coap_client_get_lightdb_reports_due,
+                struct golioth_client *);
+FAKE_VALUE_FUNC(enum golioth_status,
+                golioth_lightdb_set_async,
+                struct golioth_client *,
+                const char *,
+                enum golioth_content_type,
+                const uint8_t *,
+                size_t,
+                golioth_set_cb_fn,
+                void *);
+
+#define REPORT_INTERVAL_MS 1000
+
+static struct golioth_client *client = (struct golioth_client *) 0x1;
+static struct golioth_lightdb_report *reports_due;
+static struct golioth_timer_config timer_config;
+static uint64_t now_ms;
+
+static uint8_t last_payload[CONFIG_GOLIOTH_LIGHTDB_STATE_REPORT_MAX_PAYLOAD_LEN];
+static size_t last_payload_size;
+static golioth_set_cb_fn last_callback;
+static void *last_callback_arg;
+
+static golioth_sys_timer_t golioth_sys_timer_create_custom_fake(
+    const struct golioth_timer_config *config)
+{
+    timer_config = *config;
+
+    return (golioth_sys_timer_t) 0x2;
+}
+
+static uint64_t golioth_sys_now_ms_custom_fake(void)
+{
+    return now_ms;
+}
+
+static struct golioth_lightdb_report **golioth_coap_client_get_lightdb_reports_due_custom_fake(
+    struct golioth_client *client)
+{
+    return &reports_due;
+}
+
+static enum golioth_status golioth_lightdb_set_async_custom_fake(
+    struct golioth_client *client,
+    const char *path,
+    enum golioth_content_type content_type,
+    const uint8_t *buf,
+    size_t buf_len,
+    golioth_set_cb_fn callback,
+    void *callback_arg)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(last_payload), buf_len);
+
+    memcpy(last_payload, buf, buf_len);
+    last_payload_size = buf_len;
+    last_callback = callback;
+    last_callback_arg = callback_arg;
+
+    return GOLIOTH_OK;
+}
+
+/* Number of times the encoded key and value occur in the last payload */
+static size_t count_in_payload(const uint8_t *encoded, size_t encoded_len)
+{
+    size_t count = 0;
+    const uint8_t *pos = last_payload;
+    const uint8_t *end = last_payload + last_payload_size;
+
+    while ((pos = memmem(pos, end - pos, encoded, encoded_len)) != NULL)
+    {
+        count++;
+        pos += encoded_len;
+    }
+
+    return count;
+}
+
+/* The interval elapsed, and the timer fired */
+static void expire_timer(void)
+{
+    now_ms += REPORT_INTERVAL_MS;
+    timer_config.fn((golioth_sys_timer_t) 0x2, timer_config.user_arg);
+}
+
+static void complete_upload(enum golioth_status status)
+{
+    TEST_ASSERT_NOT_NULL(last_callback);
+
+    golioth_set_cb_fn callback = last_callback;
+    last_callback = NULL;
+    callback(client, status, NULL, "state", last_callback_arg);
+}
+
+void setUp(void)
+{
+    RESET_FAKE(golioth_sys_mutex_create);
+    RESET_FAKE(golioth_sys_mutex_destroy);
+    RESET_FAKE(golioth_sys_mutex_lock);
+    RESET_FAKE(golioth_sys_mutex_unlock);
+    RESET_FAKE(golioth_sys_timer_create);
+    RESET_FAKE(golioth_sys_timer_start);
+    RESET_FAKE(golioth_sys_timer_destroy);
+    RESET_FAKE(golioth_sys_now_ms);
+    RESET_FAKE(golioth_coap_client_get_lightdb_reports_due);
+    RESET_FAKE(golioth_lightdb_set_async);
+
+    golioth_sys_mutex_create_fake.return_val = (golioth_sys_mutex_t) 0x3;
+    golioth_sys_mutex_lock_fake.return_val = true;
+    golioth_sys_mutex_unlock_fake.return_val = true;
+    golioth_sys_timer_create_fake.custom_fake = golioth_sys_timer_create_custom_fake;
+    golioth_sys_timer_start_fake.return_val = true;
+    golioth_sys_now_ms_fake.custom_fake = golioth_sys_now_ms_custom_fake;
+    golioth_coap_client_get_lightdb_reports_due_fake.custom_fake =
+        golioth_coap_client_get_lightdb_reports_due_custom_fake;
+    golioth_lightdb_set_async_fake.custom_fake = golioth_lightdb_set_async_custom_fake;
+
+    reports_due = NULL;
+    memset(&timer_config, 0, sizeof(timer_config));
+    now_ms = 0;
+    last_payload_size = 0;
+    last_callback = NULL;
+    last_callback_arg = NULL;
+}
+
+void tearDown(void) {}
+
+void test_repeated_sets_are_coalesced(void)
+{
+    /* "temp": 42 and "temp" */
+    const uint8_t temp_42[] = {0x64, 't', 'e', 'm', 'p', 0x18, 42};
+    const uint8_t temp_key[] = {0x64, 't', 'e', 'm', 'p'};
+    struct golioth_lightdb_report_stats stats;
+
+    struct golioth_lightdb_report *report =
+        golioth_lightdb_report_init(client, "state", REPORT_INTERVAL_MS);
+    TEST_ASSERT_NOT_NULL(report);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 1));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 2));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 42));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 42));
+
+    /* The timer is only started by the first change */
+    TEST_ASSERT_EQUAL(1, golioth_sys_timer_start_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_set_async_fake.call_count);
+
+    expire_timer();
+    golioth_lightdb_report_poll(client);
+
+    /* One upload, with the last value of the field */
+    TEST_ASSERT_EQUAL(1, golioth_lightdb_set_async_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("state", golioth_lightdb_set_async_fake.arg1_val);
+    TEST_ASSERT_EQUAL(GOLIOTH_CONTENT_TYPE_CBOR, golioth_lightdb_set_async_fake.arg2_val);
+    TEST_ASSERT_EQUAL(1, count_in_payload(temp_key, sizeof(temp_key)));
+    TEST_ASSERT_EQUAL(1, count_in_payload(temp_42, sizeof(temp_42)));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_get_stats(report, &stats));
+    TEST_ASSERT_EQUAL(1, stats.uploads);
+    TEST_ASSERT_EQUAL(1, stats.fields_uploaded);
+    TEST_ASSERT_EQUAL(1, stats.fields_unchanged);
+
+    complete_upload(GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_deinit(report));
+}
+
+void test_changes_during_upload_are_coalesced(void)
+{
+    const uint8_t temp_3[] = {0x64, 't', 'e', 'm', 'p', 0x03};
+    const uint8_t temp_key[] = {0x64, 't', 'e', 'm', 'p'};
+    const uint8_t on_true[] = {0x62, 'o', 'n', 0xf5};
+    struct golioth_lightdb_report_stats stats;
+
+    struct golioth_lightdb_report *report =
+        golioth_lightdb_report_init(client, "state", REPORT_INTERVAL_MS);
+    TEST_ASSERT_NOT_NULL(report);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 1));
+    expire_timer();
+    golioth_lightdb_report_poll(client);
+    TEST_ASSERT_EQUAL(1, golioth_lightdb_set_async_fake.call_count);
+
+    /* Only one upload is in flight; these wait for it */
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 2));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_bool(report, "on", true));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 3));
+    TEST_ASSERT_EQUAL(1, golioth_lightdb_set_async_fake.call_count);
+
+    /* Not due yet, so the completed upload starts the timer instead */
+    unsigned int timer_starts = golioth_sys_timer_start_fake.call_count;
+    complete_upload(GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(1, golioth_lightdb_set_async_fake.call_count);
+    TEST_ASSERT_EQUAL(timer_starts + 1, golioth_sys_timer_start_fake.call_count);
+
+    expire_timer();
+    golioth_lightdb_report_poll(client);
+
+    TEST_ASSERT_EQUAL(2, golioth_lightdb_set_async_fake.call_count);
+    TEST_ASSERT_EQUAL(1, count_in_payload(temp_key, sizeof(temp_key)));
+    TEST_ASSERT_EQUAL(1, count_in_payload(temp_3, sizeof(temp_3)));
+    TEST_ASSERT_EQUAL(1, count_in_payload(on_true, sizeof(on_true)));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_get_stats(report, &stats));
+    TEST_ASSERT_EQUAL(2, stats.uploads);
+    TEST_ASSERT_EQUAL(3, stats.fields_uploaded);
+
+    complete_upload(GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_deinit(report));
+}
+
+void test_delivered_when_client_polls(void)
+{
+    struct golioth_lightdb_report *report =
+        golioth_lightdb_report_init(client, "state", REPORT_INTERVAL_MS);
+    TEST_ASSERT_NOT_NULL(report);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 1));
+
+    /* Nothing is due before the timer fires */
+    golioth_lightdb_report_poll(client);
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_set_async_fake.call_count);
+
+    /* The timer only queues the report for the client thread */
+    expire_timer();
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_set_async_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(report, reports_due);
+
+    /* Firing again does not queue it twice */
+    timer_config.fn((golioth_sys_timer_t) 0x2, timer_config.user_arg);
+    TEST_ASSERT_NULL(report->next_due);
+
+    golioth_lightdb_report_poll(client);
+    TEST_ASSERT_EQUAL(1, golioth_lightdb_set_async_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(report, golioth_lightdb_set_async_fake.arg6_val);
+    TEST_ASSERT_NULL(reports_due);
+
+    /* The due list is empty again */
+    golioth_lightdb_report_poll(client);
+    TEST_ASSERT_EQUAL(1, golioth_lightdb_set_async_fake.call_count);
+
+    complete_upload(GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_deinit(report));
+}
+
+void test_failed_upload_is_sent_again(void)
+{
+    const uint8_t temp_1[] = {0x64, 't', 'e', 'm', 'p', 0x01};
+    struct golioth_lightdb_report_stats stats;
+
+    struct golioth_lightdb_report *report =
+        golioth_lightdb_report_init(client, "state", REPORT_INTERVAL_MS);
+    TEST_ASSERT_NOT_NULL(report);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 1));
+    expire_timer();
+    golioth_lightdb_report_poll(client);
+    TEST_ASSERT_EQUAL(1, golioth_lightdb_set_async_fake.call_count);
+
+    complete_upload(GOLIOTH_ERR_TIMEOUT);
+    memset(last_payload, 0, sizeof(last_payload));
+
+    expire_timer();
+    golioth_lightdb_report_poll(client);
+    TEST_ASSERT_EQUAL(2, golioth_lightdb_set_async_fake.call_count);
+    TEST_ASSERT_EQUAL(1, count_in_payload(temp_1, sizeof(temp_1)));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_get_stats(report, &stats));
+    TEST_ASSERT_EQUAL(1, stats.failed);
+
+    complete_upload(GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_deinit(report));
+}
+
+void test_deinit_while_due_is_freed_by_poll(void)
+{
+    struct golioth_lightdb_report *report =
+        golioth_lightdb_report_init(client, "state", REPORT_INTERVAL_MS);
+    TEST_ASSERT_NOT_NULL(report);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_set_int(report, "temp", 1));
+    expire_timer();
+
+    /* Still referenced by the due list, so freed by the client thread */
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_report_deinit(report));
+    TEST_ASSERT_EQUAL(0, golioth_sys_mutex_destroy_fake.call_count);
+
+    golioth_lightdb_report_poll(client);
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_set_async_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_sys_mutex_destroy_fake.call_count);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_repeated_sets_are_coalesced);
+    RUN_TEST(test_changes_during_upload_are_coalesced);
+    RUN_TEST(test_delivered_when_client_polls);
+    RUN_TEST(test_failed_upload_is_sent_again);
+    RUN_TEST(test_deinit_while_due_is_freed_by_poll);
+    return UNITY_END();
+}
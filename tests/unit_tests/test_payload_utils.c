@@ -0,0 +1,212 @@
+#include <unity.h>
+#include <fff.h>
+#include <stdint.h>
+
+#include <golioth/payload_utils.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void cbor_int_is_decoded(void)
+{
+    const uint8_t small[] = {0x05};
+    const uint8_t positive[] = {0x19, 0x01, 0x00};
+    const uint8_t negative[] = {0x38, 0x63};
+    const uint8_t max[] = {0x1a, 0x7f, 0xff, 0xff, 0xff};
+    const uint8_t min[] = {0x3a, 0x7f, 0xff, 0xff, 0xff};
+    int32_t value;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_payload_cbor_as_int(small, sizeof(small), &value));
+    TEST_ASSERT_EQUAL(5, value);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_payload_cbor_as_int(positive, sizeof(positive), &value));
+    TEST_ASSERT_EQUAL(256, value);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_payload_cbor_as_int(negative, sizeof(negative), &value));
+    TEST_ASSERT_EQUAL(-100, value);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_payload_cbor_as_int(max, sizeof(max), &value));
+    TEST_ASSERT_EQUAL(INT32_MAX, value);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_payload_cbor_as_int(min, sizeof(min), &value));
+    TEST_ASSERT_EQUAL(INT32_MIN, value);
+}
+
+void cbor_int_out_of_range_is_invalid(void)
+{
+    const uint8_t too_large[] = {0x1a, 0x80, 0x00, 0x00, 0x00};
+    const uint8_t too_small[] = {0x3a, 0x80, 0x00, 0x00, 0x00};
+    int32_t value = 7;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_int(too_large, sizeof(too_large), &value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_int(too_small, sizeof(too_small), &value));
+    TEST_ASSERT_EQUAL(7, value);
+}
+
+void cbor_int_of_other_type_is_invalid(void)
+{
+    const uint8_t boolean[] = {0xf5};
+    const uint8_t string[] = {0x61, '5'};
+    const uint8_t float64[] = {0xfb, 0x40, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    int32_t value = 7;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_int(boolean, sizeof(boolean), &value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_int(string, sizeof(string), &value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_int(float64, sizeof(float64), &value));
+    TEST_ASSERT_EQUAL(7, value);
+}
+
+void cbor_float_is_decoded(void)
+{
+    const uint8_t float32[] = {0xfa, 0x3f, 0xc0, 0x00, 0x00};
+    const uint8_t float64[] = {0xfb, 0xc0, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    const uint8_t integer[] = {0x18, 0x2a};
+    const uint8_t negative[] = {0x22};
+    float value;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_payload_cbor_as_float(float32, sizeof(float32), &value));
+    TEST_ASSERT_EQUAL_FLOAT(1.5f, value);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_payload_cbor_as_float(float64, sizeof(float64), &value));
+    TEST_ASSERT_EQUAL_FLOAT(-2.5f, value);
+
+    /* Whole numbers may be encoded as integers */
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_payload_cbor_as_float(integer, sizeof(integer), &value));
+    TEST_ASSERT_EQUAL_FLOAT(42.0f, value);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_payload_cbor_as_float(negative, sizeof(negative), &value));
+    TEST_ASSERT_EQUAL_FLOAT(-3.0f, value);
+}
+
+void cbor_float_of_other_type_is_invalid(void)
+{
+    const uint8_t boolean[] = {0xf4};
+    const uint8_t string[] = {0x63, '1', '.', '5'};
+    float value = 7.0f;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_float(boolean, sizeof(boolean), &value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_float(string, sizeof(string), &value));
+    TEST_ASSERT_EQUAL_FLOAT(7.0f, value);
+}
+
+void cbor_bool_is_decoded(void)
+{
+    const uint8_t true_value[] = {0xf5};
+    const uint8_t false_value[] = {0xf4};
+    bool value;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_payload_cbor_as_bool(true_value, sizeof(true_value), &value));
+    TEST_ASSERT_TRUE(value);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_payload_cbor_as_bool(false_value, sizeof(false_value), &value));
+    TEST_ASSERT_FALSE(value);
+}
+
+void cbor_bool_of_other_type_is_invalid(void)
+{
+    const uint8_t integer[] = {0x01};
+    const uint8_t string[] = {0x64, 't', 'r', 'u', 'e'};
+    bool value;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_bool(integer, sizeof(integer), &value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_bool(string, sizeof(string), &value));
+}
+
+void cbor_string_is_decoded_in_place(void)
+{
+    const uint8_t string[] = {0x65, 'h', 'e', 'l', 'l', 'o'};
+    const uint8_t empty[] = {0x60};
+    const char *str;
+    size_t str_len;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_payload_cbor_as_string(string, sizeof(string), &str, &str_len));
+    TEST_ASSERT_EQUAL_PTR(&string[1], str);
+    TEST_ASSERT_EQUAL(5, str_len);
+    TEST_ASSERT_EQUAL_MEMORY("hello", str, str_len);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_payload_cbor_as_string(empty, sizeof(empty), &str, &str_len));
+    TEST_ASSERT_EQUAL(0, str_len);
+}
+
+void cbor_string_of_other_type_is_invalid(void)
+{
+    const uint8_t bytes[] = {0x45, 'h', 'e', 'l', 'l', 'o'};
+    const uint8_t integer[] = {0x05};
+    const char *str = NULL;
+    size_t str_len = 0;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_string(bytes, sizeof(bytes), &str, &str_len));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_string(integer, sizeof(integer), &str, &str_len));
+    TEST_ASSERT_NULL(str);
+    TEST_ASSERT_EQUAL(0, str_len);
+}
+
+void cbor_truncated_payload_is_invalid(void)
+{
+    const uint8_t integer[] = {0x1a, 0x00, 0x01};
+    const uint8_t float64[] = {0xfb, 0x3f, 0xf8, 0x00};
+    const uint8_t string[] = {0x65, 'h', 'e'};
+    int32_t int_value;
+    float float_value;
+    const char *str;
+    size_t str_len;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_int(integer, sizeof(integer), &int_value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_float(float64, sizeof(float64), &float_value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_string(string, sizeof(string), &str, &str_len));
+
+    /* Only the header of the value */
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_payload_cbor_as_string(string, 1, &str, &str_len));
+}
+
+void cbor_null_or_empty_payload_is_null(void)
+{
+    const uint8_t null[] = {0xf6};
+    int32_t int_value;
+    float float_value;
+    bool bool_value;
+    const char *str;
+    size_t str_len;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL,
+                      golioth_payload_cbor_as_int(null, sizeof(null), &int_value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL,
+                      golioth_payload_cbor_as_float(null, sizeof(null), &float_value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL,
+                      golioth_payload_cbor_as_bool(null, sizeof(null), &bool_value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL,
+                      golioth_payload_cbor_as_string(null, sizeof(null), &str, &str_len));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL, golioth_payload_cbor_as_int(null, 0, &int_value));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL, golioth_payload_cbor_as_int(NULL, 1, &int_value));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(cbor_int_is_decoded);
+    RUN_TEST(cbor_int_out_of_range_is_invalid);
+    RUN_TEST(cbor_int_of_other_type_is_invalid);
+    RUN_TEST(cbor_float_is_decoded);
+    RUN_TEST(cbor_float_of_other_type_is_invalid);
+    RUN_TEST(cbor_bool_is_decoded);
+    RUN_TEST(cbor_bool_of_other_type_is_invalid);
+    RUN_TEST(cbor_string_is_decoded_in_place);
+    RUN_TEST(cbor_string_of_other_type_is_invalid);
+    RUN_TEST(cbor_truncated_payload_is_invalid);
+    RUN_TEST(cbor_null_or_empty_payload_is_null);
+    return UNITY_END();
+}
@@ -104,6 +104,38 @@ void array_wraparound(void)
     TEST_ASSERT_TRUE(ringbuf_is_empty(&rb));
 }
 
+void get_at_keeps_order_of_other_items(void)
+{
+    // Start in the middle of the array, so that the items wrap around
+    RINGBUF_DEFINE(rb, 1, 4);
+    uint8_t item;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(ringbuf_put(&rb, &i));
+        TEST_ASSERT_TRUE(ringbuf_get(&rb, &item));
+    }
+    for (uint8_t i = 1; i <= 4; i++)
+    {
+        TEST_ASSERT_TRUE(ringbuf_put(&rb, &i));
+    }
+
+    TEST_ASSERT_EQUAL(3, *(const uint8_t *) ringbuf_item_at(&rb, 2));
+    TEST_ASSERT_NULL(ringbuf_item_at(&rb, 4));
+
+    TEST_ASSERT_TRUE(ringbuf_get_at(&rb, 2, &item));
+    TEST_ASSERT_EQUAL(3, item);
+    TEST_ASSERT_EQUAL(3, ringbuf_size(&rb));
+    TEST_ASSERT_FALSE(ringbuf_get_at(&rb, 3, &item));
+
+    uint8_t expected[] = {1, 2, 4};
+    for (size_t i = 0; i < sizeof(expected); i++)
+    {
+        TEST_ASSERT_TRUE(ringbuf_get(&rb, &item));
+        TEST_ASSERT_EQUAL(expected[i], item);
+    }
+    TEST_ASSERT_TRUE(ringbuf_is_empty(&rb));
+}
+
 void put_when_null_item_fails(void)
 {
     RINGBUF_DEFINE(rb, 1, 1);
@@ -122,5 +154,6 @@ int main(void)
     RUN_TEST(array_wraparound);
     RUN_TEST(can_peek);
     RUN_TEST(can_reset);
+    RUN_TEST(get_at_keeps_order_of_other_items);
     return UNITY_END();
 }
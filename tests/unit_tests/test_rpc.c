@@ -25,6 +25,7 @@ FAKE_VALUE_FUNC(enum golioth_rpc_status,
                 zcbor_state_t *,
                 zcbor_state_t *,
                 void *);
+FAKE_VALUE_FUNC(uint64_t, golioth_sys_now_ms);
 
 struct golioth_rpc grpc;
 uint8_t last_coap_payload[256];
@@ -61,7 +62,9 @@ void tearDown(void)
     RESET_FAKE(golioth_coap_client_observe);
     RESET_FAKE(golioth_coap_client_set);
     RESET_FAKE(test_rpc_method_fn);
+    RESET_FAKE(golioth_sys_now_ms);
     FFF_RESET_HISTORY();
+    dedup_deinit(&grpc);
 }
 
 void test_rpc_register(void)
@@ -450,11 +453,61 @@ void test_rpc_call_same_multiple(void)
     for (int i = 0; i < 100; i++)
     {
         on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+
+        /* Otherwise the next call would be a duplicate */
+        golioth_sys_now_ms_fake.return_val += 1000 * CONFIG_GOLIOTH_RPC_DEDUP_TTL_S;
     }
 
     TEST_ASSERT_EQUAL(100, test_rpc_method_fn_fake.call_count);
 }
 
+void test_rpc_call_duplicate(void)
+{
+    test_rpc_method_fn_fake.custom_fake = rpc_method_fake;
+    enum golioth_status ret = golioth_rpc_register(&grpc, "test", test_rpc_method_fn, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    enum golioth_status status = GOLIOTH_OK;
+    struct golioth_coap_rsp_code coap_rsp_code = {
+        .code_class = 2,
+        .code_detail = 0,
+    };
+    const uint8_t payload[] = {
+        0xA3,                               /* map(3) */
+        0x66,                               /* text(6) */
+        0x6D, 0x65, 0x74, 0x68, 0x6F, 0x64, /* "method" */
+        0x64,                               /* text(4) */
+        0x74, 0x65, 0x73, 0x74,             /* "test" */
+        0x62,                               /* text(2) */
+        0x69, 0x64,                         /* "id" */
+        0x63,                               /* text(3) */
+        0x31, 0x32, 0x33,                   /* "123" */
+        0x66,                               /* text(6) */
+        0x70, 0x61, 0x72, 0x61, 0x6D, 0x73, /* "params" */
+        0x80,                               /* array(0) */
+    };
+    on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+
+    uint8_t first_response[sizeof(last_coap_payload)];
+    size_t first_response_size = last_coap_payload_size;
+    memcpy(first_response, last_coap_payload, last_coap_payload_size);
+    last_coap_payload_size = 0;
+
+    golioth_sys_now_ms_fake.return_val += 1000 * CONFIG_GOLIOTH_RPC_DEDUP_TTL_S - 1;
+    on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+
+    TEST_ASSERT_EQUAL(1, test_rpc_method_fn_fake.call_count);
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(first_response_size, last_coap_payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(first_response, last_coap_payload, last_coap_payload_size);
+
+    /* Expired */
+    golioth_sys_now_ms_fake.return_val += 1;
+    on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+
+    TEST_ASSERT_EQUAL(2, test_rpc_method_fn_fake.call_count);
+}
+
 void test_rpc_register_many_call_all(void)
 {
     test_rpc_method_fn_fake.custom_fake = rpc_method_fake;
@@ -511,6 +564,152 @@ void test_rpc_register_many_call_all(void)
     }
 }
 
+static struct golioth_rpc_call *deferred_call;
+
+static void rpc_deferred_method(struct golioth_rpc_call *call,
+                                zcbor_state_t *request_params_array,
+                                void *callback_arg)
+{
+    deferred_call = call;
+}
+
+void test_rpc_call_deferred(void)
+{
+    deferred_call = NULL;
+    enum golioth_status ret =
+        golioth_rpc_register_deferred(&grpc, "test", rpc_deferred_method, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    enum golioth_status status = GOLIOTH_OK;
+    struct golioth_coap_rsp_code coap_rsp_code = {
+        .code_class = 2,
+        .code_detail = 0,
+    };
+    const uint8_t payload[] = {
+        0xA3,                               /* map(3) */
+        0x66,                               /* text(6) */
+        0x6D, 0x65, 0x74, 0x68, 0x6F, 0x64, /* "method" */
+        0x64,                               /* text(4) */
+        0x74, 0x65, 0x73, 0x74,             /* "test" */
+        0x62,                               /* text(2) */
+        0x69, 0x64,                         /* "id" */
+        0x63,                               /* text(3) */
+        0x31, 0x32, 0x33,                   /* "123" */
+        0x66,                               /* text(6) */
+        0x70, 0x61, 0x72, 0x61, 0x6D, 0x73, /* "params" */
+        0x80,                               /* array(0) */
+    };
+    on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+
+    TEST_ASSERT_NOT_NULL(deferred_call);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+
+    zcbor_state_t *detail = golioth_rpc_call_detail(deferred_call);
+    zcbor_tstr_put_lit(detail, "return_val");
+    zcbor_tstr_put_lit(detail, "foo");
+
+    ret = golioth_rpc_respond(deferred_call, GOLIOTH_RPC_OK);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+
+    const uint8_t expected[] = {
+        0xBF,                                                       /* map(*) */
+        0x62,                                                       /* text(2) */
+        0x69, 0x64,                                                 /* "id" */
+        0x63,                                                       /* text(3) */
+        0x31, 0x32, 0x33,                                           /* "123" */
+        0x66,                                                       /* text(6) */
+        0x64, 0x65, 0x74, 0x61, 0x69, 0x6C,                         /* "detail" */
+        0xBF,                                                       /* map(*) */
+        0x6A,                                                       /* text(10) */
+        0x72, 0x65, 0x74, 0x75, 0x72, 0x6E, 0x5F, 0x76, 0x61, 0x6C, /* "return_val" */
+        0x63,                                                       /* text(3) */
+        0x66, 0x6F, 0x6F,                                           /* "foo" */
+        0xFF,                                                       /* primitive(*) */
+        0x6A,                                                       /* text(10) */
+        0x73, 0x74, 0x61, 0x74, 0x75, 0x73, 0x43, 0x6F, 0x64, 0x65, /* "statusCode" */
+        0x00,                                                       /* unsigned(0) */
+        0xFF,                                                       /* primitive(*) */
+    };
+
+    TEST_ASSERT_EQUAL(sizeof(expected), last_coap_payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, last_coap_payload, last_coap_payload_size);
+}
+
+void test_rpc_register_methods(void)
+{
+    static const struct golioth_rpc_method_desc methods[] = {
+        GOLIOTH_RPC_METHOD("other", test_rpc_method_fn, NULL),
+        GOLIOTH_RPC_METHOD("test", test_rpc_method_fn, NULL),
+    };
+    enum golioth_status ret = golioth_rpc_register_methods(&grpc, methods, ARRAY_SIZE(methods));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    TEST_ASSERT_EQUAL(2, grpc.num_rpcs);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_observe_fake.call_count);
+
+    enum golioth_status status = GOLIOTH_OK;
+    struct golioth_coap_rsp_code coap_rsp_code = {
+        .code_class = 2,
+        .code_detail = 0,
+    };
+    const uint8_t payload[] = {
+        0xA3,                               /* map(3) */
+        0x66,                               /* text(6) */
+        0x6D, 0x65, 0x74, 0x68, 0x6F, 0x64, /* "method" */
+        0x64,                               /* text(4) */
+        0x74, 0x65, 0x73, 0x74,             /* "test" */
+        0x62,                               /* text(2) */
+        0x69, 0x64,                         /* "id" */
+        0x63,                               /* text(3) */
+        0x31, 0x32, 0x33,                   /* "123" */
+        0x66,                               /* text(6) */
+        0x70, 0x61, 0x72, 0x61, 0x6D, 0x73, /* "params" */
+        0x80,                               /* array(0) */
+    };
+    on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+
+    TEST_ASSERT_EQUAL(1, test_rpc_method_fn_fake.call_count);
+}
+
+void test_rpc_register_methods_too_many(void)
+{
+    struct golioth_rpc_method_desc methods[CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS + 1];
+    for (size_t i = 0; i < ARRAY_SIZE(methods); i++)
+    {
+        methods[i] = (struct golioth_rpc_method_desc) GOLIOTH_RPC_METHOD("", NULL, NULL);
+    }
+
+    enum golioth_status ret = golioth_rpc_register_methods(&grpc, methods, ARRAY_SIZE(methods));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC, ret);
+    TEST_ASSERT_EQUAL(0, grpc.num_rpcs);
+}
+
+void test_rpc_register_methods_observe_fail(void)
+{
+    static const struct golioth_rpc_method_desc methods[] = {
+        GOLIOTH_RPC_METHOD("other", test_rpc_method_fn, NULL),
+        GOLIOTH_RPC_METHOD("test", test_rpc_method_fn, NULL),
+    };
+    const struct zcbor_string test = {
+        .value = (const uint8_t *) "test",
+        .len = 4,
+    };
+
+    golioth_coap_client_observe_fake.return_val = GOLIOTH_ERR_QUEUE_FULL;
+    enum golioth_status ret = golioth_rpc_register_methods(&grpc, methods, ARRAY_SIZE(methods));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_QUEUE_FULL, ret);
+    TEST_ASSERT_EQUAL(0, grpc.num_rpcs);
+    TEST_ASSERT_NULL(method_find(&grpc, &test));
+
+    /* Registering again starts the observation */
+    golioth_coap_client_observe_fake.return_val = GOLIOTH_OK;
+    ret = golioth_rpc_register_methods(&grpc, methods, ARRAY_SIZE(methods));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    TEST_ASSERT_EQUAL(2, grpc.num_rpcs);
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_observe_fake.call_count);
+    TEST_ASSERT_NOT_NULL(method_find(&grpc, &test));
+}
+
 int main(void)
 {
     UNITY_BEGIN();
@@ -528,6 +727,11 @@ int main(void)
     RUN_TEST(test_rpc_call_with_return);
     RUN_TEST(test_rpc_call_one_with_params);
     RUN_TEST(test_rpc_call_same_multiple);
+    RUN_TEST(test_rpc_call_duplicate);
     RUN_TEST(test_rpc_register_many_call_all);
+    RUN_TEST(test_rpc_register_methods);
+    RUN_TEST(test_rpc_register_methods_too_many);
+    RUN_TEST(test_rpc_register_methods_observe_fail);
+    RUN_TEST(test_rpc_call_deferred);
     return UNITY_END();
 }
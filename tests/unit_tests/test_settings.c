@@ -0,0 +1,635 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+static const char *last_err_msg = NULL;
+
+#define CONFIG_GOLIOTH_SETTINGS
+#define CONFIG_GOLIOTH_SETTINGS_SNAPSHOT
+#define CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN 64
+#define CONFIG_GOLIOTH_DEBUG_LOG
+#define GLTH_LOGX(...)
+#define GLTH_LOG_BUFFER_HEXDUMP(...)
+#define GLTH_LOGE(TAG, msg, ...) last_err_msg = msg;
+#define GLTH_LOGW(TAG, msg, ...)
+
+#include "fakes/coap_client_fake.h"
+#include "../../src/settings.c"
+
+static struct golioth_client *client = (struct golioth_client *) 0x1;
+static struct golioth_settings *gsettings;
+
+static int32_t motor_speed;
+static bool led_on;
+static char units[16];
+static float gain;
+static size_t num_callbacks;
+
+/*
+ * {
+ *   "settings": {"MOTOR_SPEED": 100, "LED_ON": true, "UNITS": "celsius", "GAIN": 0.5},
+ *   "version": 1652109801583
+ * }
+ */
+static const uint8_t document[] = {
+    0xA2,                                                       /* map(2) */
+    0x68, 's', 'e', 't', 't', 'i', 'n', 'g', 's',               /* "settings" */
+    0xA4,                                                       /* map(4) */
+    0x6B, 'M', 'O', 'T', 'O', 'R', '_', 'S', 'P', 'E', 'E', 'D', /* "MOTOR_SPEED" */
+    0x18, 0x64,                                                 /* 100 */
+    0x66, 'L', 'E', 'D', '_', 'O', 'N',                         /* "LED_ON" */
+    0xF5,                                                       /* true */
+    0x65, 'U', 'N', 'I', 'T', 'S',                              /* "UNITS" */
+    0x67, 'c', 'e', 'l', 's', 'i', 'u', 's',                    /* "celsius" */
+    0x64, 'G', 'A', 'I', 'N',                                   /* "GAIN" */
+    0xFB, 0x3F, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,       /* 0.5 */
+    0x67, 'v', 'e', 'r', 's', 'i', 'o', 'n',                    /* "version" */
+    0x1B, 0x00, 0x00, 0x01, 0x80, 0xA9, 0x6A, 0xF8, 0x6F,       /* 1652109801583 */
+};
+
+/* Same as document, with indefinite-length maps */
+static const uint8_t document_indefinite[] = {
+    0xBF,                                                       /* map(*) */
+    0x68, 's', 'e', 't', 't', 'i', 'n', 'g', 's',               /* "settings" */
+    0xBF,                                                       /* map(*) */
+    0x6B, 'M', 'O', 'T', 'O', 'R', '_', 'S', 'P', 'E', 'E', 'D', /* "MOTOR_SPEED" */
+    0x18, 0x64,                                                 /* 100 */
+    0x66, 'L', 'E', 'D', '_', 'O', 'N',                         /* "LED_ON" */
+    0xF5,                                                       /* true */
+    0x65, 'U', 'N', 'I', 'T', 'S',                              /* "UNITS" */
+    0x67, 'c', 'e', 'l', 's', 'i', 'u', 's',                    /* "celsius" */
+    0x64, 'G', 'A', 'I', 'N',                                   /* "GAIN" */
+    0xFB, 0x3F, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,       /* 0.5 */
+    0xFF,                                                       /* break */
+    0x67, 'v', 'e', 'r', 's', 'i', 'o', 'n',                    /* "version" */
+    0x1B, 0x00, 0x00, 0x01, 0x80, 0xA9, 0x6A, 0xF8, 0x6F,       /* 1652109801583 */
+    0xFF,                                                       /* break */
+};
+
+static enum golioth_settings_status on_motor_speed(int32_t new_value, void *arg)
+{
+    motor_speed = new_value;
+    num_callbacks++;
+    return GOLIOTH_SETTINGS_SUCCESS;
+}
+
+static enum golioth_settings_status on_led_on(bool new_value, void *arg)
+{
+    led_on = new_value;
+    num_callbacks++;
+    return GOLIOTH_SETTINGS_SUCCESS;
+}
+
+static enum golioth_settings_status on_units(const char *new_value,
+                                             size_t new_value_len,
+                                             void *arg)
+{
+    snprintf(units, sizeof(units), "%.*s", (int) new_value_len, new_value);
+    num_callbacks++;
+    return GOLIOTH_SETTINGS_SUCCESS;
+}
+
+static enum golioth_settings_status on_gain(float new_value, void *arg)
+{
+    gain = new_value;
+    num_callbacks++;
+    return GOLIOTH_SETTINGS_SUCCESS;
+}
+
+/* Held by the settings service while a setting is applied */
+static int lock_count;
+
+golioth_sys_mutex_t golioth_sys_mutex_create(void)
+{
+    return &lock_count;
+}
+
+bool golioth_sys_mutex_lock(golioth_sys_mutex_t mutex, int32_t ms_to_wait)
+{
+    TEST_ASSERT_EQUAL(0, lock_count);
+    lock_count++;
+    return true;
+}
+
+bool golioth_sys_mutex_unlock(golioth_sys_mutex_t mutex)
+{
+    lock_count--;
+    return true;
+}
+
+void golioth_sys_mutex_destroy(golioth_sys_mutex_t mutex)
+{
+    TEST_ASSERT_EQUAL(0, lock_count);
+}
+
+/* Snapshot storage of the port; no snapshot is saved while saved_snapshot_len is 0 */
+static uint8_t saved_snapshot[CONFIG_GOLIOTH_SETTINGS_SNAPSHOT_MAX_LEN];
+static size_t saved_snapshot_len;
+static size_t num_snapshot_saves;
+static enum golioth_status snapshot_save_status;
+
+enum golioth_status golioth_settings_snapshot_load(uint8_t *buf, size_t *len)
+{
+    if (saved_snapshot_len == 0)
+    {
+        return GOLIOTH_ERR_NO_MORE_DATA;
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL(*len, saved_snapshot_len);
+    memcpy(buf, saved_snapshot, saved_snapshot_len);
+    *len = saved_snapshot_len;
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_settings_snapshot_save(const uint8_t *data, size_t len)
+{
+    num_snapshot_saves++;
+    if (len > 0 && snapshot_save_status != GOLIOTH_OK)
+    {
+        return snapshot_save_status;
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(saved_snapshot), len);
+    if (len > 0)
+    {
+        memcpy(saved_snapshot, data, len);
+    }
+    saved_snapshot_len = len;
+    return GOLIOTH_OK;
+}
+
+/* Blocks of the status report, as uploaded with golioth_coap_client_set_block() */
+static uint8_t report[2048];
+static size_t report_len;
+static size_t report_block_idx[32];
+static size_t report_block_szx[32];
+static bool report_is_last;
+static golioth_set_block_cb_fn report_cb;
+static void *report_cb_arg;
+
+enum golioth_status golioth_coap_client_set_block_custom_fake(struct golioth_client *client,
+                                                              const uint8_t *token,
+                                                              const char *path_prefix,
+                                                              const char *path,
+                                                              bool is_last,
+                                                              uint32_t content_type,
+                                                              size_t block_index,
+                                                              size_t block_szx,
+                                                              const uint8_t *payload,
+                                                              size_t payload_size,
+                                                              golioth_set_block_cb_fn callback,
+                                                              void *callback_arg,
+                                                              bool is_synchronous,
+                                                              int32_t timeout_s)
+{
+    size_t n = golioth_coap_client_set_block_fake.call_count - 1;
+
+    TEST_ASSERT_NULL(report_cb);
+    TEST_ASSERT_LESS_THAN(ARRAY_SIZE(report_block_idx), n);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(report) - report_len, payload_size);
+
+    memcpy(&report[report_len], payload, payload_size);
+    report_len += payload_size;
+    report_block_idx[n] = block_index;
+    report_block_szx[n] = block_szx;
+    report_is_last = is_last;
+    report_cb = callback;
+    report_cb_arg = callback_arg;
+
+    return GOLIOTH_OK;
+}
+
+/// Acknowledge the block in flight, with the block size chosen by the server
+static void report_ack(size_t block_size)
+{
+    golioth_set_block_cb_fn cb = report_cb;
+    struct golioth_coap_rsp_code rsp_code = {.code_class = 2, .code_detail = 31};
+
+    TEST_ASSERT_NOT_NULL(cb);
+    report_cb = NULL;
+    cb(client, GOLIOTH_OK, &rsp_code, SETTINGS_STATUS_PATH, block_size, report_cb_arg);
+}
+
+static void register_settings(void)
+{
+    TEST_ASSERT_EQUAL(
+        GOLIOTH_OK,
+        golioth_settings_register_int(gsettings, "MOTOR_SPEED", on_motor_speed, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_bool(gsettings, "LED_ON", on_led_on, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_string(gsettings, "UNITS", on_units, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_float(gsettings, "GAIN", on_gain, NULL));
+}
+
+/// Make the next document apply all settings again
+static void forget_applied(void)
+{
+    for (size_t i = 0; i < gsettings->num_settings; i++)
+    {
+        gsettings->settings[i].has_value = false;
+    }
+    gsettings->has_applied_version = false;
+
+    motor_speed = 0;
+    led_on = false;
+    units[0] = '\0';
+    gain = 0;
+    num_callbacks = 0;
+}
+
+static void assert_settings_applied(void)
+{
+    TEST_ASSERT_EQUAL(4, num_callbacks);
+    TEST_ASSERT_EQUAL(100, motor_speed);
+    TEST_ASSERT_TRUE(led_on);
+    TEST_ASSERT_EQUAL_STRING("celsius", units);
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, gain);
+}
+
+/// Feed \p doc in blocks of \p block_size and check the result
+static void feed_in_blocks(const uint8_t *doc, size_t doc_len, size_t block_size)
+{
+    struct settings_stream stream;
+
+    forget_applied();
+    stream_init(&stream, gsettings);
+
+    for (size_t offset = 0; offset < doc_len; offset += block_size)
+    {
+        size_t len = min(block_size, doc_len - offset);
+        TEST_ASSERT_EQUAL(0, stream_feed(&stream, &doc[offset], len));
+    }
+
+    TEST_ASSERT_EQUAL(STREAM_DONE, stream.state);
+    TEST_ASSERT_EQUAL(0, stream.carry_len);
+    TEST_ASSERT_TRUE(stream.has_version);
+    TEST_ASSERT_EQUAL_INT64(1652109801583, stream.version);
+    TEST_ASSERT_EQUAL(0, stream.response.num_errors);
+    assert_settings_applied();
+}
+
+void setUp(void)
+{
+    golioth_coap_client_set_block_fake.custom_fake = golioth_coap_client_set_block_custom_fake;
+
+    gsettings = golioth_settings_init(client);
+    TEST_ASSERT_NOT_NULL(gsettings);
+}
+
+void tearDown(void)
+{
+    golioth_settings_deinit(gsettings);
+
+    last_err_msg = NULL;
+    saved_snapshot_len = 0;
+    num_snapshot_saves = 0;
+    snapshot_save_status = GOLIOTH_OK;
+    report_len = 0;
+    report_is_last = false;
+    report_cb = NULL;
+    RESET_FAKE(golioth_coap_client_observe);
+    RESET_FAKE(golioth_coap_client_set);
+    RESET_FAKE(golioth_coap_client_set_block);
+    RESET_FAKE(golioth_coap_client_get);
+    RESET_FAKE(golioth_coap_client_get_block);
+    FFF_RESET_HISTORY();
+}
+
+void test_settings_one_payload(void)
+{
+    register_settings();
+    forget_applied();
+
+    on_settings(client, GOLIOTH_OK, NULL, "", document, sizeof(document), gsettings);
+
+    assert_settings_applied();
+    TEST_ASSERT_NULL(last_err_msg);
+
+    /* The report fits in one request: {"version": 1652109801583} */
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_block_fake.call_count);
+    TEST_ASSERT_EQUAL(1 + 8 + 9 + 1, golioth_coap_client_set_fake.arg6_val);
+}
+
+void test_settings_split_anywhere(void)
+{
+    register_settings();
+
+    /* Every entry is cut off by a block boundary once, and completed from the carry buffer */
+    for (size_t split = 1; split < sizeof(document); split++)
+    {
+        struct settings_stream stream;
+
+        forget_applied();
+        stream_init(&stream, gsettings);
+
+        TEST_ASSERT_EQUAL(0, stream_feed(&stream, document, split));
+        TEST_ASSERT_EQUAL(0, stream_feed(&stream, &document[split], sizeof(document) - split));
+
+        TEST_ASSERT_EQUAL(STREAM_DONE, stream.state);
+        TEST_ASSERT_EQUAL(0, stream.carry_len);
+        TEST_ASSERT_EQUAL_INT64(1652109801583, stream.version);
+        assert_settings_applied();
+    }
+}
+
+void test_settings_blocks(void)
+{
+    register_settings();
+
+    feed_in_blocks(document, sizeof(document), 16);
+    feed_in_blocks(document, sizeof(document), 32);
+    feed_in_blocks(document_indefinite, sizeof(document_indefinite), 16);
+    feed_in_blocks(document_indefinite, sizeof(document_indefinite), 32);
+}
+
+void test_settings_byte_by_byte(void)
+{
+    register_settings();
+
+    feed_in_blocks(document, sizeof(document), 1);
+    feed_in_blocks(document_indefinite, sizeof(document_indefinite), 1);
+}
+
+void test_settings_carry_overflow(void)
+{
+    uint8_t doc[1 + 9 + 1 + 6 + 3 + CONFIG_GOLIOTH_SETTINGS_STREAM_BUF_LEN + 8 + 1];
+    size_t len = 0;
+    struct settings_stream stream;
+
+    register_settings();
+
+    /* {"settings": {"UNITS": <string longer than the carry buffer>}, "version": 1} */
+    doc[len++] = 0xA2;
+    memcpy(&doc[len], "\x68settings\xA1\x65UNITS", 16);
+    len += 16;
+    doc[len++] = 0x79;
+    doc[len++] = CONFIG_GOLIOTH_SETTINGS_STREAM_BUF_LEN >> 8;
+    doc[len++] = CONFIG_GOLIOTH_SETTINGS_STREAM_BUF_LEN & 0xFF;
+    memset(&doc[len], 'x', CONFIG_GOLIOTH_SETTINGS_STREAM_BUF_LEN);
+    len += CONFIG_GOLIOTH_SETTINGS_STREAM_BUF_LEN;
+    memcpy(&doc[len], "\x67version\x01", 9);
+    len += 9;
+    TEST_ASSERT_EQUAL(sizeof(doc), len);
+
+    /* In one payload, the setting is decoded in place */
+    forget_applied();
+    stream_init(&stream, gsettings);
+    TEST_ASSERT_EQUAL(0, stream_feed(&stream, doc, len));
+    TEST_ASSERT_EQUAL(STREAM_DONE, stream.state);
+    TEST_ASSERT_EQUAL(1, num_callbacks);
+
+    /* Cut off, it doesn't fit in the carry buffer */
+    forget_applied();
+    stream_init(&stream, gsettings);
+    TEST_ASSERT_EQUAL(0, stream_feed(&stream, doc, 32));
+    TEST_ASSERT_EQUAL(-ENOMEM, stream_feed(&stream, &doc[32], len - 32));
+    TEST_ASSERT_EQUAL(0, num_callbacks);
+}
+
+void test_settings_block_transfer(void)
+{
+    register_settings();
+    forget_applied();
+
+    /* The notification only holds the first block of the document */
+    on_settings(client, GOLIOTH_OK, NULL, "", document, 64, gsettings);
+
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_get_block_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_get_block_fake.arg5_val);
+    TEST_ASSERT_EQUAL(64, golioth_coap_client_get_block_fake.arg6_val);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+
+    golioth_get_block_cb_fn cb = golioth_coap_client_get_block_fake.arg7_val;
+    void *arg = golioth_coap_client_get_block_fake.arg8_val;
+    cb(client, GOLIOTH_OK, NULL, "", &document[64], sizeof(document) - 64, true, arg);
+
+    assert_settings_applied();
+    TEST_ASSERT_NULL(gsettings->stream);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+}
+
+void test_settings_report_blockwise(void)
+{
+    uint8_t doc[512];
+    size_t len = 0;
+
+    /* Settings that are not registered, so each one is reported as an error */
+    doc[len++] = 0xA2;
+    memcpy(&doc[len], "\x68settings\xB8\x18", 11);
+    len += 11;
+    for (int i = 0; i < 24; i++)
+    {
+        len += sprintf((char *) &doc[len], "\x6aSETTING_%02d", i);
+        doc[len++] = 0x01;
+    }
+    memcpy(&doc[len], "\x67version\x01", 9);
+    len += 9;
+
+    on_settings(client, GOLIOTH_OK, NULL, "", doc, len, gsettings);
+
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+
+    /* Blocks are sent one at a time, each after the previous one was acknowledged */
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_block_fake.call_count);
+    TEST_ASSERT_EQUAL(0, report_block_idx[0]);
+    TEST_ASSERT_EQUAL(BLOCKSIZE_TO_SZX(RESPONSE_BLOCK_SIZE), report_block_szx[0]);
+    TEST_ASSERT_FALSE(report_is_last);
+
+    report_ack(RESPONSE_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_set_block_fake.call_count);
+    TEST_ASSERT_EQUAL(1, report_block_idx[1]);
+    TEST_ASSERT_FALSE(report_is_last);
+
+    /* The server asks for blocks of half the size */
+    report_ack(RESPONSE_BLOCK_SIZE / 2);
+    TEST_ASSERT_EQUAL(3, golioth_coap_client_set_block_fake.call_count);
+    TEST_ASSERT_EQUAL(4, report_block_idx[2]);
+    TEST_ASSERT_EQUAL(BLOCKSIZE_TO_SZX(RESPONSE_BLOCK_SIZE / 2), report_block_szx[2]);
+
+    while (!report_is_last)
+    {
+        size_t n = golioth_coap_client_set_block_fake.call_count;
+
+        report_ack(RESPONSE_BLOCK_SIZE / 2);
+        TEST_ASSERT_EQUAL(n + 1, golioth_coap_client_set_block_fake.call_count);
+        TEST_ASSERT_EQUAL(report_block_idx[n - 1] + 1, report_block_idx[n]);
+    }
+
+    size_t num_blocks = golioth_coap_client_set_block_fake.call_count;
+    report_ack(RESPONSE_BLOCK_SIZE / 2);
+    TEST_ASSERT_EQUAL(num_blocks, golioth_coap_client_set_block_fake.call_count);
+
+    /* {"errors": [...24 entries...], "version": 1} */
+    TEST_ASSERT_EQUAL_HEX8(CBOR_INDEFINITE_MAP, report[0]);
+    TEST_ASSERT_EQUAL_HEX8(CBOR_BREAK, report[report_len - 1]);
+    TEST_ASSERT_GREATER_THAN(2 * RESPONSE_BLOCK_SIZE, report_len);
+
+    ZCBOR_STATE_D(zsd, 2, report, report_len, 1, 0);
+    TEST_ASSERT_TRUE(zcbor_any_skip(zsd, NULL));
+    TEST_ASSERT_EQUAL_PTR(&report[report_len], zsd->payload);
+}
+
+void test_settings_report_block_failed(void)
+{
+    uint8_t doc[512];
+    size_t len = 0;
+
+    doc[len++] = 0xA2;
+    memcpy(&doc[len], "\x68settings\xB8\x18", 11);
+    len += 11;
+    for (int i = 0; i < 24; i++)
+    {
+        len += sprintf((char *) &doc[len], "\x6aSETTING_%02d", i);
+        doc[len++] = 0x01;
+    }
+    memcpy(&doc[len], "\x67version\x01", 9);
+    len += 9;
+
+    on_settings(client, GOLIOTH_OK, NULL, "", doc, len, gsettings);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_block_fake.call_count);
+
+    /* No more blocks are sent after a block failed */
+    golioth_set_block_cb_fn cb = report_cb;
+    report_cb = NULL;
+    cb(client, GOLIOTH_ERR_TIMEOUT, NULL, SETTINGS_STATUS_PATH, 0, report_cb_arg);
+
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_block_fake.call_count);
+    TEST_ASSERT_NOT_NULL(last_err_msg);
+}
+
+/* {"settings": {"MOTOR_SPEED": 100}, "version": 1652109801583} */
+static const uint8_t motor_speed_document[] = {
+    0xA2,                                                       /* map(2) */
+    0x68, 's', 'e', 't', 't', 'i', 'n', 'g', 's',               /* "settings" */
+    0xA1,                                                       /* map(1) */
+    0x6B, 'M', 'O', 'T', 'O', 'R', '_', 'S', 'P', 'E', 'E', 'D', /* "MOTOR_SPEED" */
+    0x18, 0x64,                                                 /* 100 */
+    0x67, 'v', 'e', 'r', 's', 'i', 'o', 'n',                    /* "version" */
+    0x1B, 0x00, 0x00, 0x01, 0x80, 0xA9, 0x6A, 0xF8, 0x6F,       /* 1652109801583 */
+};
+
+/// Save the snapshot of motor_speed_document, as if it was applied before a reboot
+static void reboot_with_snapshot(void)
+{
+    TEST_ASSERT_EQUAL(
+        GOLIOTH_OK,
+        golioth_settings_register_int(gsettings, "MOTOR_SPEED", on_motor_speed, NULL));
+    on_settings(client,
+                GOLIOTH_OK,
+                NULL,
+                "",
+                motor_speed_document,
+                sizeof(motor_speed_document),
+                gsettings);
+    TEST_ASSERT_NOT_EQUAL(0, saved_snapshot_len);
+
+    golioth_settings_deinit(gsettings);
+    gsettings = golioth_settings_init(client);
+    TEST_ASSERT_NOT_NULL(gsettings);
+
+    motor_speed = 0;
+    num_callbacks = 0;
+    num_snapshot_saves = 0;
+}
+
+void test_settings_snapshot_applied_on_register(void)
+{
+    reboot_with_snapshot();
+
+    TEST_ASSERT_EQUAL(
+        GOLIOTH_OK,
+        golioth_settings_register_int(gsettings, "MOTOR_SPEED", on_motor_speed, NULL));
+    TEST_ASSERT_EQUAL(1, num_callbacks);
+    TEST_ASSERT_EQUAL(100, motor_speed);
+
+    /* Only the new setting is applied; it is not in the snapshot */
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_bool(gsettings, "LED_ON", on_led_on, NULL));
+    TEST_ASSERT_EQUAL(1, num_callbacks);
+    TEST_ASSERT_FALSE(gsettings->has_applied_version);
+
+    /* The server's document of the same version only applies the rest */
+    on_settings(client, GOLIOTH_OK, NULL, "", document, sizeof(document), gsettings);
+    TEST_ASSERT_EQUAL(2, num_callbacks);
+    TEST_ASSERT_TRUE(led_on);
+}
+
+void test_settings_snapshot_until_first_document(void)
+{
+    reboot_with_snapshot();
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_bool(gsettings, "LED_ON", on_led_on, NULL));
+    on_settings(client, GOLIOTH_OK, NULL, "", document, sizeof(document), gsettings);
+    TEST_ASSERT_NULL(gsettings->snapshot);
+    num_callbacks = 0;
+
+    /* The document is newer than the snapshot, which is no longer applied */
+    TEST_ASSERT_EQUAL(
+        GOLIOTH_OK,
+        golioth_settings_register_int(gsettings, "MOTOR_SPEED", on_motor_speed, NULL));
+    TEST_ASSERT_EQUAL(0, num_callbacks);
+    TEST_ASSERT_FALSE(gsettings->has_applied_version);
+}
+
+void test_settings_snapshot_overflow(void)
+{
+    reboot_with_snapshot();
+
+    /* All four settings do not fit in the snapshot, so the old one is removed */
+    register_settings();
+    forget_applied();
+    on_settings(client, GOLIOTH_OK, NULL, "", document, sizeof(document), gsettings);
+
+    assert_settings_applied();
+    TEST_ASSERT_EQUAL(1, num_snapshot_saves);
+    TEST_ASSERT_EQUAL(0, saved_snapshot_len);
+}
+
+void test_settings_snapshot_save_failed(void)
+{
+    reboot_with_snapshot();
+
+    TEST_ASSERT_EQUAL(
+        GOLIOTH_OK,
+        golioth_settings_register_int(gsettings, "MOTOR_SPEED", on_motor_speed, NULL));
+    forget_applied();
+    snapshot_save_status = GOLIOTH_ERR_FAIL;
+    on_settings(client,
+                GOLIOTH_OK,
+                NULL,
+                "",
+                motor_speed_document,
+                sizeof(motor_speed_document),
+                gsettings);
+
+    /* The new snapshot could not be saved, so the old one is removed */
+    TEST_ASSERT_EQUAL(2, num_snapshot_saves);
+    TEST_ASSERT_EQUAL(0, saved_snapshot_len);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_settings_one_payload);
+    RUN_TEST(test_settings_split_anywhere);
+    RUN_TEST(test_settings_blocks);
+    RUN_TEST(test_settings_byte_by_byte);
+    RUN_TEST(test_settings_carry_overflow);
+    RUN_TEST(test_settings_block_transfer);
+    RUN_TEST(test_settings_report_blockwise);
+    RUN_TEST(test_settings_report_block_failed);
+    RUN_TEST(test_settings_snapshot_applied_on_register);
+    RUN_TEST(test_settings_snapshot_until_first_document);
+    RUN_TEST(test_settings_snapshot_overflow);
+    RUN_TEST(test_settings_snapshot_save_failed);
+    return UNITY_END();
+}
@@ -0,0 +1,458 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_STORE_FORWARD
+#define CONFIG_GOLIOTH_STORE_FORWARD_LINUX_SEGMENT_SIZE 256
+#define CONFIG_GOLIOTH_STORE_FORWARD_LINUX_MAX_SEGMENTS 4
+#define CONFIG_GOLIOTH_DEBUG_LOG
+#define GLTH_LOGX(...)
+#define GLTH_LOG_BUFFER_HEXDUMP(...)
+#define GLTH_LOGE(TAG, msg, ...)
+#define GLTH_LOGW(TAG, msg, ...)
+
+#include "fakes/coap_client_fake.h"
+#include "../../src/store_forward.c"
+#include "../../port/linux/golioth_store_linux.c"
+
+FAKE_VALUE_FUNC(golioth_sys_mutex_t, golioth_sys_mutex_create);
+FAKE_VALUE_FUNC(bool, golioth_sys_mutex_lock, golioth_sys_mutex_t, int32_t);
+FAKE_VALUE_FUNC(bool, golioth_sys_mutex_unlock, golioth_sys_mutex_t);
+FAKE_VALUE_FUNC(uint64_t, golioth_sys_now_ms);
+FAKE_VALUE_FUNC(bool, golioth_client_is_connected, struct golioth_client *);
+
+#define MAX_SENT 8
+
+/* Payload of stream records; 3 fit in a segment of the store */
+#define STREAM_PAYLOAD_SIZE 60
+
+struct sent_request
+{
+    char path_prefix[8];
+    char path[16];
+    uint8_t payload[64];
+    size_t payload_size;
+    golioth_set_cb_fn callback;
+    void *callback_arg;
+};
+
+static struct golioth_client *client = (struct golioth_client *) 0x1;
+static char store_dir[] = "/tmp/golioth_store_test_XXXXXX";
+static struct sent_request sent[MAX_SENT];
+static size_t num_sent;
+static enum golioth_status set_status;
+
+static enum golioth_status golioth_coap_client_set_custom_fake(
+    struct golioth_client *client,
+    const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+    const char *path_prefix,
+    const char *path,
+    uint32_t content_type,
+    const uint8_t *payload,
+    size_t payload_size,
+    golioth_set_cb_fn callback,
+    void *callback_arg,
+    bool is_synchronous,
+    int32_t timeout_s)
+{
+    if (set_status != GOLIOTH_OK)
+    {
+        return set_status;
+    }
+
+    TEST_ASSERT_LESS_THAN(MAX_SENT, num_sent);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(sent[0].payload), payload_size);
+
+    struct sent_request *request = &sent[num_sent++];
+
+    snprintf(request->path_prefix, sizeof(request->path_prefix), "%s", path_prefix);
+    snprintf(request->path, sizeof(request->path), "%s", path);
+    memcpy(request->payload, payload, payload_size);
+    request->payload_size = payload_size;
+    request->callback = callback;
+    request->callback_arg = callback_arg;
+
+    return GOLIOTH_OK;
+}
+
+static void on_set(struct golioth_client *client,
+                   enum golioth_status status,
+                   const struct golioth_coap_rsp_code *coap_rsp_code,
+                   const char *path,
+                   void *arg)
+{
+}
+
+/* Complete the n-th request sent */
+static void complete(size_t n, enum golioth_status status)
+{
+    TEST_ASSERT_LESS_THAN(num_sent, n);
+
+    sent[n].callback(client, status, NULL, sent[n].path, sent[n].callback_arg);
+}
+
+static void append_stream(uint8_t value)
+{
+    uint8_t payload[STREAM_PAYLOAD_SIZE];
+
+    memset(payload, value, sizeof(payload));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_store_forward_append(client,
+                                                   ".s/",
+                                                   "temp",
+                                                   GOLIOTH_CONTENT_TYPE_CBOR,
+                                                   payload,
+                                                   sizeof(payload)));
+}
+
+static void assert_sent_stream(size_t n, uint8_t value)
+{
+    TEST_ASSERT_LESS_THAN(num_sent, n);
+    TEST_ASSERT_EQUAL_STRING(".s/", sent[n].path_prefix);
+    TEST_ASSERT_EQUAL_STRING("temp", sent[n].path);
+    TEST_ASSERT_EQUAL(STREAM_PAYLOAD_SIZE, sent[n].payload_size);
+    TEST_ASSERT_EQUAL(value, sent[n].payload[0]);
+    TEST_ASSERT_EQUAL(value, sent[n].payload[STREAM_PAYLOAD_SIZE - 1]);
+}
+
+/* Size of a stream record in the store, see golioth_store_linux.c */
+static size_t stream_record_size(void)
+{
+    return record_size(RECORD_HEADER_LEN + strlen("temp") + STREAM_PAYLOAD_SIZE);
+}
+
+static void remove_store_dir(void)
+{
+    DIR *d = opendir(store_dir);
+    struct dirent *entry;
+    char path[sizeof(store_dir) + sizeof(entry->d_name)];
+
+    if (!d)
+    {
+        return;
+    }
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            snprintf(path, sizeof(path), "%s/%s", store_dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+    rmdir(store_dir);
+}
+
+void setUp(void)
+{
+    golioth_sys_mutex_create_fake.return_val = (golioth_sys_mutex_t) 0x1;
+    golioth_sys_mutex_lock_fake.return_val = true;
+    golioth_sys_mutex_unlock_fake.return_val = true;
+    golioth_coap_client_set_fake.custom_fake = golioth_coap_client_set_custom_fake;
+
+    memset(&_sf, 0, sizeof(_sf));
+    memset(sent, 0, sizeof(sent));
+    num_sent = 0;
+    set_status = GOLIOTH_OK;
+
+    strcpy(store_dir, "/tmp/golioth_store_test_XXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(store_dir));
+    setenv("GOLIOTH_STORE_FORWARD_DIR", store_dir, 1);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_store_forward_init(client));
+}
+
+void tearDown(void)
+{
+    golioth_store_forward_deinit(client);
+    remove_store_dir();
+
+    RESET_FAKE(golioth_coap_client_set);
+    RESET_FAKE(golioth_coap_next_token);
+    RESET_FAKE(golioth_sys_mutex_create);
+    RESET_FAKE(golioth_sys_mutex_lock);
+    RESET_FAKE(golioth_sys_mutex_unlock);
+    RESET_FAKE(golioth_sys_now_ms);
+    RESET_FAKE(golioth_client_is_connected);
+    FFF_RESET_HISTORY();
+}
+
+void test_store_forward_is_eligible(void)
+{
+    TEST_ASSERT_TRUE(golioth_store_forward_is_eligible("", "logs", NULL, false));
+    TEST_ASSERT_TRUE(golioth_store_forward_is_eligible(".s/", "temp", NULL, false));
+
+    /* Synchronous requests and requests with a callback report their result to the caller */
+    TEST_ASSERT_FALSE(golioth_store_forward_is_eligible(".s/", "temp", NULL, true));
+    TEST_ASSERT_FALSE(golioth_store_forward_is_eligible(".s/", "temp", on_set, false));
+    TEST_ASSERT_FALSE(golioth_store_forward_is_eligible("", "logs", NULL, true));
+    TEST_ASSERT_FALSE(golioth_store_forward_is_eligible("", "logs", on_set, false));
+
+    /* Only stream and logs */
+    TEST_ASSERT_FALSE(golioth_store_forward_is_eligible(".d/", "temp", NULL, false));
+    TEST_ASSERT_FALSE(golioth_store_forward_is_eligible("", "temp", NULL, false));
+    TEST_ASSERT_FALSE(golioth_store_forward_is_eligible(NULL, "logs", NULL, false));
+    TEST_ASSERT_FALSE(golioth_store_forward_is_eligible("", NULL, NULL, false));
+}
+
+void test_store_forward_merges_logs(void)
+{
+    /* {"a": 1} */
+    const uint8_t log_map[] = {0xA1, 0x61, 'a', 0x01};
+    /* [{"b": 2}, {"c": 3}] */
+    const uint8_t log_array[] = {0x82, 0xA1, 0x61, 'b', 0x02, 0xA1, 0x61, 'c', 0x03};
+    /* [{"a": 1}, {"b": 2}, {"c": 3}, {"a": 1}] */
+    const uint8_t merged[] = {
+        0x84,
+        0xA1, 0x61, 'a', 0x01,
+        0xA1, 0x61, 'b', 0x02,
+        0xA1, 0x61, 'c', 0x03,
+        0xA1, 0x61, 'a', 0x01,
+    };
+
+    golioth_client_is_connected_fake.return_val = false;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_store_forward_append(client,
+                                                   "",
+                                                   "logs",
+                                                   GOLIOTH_CONTENT_TYPE_CBOR,
+                                                   log_map,
+                                                   sizeof(log_map)));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_store_forward_append(client,
+                                                   "",
+                                                   "logs",
+                                                   GOLIOTH_CONTENT_TYPE_CBOR,
+                                                   log_array,
+                                                   sizeof(log_array)));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_store_forward_append(client,
+                                                   "",
+                                                   "logs",
+                                                   GOLIOTH_CONTENT_TYPE_CBOR,
+                                                   log_map,
+                                                   sizeof(log_map)));
+    append_stream(1);
+
+    /* Stored while disconnected */
+    TEST_ASSERT_EQUAL(0, num_sent);
+
+    golioth_client_is_connected_fake.return_val = true;
+    golioth_store_forward_connected(client);
+
+    /* The log records are merged into one array; the stream record that follows is not */
+    TEST_ASSERT_EQUAL(2, num_sent);
+    TEST_ASSERT_EQUAL_STRING("", sent[0].path_prefix);
+    TEST_ASSERT_EQUAL_STRING("logs", sent[0].path);
+    TEST_ASSERT_EQUAL(sizeof(merged), sent[0].payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(merged, sent[0].payload, sizeof(merged));
+    assert_sent_stream(1, 1);
+
+    complete(0, GOLIOTH_OK);
+    complete(1, GOLIOTH_OK);
+
+    struct golioth_store_forward_stats stats;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_store_forward_get_stats(&stats));
+    TEST_ASSERT_EQUAL(4, stats.stored);
+    TEST_ASSERT_EQUAL(4, stats.forwarded);
+    TEST_ASSERT_EQUAL(2, stats.requests);
+    TEST_ASSERT_EQUAL(golioth_store_tail(), golioth_store_head());
+}
+
+void test_store_forward_releases_completed_slots(void)
+{
+    golioth_client_is_connected_fake.return_val = false;
+    append_stream(1);
+    append_stream(2);
+    append_stream(3);
+
+    uint64_t head = golioth_store_head();
+
+    golioth_client_is_connected_fake.return_val = true;
+    golioth_store_forward_connected(client);
+
+    /* At most CONFIG_GOLIOTH_STORE_FORWARD_MAX_IN_FLIGHT requests are sent */
+    TEST_ASSERT_EQUAL(2, num_sent);
+    assert_sent_stream(0, 1);
+    assert_sent_stream(1, 2);
+
+    /* The oldest slot completed: its record is released, and its slot reused */
+    complete(0, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(head + stream_record_size(), golioth_store_head());
+    TEST_ASSERT_EQUAL(3, num_sent);
+    assert_sent_stream(2, 3);
+
+    /* A newer slot completed first: nothing is released until the older one completes */
+    complete(2, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(head + stream_record_size(), golioth_store_head());
+
+    complete(1, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(golioth_store_tail(), golioth_store_head());
+    TEST_ASSERT_EQUAL(3, num_sent);
+}
+
+void test_store_forward_retry_after_failed_forward(void)
+{
+    golioth_client_is_connected_fake.return_val = false;
+    append_stream(1);
+    append_stream(2);
+
+    uint64_t head = golioth_store_head();
+
+    golioth_client_is_connected_fake.return_val = true;
+    golioth_sys_now_ms_fake.return_val = 1000;
+    golioth_store_forward_connected(client);
+    TEST_ASSERT_EQUAL(2, num_sent);
+
+    /* No response; forwarding stops once the other slot completes */
+    complete(0, GOLIOTH_ERR_TIMEOUT);
+    TEST_ASSERT_FALSE(_sf.retry_pending);
+
+    complete(1, GOLIOTH_OK);
+    TEST_ASSERT_TRUE(_sf.retry_pending);
+    TEST_ASSERT_EQUAL(0, num_slots());
+    TEST_ASSERT_EQUAL(head, golioth_store_head());
+    TEST_ASSERT_EQUAL(2, num_sent);
+
+    /* Not retried before CONFIG_GOLIOTH_STORE_FORWARD_RETRY_MS */
+    golioth_sys_now_ms_fake.return_val = 1000 + CONFIG_GOLIOTH_STORE_FORWARD_RETRY_MS - 1;
+    golioth_store_forward_poll(client);
+    TEST_ASSERT_EQUAL(2, num_sent);
+
+    /* Retried from the oldest record that was not released */
+    golioth_sys_now_ms_fake.return_val = 1000 + CONFIG_GOLIOTH_STORE_FORWARD_RETRY_MS;
+    golioth_store_forward_poll(client);
+    TEST_ASSERT_FALSE(_sf.retry_pending);
+    TEST_ASSERT_EQUAL(4, num_sent);
+    assert_sent_stream(2, 1);
+    assert_sent_stream(3, 2);
+
+    /* Callbacks of abandoned slots are ignored */
+    complete(1, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(head, golioth_store_head());
+
+    complete(2, GOLIOTH_OK);
+    complete(3, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(golioth_store_tail(), golioth_store_head());
+
+    struct golioth_store_forward_stats stats;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_store_forward_get_stats(&stats));
+    TEST_ASSERT_EQUAL(1, stats.retries);
+    TEST_ASSERT_EQUAL(4, stats.requests);
+    /* The second record was acknowledged twice */
+    TEST_ASSERT_EQUAL(3, stats.forwarded);
+}
+
+void test_store_forward_retry_when_not_queued(void)
+{
+    golioth_client_is_connected_fake.return_val = false;
+    append_stream(1);
+    append_stream(2);
+
+    /* The request queue is full */
+    golioth_client_is_connected_fake.return_val = true;
+    set_status = GOLIOTH_ERR_QUEUE_FULL;
+    golioth_store_forward_connected(client);
+
+    TEST_ASSERT_EQUAL(0, num_sent);
+    TEST_ASSERT_TRUE(_sf.retry_pending);
+    TEST_ASSERT_EQUAL(0, num_slots());
+    TEST_ASSERT_EQUAL(golioth_store_head(), _sf.read_pos);
+
+    /* The slot is released, and the record sent again on the next poll */
+    set_status = GOLIOTH_OK;
+    golioth_store_forward_poll(client);
+    TEST_ASSERT_FALSE(_sf.retry_pending);
+    TEST_ASSERT_EQUAL(2, num_sent);
+    assert_sent_stream(0, 1);
+    assert_sent_stream(1, 2);
+}
+
+void test_store_forward_torn_record(void)
+{
+    golioth_client_is_connected_fake.return_val = false;
+    append_stream(1);
+    append_stream(2);
+    append_stream(3);
+
+    /* Tear the second record: its length was written, but not all of its data */
+    uint8_t *data = segment_data(&_store.segments[0]);
+    data[stream_record_size() + sizeof(struct record_header) + 10] ^= 0xff;
+
+    golioth_store_forward_deinit(client);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_store_forward_init(client));
+
+    /* The torn record and everything after it are discarded */
+    TEST_ASSERT_EQUAL(stream_record_size(), golioth_store_tail());
+
+    /* The next record takes the place of the torn one, and the discarded one is not found again */
+    append_stream(4);
+    golioth_store_forward_deinit(client);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_store_forward_init(client));
+    TEST_ASSERT_EQUAL(2 * stream_record_size(), golioth_store_tail());
+
+    golioth_client_is_connected_fake.return_val = true;
+    golioth_store_forward_connected(client);
+
+    TEST_ASSERT_EQUAL(2, num_sent);
+    assert_sent_stream(0, 1);
+    assert_sent_stream(1, 4);
+
+    complete(0, GOLIOTH_OK);
+    complete(1, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(2, num_sent);
+    TEST_ASSERT_EQUAL(golioth_store_tail(), golioth_store_head());
+}
+
+void test_store_forward_crc_mismatch(void)
+{
+    golioth_client_is_connected_fake.return_val = false;
+    append_stream(1);
+    append_stream(2);
+    append_stream(3);
+    append_stream(4);
+
+    /* The fourth record did not fit in the first segment */
+    TEST_ASSERT_EQUAL(2, _store.num_segments);
+
+    /* Corrupt the second record of the first segment */
+    uint8_t *data = segment_data(&_store.segments[0]);
+    struct record_header *record = (struct record_header *) &data[stream_record_size()];
+    record->crc ^= 0x1;
+
+    golioth_client_is_connected_fake.return_val = true;
+    golioth_store_forward_connected(client);
+
+    /* The rest of the segment is skipped */
+    TEST_ASSERT_EQUAL(2, num_sent);
+    assert_sent_stream(0, 1);
+    assert_sent_stream(1, 4);
+
+    complete(0, GOLIOTH_OK);
+    complete(1, GOLIOTH_OK);
+
+    /* Released, including the skipped records; the first segment is deleted */
+    TEST_ASSERT_EQUAL(golioth_store_tail(), golioth_store_head());
+    TEST_ASSERT_EQUAL(1, _store.num_segments);
+    TEST_ASSERT_EQUAL(1, _store.segments[0].index);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_store_forward_is_eligible);
+    RUN_TEST(test_store_forward_merges_logs);
+    RUN_TEST(test_store_forward_releases_completed_slots);
+    RUN_TEST(test_store_forward_retry_after_failed_forward);
+    RUN_TEST(test_store_forward_retry_when_not_queued);
+    RUN_TEST(test_store_forward_torn_record);
+    RUN_TEST(test_store_forward_crc_mismatch);
+    return UNITY_END();
+}